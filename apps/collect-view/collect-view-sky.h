@@ -12,9 +12,6 @@ enum {
   HUMIDITY_SENSOR,
   RSSI_SENSOR,
   ETX1_SENSOR,
-  ETX2_SENSOR,
-  ETX3_SENSOR,
-  ETX4_SENSOR,
 };
 
 
@@ -56,7 +56,9 @@ collect_view_construct_message(struct collect_view_data_msg *msg,
                                uint16_t beacon_interval)
 {
   static unsigned long last_cpu, last_lpm, last_transmit, last_listen;
+  static uint32_t last_packets, last_frames;
   unsigned long cpu, lpm, transmit, listen;
+  uint32_t packets, frames;
 
 
   msg->len = sizeof(struct collect_view_data_msg) / sizeof(uint16_t);
@@ -100,6 +102,18 @@ collect_view_construct_message(struct collect_view_data_msg *msg,
   msg->num_neighbors = num_neighbors;
   msg->beacon_interval = beacon_interval;
 
+  /* The number of packets that were sent in aggregated frames, and
+     the number of frames, since the last message. */
+#if COLLECT_AGGREGATION
+  collect_aggregation_stats(&packets, &frames);
+#else /* COLLECT_AGGREGATION */
+  packets = frames = 0;
+#endif /* COLLECT_AGGREGATION */
+  msg->aggregated_packets = packets - last_packets;
+  msg->aggregate_frames = frames - last_frames;
+  last_packets = packets;
+  last_frames = frames;
+
   memset(msg->sensors, 0, sizeof(msg->sensors));
   collect_view_arch_read_sensors(msg);
 }
@@ -19,7 +19,10 @@ struct collect_view_data_msg {
   uint16_t num_neighbors;
   uint16_t beacon_interval;
 
-  uint16_t sensors[10];
+  uint16_t sensors[8];
+
+  uint16_t aggregated_packets;
+  uint16_t aggregate_frames;
 };
 
 void collect_view_construct_message(struct collect_view_data_msg *msg,
@@ -126,7 +126,7 @@ write_page(struct deluge_object *obj, unsigned pagenum, unsigned char *data)
 {
   cfs_offset_t offset;
 
-  offset = pagenum * S_PAGE;
+  offset = (cfs_offset_t)pagenum * S_PAGE;
 
   if(cfs_seek(obj->cfs_fd, offset, CFS_SEEK_SET) != offset) {
     return -1;
@@ -135,23 +135,25 @@ write_page(struct deluge_object *obj, unsigned pagenum, unsigned char *data)
 }
 
 static int
-read_page(struct deluge_object *obj, unsigned pagenum, unsigned char *buf)
+read_packet(struct deluge_object *obj, unsigned pagenum, unsigned packetnum,
+	    unsigned char *buf)
 {
   cfs_offset_t offset;
 
-  offset = pagenum * S_PAGE;
+  offset = (cfs_offset_t)pagenum * S_PAGE + packetnum * S_PKT;
 
   if(cfs_seek(obj->cfs_fd, offset, CFS_SEEK_SET) != offset) {
     return -1;
   }
-  return cfs_read(obj->cfs_fd, (char *)buf, S_PAGE);
+  return cfs_read(obj->cfs_fd, (char *)buf, S_PKT);
 }
 
 static void
 init_page(struct deluge_object *obj, int pagenum, int have)
 {
   struct deluge_page *page;
-  unsigned char buf[S_PAGE];
+  unsigned char buf[S_PKT];
+  int i;
 
   page = &obj->pages[pagenum];
 
@@ -163,8 +165,12 @@ init_page(struct deluge_object *obj, int pagenum, int have)
     page->version = obj->version;
     page->packet_set = ALL_PACKETS;
     page->flags |= PAGE_COMPLETE;
-    read_page(obj, pagenum, buf);
-    page->crc = crc16_data(buf, S_PAGE, 0);
+    /* The page is read a packet at a time to keep the stack small. */
+    page->crc = 0;
+    for(i = 0; i < N_PKT; i++) {
+      read_packet(obj, pagenum, i, buf);
+      page->crc = crc16_data(buf, S_PKT, page->crc);
+    }
   } else {
     page->version = 0;
     page->packet_set = 0;
@@ -204,8 +210,9 @@ init_object(struct deluge_object *obj, char *filename, unsigned version)
   obj->size = file_size(filename);
   obj->version = obj->update_version = version;
   obj->current_rx_page = 0;
+  obj->current_tx_page = -1;
   obj->nrequests = 0;
-  obj->tx_set = 0;
+  memset(obj->tx_set, 0, sizeof(obj->tx_set));
 
   obj->pages = malloc(OBJECT_PAGE_COUNT(*obj) * sizeof(*obj->pages));
   if(obj->pages == NULL) {
@@ -241,19 +248,47 @@ static void
 send_request(void *arg)
 {
   struct deluge_object *obj;
-  struct deluge_msg_request request;
+  struct deluge_msg_request *request;
+  uint8_t buf[sizeof(struct deluge_msg_request) + 1 +
+	      DELUGE_PAGES_IN_FLIGHT * sizeof(deluge_packet_set_t)];
+  uint8_t *p;
+#if DELUGE_REQUEST_EXTENDED
+  deluge_packet_set_t request_set;
+  unsigned npages, pagenum, i;
+#endif /* DELUGE_REQUEST_EXTENDED */
 
   obj = (struct deluge_object *)arg;
 
-  request.cmd = DELUGE_CMD_REQUEST;
-  request.pagenum = obj->current_rx_page;
-  request.version = obj->pages[request.pagenum].version;
-  request.request_set = ~obj->pages[obj->current_rx_page].packet_set;
-  request.object_id = obj->object_id;
+  request = (struct deluge_msg_request *)buf;
+  request->cmd = DELUGE_CMD_REQUEST;
+  request->pagenum = obj->current_rx_page;
+  request->version = obj->pages[request->pagenum].version;
+  request->object_id = obj->object_id;
+  request->request_set =
+    ~obj->pages[request->pagenum].packet_set & ALL_PACKETS;
+  p = buf + sizeof(struct deluge_msg_request);
+
+#if DELUGE_REQUEST_EXTENDED
+  /* Ask for the missing packets of as many pages as the neighbor has,
+     up to the number of receive buffers. */
+  p++;
+  for(npages = 0; npages < DELUGE_PAGES_IN_FLIGHT; npages++) {
+    pagenum = request->pagenum + npages;
+    if(pagenum >= OBJECT_PAGE_COUNT(*obj) ||
+       (npages > 0 && pagenum >= obj->summary_available)) {
+      break;
+    }
+    request_set = ~obj->pages[pagenum].packet_set & ALL_PACKETS;
+    for(i = 0; i < sizeof(request_set); i++) {
+      *p++ = (uint8_t)(request_set >> (8 * i));
+    }
+  }
+  buf[sizeof(struct deluge_msg_request)] = npages;
+#endif /* DELUGE_REQUEST_EXTENDED */
 
-  PRINTF("Sending request for page %d, version %u, request_set %u\n", 
-	request.pagenum, request.version, request.request_set);
-  packetbuf_copyfrom(&request, sizeof(request));
+  PRINTF("Sending request for page %d, version %u, %u bytes\n",
+	request->pagenum, request->version, (unsigned)(p - buf));
+  packetbuf_copyfrom(buf, p - buf);
   unicast_send(&deluge_uc, &obj->summary_from);
 
   /* Deluge R.2 */
@@ -334,43 +369,54 @@ handle_summary(struct deluge_msg_summary *msg, const rimeaddr_t *sender)
     }
 
     rimeaddr_copy(&current_object.summary_from, sender);
+    current_object.summary_available = msg->highest_available;
     transition(DELUGE_STATE_RX);
 
     if(ctimer_expired(&rx_timer)) {
       ctimer_set(&rx_timer,
-	CONST_OMEGA * ESTIMATED_TX_TIME + ((unsigned)random_rand() % T_R),
+	REQUEST_DELAY + ((unsigned)random_rand() % T_R),
 	send_request, &current_object);
     }
   }
 }
 
-static void
-send_page(struct deluge_object *obj, unsigned pagenum)
+static int
+send_packets(struct deluge_object *obj)
 {
-  unsigned char buf[S_PAGE];
   struct deluge_msg_packet pkt;
-  unsigned char *cp;
-
-  pkt.cmd = DELUGE_CMD_PACKET;
-  pkt.pagenum = pagenum;
-  pkt.version = obj->pages[pagenum].version;
-  pkt.packetnum = 0;
-  pkt.object_id = obj->object_id;
-  pkt.crc = 0;
-
-  read_page(obj, pagenum, buf);
-
-  /* Divide the page into packets and send them one at a time. */
-  for(cp = buf; cp + S_PKT <= (unsigned char *)&buf[S_PAGE]; cp += S_PKT) {
-    if(obj->tx_set & (1 << pkt.packetnum)) {
-      pkt.crc = crc16_data(cp, S_PKT, 0);
-      memcpy(pkt.payload, cp, S_PKT);
+  deluge_packet_set_t *set;
+  unsigned i, burst;
+
+  burst = 0;
+  for(i = 0; i < DELUGE_PAGES_IN_FLIGHT; i++) {
+    set = &obj->tx_set[i];
+    if(*set == 0) {
+      continue;
+    }
+
+    pkt.cmd = DELUGE_CMD_PACKET;
+    pkt.pagenum = obj->current_tx_page + i;
+    pkt.version = obj->pages[pkt.pagenum].version;
+    pkt.object_id = obj->object_id;
+
+    /* Send the requested packets in order, a burst at a time. */
+    for(pkt.packetnum = 0; *set != 0; pkt.packetnum++) {
+      if(!(*set & ((deluge_packet_set_t)1 << pkt.packetnum))) {
+	continue;
+      }
+      if(burst == DELUGE_TX_BURST) {
+	return 1;
+      }
+      *set &= ~((deluge_packet_set_t)1 << pkt.packetnum);
+
+      read_packet(obj, pkt.pagenum, pkt.packetnum, pkt.payload);
+      pkt.crc = crc16_data(pkt.payload, S_PKT, 0);
       packetbuf_copyfrom(&pkt, sizeof(pkt));
       broadcast_send(&deluge_broadcast);
+      burst++;
     }
-    pkt.packetnum++;
   }
-  obj->tx_set = 0;
+  return 0;
 }
 
 static void
@@ -379,13 +425,12 @@ tx_callback(void *arg)
   struct deluge_object *obj;
 
   obj = (struct deluge_object *)arg;
-  if(obj->current_tx_page >= 0 && obj->tx_set) {
-    send_page(obj, obj->current_tx_page);
+  if(obj->current_tx_page >= 0) {
     /* Deluge T.2. */
-    if(obj->tx_set) {
+    if(send_packets(obj)) {
       packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
 			 PACKETBUF_ATTR_PACKET_TYPE_STREAM);
-      ctimer_reset(&tx_timer);
+      ctimer_set(&tx_timer, T_TX, tx_callback, obj);
     } else {
       packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
 			 PACKETBUF_ATTR_PACKET_TYPE_STREAM_END);
@@ -396,14 +441,40 @@ tx_callback(void *arg)
 }
 
 static void
-handle_request(struct deluge_msg_request *msg)
+handle_request(struct deluge_msg_request *msg, int len)
 {
+  deluge_packet_set_t request_set[DELUGE_PAGES_IN_FLIGHT];
   int highest_available;
+  unsigned i, pagenum, npages;
+#if DELUGE_REQUEST_EXTENDED
+  const uint8_t *p;
+  unsigned j;
+#endif /* DELUGE_REQUEST_EXTENDED */
 
   if(msg->pagenum >= OBJECT_PAGE_COUNT(current_object)) {
     return;
   }
 
+  npages = 1;
+  request_set[0] = msg->request_set;
+#if DELUGE_REQUEST_EXTENDED
+  if(len > sizeof(struct deluge_msg_request)) {
+    p = (const uint8_t *)(msg + 1);
+    npages = *p++;
+    if(npages == 0 || npages > DELUGE_PAGES_IN_FLIGHT ||
+       len < sizeof(struct deluge_msg_request) + 1 +
+	     npages * sizeof(deluge_packet_set_t)) {
+      return;
+    }
+    for(i = 0; i < npages; i++) {
+      request_set[i] = 0;
+      for(j = 0; j < sizeof(deluge_packet_set_t); j++) {
+	request_set[i] |= (deluge_packet_set_t)*p++ << (8 * j);
+      }
+    }
+  }
+#endif /* DELUGE_REQUEST_EXTENDED */
+
   if(msg->version != current_object.version) {
     neighbor_inconsistency = 1;
   }
@@ -415,16 +486,28 @@ handle_request(struct deluge_msg_request *msg)
       msg->pagenum <= highest_available) {
     current_object.pages[msg->pagenum].last_request = clock_time();
 
-    /* Deluge T.1 */
-    if(msg->pagenum == current_object.current_tx_page) {
-      current_object.tx_set |= msg->request_set;
-    } else {
+    /* Deluge T.1. Requests for the pages being sent are merged, so
+       that one transmission serves all requesting neighbors. */
+    if(current_object.current_tx_page < 0) {
       current_object.current_tx_page = msg->pagenum;
-      current_object.tx_set = msg->request_set;
+      memset(current_object.tx_set, 0, sizeof(current_object.tx_set));
+    }
+    for(i = 0; i < npages; i++) {
+      pagenum = msg->pagenum + i;
+      if(pagenum >= highest_available && i > 0) {
+	break;
+      }
+      if(pagenum >= current_object.current_tx_page &&
+	 pagenum < current_object.current_tx_page + DELUGE_PAGES_IN_FLIGHT) {
+	current_object.tx_set[pagenum - current_object.current_tx_page] |=
+	  request_set[i] & ALL_PACKETS;
+      }
     }
 
-    transition(DELUGE_STATE_TX);
-    ctimer_set(&tx_timer, CLOCK_SECOND, tx_callback, &current_object);
+    if(deluge_state != DELUGE_STATE_TX) {
+      transition(DELUGE_STATE_TX);
+      ctimer_set(&tx_timer, CLOCK_SECOND, tx_callback, &current_object);
+    }
   }
 }
 
@@ -434,6 +517,7 @@ handle_packet(struct deluge_msg_packet *msg)
   struct deluge_page *page;
   uint16_t crc;
   struct deluge_msg_packet packet;
+  unsigned char *buf;
 
   memcpy(&packet, msg, sizeof(packet));
 
@@ -441,7 +525,10 @@ handle_packet(struct deluge_msg_packet *msg)
 	(unsigned)packet.object_id, (unsigned)packet.version,
 	(unsigned)packet.pagenum, (unsigned)packet.packetnum);
 
-  if(packet.pagenum != current_object.current_rx_page) {
+  if(packet.pagenum < current_object.current_rx_page ||
+     packet.pagenum >= current_object.current_rx_page + DELUGE_PAGES_IN_FLIGHT ||
+     packet.pagenum >= OBJECT_PAGE_COUNT(current_object) ||
+     packet.packetnum >= N_PKT) {
     return;
   }
 
@@ -451,8 +538,8 @@ handle_packet(struct deluge_msg_packet *msg)
 
   page = &current_object.pages[packet.pagenum];
   if(packet.version == page->version && !(page->flags & PAGE_COMPLETE)) {
-    memcpy(&current_object.current_page[S_PKT * packet.packetnum],
-	packet.payload, S_PKT);
+    buf = current_object.current_page[packet.pagenum % DELUGE_PAGES_IN_FLIGHT];
+    memcpy(&buf[S_PKT * packet.packetnum], packet.payload, S_PKT);
 
     crc = crc16_data(packet.payload, S_PKT, 0);
     if(packet.crc != crc) {
@@ -461,34 +548,58 @@ handle_packet(struct deluge_msg_packet *msg)
     }
 
     page->last_data = clock_time();
-    page->packet_set |= (1 << packet.packetnum);
+    page->packet_set |= ((deluge_packet_set_t)1 << packet.packetnum);
 
     if(page->packet_set == ALL_PACKETS) {
       /* This is the last packet of the requested page; stop streaming. */
       packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
 			 PACKETBUF_ATTR_PACKET_TYPE_STREAM_END);
 
-      write_page(&current_object, packet.pagenum, current_object.current_page);
+      write_page(&current_object, packet.pagenum, buf);
       page->version = packet.version;
       page->flags = PAGE_COMPLETE;
       PRINTF("Page %u completed\n", packet.pagenum);
 
-      current_object.current_rx_page++;
+      /* Pages after the first one in flight may complete first. */
+      current_object.current_rx_page = highest_available_page(&current_object);
 
-      if(packet.pagenum == OBJECT_PAGE_COUNT(current_object) - 1) {
+      if(current_object.current_rx_page == OBJECT_PAGE_COUNT(current_object)) {
 	current_object.version = current_object.update_version;
 	leds_on(LEDS_RED);
 	PRINTF("Update completed for object %u, version %u\n", 
 	       (unsigned)current_object.object_id, packet.version);
-      } else if(current_object.current_rx_page < OBJECT_PAGE_COUNT(current_object)) {
+	/* Deluge R.3 */
+	transition(DELUGE_STATE_MAINTAIN);
+#if DELUGE_PIPELINE
+      } else if(current_object.current_rx_page <
+		current_object.summary_available) {
+	/* Keep fetching from the same neighbor instead of waiting for
+	   its next advertisement. Requests of the pages in flight ask
+	   only for the packets that are still missing. */
+	current_object.nrequests = 0;
+	if(deluge_state != DELUGE_STATE_TX && ctimer_expired(&rx_timer)) {
+	  transition(DELUGE_STATE_RX);
+	  ctimer_set(&rx_timer,
+		REQUEST_DELAY + (random_rand() % T_R),
+		send_request, &current_object);
+	}
+      } else {
+	transition(DELUGE_STATE_MAINTAIN);
+      }
+      /* Advertise the new page at once, so that the next hop can fetch
+	 it while we fetch the following pages. */
+      neighbor_inconsistency = 1;
+#else /* DELUGE_PIPELINE */
+      } else {
         if(ctimer_expired(&rx_timer)) {
 	  ctimer_set(&rx_timer,
-		CONST_OMEGA * ESTIMATED_TX_TIME + (random_rand() % T_R),
+		REQUEST_DELAY + (random_rand() % T_R),
 		send_request, &current_object);
 	}
+	/* Deluge R.3 */
+	transition(DELUGE_STATE_MAINTAIN);
       }
-      /* Deluge R.3 */
-      transition(DELUGE_STATE_MAINTAIN);
+#endif /* DELUGE_PIPELINE */
     } else {
       /* More packets to come. Put lower layers in streaming mode. */
       packetbuf_set_attr(PACKETBUF_ATTR_PACKET_TYPE,
@@ -538,7 +649,7 @@ handle_profile(struct deluge_msg_profile *msg)
 	msg->version, msg->npages);
 
   leds_off(LEDS_RED);
-  current_object.tx_set = 0;
+  memset(current_object.tx_set, 0, sizeof(current_object.tx_set));
 
   npages = OBJECT_PAGE_COUNT(*obj);
   obj->size = msg->npages * S_PAGE;
@@ -598,7 +709,7 @@ command_dispatcher(const rimeaddr_t *sender)
     break;
   case DELUGE_CMD_REQUEST:
     if(len >= sizeof(struct deluge_msg_request))
-      handle_request((struct deluge_msg_request *)msg);
+      handle_request((struct deluge_msg_request *)msg, len);
     break;
   case DELUGE_CMD_PACKET:
     if(len >= sizeof(struct deluge_msg_packet))
@@ -682,7 +793,18 @@ PROCESS_THREAD(deluge_process, ev, data)
     ctimer_set(&profile_timer, r_rand * CLOCK_SECOND,
 	(void *)(void *)send_profile, &current_object);
 
+#if DELUGE_PIPELINE
+    /* Start a new round as soon as there is something to advertise. */
+    for(time_counter = 0; time_counter < r_interval; time_counter++) {
+      etimer_set(&et, CLOCK_SECOND);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+      if(neighbor_inconsistency) {
+	break;
+      }
+    }
+#else /* DELUGE_PIPELINE */
     LONG_TIMER(et, time_counter, r_interval);
+#endif /* DELUGE_PIPELINE */
   }
 
 exit:
@@ -61,9 +61,52 @@ PROCESS_NAME(deluge_process);
 /* All pages up to, and including, this page are complete. */
 #define PAGE_AVAILABLE	1
 
+/*
+ * In pipelined mode, receivers fetch several pages with one request and
+ * advertise every completed page right away, so that nodes a few hops
+ * apart transfer different pages at the same time.
+ */
+#ifdef DELUGE_CONF_PIPELINE
+#define DELUGE_PIPELINE		DELUGE_CONF_PIPELINE
+#else
+#define DELUGE_PIPELINE		0
+#endif
+
+#ifdef DELUGE_CONF_PKT_SIZE
+#define S_PKT		DELUGE_CONF_PKT_SIZE
+#else
 #define S_PKT		64		/* Deluge packet size. */
-#define N_PKT		4		/* Packets per page. */
-#define S_PAGE		(S_PKT * N_PKT)	/* Fixed page size. */
+#endif
+
+/* Packets per page, at most 32. */
+#ifdef DELUGE_CONF_PAGE_PACKETS
+#define N_PKT		DELUGE_CONF_PAGE_PACKETS
+#elif DELUGE_PIPELINE
+#define N_PKT		8
+#else
+#define N_PKT		4
+#endif
+
+#define S_PAGE		(S_PKT * N_PKT)	/* Page size. */
+
+/* Pages that a receiver requests at once. Each takes a page of RAM. */
+#ifdef DELUGE_CONF_PAGES_IN_FLIGHT
+#define DELUGE_PAGES_IN_FLIGHT	DELUGE_CONF_PAGES_IN_FLIGHT
+#elif DELUGE_PIPELINE
+#define DELUGE_PAGES_IN_FLIGHT	2
+#else
+#define DELUGE_PAGES_IN_FLIGHT	1
+#endif
+
+/* Packets that a sender transmits back to back. */
+#ifdef DELUGE_CONF_TX_BURST
+#define DELUGE_TX_BURST		DELUGE_CONF_TX_BURST
+#else
+#define DELUGE_TX_BURST		4
+#endif
+
+/* Pause between two bursts in jiffies. */
+#define T_TX		(CLOCK_SECOND / 4)
 
 /* Bounds for the round time in seconds. */
 #define T_LOW		2
@@ -78,7 +121,16 @@ PROCESS_NAME(deluge_process);
 /* The number of pages in this object. */
 #define OBJECT_PAGE_COUNT(obj)	(((obj).size + (S_PAGE - 1)) / S_PAGE)
 
-#define ALL_PACKETS		((1 << N_PKT) - 1)
+#if N_PKT > 16
+typedef uint32_t deluge_packet_set_t;
+#elif N_PKT > 8
+typedef uint16_t deluge_packet_set_t;
+#else
+typedef uint8_t deluge_packet_set_t;
+#endif
+
+#define ALL_PACKETS	((deluge_packet_set_t)((deluge_packet_set_t)~0 >> \
+				(8 * sizeof(deluge_packet_set_t) - N_PKT)))
 
 #define DELUGE_CMD_SUMMARY	1
 #define DELUGE_CMD_REQUEST	2
@@ -95,6 +147,13 @@ PROCESS_NAME(deluge_process);
 #define CONST_OMEGA		8
 #define ESTIMATED_TX_TIME	(CLOCK_SECOND)
 
+/* Delay before requesting pages from a neighbor that has them. */
+#if DELUGE_PIPELINE
+#define REQUEST_DELAY		ESTIMATED_TX_TIME
+#else
+#define REQUEST_DELAY		(CONST_OMEGA * ESTIMATED_TX_TIME)
+#endif
+
 typedef uint8_t deluge_object_id_t;
 
 struct deluge_msg_summary {
@@ -104,6 +163,13 @@ struct deluge_msg_summary {
   deluge_object_id_t object_id;
 };
 
+/*
+ * Requests the missing packets of a page. With more than one page in
+ * flight, or more than 8 packets per page, the message is followed by
+ * the number of consecutive pages requested and the bitmap of the
+ * missing packets of each of them, least significant byte first. The
+ * request_set field then holds the low byte of the first bitmap.
+ */
 struct deluge_msg_request {
   uint8_t cmd;
   uint8_t version;
@@ -112,6 +178,8 @@ struct deluge_msg_request {
   deluge_object_id_t object_id;
 };
 
+#define DELUGE_REQUEST_EXTENDED	(DELUGE_PAGES_IN_FLIGHT > 1 || N_PKT > 8)
+
 struct deluge_msg_packet {
   uint8_t cmd;
   uint8_t version;
@@ -140,14 +208,17 @@ struct deluge_object {
   uint8_t current_rx_page;
   int8_t current_tx_page;
   uint8_t nrequests;
-  uint8_t current_page[S_PAGE];
-  uint8_t tx_set;
+  /* Receive buffers of the pages in flight, indexed by page number. */
+  uint8_t current_page[DELUGE_PAGES_IN_FLIGHT][S_PAGE];
+  /* Packets to send of current_tx_page and the pages after it. */
+  deluge_packet_set_t tx_set[DELUGE_PAGES_IN_FLIGHT];
   int cfs_fd;
   rimeaddr_t summary_from;
+  uint8_t summary_available;
 };
 
 struct deluge_page {
-  uint32_t packet_set;
+  deluge_packet_set_t packet_set;
   uint16_t crc;
   clock_time_t last_request;
   clock_time_t last_data;
@@ -43,6 +43,11 @@
 #include "contiki-net.h"
 
 #include "er-coap-07-engine.h"
+#include "er-coap-dedup.h"
+
+#if COAP_DEDUP_CACHE_SIZE && COAP_DEDUP_PACKET_SIZE<COAP_MAX_PACKET_SIZE
+#warning "COAP_DEDUP_PACKET_SIZE smaller than COAP_MAX_PACKET_SIZE: longer responses are not cached"
+#endif
 
 #define DEBUG 0 
 #if DEBUG
@@ -86,9 +91,20 @@ coap_receive(void)
   static coap_packet_t message[1]; /* This way the packet can be treated as pointer as usual. */
   static coap_packet_t response[1];
   static coap_transaction_t *transaction = NULL;
+  uint8_t group;
+#if COAP_DEDUP_CACHE_SIZE
+  uint8_t request = 0;
+#endif /* COAP_DEDUP_CACHE_SIZE */
+  uip_ipaddr_t src_addr; /* sending clobbers the IP header */
+  uint16_t src_port;
 
   if (uip_newdata()) {
 
+    /* Requests to a multicast address are group communication (RFC 7390). */
+    group = uip_is_addr_mcast(&UIP_IP_BUF->destipaddr);
+    uip_ipaddr_copy(&src_addr, &UIP_IP_BUF->srcipaddr);
+    src_port = UIP_UDP_BUF->srcport;
+
     PRINTF("receiving UDP datagram from: ");
     PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
     PRINTF(":%u\n  Length: %u\n  Data: ", uip_ntohs(UIP_UDP_BUF->srcport), uip_datalen() );
@@ -100,8 +116,6 @@ coap_receive(void)
     if (coap_error_code==NO_ERROR)
     {
 
-      /*TODO duplicates suppression, if required by application */
-
       PRINTF("  Parsed: v %u, t %u, oc %u, c %u, mid %u\n", message->version, message->type, message->option_count, message->code, message->mid);
       PRINTF("  URL: %.*s\n", message->uri_path_len, message->uri_path);
       PRINTF("  Payload: %.*s\n", message->payload_len, message->payload);
@@ -109,6 +123,22 @@ coap_receive(void)
       /* Handle requests. */
       if (message->code >= COAP_GET && message->code <= COAP_DELETE)
       {
+#if COAP_DEDUP_CACHE_SIZE
+        coap_dedup_entry_t *duplicate;
+
+        /* Repeat the response to a retransmitted request instead of running the resource again. */
+        if (!group && (duplicate = coap_dedup_lookup(&src_addr, src_port, message->mid)))
+        {
+          PRINTF("Duplicate of MID %u\n", message->mid);
+          if (duplicate->packet_len)
+          {
+            coap_send_message(&src_addr, src_port, duplicate->packet, duplicate->packet_len);
+          }
+          return NO_ERROR;
+        }
+        request = !group;
+#endif /* COAP_DEDUP_CACHE_SIZE */
+
         /* Use transaction buffer for response to confirmable request. */
         if ( (transaction = coap_new_transaction(message->mid, &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport)) )
         {
@@ -118,7 +148,7 @@ coap_receive(void)
           int32_t new_offset = 0;
 
           /* prepare response */
-          if (message->type==COAP_TYPE_CON)
+          if (message->type==COAP_TYPE_CON && !group)
           {
             /* Reliable CON requests are answered with an ACK. */
             coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, message->mid);
@@ -253,18 +283,51 @@ coap_receive(void)
 
     if (coap_error_code==NO_ERROR)
     {
-      if (transaction) coap_send_transaction(transaction);
+      if (transaction && group)
+      {
+        /* Spread the responses of the group members over the leisure period. */
+        coap_send_transaction_delayed(transaction, random_rand() % (clock_time_t) (COAP_DEFAULT_LEISURE * CLOCK_SECOND));
+      }
+      else if (transaction)
+      {
+#if COAP_DEDUP_CACHE_SIZE
+        if (request)
+        {
+          coap_dedup_store(&src_addr, src_port, message->mid, transaction->packet, transaction->packet_len);
+        }
+#endif /* COAP_DEDUP_CACHE_SIZE */
+        coap_send_transaction(transaction);
+      }
     }
     else if (coap_error_code==MANUAL_RESPONSE)
     {
       PRINTF("Clearing transaction for manual response");
       coap_clear_transaction(transaction);
+#if COAP_DEDUP_CACHE_SIZE
+      if (request)
+      {
+        /* A separate response follows; duplicates of CON requests only get the empty ACK again. */
+        uint16_t len = 0;
+        if (message->type==COAP_TYPE_CON)
+        {
+          coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+          len = coap_serialize_message(response, uip_appdata);
+        }
+        coap_dedup_store(&src_addr, src_port, message->mid, uip_appdata, len);
+      }
+#endif /* COAP_DEDUP_CACHE_SIZE */
     }
     else
     {
       PRINTF("ERROR %u: %s\n", coap_error_code, coap_error_message);
       coap_clear_transaction(transaction);
 
+      /* Group members do not answer with errors, e.g., for unknown resources. */
+      if (group)
+      {
+        return coap_error_code;
+      }
+
       /* Set to sendable error code. */
       if (coap_error_code >= 192)
       {
@@ -273,7 +336,14 @@ coap_receive(void)
       /* Reuse input buffer for error message. */
       coap_init_message(message, COAP_TYPE_ACK, coap_error_code, message->mid);
       coap_set_payload(message, coap_error_message, strlen(coap_error_message));
-      coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport, uip_appdata, coap_serialize_message(message, uip_appdata));
+      uint16_t len = coap_serialize_message(message, uip_appdata);
+#if COAP_DEDUP_CACHE_SIZE
+      if (request)
+      {
+        coap_dedup_store(&src_addr, src_port, message->mid, uip_appdata, len);
+      }
+#endif /* COAP_DEDUP_CACHE_SIZE */
+      coap_send_message(&src_addr, src_port, uip_appdata, len);
     }
   } /* if (new data) */
 
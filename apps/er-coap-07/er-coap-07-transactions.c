@@ -153,6 +153,18 @@ coap_send_transaction(coap_transaction_t *t)
   }
 }
 
+void
+coap_send_transaction_delayed(coap_transaction_t *t, clock_time_t delay)
+{
+  PRINTF("Delaying transaction %u by %lu ticks\n", t->mid, (unsigned long) delay);
+
+  /* The first expiration sends the message; NON messages are freed afterwards. */
+  struct process *process_actual = PROCESS_CURRENT();
+  process_current = transaction_handler_process;
+  etimer_set(&t->retrans_timer, delay);
+  process_current = process_actual;
+}
+
 void
 coap_clear_transaction(coap_transaction_t *t)
 {
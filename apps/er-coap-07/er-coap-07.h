@@ -53,6 +53,7 @@
 #define COAP_RESPONSE_TIMEOUT                2
 #define COAP_RESPONSE_RANDOM_FACTOR          1.5
 #define COAP_MAX_RETRANSMIT                  4
+#define COAP_DEFAULT_LEISURE                 5 /* Seconds over which responses to group requests are spread */
 
 #define COAP_HEADER_LEN                      4 /* | oc:0xF0 type:0x0C version:0x03 | code | mid:0x00FF | mid:0xFF00 | */
 #define COAP_ETAG_LEN                        8 /* The maximum number of bytes for the ETag */
@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2013, Institute for Pervasive Computing, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *      Non-blocking CoAP client
+ */
+
+#include <string.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "lib/random.h"
+
+#include "er-coap-13-engine.h"
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define END_UNKNOWN 0xFFFFFFFF
+
+enum {
+  BLOCK_FREE,
+  BLOCK_SENT,  /* waiting for the ACK or the response */
+  BLOCK_ACKED  /* empty ACK received, waiting for the separate response */
+};
+
+/* Reserved when a block is asked for ahead of the next one to deliver. */
+struct buffered_block {
+  struct buffered_block *next; /* for LIST */
+  coap_client_request_t *request;
+  uint32_t num;
+  uint8_t filled;
+  uint8_t more;
+  uint8_t code;
+  uint16_t len;
+  uint8_t payload[REST_MAX_CHUNK_SIZE];
+};
+
+MEMB(requests_memb, coap_client_request_t, COAP_CLIENT_MAX_REQUESTS);
+LIST(requests_list);
+
+MEMB(blocks_memb, struct buffered_block, COAP_CLIENT_BUFFERED_BLOCKS);
+LIST(blocks_list);
+
+static uint16_t next_token;
+
+/* The request whose handler runs, and whether the handler cancelled it. */
+static coap_client_request_t *current;
+static uint8_t cancelled;
+
+static int receive(void *response);
+
+/* Claims the responses of client requests from the engine's handler chain. */
+static coap_response_handler_t response_handler = { NULL, receive };
+static uint8_t registered;
+/*----------------------------------------------------------------------------*/
+static void
+free_request(coap_client_request_t *r)
+{
+  struct buffered_block *b, *next;
+  int i;
+
+  for (i=0; i<COAP_CLIENT_BLOCK_WINDOW; ++i)
+  {
+    if (r->blocks[i].state==BLOCK_SENT && r->type==COAP_TYPE_CON)
+    {
+      coap_clear_transaction(coap_get_transaction_by_mid(r->blocks[i].mid));
+    }
+  }
+  for (b = (struct buffered_block *) list_head(blocks_list); b; b = next)
+  {
+    next = b->next;
+    if (b->request==r)
+    {
+      list_remove(blocks_list, b);
+      memb_free(&blocks_memb, b);
+    }
+  }
+
+  ctimer_stop(&r->timer);
+  list_remove(requests_list, r);
+  memb_free(&requests_memb, r);
+}
+/*----------------------------------------------------------------------------*/
+/* Returns 0 if the request is gone afterwards. */
+static int
+call_handler(coap_client_request_t *r, coap_client_status_t status, coap_packet_t *response)
+{
+  current = r;
+  cancelled = 0;
+  r->handler(r, status, response);
+  current = NULL;
+
+  if (cancelled || status!=COAP_CLIENT_BLOCK)
+  {
+    free_request(r);
+    return 0;
+  }
+  return 1;
+}
+/*----------------------------------------------------------------------------*/
+static coap_client_block_state_t *
+find_block(coap_client_request_t *r, uint32_t num)
+{
+  int i;
+
+  for (i=0; i<COAP_CLIENT_BLOCK_WINDOW; ++i)
+  {
+    if (r->blocks[i].state!=BLOCK_FREE && r->blocks[i].num==num)
+    {
+      return &r->blocks[i];
+    }
+  }
+  return NULL;
+}
+/*----------------------------------------------------------------------------*/
+static struct buffered_block *
+find_buffered(coap_client_request_t *r, uint32_t num)
+{
+  struct buffered_block *b;
+
+  for (b = (struct buffered_block *) list_head(blocks_list); b; b = b->next)
+  {
+    if (b->request==r && b->num==num)
+    {
+      return b;
+    }
+  }
+  return NULL;
+}
+/*----------------------------------------------------------------------------*/
+static int
+in_flight(coap_client_request_t *r)
+{
+  int i, n = 0;
+
+  for (i=0; i<COAP_CLIENT_BLOCK_WINDOW; ++i)
+  {
+    n += r->blocks[i].state!=BLOCK_FREE;
+  }
+  return n;
+}
+/*----------------------------------------------------------------------------*/
+static void
+transaction_callback(void *data, void *response);
+
+/* Builds the request for block num in its transaction, or in the uIP buffer for NON, and sends it. */
+static int
+send_request(coap_client_request_t *r, coap_client_block_state_t *s, coap_packet_t *request, uint32_t num)
+{
+  coap_transaction_t *t = NULL;
+  uint8_t *packet = COAP_SEND_BUF;
+  uint16_t len;
+
+  request->mid = coap_get_mid();
+  if (num>0 || r->block_size)
+  {
+    coap_set_header_block2(request, num, 0, r->block_size);
+  }
+
+  if (r->type==COAP_TYPE_CON)
+  {
+    if (!(t = coap_new_transaction(request->mid, &r->addr, r->port)))
+    {
+      PRINTF("Client: no transaction for block %lu\n", num);
+      return 0;
+    }
+    packet = t->packet;
+  }
+  len = coap_serialize_message(request, packet);
+
+  if (r->packet_len==0)
+  {
+    /* The first request is kept to ask for the following blocks. */
+    if (len==0 || len>sizeof(r->packet))
+    {
+      PRINTF("Client: request of %u bytes too long\n", len);
+      coap_clear_transaction(t);
+      return 0;
+    }
+    memcpy(r->packet, packet, len);
+    r->packet_len = len;
+  }
+
+  if (t)
+  {
+    t->callback = transaction_callback;
+    t->callback_data = r;
+    t->packet_len = len;
+    coap_send_transaction(t);
+  }
+  else
+  {
+    coap_send_message(&r->addr, r->port, packet, len);
+  }
+
+  PRINTF("Client: requested block %lu (MID %u)\n", num, request->mid);
+  s->num = num;
+  s->mid = request->mid;
+  s->state = BLOCK_SENT;
+  return 1;
+}
+/*----------------------------------------------------------------------------*/
+static int
+send_block(coap_client_request_t *r, coap_client_block_state_t *s, uint32_t num)
+{
+  static coap_packet_t request[1];
+
+  coap_parse_message(request, r->packet, r->packet_len);
+  return send_request(r, s, request, num);
+}
+/*----------------------------------------------------------------------------*/
+static void
+fill_window(coap_client_request_t *r)
+{
+  coap_client_block_state_t *s;
+  struct buffered_block *b = NULL;
+  int i;
+
+  /* Further blocks can only be asked for once their size is known. The window
+   * slides with delivery, so at most COAP_CLIENT_BLOCK_WINDOW-1 wait in buffers. */
+  while (r->next_request<r->end && (r->next_request==0 || r->block_size)
+         && r->next_request<r->next_deliver+COAP_CLIENT_BLOCK_WINDOW)
+  {
+    for (s = NULL, i=0; i<COAP_CLIENT_BLOCK_WINDOW; ++i)
+    {
+      if (r->blocks[i].state==BLOCK_FREE)
+      {
+        s = &r->blocks[i];
+        break;
+      }
+    }
+    if (s==NULL)
+    {
+      break;
+    }
+    if (!find_block(r, r->next_request) && !find_buffered(r, r->next_request))
+    {
+      /* A block ahead of the next one needs a buffer to wait in. */
+      if (r->next_request>r->next_deliver)
+      {
+        if (!(b = memb_alloc(&blocks_memb)))
+        {
+          break;
+        }
+        b->request = r;
+        b->num = r->next_request;
+        b->filled = 0;
+      }
+      if (!send_block(r, s, r->next_request))
+      {
+        if (b)
+        {
+          memb_free(&blocks_memb, b);
+        }
+        break;
+      }
+      if (b)
+      {
+        list_add(blocks_list, b);
+        b = NULL;
+      }
+    }
+    ++(r->next_request);
+  }
+}
+/*----------------------------------------------------------------------------*/
+/* Passes the blocks that arrived early and are next now. */
+static int
+deliver_buffered(coap_client_request_t *r)
+{
+  static coap_packet_t packet[1];
+  struct buffered_block *b;
+  int more;
+
+  while ((b = find_buffered(r, r->next_deliver)) && b->filled)
+  {
+    list_remove(blocks_list, b);
+    ++(r->next_deliver);
+
+    coap_init_message(packet, COAP_TYPE_ACK, b->code, 0);
+    coap_set_header_block2(packet, b->num, b->more, r->block_size);
+    coap_set_payload(packet, b->payload, b->len);
+    more = b->more;
+
+    if (!call_handler(r, more ? COAP_CLIENT_BLOCK : COAP_CLIENT_DONE, packet))
+    {
+      memb_free(&blocks_memb, b);
+      return 0;
+    }
+    memb_free(&blocks_memb, b);
+  }
+  return 1;
+}
+/*----------------------------------------------------------------------------*/
+static void
+handle_response(coap_client_request_t *r, coap_client_block_state_t *s, coap_packet_t *response)
+{
+  struct buffered_block *b;
+  uint32_t num = 0;
+  uint8_t more = 0;
+  uint16_t size = 0;
+  int blockwise;
+
+  if (response==NULL)
+  {
+    PRINTF("Client: timeout\n");
+    call_handler(r, COAP_CLIENT_TIMEOUT, NULL);
+    return;
+  }
+  if (response->type==COAP_TYPE_RST)
+  {
+    PRINTF("Client: reset\n");
+    call_handler(r, COAP_CLIENT_FAILED, response);
+    return;
+  }
+
+  ctimer_restart(&r->timer);
+  if (response->code==0)
+  {
+    /* Empty ACK: the response will come separately. */
+    if (s)
+    {
+      s->state = BLOCK_ACKED;
+    }
+    return;
+  }
+
+  blockwise = coap_get_header_block2(response, &num, &more, &size, NULL);
+  if (s==NULL)
+  {
+    s = find_block(r, num);
+  }
+  if (s)
+  {
+    s->state = BLOCK_FREE;
+  }
+  PRINTF("Client: received block %lu%s (code %u)\n", num, more ? "+" : "", response->code);
+
+  b = find_buffered(r, num);
+  if (num<r->next_deliver || num>=r->end || (b && b->filled))
+  {
+    /* A duplicate, or an answer to a block past the end. */
+  }
+  else if (response->code>=BAD_REQUEST_4_00 && num>0)
+  {
+    /* Blocks past the end are asked for before the end is known. */
+    r->end = num;
+  }
+  else
+  {
+    if (blockwise && r->block_size==0)
+    {
+      r->block_size = size;
+    }
+    if (!blockwise || !more)
+    {
+      r->end = num+1;
+    }
+
+    if (num==r->next_deliver)
+    {
+      if (b)
+      {
+        /* Reserved while it was still ahead. */
+        list_remove(blocks_list, b);
+        memb_free(&blocks_memb, b);
+      }
+      ++(r->next_deliver);
+      if (!call_handler(r, r->next_deliver<r->end ? COAP_CLIENT_BLOCK : COAP_CLIENT_DONE, response)
+          || !deliver_buffered(r))
+      {
+        return;
+      }
+    }
+    else if (b)
+    {
+      b->filled = 1;
+      b->more = more;
+      b->code = response->code;
+      b->len = MIN(response->payload_len, REST_MAX_CHUNK_SIZE);
+      memcpy(b->payload, response->payload, b->len);
+    }
+    else if (r->next_request>num)
+    {
+      /* Nowhere to keep it; ask again when it is next. */
+      r->next_request = num;
+    }
+  }
+
+  if (r->next_deliver>=r->end)
+  {
+    /* The body ended in an error before the block that said it was last. */
+    call_handler(r, COAP_CLIENT_FAILED, NULL);
+    return;
+  }
+
+  fill_window(r);
+  if (in_flight(r)==0)
+  {
+    PRINTF("Client: stalled\n");
+    call_handler(r, COAP_CLIENT_FAILED, NULL);
+  }
+}
+/*----------------------------------------------------------------------------*/
+static void
+transaction_callback(void *data, void *response)
+{
+  coap_client_request_t *r = (coap_client_request_t *) data;
+  coap_client_block_state_t *s = NULL;
+  int i;
+
+  if (response)
+  {
+    for (i=0; i<COAP_CLIENT_BLOCK_WINDOW; ++i)
+    {
+      if (r->blocks[i].state==BLOCK_SENT && r->blocks[i].mid==((coap_packet_t *) response)->mid)
+      {
+        s = &r->blocks[i];
+        break;
+      }
+    }
+  }
+  handle_response(r, s, (coap_packet_t *) response);
+}
+/*----------------------------------------------------------------------------*/
+static void
+timeout_callback(void *data)
+{
+  call_handler((coap_client_request_t *) data, COAP_CLIENT_TIMEOUT, NULL);
+}
+/*----------------------------------------------------------------------------*/
+/* NON and separate responses are matched by their token. */
+static int
+receive(void *message)
+{
+  coap_packet_t *const response = (coap_packet_t *) message;
+  coap_client_request_t *r;
+
+  if (response->token_len!=sizeof(r->token))
+  {
+    return 0;
+  }
+  for (r = (coap_client_request_t *) list_head(requests_list); r; r = r->next)
+  {
+    if (memcmp(r->token, response->token, sizeof(r->token))==0 &&
+        uip_ipaddr_cmp(&r->addr, &UIP_IP_BUF->srcipaddr) && r->port==UIP_UDP_BUF->srcport)
+    {
+      handle_response(r, NULL, response);
+      return 1;
+    }
+  }
+  return 0;
+}
+/*----------------------------------------------------------------------------*/
+coap_client_request_t *
+coap_client_request(uip_ipaddr_t *addr, uint16_t port, coap_packet_t *request, coap_client_handler_t handler, void *data)
+{
+  coap_client_request_t *r;
+
+  if (next_token==0)
+  {
+    next_token = random_rand() | 1;
+  }
+  if (!registered)
+  {
+    coap_register_response_handler(&response_handler);
+    registered = 1;
+  }
+
+  if (!(r = memb_alloc(&requests_memb)))
+  {
+    PRINTF("Client: no free request\n");
+    return NULL;
+  }
+  memset(r, 0, sizeof(coap_client_request_t));
+  uip_ipaddr_copy(&r->addr, addr);
+  r->port = port;
+  r->type = request->type;
+  r->handler = handler;
+  r->data = data;
+  r->end = END_UNKNOWN;
+  if (IS_OPTION(request, COAP_OPTION_BLOCK2))
+  {
+    r->block_size = request->block2_size;
+  }
+
+  r->token[0] = next_token>>8;
+  r->token[1] = next_token;
+  ++next_token;
+  coap_set_header_token(request, r->token, sizeof(r->token));
+
+  list_add(requests_list, r);
+  if (!send_request(r, &r->blocks[0], request, 0))
+  {
+    list_remove(requests_list, r);
+    memb_free(&requests_memb, r);
+    return NULL;
+  }
+  r->next_request = 1;
+  ctimer_set(&r->timer, COAP_CLIENT_RESPONSE_TIMEOUT, timeout_callback, r);
+
+  return r;
+}
+/*----------------------------------------------------------------------------*/
+void
+coap_client_cancel(coap_client_request_t *r)
+{
+  if (r==current)
+  {
+    cancelled = 1;
+  }
+  else
+  {
+    free_request(r);
+  }
+}
+/*----------------------------------------------------------------------------*/
+int
+coap_client_pending(void)
+{
+  return list_length(requests_list);
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2013, Institute for Pervasive Computing, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *      Non-blocking CoAP client
+ *
+ *      Unlike COAP_BLOCKING_REQUEST(), a process can have any number of
+ *      requests outstanding, up to COAP_CLIENT_MAX_REQUESTS for all
+ *      processes together. Each request gets its own token, so that NON
+ *      and separate responses are matched as well as piggy-backed ones.
+ *      Block2 bodies are fetched with up to COAP_CLIENT_BLOCK_WINDOW blocks
+ *      in flight; the handler still gets the blocks in order. NON blocks
+ *      are not repeated, so a lost one ends the request with a timeout.
+ *
+ *      Responses arrive through the CoAP receiver, so coap_receiver_init()
+ *      must have been called, e.g., through rest_init_engine().
+ */
+
+#ifndef COAP_CLIENT_H_
+#define COAP_CLIENT_H_
+
+#include "er-coap-13.h"
+#include "er-coap-13-transactions.h"
+#include "sys/ctimer.h"
+
+/* Requests outstanding at the same time, for all processes together. */
+#ifndef COAP_CLIENT_MAX_REQUESTS
+#define COAP_CLIENT_MAX_REQUESTS 4
+#endif /* COAP_CLIENT_MAX_REQUESTS */
+
+/* Blocks in flight per request; 1 fetches one block per round trip. CON blocks take a transaction each. */
+#ifndef COAP_CLIENT_BLOCK_WINDOW
+#define COAP_CLIENT_BLOCK_WINDOW 1
+#endif /* COAP_CLIENT_BLOCK_WINDOW */
+
+/* Buffers for blocks asked for ahead of the next one to deliver, for all requests together. */
+#ifndef COAP_CLIENT_BUFFERED_BLOCKS
+#define COAP_CLIENT_BUFFERED_BLOCKS COAP_CLIENT_BLOCK_WINDOW
+#endif /* COAP_CLIENT_BUFFERED_BLOCKS */
+
+/* Time to wait for a NON or separate response. */
+#ifndef COAP_CLIENT_RESPONSE_TIMEOUT
+#define COAP_CLIENT_RESPONSE_TIMEOUT (CLOCK_SECOND * COAP_RESPONSE_TIMEOUT * ((1 << (COAP_MAX_RETRANSMIT + 1)) - 1))
+#endif /* COAP_CLIENT_RESPONSE_TIMEOUT */
+
+/* Space kept per request to ask for the following blocks; longer requests are refused. */
+#ifndef COAP_CLIENT_REQUEST_SIZE
+#define COAP_CLIENT_REQUEST_SIZE COAP_MAX_HEADER_SIZE
+#endif /* COAP_CLIENT_REQUEST_SIZE */
+
+#if COAP_MAX_OPEN_TRANSACTIONS<COAP_CLIENT_BLOCK_WINDOW
+#warning "COAP_MAX_OPEN_TRANSACTIONS smaller than COAP_CLIENT_BLOCK_WINDOW: CON windows are limited by transactions"
+#endif
+
+typedef enum {
+  COAP_CLIENT_BLOCK,   /* a block of the response, more follow */
+  COAP_CLIENT_DONE,    /* the response, or its last block */
+  COAP_CLIENT_TIMEOUT, /* no response; response is NULL */
+  COAP_CLIENT_FAILED   /* reset, or a block could not be fetched; response may be NULL */
+} coap_client_status_t;
+
+struct coap_client_request;
+
+/*
+ * Called for every block of the response in order. The last call has a
+ * status other than COAP_CLIENT_BLOCK, and the request is freed after it.
+ * Blocks that arrived out of order are passed with only the code, the
+ * Block2 option and the payload set.
+ */
+typedef void (*coap_client_handler_t)(struct coap_client_request *request, coap_client_status_t status, coap_packet_t *response);
+
+typedef struct coap_client_block_state {
+  uint32_t num;
+  uint16_t mid;
+  uint8_t state;
+} coap_client_block_state_t;
+
+typedef struct coap_client_request {
+  struct coap_client_request *next; /* for LIST */
+
+  uip_ipaddr_t addr;
+  uint16_t port;
+  uint8_t token[2];
+  uint8_t type;
+
+  coap_client_handler_t handler;
+  void *data; /* for the application */
+
+  struct ctimer timer;
+  uint16_t block_size;
+  uint32_t next_request; /* next block to ask for */
+  uint32_t next_deliver; /* next block to pass to the handler */
+  uint32_t end;          /* first block past the body, once known */
+  coap_client_block_state_t blocks[COAP_CLIENT_BLOCK_WINDOW];
+
+  uint16_t packet_len;
+  uint8_t packet[COAP_CLIENT_REQUEST_SIZE]; /* the first request sent, parsed again for each block */
+} coap_client_request_t;
+
+/**
+ * \brief Sends a request without waiting for the response.
+ * \param addr The server
+ * \param port The server port, in network byte order
+ * \param request A CON or NON request; the client sets its MID and token
+ * \param handler Called with the response
+ * \param data Stored in the data field of the request
+ * \return The request, or NULL if the pool or the transactions are exhausted
+ *
+ * The request packet is copied and can be reused when this returns. CON
+ * requests are built in a transaction buffer, NON requests in the uIP
+ * buffer, so a handler must not call this while it still reads the
+ * payload of a NON response.
+ */
+coap_client_request_t *coap_client_request(uip_ipaddr_t *addr, uint16_t port, coap_packet_t *request, coap_client_handler_t handler, void *data);
+
+/**
+ * \brief Forgets a request; its handler is not called anymore.
+ */
+void coap_client_cancel(coap_client_request_t *request);
+
+/**
+ * \brief The number of requests outstanding.
+ */
+int coap_client_pending(void);
+
+#endif /* COAP_CLIENT_H_ */
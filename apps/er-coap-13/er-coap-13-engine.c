@@ -43,6 +43,11 @@
 #include "contiki-net.h"
 
 #include "er-coap-13-engine.h"
+#include "er-coap-dedup.h"
+
+#if COAP_DEDUP_CACHE_SIZE && COAP_DEDUP_PACKET_SIZE<COAP_MAX_PACKET_SIZE
+#warning "COAP_DEDUP_PACKET_SIZE smaller than COAP_MAX_PACKET_SIZE: longer responses are not cached"
+#endif
 
 #define DEBUG 0
 #if DEBUG
@@ -71,6 +76,7 @@ PROCESS(coap_receiver, "CoAP Receiver");
 /*- Variables ----------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 static service_callback_t service_cbk = NULL;
+LIST(response_handlers);
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
 /*----------------------------------------------------------------------------*/
@@ -86,9 +92,24 @@ coap_receive(void)
   static coap_packet_t message[1]; /* This way the packet can be treated as pointer as usual. */
   static coap_packet_t response[1];
   static coap_transaction_t *transaction = NULL;
+  uint8_t group;
+#if COAP_DEDUP_CACHE_SIZE
+  uint8_t request = 0;
+#endif /* COAP_DEDUP_CACHE_SIZE */
+  uip_ipaddr_t src_addr; /* sending clobbers the IP header */
+  uint16_t src_port;
+  uint16_t in_place_len = 0;
+  uint8_t *buffer;
 
   if (uip_newdata()) {
 
+    transaction = NULL;
+
+    /* Requests to a multicast address are group communication (RFC 7390). */
+    group = uip_is_addr_mcast(&UIP_IP_BUF->destipaddr);
+    uip_ipaddr_copy(&src_addr, &UIP_IP_BUF->srcipaddr);
+    src_port = UIP_UDP_BUF->srcport;
+
     PRINTF("receiving UDP datagram from: ");
     PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
     PRINTF(":%u\n  Length: %u\n  Data: ", uip_ntohs(UIP_UDP_BUF->srcport), uip_datalen() );
@@ -100,8 +121,6 @@ coap_receive(void)
     if (coap_error_code==NO_ERROR)
     {
 
-      /*TODO duplicates suppression, if required by application */
-
       PRINTF("  Parsed: v %u, t %u, tkl %u, c %u, mid %u\n", message->version, message->type, message->token_len, message->code, message->mid);
       PRINTF("  URL: %.*s\n", message->uri_path_len, message->uri_path);
       PRINTF("  Payload: %.*s\n", message->payload_len, message->payload);
@@ -109,8 +128,32 @@ coap_receive(void)
       /* Handle requests. */
       if (message->code >= COAP_GET && message->code <= COAP_DELETE)
       {
-        /* Use transaction buffer for response to confirmable request. */
-        if ( (transaction = coap_new_transaction(message->mid, &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport)) )
+#if COAP_DEDUP_CACHE_SIZE
+        coap_dedup_entry_t *duplicate;
+
+        /* Repeat the response to a retransmitted request instead of running the resource again. */
+        if (!group && (duplicate = coap_dedup_lookup(&src_addr, src_port, message->mid)))
+        {
+          PRINTF("Duplicate of MID %u\n", message->mid);
+          if (duplicate->packet_len)
+          {
+            coap_send_message(&src_addr, src_port, duplicate->packet, duplicate->packet_len);
+          }
+          return NO_ERROR;
+        }
+        request = !group;
+#endif /* COAP_DEDUP_CACHE_SIZE */
+
+        /* Resources write their payload straight into uip_buf behind the request. Only delayed
+         * group responses are kept, and requests that reach into that space need a buffer, too.
+         * Like the transaction buffer, uip_buf must leave room for the terminating '\0' of snprintf(). */
+        buffer = COAP_SEND_BUF+COAP_MAX_HEADER_SIZE;
+        if (group || uip_datalen()>COAP_MAX_HEADER_SIZE || COAP_MAX_PACKET_SIZE >= UIP_BUFSIZE-UIP_LLH_LEN-UIP_IPUDPH_LEN)
+        {
+          buffer = (transaction = coap_new_transaction(message->mid, &src_addr, src_port)) ? transaction->packet+COAP_MAX_HEADER_SIZE : NULL;
+        }
+
+        if (buffer)
         {
           uint32_t block_num = 0;
           uint16_t block_size = REST_MAX_CHUNK_SIZE;
@@ -118,7 +161,7 @@ coap_receive(void)
           int32_t new_offset = 0;
 
           /* prepare response */
-          if (message->type==COAP_TYPE_CON)
+          if (message->type==COAP_TYPE_CON && !group)
           {
             /* Reliable CON requests are answered with an ACK. */
             coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, message->mid);
@@ -147,7 +190,7 @@ coap_receive(void)
           if (service_cbk)
           {
             /* Call REST framework and check if found and allowed. */
-            if (service_cbk(message, response, transaction->packet+COAP_MAX_HEADER_SIZE, block_size, &new_offset))
+            if (service_cbk(message, response, buffer, block_size, &new_offset))
             {
               if (coap_error_code==NO_ERROR)
               {
@@ -196,10 +239,20 @@ coap_receive(void)
               } /* no errors/hooks */
             } /* successful service callback */
 
-            /* Serialize response. */
+            /* Serialize response. Only delayed group responses are kept; the others go straight into uip_buf. */
             if (coap_error_code==NO_ERROR)
             {
-              if ((transaction->packet_len = coap_serialize_message(response, transaction->packet))==0)
+              if (!group && (in_place_len = coap_serialize_message_in_place(response)))
+              {
+                PRINTF("Serialized response in place\n");
+              }
+              else if (!transaction && !(transaction = coap_new_transaction(message->mid, &src_addr, src_port)))
+              {
+                /* The response refers to the request, which serializing in place would overwrite. */
+                coap_error_code = SERVICE_UNAVAILABLE_5_03;
+                coap_error_message = "NoFreeTraBuffer";
+              }
+              else if ((transaction->packet_len = coap_serialize_message(response, transaction->packet))==0)
               {
                 coap_error_code = PACKET_SERIALIZATION_ERROR;
               }
@@ -244,6 +297,23 @@ coap_receive(void)
             callback(callback_data, message);
           }
         } /* if (ACKed transaction) */
+        else if (list_head(response_handlers) && (message->type==COAP_TYPE_CON || message->type==COAP_TYPE_NON))
+        {
+          /* NON and separate responses are matched by token. */
+          coap_response_handler_t *handler;
+          int claimed = 0;
+
+          for (handler = (coap_response_handler_t *) list_head(response_handlers); handler && !claimed; handler = handler->next)
+          {
+            claimed = handler->callback(message);
+          }
+
+          if (message->type==COAP_TYPE_CON)
+          {
+            coap_init_message(message, claimed ? COAP_TYPE_ACK : COAP_TYPE_RST, 0, message->mid);
+            coap_send_message(&src_addr, src_port, COAP_SEND_BUF, coap_serialize_message(message, COAP_SEND_BUF));
+          }
+        }
         transaction = NULL;
 
       } /* Request or Response */
@@ -252,18 +322,63 @@ coap_receive(void)
 
     if (coap_error_code==NO_ERROR)
     {
-      if (transaction) coap_send_transaction(transaction);
+      if (transaction && group)
+      {
+        /* Spread the responses of the group members over the leisure period. */
+        coap_send_transaction_delayed(transaction, random_rand() % (clock_time_t) (COAP_DEFAULT_LEISURE * CLOCK_SECOND));
+      }
+      else if (in_place_len)
+      {
+#if COAP_DEDUP_CACHE_SIZE
+        if (request)
+        {
+          coap_dedup_store(&src_addr, src_port, message->mid, COAP_SEND_BUF, in_place_len);
+        }
+#endif /* COAP_DEDUP_CACHE_SIZE */
+        /* A transaction only held the payload of a long request's response while the resource wrote it. */
+        coap_clear_transaction(transaction);
+        coap_send_message(&src_addr, src_port, COAP_SEND_BUF, in_place_len);
+      }
+      else if (transaction)
+      {
+#if COAP_DEDUP_CACHE_SIZE
+        if (request)
+        {
+          coap_dedup_store(&src_addr, src_port, message->mid, transaction->packet, transaction->packet_len);
+        }
+#endif /* COAP_DEDUP_CACHE_SIZE */
+        coap_send_transaction(transaction);
+      }
     }
     else if (coap_error_code==MANUAL_RESPONSE)
     {
       PRINTF("Clearing transaction for manual response");
       coap_clear_transaction(transaction);
+#if COAP_DEDUP_CACHE_SIZE
+      if (request)
+      {
+        /* A separate response follows; duplicates of CON requests only get the empty ACK again. */
+        uint16_t len = 0;
+        if (message->type==COAP_TYPE_CON)
+        {
+          coap_init_message(response, COAP_TYPE_ACK, 0, message->mid);
+          len = coap_serialize_message(response, COAP_SEND_BUF);
+        }
+        coap_dedup_store(&src_addr, src_port, message->mid, COAP_SEND_BUF, len);
+      }
+#endif /* COAP_DEDUP_CACHE_SIZE */
     }
     else
     {
       PRINTF("ERROR %u: %s\n", coap_error_code, coap_error_message);
       coap_clear_transaction(transaction);
 
+      /* Group members do not answer with errors, e.g., for unknown resources. */
+      if (group)
+      {
+        return coap_error_code;
+      }
+
       /* Set to sendable error code. */
       if (coap_error_code >= 192)
       {
@@ -272,7 +387,14 @@ coap_receive(void)
       /* Reuse input buffer for error message. */
       coap_init_message(message, COAP_TYPE_ACK, coap_error_code, message->mid);
       coap_set_payload(message, coap_error_message, strlen(coap_error_message));
-      coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport, uip_appdata, coap_serialize_message(message, uip_appdata));
+      uint16_t len = coap_serialize_message(message, COAP_SEND_BUF);
+#if COAP_DEDUP_CACHE_SIZE
+      if (request)
+      {
+        coap_dedup_store(&src_addr, src_port, message->mid, COAP_SEND_BUF, len);
+      }
+#endif /* COAP_DEDUP_CACHE_SIZE */
+      coap_send_message(&src_addr, src_port, COAP_SEND_BUF, len);
     }
   } /* if (new data) */
 
@@ -291,6 +413,18 @@ coap_set_service_callback(service_callback_t callback)
   service_cbk = callback;
 }
 /*----------------------------------------------------------------------------*/
+void
+coap_register_response_handler(coap_response_handler_t *handler)
+{
+  list_add(response_handlers, handler);
+}
+/*----------------------------------------------------------------------------*/
+void
+coap_remove_response_handler(coap_response_handler_t *handler)
+{
+  list_remove(response_handlers, handler);
+}
+/*----------------------------------------------------------------------------*/
 rest_resource_flags_t
 coap_get_rest_method(void *packet)
 {
@@ -47,6 +47,7 @@
 #include "er-coap-13-transactions.h"
 #include "er-coap-13-observing.h"
 #include "er-coap-13-separate.h"
+#include "er-coap-13-client.h"
 
 #include "pt.h"
 
@@ -62,6 +63,23 @@ extern const struct rest_implementation coap_rest_implementation;
 
 void coap_receiver_init(void);
 
+/* Gets responses that match no transaction; returns 1 if it claims the response by its token. */
+typedef int (*response_callback_t)(void *response);
+
+typedef struct coap_response_handler {
+  struct coap_response_handler *next; /* for LIST */
+  response_callback_t callback;
+} coap_response_handler_t;
+
+/*
+ * Responses that match no transaction go to the registered handlers in
+ * order until one claims them. The CoAP client registers one of them. A
+ * CON response is ACKed if claimed and reset otherwise. Without handlers,
+ * such responses are ignored.
+ */
+void coap_register_response_handler(coap_response_handler_t *handler);
+void coap_remove_response_handler(coap_response_handler_t *handler);
+
 /*-----------------------------------------------------------------------------------*/
 /*- Client part ---------------------------------------------------------------------*/
 /*-----------------------------------------------------------------------------------*/
@@ -37,6 +37,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "er-coap-13-observing.h"
@@ -54,7 +55,13 @@
 
 
 MEMB(observers_memb, coap_observer_t, COAP_MAX_OBSERVERS);
-LIST(observers_list);
+
+#define URL_HASH(url) ((((uintptr_t) (url)) ^ (((uintptr_t) (url))>>4)) & (COAP_OBSERVERS_HASH_SIZE-1))
+#define CLIENT_HASH(addr, port) (((addr)->u8[15] ^ (addr)->u8[14] ^ (port) ^ ((port)>>8)) & (COAP_OBSERVERS_HASH_SIZE-1))
+
+static coap_observer_t *url_table[COAP_OBSERVERS_HASH_SIZE];
+static coap_observer_t *client_table[COAP_OBSERVERS_HASH_SIZE];
+static uint8_t observers_count = 0;
 
 /*-----------------------------------------------------------------------------------*/
 coap_observer_t *
@@ -77,7 +84,11 @@ coap_add_observer(uip_ipaddr_t *addr, uint16_t port, const uint8_t *token, size_
     stimer_set(&o->refresh_timer, COAP_OBSERVING_REFRESH_INTERVAL);
 
     PRINTF("Adding observer for /%s [0x%02X%02X]\n", o->url, o->token[0], o->token[1]);
-    list_add(observers_list, o);
+    o->next = url_table[URL_HASH(url)];
+    url_table[URL_HASH(url)] = o;
+    o->client_next = client_table[CLIENT_HASH(addr, port)];
+    client_table[CLIENT_HASH(addr, port)] = o;
+    ++observers_count;
   }
 
   return o;
@@ -86,23 +97,42 @@ coap_add_observer(uip_ipaddr_t *addr, uint16_t port, const uint8_t *token, size_
 void
 coap_remove_observer(coap_observer_t *o)
 {
+  coap_observer_t **p;
+
   PRINTF("Removing observer for /%s [0x%02X%02X]\n", o->url, o->token[0], o->token[1]);
 
+  for (p = &url_table[URL_HASH(o->url)]; *p; p = &(*p)->next)
+  {
+    if (*p==o)
+    {
+      *p = o->next;
+      break;
+    }
+  }
+  for (p = &client_table[CLIENT_HASH(&o->addr, o->port)]; *p; p = &(*p)->client_next)
+  {
+    if (*p==o)
+    {
+      *p = o->client_next;
+      break;
+    }
+  }
+  --observers_count;
   memb_free(&observers_memb, o);
-  list_remove(observers_list, o);
 }
 
 int
 coap_remove_observer_by_client(uip_ipaddr_t *addr, uint16_t port)
 {
   int removed = 0;
-  coap_observer_t* obs = NULL;
+  coap_observer_t *obs, *next;
 
-  for (obs = (coap_observer_t*)list_head(observers_list); obs; obs = obs->next)
+  PRINTF("Remove check client ");
+  PRINT6ADDR(addr);
+  PRINTF(":%u\n", port);
+  for (obs = client_table[CLIENT_HASH(addr, port)]; obs; obs = next)
   {
-    PRINTF("Remove check client ");
-    PRINT6ADDR(addr);
-    PRINTF(":%u\n", port);
+    next = obs->client_next;
     if (uip_ipaddr_cmp(&obs->addr, addr) && obs->port==port)
     {
       coap_remove_observer(obs);
@@ -116,11 +146,12 @@ int
 coap_remove_observer_by_token(uip_ipaddr_t *addr, uint16_t port, uint8_t *token, size_t token_len)
 {
   int removed = 0;
-  coap_observer_t* obs = NULL;
+  coap_observer_t *obs, *next;
 
-  for (obs = (coap_observer_t*)list_head(observers_list); obs; obs = obs->next)
+  PRINTF("Remove check Token 0x%02X%02X\n", token[0], token[1]);
+  for (obs = client_table[CLIENT_HASH(addr, port)]; obs; obs = next)
   {
-    PRINTF("Remove check Token 0x%02X%02X\n", token[0], token[1]);
+    next = obs->client_next;
     if (uip_ipaddr_cmp(&obs->addr, addr) && obs->port==port && obs->token_len==token_len && memcmp(obs->token, token, token_len)==0)
     {
       coap_remove_observer(obs);
@@ -134,12 +165,13 @@ int
 coap_remove_observer_by_url(uip_ipaddr_t *addr, uint16_t port, const char *url)
 {
   int removed = 0;
-  coap_observer_t* obs = NULL;
+  coap_observer_t *obs, *next;
 
-  for (obs = (coap_observer_t*)list_head(observers_list); obs; obs = obs->next)
+  PRINTF("Remove check URL %p\n", url);
+  for (obs = url_table[URL_HASH(url)]; obs; obs = next)
   {
-    PRINTF("Remove check URL %p\n", url);
-    if ((addr==NULL || (uip_ipaddr_cmp(&obs->addr, addr) && obs->port==port)) && (obs->url==url || memcmp(obs->url, url, strlen(obs->url))==0))
+    next = obs->next;
+    if ((addr==NULL || (uip_ipaddr_cmp(&obs->addr, addr) && obs->port==port)) && obs->url==url)
     {
       coap_remove_observer(obs);
       removed++;
@@ -152,11 +184,12 @@ int
 coap_remove_observer_by_mid(uip_ipaddr_t *addr, uint16_t port, uint16_t mid)
 {
   int removed = 0;
-  coap_observer_t* obs = NULL;
+  coap_observer_t *obs, *next;
 
-  for (obs = (coap_observer_t*)list_head(observers_list); obs; obs = obs->next)
+  PRINTF("Remove check MID %u\n", mid);
+  for (obs = client_table[CLIENT_HASH(addr, port)]; obs; obs = next)
   {
-    PRINTF("Remove check MID %u\n", mid);
+    next = obs->client_next;
     if (uip_ipaddr_cmp(&obs->addr, addr) && obs->port==port && obs->last_mid==mid)
     {
       coap_remove_observer(obs);
@@ -175,40 +208,42 @@ coap_notify_observers(resource_t *resource, int32_t obs_counter, void *notificat
 
   PRINTF("Observing: Notification from %s\n", resource->url);
 
-  /* Iterate over observers. */
-  for (obs = (coap_observer_t*)list_head(observers_list); obs; obs = obs->next)
+  /* Iterate over the observers in the bucket of the resource. */
+  for (obs = url_table[URL_HASH(resource->url)]; obs; obs = obs->next)
   {
     if (obs->url==resource->url) /* using RESOURCE url pointer as handle */
     {
       coap_transaction_t *transaction = NULL;
+      size_t len;
 
-      /*TODO implement special transaction for CON, sharing the same buffer to allow for more observers. */
+      PRINTF("           Observer ");
+      PRINT6ADDR(&obs->addr);
+      PRINTF(":%u\n", obs->port);
 
-      if ( (transaction = coap_new_transaction(coap_get_mid(), &obs->addr, obs->port)) )
-      {
-        PRINTF("           Observer ");
-        PRINT6ADDR(&obs->addr);
-        PRINTF(":%u\n", obs->port);
+      /* Prepare response */
+      coap_res->mid = coap_get_mid();
+      if (obs_counter>=0) coap_set_header_observe(coap_res, obs_counter);
+      coap_set_header_token(coap_res, obs->token, obs->token_len);
 
-        /* Update last MID for RST matching. */
-        obs->last_mid = transaction->mid;
+      /* Use CON to check whether client is still there/interested after COAP_OBSERVING_REFRESH_INTERVAL. */
+      coap_res->type = stimer_expired(&obs->refresh_timer) ? COAP_TYPE_CON : preferred_type;
 
-        /* Prepare response */
-        coap_res->mid = transaction->mid;
-        if (obs_counter>=0) coap_set_header_observe(coap_res, obs_counter);
-        coap_set_header_token(coap_res, obs->token, obs->token_len);
-
-        /* Use CON to check whether client is still there/interested after COAP_OBSERVING_REFRESH_INTERVAL. */
-        if (stimer_expired(&obs->refresh_timer))
+      if (coap_res->type!=COAP_TYPE_CON && (len = coap_serialize_message_in_place(coap_res)))
+      {
+        /* NON notifications are not retransmitted and need no transaction buffer. */
+        obs->last_mid = coap_res->mid;
+        coap_send_message(&obs->addr, obs->port, COAP_SEND_BUF, len);
+      }
+      else if ( (transaction = coap_new_transaction(coap_res->mid, &obs->addr, obs->port)) )
+      {
+        if (coap_res->type==COAP_TYPE_CON)
         {
           PRINTF("           Refreshing with CON\n");
-          coap_res->type = COAP_TYPE_CON;
           stimer_restart(&obs->refresh_timer);
         }
-        else
-        {
-          coap_res->type = preferred_type;
-        }
+
+        /* Update last MID for RST matching. */
+        obs->last_mid = transaction->mid;
 
         transaction->packet_len = coap_serialize_message(coap_res, transaction->packet);
 
@@ -238,7 +273,7 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
          * For demonstration purposes only. A subscription should return the same representation as a normal GET.
          * TODO: Comment the following line for any real application.
          */
-        coap_set_payload(coap_res, content, snprintf(content, sizeof(content), "Added %u/%u", list_length(observers_list), COAP_MAX_OBSERVERS));
+        coap_set_payload(coap_res, content, snprintf(content, sizeof(content), "Added %u/%u", observers_count, COAP_MAX_OBSERVERS));
       }
       else
       {
@@ -47,6 +47,13 @@
 #define COAP_MAX_OBSERVERS    COAP_MAX_OPEN_TRANSACTIONS-1
 #endif /* COAP_MAX_OBSERVERS */
 
+/*
+ * Buckets of the observer index by resource and by client; must be a power of two.
+ */
+#ifndef COAP_OBSERVERS_HASH_SIZE
+#define COAP_OBSERVERS_HASH_SIZE 8
+#endif /* COAP_OBSERVERS_HASH_SIZE */
+
 /* Interval in seconds in which NON notifies are changed to CON notifies to check client. */
 #define COAP_OBSERVING_REFRESH_INTERVAL  60
 
@@ -55,9 +62,10 @@
 #endif
 
 typedef struct coap_observer {
-  struct coap_observer *next; /* for LIST */
+  struct coap_observer *next;        /* in the bucket for its resource */
+  struct coap_observer *client_next; /* in the bucket for its client */
 
-  const char *url;
+  const char *url; /* the resource url pointer, used as its handle */
   uip_ipaddr_t addr;
   uint16_t port;
   uint8_t token_len;
@@ -66,8 +74,6 @@ typedef struct coap_observer {
   struct stimer refresh_timer;
 } coap_observer_t;
 
-list_t coap_get_observers(void);
-
 coap_observer_t *coap_add_observer(uip_ipaddr_t *addr, uint16_t port, const uint8_t *token, size_t token_len, const char *url);
 
 void coap_remove_observer(coap_observer_t *o);
@@ -65,11 +65,15 @@ int
 coap_separate_accept(void *request, coap_separate_t *separate_store)
 {
   coap_packet_t *const coap_req = (coap_packet_t *) request;
-  coap_transaction_t *const t = coap_get_transaction_by_mid(coap_req->mid);
 
   PRINTF("Separate ACCEPT: /%.*s MID %u\n", coap_req->uri_path_len, coap_req->uri_path, coap_req->mid);
-  if (t)
+  /* The request must still be in uip_buf, i.e., accepted from within the resource handler. */
+  if (uip_newdata())
   {
+    /* Store remote address before sending the ACK clobbers the IP header. */
+    uip_ipaddr_copy(&separate_store->addr, &UIP_IP_BUF->srcipaddr);
+    separate_store->port = UIP_UDP_BUF->srcport;
+
     /* Send separate ACK for CON. */
     if (coap_req->type==COAP_TYPE_CON)
     {
@@ -77,13 +81,9 @@ coap_separate_accept(void *request, coap_separate_t *separate_store)
       /* ACK with empty code (0) */
       coap_init_message(ack, COAP_TYPE_ACK, 0, coap_req->mid);
       /* Serializing into IPBUF: Only overwrites header parts that are already parsed into the request struct. */
-      coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport, (uip_appdata), coap_serialize_message(ack, uip_appdata));
+      coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport, COAP_SEND_BUF, coap_serialize_message(ack, COAP_SEND_BUF));
     }
 
-    /* Store remote address. */
-    uip_ipaddr_copy(&separate_store->addr, &t->addr);
-    separate_store->port = t->port;
-
     /* Store correct response type. */
     separate_store->type = coap_req->type==COAP_TYPE_CON ? COAP_TYPE_CON : COAP_TYPE_NON;
     separate_store->mid = coap_get_mid(); /* if it was a NON, we burned one MID in the engine... */
@@ -101,7 +101,7 @@ coap_separate_accept(void *request, coap_separate_t *separate_store)
   }
   else
   {
-    PRINTF("ERROR: Response transaction for separate request not found!\n");
+    PRINTF("ERROR: Separate request no longer in uip_buf!\n");
     return 0;
   }
 }
@@ -63,11 +63,119 @@
 
 
 MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
-LIST(transactions_list);
 
+/* MIDs are handed out in sequence, so the low bits spread them evenly. */
+#define MID_HASH(mid) ((mid) & (COAP_TRANSACTIONS_HASH_SIZE-1))
+
+static coap_transaction_t *mid_table[COAP_TRANSACTIONS_HASH_SIZE];
+
+/* Transactions waiting for a (re)transmission, driven by a single timer. */
+static coap_transaction_t *queue_head = NULL;
+static coap_transaction_t *queue_tail = NULL;
+static struct etimer retrans_timer;
 
 static struct process *transaction_handler_process = NULL;
 
+/*----------------------------------------------------------------------------*/
+/* Whether deadline a comes before b; correct across clock wrap-around. */
+static int
+before(clock_time_t a, clock_time_t b)
+{
+  return (clock_time_t)(a - b) > ((clock_time_t)~0 >> 1);
+}
+/*----------------------------------------------------------------------------*/
+static void
+set_retrans_timer(void)
+{
+  /*FIXME
+   * Hack: Setting timer for responsible process.
+   * Maybe there is a better way, but avoid posting everything to the process.
+   */
+  struct process *process_actual = PROCESS_CURRENT();
+  process_current = transaction_handler_process;
+
+  if (queue_head==NULL)
+  {
+    etimer_stop(&retrans_timer);
+  }
+  else if (before(queue_head->retrans_deadline, clock_time()))
+  {
+    etimer_set(&retrans_timer, 0);
+  }
+  else
+  {
+    etimer_set(&retrans_timer, queue_head->retrans_deadline - clock_time());
+  }
+
+  process_current = process_actual;
+}
+/*----------------------------------------------------------------------------*/
+static int
+is_queued(coap_transaction_t *t)
+{
+  return t->prev!=NULL || queue_head==t;
+}
+/*----------------------------------------------------------------------------*/
+static void
+queue_insert(coap_transaction_t *t, clock_time_t delay)
+{
+  coap_transaction_t *p;
+
+  t->retrans_deadline = clock_time() + delay;
+
+  /* New deadlines are mostly the latest, so search from the tail. */
+  for (p = queue_tail; p && before(t->retrans_deadline, p->retrans_deadline); p = p->prev);
+
+  t->prev = p;
+  t->next = p ? p->next : queue_head;
+  if (t->next)
+  {
+    t->next->prev = t;
+  }
+  else
+  {
+    queue_tail = t;
+  }
+  if (p)
+  {
+    p->next = t;
+  }
+  else
+  {
+    queue_head = t;
+    set_retrans_timer();
+  }
+}
+/*----------------------------------------------------------------------------*/
+static void
+queue_remove(coap_transaction_t *t)
+{
+  int was_head = queue_head==t;
+
+  if (t->prev)
+  {
+    t->prev->next = t->next;
+  }
+  else
+  {
+    queue_head = t->next;
+  }
+  if (t->next)
+  {
+    t->next->prev = t->prev;
+  }
+  else
+  {
+    queue_tail = t->prev;
+  }
+  t->next = t->prev = NULL;
+
+  if (was_head)
+  {
+    set_retrans_timer();
+  }
+}
+/*----------------------------------------------------------------------------*/
 void
 coap_register_as_transaction_handler()
 {
@@ -83,12 +191,14 @@ coap_new_transaction(uint16_t mid, uip_ipaddr_t *addr, uint16_t port)
   {
     t->mid = mid;
     t->retrans_counter = 0;
+    t->next = t->prev = NULL;
 
     /* save client address */
     uip_ipaddr_copy(&t->addr, addr);
     t->port = port;
 
-    list_add(transactions_list, t); /* List itself makes sure same element is not added twice. */
+    t->mid_next = mid_table[MID_HASH(mid)];
+    mid_table[MID_HASH(mid)] = t;
   }
 
   return t;
@@ -110,23 +220,16 @@ coap_send_transaction(coap_transaction_t *t)
 
       if (t->retrans_counter==0)
       {
-        t->retrans_timer.timer.interval = COAP_RESPONSE_TIMEOUT_TICKS + (random_rand() % (clock_time_t) COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
-        PRINTF("Initial interval %f\n", (float)t->retrans_timer.timer.interval/CLOCK_SECOND);
+        t->retrans_interval = COAP_RESPONSE_TIMEOUT_TICKS + (random_rand() % (clock_time_t) COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+        PRINTF("Initial interval %f\n", (float)t->retrans_interval/CLOCK_SECOND);
       }
       else
       {
-        t->retrans_timer.timer.interval <<= 1; /* double */
-        PRINTF("Doubled (%u) interval %f\n", t->retrans_counter, (float)t->retrans_timer.timer.interval/CLOCK_SECOND);
+        t->retrans_interval <<= 1; /* double */
+        PRINTF("Doubled (%u) interval %f\n", t->retrans_counter, (float)t->retrans_interval/CLOCK_SECOND);
       }
 
-      /*FIXME
-       * Hack: Setting timer for responsible process.
-       * Maybe there is a better way, but avoid posting everything to the process.
-       */
-      struct process *process_actual = PROCESS_CURRENT();
-      process_current = transaction_handler_process;
-      etimer_restart(&t->retrans_timer); /* interval updated above */
-      process_current = process_actual;
+      queue_insert(t, t->retrans_interval);
 
       t = NULL;
     }
@@ -153,15 +256,37 @@ coap_send_transaction(coap_transaction_t *t)
   }
 }
 
+void
+coap_send_transaction_delayed(coap_transaction_t *t, clock_time_t delay)
+{
+  PRINTF("Delaying transaction %u by %lu ticks\n", t->mid, (unsigned long) delay);
+
+  /* The first expiration sends the message; NON messages are freed afterwards. */
+  t->retrans_interval = delay;
+  queue_insert(t, delay);
+}
+
 void
 coap_clear_transaction(coap_transaction_t *t)
 {
+  coap_transaction_t **p;
+
   if (t)
   {
     PRINTF("Freeing transaction %u: %p\n", t->mid, t);
 
-    etimer_stop(&t->retrans_timer);
-    list_remove(transactions_list, t);
+    if (is_queued(t))
+    {
+      queue_remove(t);
+    }
+    for (p = &mid_table[MID_HASH(t->mid)]; *p; p = &(*p)->mid_next)
+    {
+      if (*p==t)
+      {
+        *p = t->mid_next;
+        break;
+      }
+    }
     memb_free(&transactions_memb, t);
   }
 }
@@ -171,7 +296,7 @@ coap_get_transaction_by_mid(uint16_t mid)
 {
   coap_transaction_t *t = NULL;
 
-  for (t = (coap_transaction_t*)list_head(transactions_list); t; t = t->next)
+  for (t = mid_table[MID_HASH(mid)]; t; t = t->mid_next)
   {
     if (t->mid==mid)
     {
@@ -187,13 +312,18 @@ coap_check_transactions()
 {
   coap_transaction_t *t = NULL;
 
-  for (t = (coap_transaction_t*)list_head(transactions_list); t; t = t->next)
+  /* Sending may queue the transaction again, but only with a later deadline. */
+  while ((t = queue_head) && !before(clock_time(), t->retrans_deadline))
   {
-    if (etimer_expired(&t->retrans_timer))
-    {
-      ++(t->retrans_counter);
-      PRINTF("Retransmitting %u (%u)\n", t->mid, t->retrans_counter);
-      coap_send_transaction(t);
-    }
+    queue_remove(t);
+    ++(t->retrans_counter);
+    PRINTF("Retransmitting %u (%u)\n", t->mid, t->retrans_counter);
+    coap_send_transaction(t);
+  }
+
+  /* Re-arm in case the timer expired before the head was due. */
+  if (queue_head && etimer_expired(&retrans_timer))
+  {
+    set_retrans_timer();
   }
 }
@@ -400,6 +400,37 @@ coap_serialize_message(void *packet, uint8_t *buffer)
   return (option - buffer) + coap_pkt->payload_len; /* packet length */
 }
 /*-----------------------------------------------------------------------------------*/
+static int
+points_into_uip_buf(const void *data)
+{
+  return (const uint8_t *) data>=uip_buf && (const uint8_t *) data<uip_buf+UIP_BUFSIZE;
+}
+/*-----------------------------------------------------------------------------------*/
+/*
+ * Serializes straight into COAP_SEND_BUF, so that coap_send_message() need not copy.
+ * Returns 0 if the packet still points into uip_buf, e.g., to the request, which
+ * serializing would overwrite; the caller then uses its own buffer. A payload that
+ * was written behind the header space, at COAP_SEND_BUF+COAP_MAX_HEADER_SIZE or
+ * later, is only moved down.
+ */
+size_t
+coap_serialize_message_in_place(void *packet)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *) packet;
+
+  if ((points_into_uip_buf(coap_pkt->payload) && coap_pkt->payload<COAP_SEND_BUF+COAP_MAX_HEADER_SIZE)
+      || points_into_uip_buf(coap_pkt->uri_host)
+      || points_into_uip_buf(coap_pkt->location_path) || points_into_uip_buf(coap_pkt->uri_path)
+      || points_into_uip_buf(coap_pkt->uri_query) || points_into_uip_buf(coap_pkt->location_query)
+      || points_into_uip_buf(coap_pkt->proxy_uri))
+  {
+    PRINTF("-Not serializing in place: packet refers to uip_buf-\n");
+    return 0;
+  }
+
+  return coap_serialize_message(packet, COAP_SEND_BUF);
+}
+/*-----------------------------------------------------------------------------------*/
 void
 coap_send_message(uip_ipaddr_t *addr, uint16_t port, uint8_t *data, uint16_t length)
 {
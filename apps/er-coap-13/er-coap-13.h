@@ -55,6 +55,7 @@
 #define COAP_RESPONSE_TIMEOUT                2
 #define COAP_RESPONSE_RANDOM_FACTOR          1.5
 #define COAP_MAX_RETRANSMIT                  4
+#define COAP_DEFAULT_LEISURE                 5 /* Seconds over which responses to group requests are spread */
 
 #define COAP_HEADER_LEN                      4 /* | version:0x03 type:0x0C tkl:0xF0 | code | mid:0x00FF | mid:0xFF00 | */
 #define COAP_ETAG_LEN                        8 /* The maximum number of bytes for the ETag */
@@ -94,6 +95,8 @@
 
 #define UIP_IP_BUF    ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
 #define UIP_UDP_BUF   ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+/* Where uip_udp_packet_send() expects the UDP payload; data already there is not copied. */
+#define COAP_SEND_BUF ((uint8_t *)&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN])
 
 /* Bitmap for set options */
 enum { OPTION_MAP_SIZE = sizeof(uint8_t) * 8 };
@@ -315,6 +318,7 @@ uint16_t coap_get_mid(void);
 
 void coap_init_message(void *packet, coap_message_type_t type, uint8_t code, uint16_t mid);
 size_t coap_serialize_message(void *packet, uint8_t *buffer);
+size_t coap_serialize_message_in_place(void *packet);
 void coap_send_message(uip_ipaddr_t *addr, uint16_t port, uint8_t *data, uint16_t length);
 coap_status_t coap_parse_message(void *request, uint8_t *data, uint16_t data_len);
 
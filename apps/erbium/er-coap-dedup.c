@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2013, Institute for Pervasive Computing, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *      Response cache for duplicate CoAP requests, shared by the CoAP engines
+ */
+
+#include <string.h>
+
+#include "er-coap-dedup.h"
+
+#if COAP_DEDUP_CACHE_SIZE
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+static coap_dedup_entry_t dedup_cache[COAP_DEDUP_CACHE_SIZE];
+static uint8_t dedup_next = 0;
+
+/*----------------------------------------------------------------------------*/
+coap_dedup_entry_t *
+coap_dedup_lookup(uip_ipaddr_t *addr, uint16_t port, uint16_t mid)
+{
+  int i;
+
+  for (i=0; i<COAP_DEDUP_CACHE_SIZE; ++i)
+  {
+    if (dedup_cache[i].port==port && dedup_cache[i].mid==mid && uip_ipaddr_cmp(&dedup_cache[i].addr, addr)
+        && !stimer_expired(&dedup_cache[i].lifetime))
+    {
+      return &dedup_cache[i];
+    }
+  }
+  return NULL;
+}
+/*----------------------------------------------------------------------------*/
+void
+coap_dedup_store(uip_ipaddr_t *addr, uint16_t port, uint16_t mid, uint8_t *packet, uint16_t packet_len)
+{
+  coap_dedup_entry_t *d;
+
+  if (packet_len>COAP_DEDUP_PACKET_SIZE)
+  {
+    /* A duplicate will run the resource again. */
+    PRINTF("Response of %u bytes not cached\n", packet_len);
+    return;
+  }
+
+  d = &dedup_cache[dedup_next];
+  dedup_next = (dedup_next+1) % COAP_DEDUP_CACHE_SIZE;
+
+  uip_ipaddr_copy(&d->addr, addr);
+  d->port = port;
+  d->mid = mid;
+  stimer_set(&d->lifetime, COAP_EXCHANGE_LIFETIME);
+  d->packet_len = packet_len;
+  memcpy(d->packet, packet, packet_len);
+}
+/*----------------------------------------------------------------------------*/
+#endif /* COAP_DEDUP_CACHE_SIZE */
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2013, Institute for Pervasive Computing, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *      Response cache for duplicate CoAP requests, shared by the CoAP engines
+ *
+ *      A CON request is retransmitted when its ACK is lost. The engines keep
+ *      the serialized response they sent, keyed by client endpoint and MID,
+ *      and send it again for a duplicate instead of calling the resource.
+ */
+
+#ifndef ER_COAP_DEDUP_H_
+#define ER_COAP_DEDUP_H_
+
+#include "contiki-net.h"
+#include "erbium.h"
+
+/*
+ * Number of responses kept to answer duplicate requests; 0 disables the
+ * cache. Each entry takes COAP_DEDUP_PACKET_SIZE bytes of RAM.
+ */
+#ifndef COAP_DEDUP_CACHE_SIZE
+#define COAP_DEDUP_CACHE_SIZE         0
+#endif /* COAP_DEDUP_CACHE_SIZE */
+
+/* Longer responses are not cached; the default fits COAP_MAX_PACKET_SIZE of er-coap-07 and er-coap-13. */
+#ifndef COAP_DEDUP_PACKET_SIZE
+#define COAP_DEDUP_PACKET_SIZE        (70 + REST_MAX_CHUNK_SIZE)
+#endif /* COAP_DEDUP_PACKET_SIZE */
+
+#define COAP_EXCHANGE_LIFETIME        247 /* Seconds a request can be retransmitted: 45 s transmit span + 2*100 s latency + 2 s processing */
+
+#if COAP_DEDUP_CACHE_SIZE
+typedef struct coap_dedup_entry {
+  uip_ipaddr_t addr;
+  uint16_t port;
+  uint16_t mid;
+  struct stimer lifetime;
+  uint16_t packet_len; /* 0 if nothing is to be repeated */
+  uint8_t packet[COAP_DEDUP_PACKET_SIZE];
+} coap_dedup_entry_t;
+
+/* Returns the response kept for the request, or NULL if it is new. */
+coap_dedup_entry_t *coap_dedup_lookup(uip_ipaddr_t *addr, uint16_t port, uint16_t mid);
+
+/* Keeps the response to a request, replacing the oldest one. */
+void coap_dedup_store(uip_ipaddr_t *addr, uint16_t port, uint16_t mid, uint8_t *packet, uint16_t packet_len);
+#endif /* COAP_DEDUP_CACHE_SIZE */
+
+#endif /* ER_COAP_DEDUP_H_ */
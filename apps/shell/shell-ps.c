@@ -40,6 +40,9 @@
 
 #include "contiki.h"
 #include "shell-ps.h"
+#if PROCESS_CONF_ACCOUNTING
+#include "sys/rtimer.h"
+#endif /* PROCESS_CONF_ACCOUNTING */
 
 #include <stdio.h>
 #include <string.h>
@@ -57,10 +60,30 @@ PROCESS_THREAD(shell_ps_process, ev, data)
   PROCESS_BEGIN();
 
   shell_output_str(&ps_command, "Processes:", "");
+#if PROCESS_CONF_ACCOUNTING
+  {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)RTIMER_SECOND);
+    shell_output_str(&ps_command,
+                     "calls time max-time events wait max-wait name; "
+                     "rtimer ticks per second: ", buf);
+  }
+#endif /* PROCESS_CONF_ACCOUNTING */
   for(p = PROCESS_LIST(); p != NULL; p = p->next) {
     char namebuf[30];
+#if PROCESS_CONF_ACCOUNTING
+    char buf[80];
+#endif /* PROCESS_CONF_ACCOUNTING */
     strncpy(namebuf, PROCESS_NAME_STRING(p), sizeof(namebuf));
+    namebuf[sizeof(namebuf) - 1] = 0;
+#if PROCESS_CONF_ACCOUNTING
+    snprintf(buf, sizeof(buf), "%lu %lu %lu %lu %lu %lu ",
+             p->acct.calls, p->acct.time, p->acct.max_time,
+             p->acct.events, p->acct.wait, p->acct.max_wait);
+    shell_output_str(&ps_command, buf, namebuf);
+#else /* PROCESS_CONF_ACCOUNTING */
     shell_output_str(&ps_command, namebuf, "");
+#endif /* PROCESS_CONF_ACCOUNTING */
   }
 
   PROCESS_END();
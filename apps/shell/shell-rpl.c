@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Shell command that shows the RPL statistics: control message
+ *         rates, the parent set with the link metric history of every
+ *         parent, and the log of recent topology events.
+ */
+
+#include <stdio.h>
+
+#include "contiki.h"
+#include "shell.h"
+#include "contiki-net.h"
+
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL && RPL_CONF_STATS
+
+#include "net/rpl/rpl.h"
+
+#define BUFLEN 80
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_rpl_stats_process, "rpl-stats");
+SHELL_COMMAND(rpl_stats_command,
+	      "rpl-stats",
+	      "rpl-stats: show RPL message rates, parents and routing events",
+	      &shell_rpl_stats_process);
+/*---------------------------------------------------------------------------*/
+/* The rates are averages since boot. */
+static void
+output_messages(char *name, uint16_t sent, uint16_t recv)
+{
+  char buf[BUFLEN];
+
+  snprintf(buf, BUFLEN, "sent %u (avg %lu/min) received %u (avg %lu/min)",
+           sent, rpl_stats_per_minute(sent),
+           recv, rpl_stats_per_minute(recv));
+  shell_output_str(&rpl_stats_command, name, buf);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_rpl_stats_process, ev, data)
+{
+  char buf[BUFLEN];
+  rpl_dag_t *dag;
+  rpl_parent_t *p;
+  struct rpl_stats_event *e;
+  int i, len, n;
+
+  PROCESS_BEGIN();
+
+  output_messages("DIO ", rpl_stats.dio_sent, rpl_stats.dio_recv);
+  output_messages("DAO ", rpl_stats.dao_sent, rpl_stats.dao_recv);
+  output_messages("DIS ", rpl_stats.dis_sent, rpl_stats.dis_recv);
+  snprintf(buf, BUFLEN,
+           "parent switches %u rank changes %u repairs %u local %u global",
+           rpl_stats.parent_switch, rpl_stats.rank_changes,
+           rpl_stats.local_repairs, rpl_stats.global_repairs);
+  shell_output_str(&rpl_stats_command, buf, "");
+
+  dag = rpl_get_any_dag();
+  if(dag != NULL) {
+    snprintf(buf, BUFLEN, "rank %u", dag->rank);
+    shell_output_str(&rpl_stats_command, "DAG ", buf);
+    for(p = list_head(dag->parents); p != NULL; p = list_item_next(p)) {
+      len = snprintf(buf, BUFLEN, "%02x%02x rank %u etx",
+                     p->addr.u8[14], p->addr.u8[15], p->rank);
+      /* The link metric history, oldest first. */
+      for(i = 0; i < RPL_STATS_LINK_METRIC_HISTORY && len < BUFLEN; i++) {
+        n = (p->link_metric_next + i) % RPL_STATS_LINK_METRIC_HISTORY;
+        len += snprintf(buf + len, BUFLEN - len, " %u",
+                        p->link_metric_history[n]);
+      }
+      shell_output_str(&rpl_stats_command,
+                       p == dag->preferred_parent ? "parent* " : "parent  ",
+                       buf);
+    }
+  }
+
+  for(i = 0; i < rpl_stats_num_events(); i++) {
+    e = rpl_stats_get_event(i);
+    snprintf(buf, BUFLEN, "%lu %s %04x rank %u -> %u",
+             (unsigned long)e->time, rpl_stats_event_name(e->type),
+             e->parent, e->old_rank, e->new_rank);
+    shell_output_str(&rpl_stats_command, "event ", buf);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_rpl_init(void)
+{
+  shell_register_command(&rpl_stats_command);
+}
+/*---------------------------------------------------------------------------*/
+#else /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL && RPL_CONF_STATS */
+void
+shell_rpl_init(void)
+{
+}
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL && RPL_CONF_STATS */
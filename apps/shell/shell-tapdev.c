@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2013, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Shell command that shows the frame counters and batch size
+ *         histograms of the tap device driver of the native and
+ *         minimal-net platforms.
+ */
+
+#include <stdio.h>
+
+#include "contiki.h"
+#include "shell.h"
+
+#if (defined(CONTIKI_TARGET_NATIVE) || defined(CONTIKI_TARGET_MINIMAL_NET)) && \
+    !defined(__CYGWIN__) && !defined(_WIN32)
+
+#include "net/tapdev-drv.h"
+
+#define BUFLEN 80
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_tapdev_stats_process, "tapdev-stats");
+SHELL_COMMAND(tapdev_stats_command,
+	      "tapdev-stats",
+	      "tapdev-stats: show tap device frame counters and batch sizes",
+	      &shell_tapdev_stats_process);
+/*---------------------------------------------------------------------------*/
+static void
+output_hist(char *name, unsigned long *hist)
+{
+  char buf[BUFLEN];
+
+  snprintf(buf, BUFLEN, "1: %lu 2-3: %lu 4-7: %lu 8-15: %lu 16+: %lu",
+           hist[0], hist[1], hist[2], hist[3], hist[4]);
+  shell_output_str(&tapdev_stats_command, name, buf);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_tapdev_stats_process, ev, data)
+{
+  char buf[BUFLEN];
+
+  PROCESS_BEGIN();
+
+  snprintf(buf, BUFLEN, "frames %lu batches %lu",
+           tapdev_stats.rx_frames, tapdev_stats.rx_batches);
+  shell_output_str(&tapdev_stats_command, "rx ", buf);
+  output_hist("rx batches ", tapdev_stats.rx_batch_hist);
+
+  snprintf(buf, BUFLEN, "frames %lu drops %lu batches %lu",
+           tapdev_stats.tx_frames, tapdev_stats.tx_drops,
+           tapdev_stats.tx_batches);
+  shell_output_str(&tapdev_stats_command, "tx ", buf);
+  output_hist("tx batches ", tapdev_stats.tx_batch_hist);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_tapdev_init(void)
+{
+  shell_register_command(&tapdev_stats_command);
+}
+/*---------------------------------------------------------------------------*/
+#else /* native or minimal-net */
+void
+shell_tapdev_init(void)
+{
+}
+#endif /* native or minimal-net */
@@ -401,11 +401,13 @@ struct shell_input {
 #include "shell-rime-sniff.h"
 #include "shell-rime-unicast.h"
 #include "shell-rime.h"
+#include "shell-rpl.h"
 #include "shell-rsh.h"
 #include "shell-run.h"
 #include "shell-sendtest.h"
 #include "shell-sensortweet.h"
 #include "shell-sky.h"
+#include "shell-tapdev.h"
 #include "shell-tcpsend.h"
 #include "shell-text.h"
 #include "shell-time.h"
@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *	An append-only time-series log on top of CFS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfs/cfs.h"
+#include "tslog.h"
+#if TSLOG_COFFEE
+#include "cfs/cfs-coffee.h"
+#endif
+
+#ifdef REST
+#include "erbium.h"
+#endif
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define SEGMENT_SIZE		((cfs_offset_t)TSLOG_SEGMENT_BLOCKS * TSLOG_BLOCK_SIZE)
+#define SEGMENT_NAME_LENGTH	16
+
+/* The number of samples read at a time for a REST response. */
+#define REST_CHUNK_SAMPLES	8
+
+/* Return values of the block visitors. */
+#define VISIT_NEXT		0
+#define VISIT_DECODE		1
+#define VISIT_STOP		2
+
+/*
+ * A block visitor is first called with only the block header. It can
+ * then either skip the block, stop the traversal, or ask for the block
+ * data, in which case it is called a second time with the data.
+ */
+typedef int (*block_visitor_t)(void *ptr, const struct tslog_block_header *hdr,
+                               const uint8_t *data);
+
+struct decoder {
+  const uint8_t *data;
+  uint16_t pos;
+  uint16_t length;
+  uint16_t left;
+  uint8_t first;
+  struct tslog_sample sample;
+};
+
+struct read_state {
+  uint32_t from;
+  uint32_t to;
+  uint32_t skip;
+  struct tslog_sample *samples;
+  int max;
+  int count;
+};
+
+struct summary_state {
+  uint32_t from;
+  uint32_t to;
+  struct tslog_block_header *summary;
+};
+/*---------------------------------------------------------------------------*/
+static uint32_t
+zigzag_encode(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+/*---------------------------------------------------------------------------*/
+static int32_t
+zigzag_decode(uint32_t value)
+{
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+put_varint(uint8_t *buf, uint32_t value)
+{
+  int n;
+
+  for(n = 0; value >= 0x80; n++) {
+    buf[n] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  buf[n++] = value;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_varint(struct decoder *d, uint32_t *value)
+{
+  uint8_t shift;
+  uint8_t c;
+
+  *value = 0;
+  for(shift = 0; shift < 35 && d->pos < d->length; shift += 7) {
+    c = d->data[d->pos++];
+    *value |= (uint32_t)(c & 0x7f) << shift;
+    if((c & 0x80) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+decoder_init(struct decoder *d, const struct tslog_block_header *hdr,
+             const uint8_t *data)
+{
+  d->data = data;
+  d->pos = 0;
+  d->length = hdr->length;
+  d->left = hdr->count;
+  d->first = 1;
+  d->sample.time = hdr->first_time;
+  d->sample.value = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+decoder_next(struct decoder *d)
+{
+  uint32_t delta;
+
+  if(d->left == 0) {
+    return 0;
+  }
+
+  if(!d->first) {
+    if(get_varint(d, &delta) < 0) {
+      return 0;
+    }
+    d->sample.time += delta;
+  }
+  if(get_varint(d, &delta) < 0) {
+    return 0;
+  }
+  d->sample.value = (int32_t)((uint32_t)d->sample.value +
+                              (uint32_t)zigzag_decode(delta));
+
+  d->first = 0;
+  d->left--;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+segment_name(struct tslog *log, uint8_t segment, char *name)
+{
+  snprintf(name, SEGMENT_NAME_LENGTH, "%s.%u", log->name, (unsigned)segment);
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_block_header(int fd, uint16_t block, struct tslog_block_header *hdr)
+{
+  if(cfs_seek(fd, (cfs_offset_t)block * TSLOG_BLOCK_SIZE,
+              CFS_SEEK_SET) == (cfs_offset_t)-1 ||
+     cfs_read(fd, hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+     hdr->count == 0 || hdr->length > TSLOG_BLOCK_DATA_SIZE) {
+    return -1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_open(struct tslog *log, const char *name)
+{
+  char filename[SEGMENT_NAME_LENGTH];
+  struct tslog_block_header hdr;
+  uint8_t segment;
+  uint16_t block;
+  uint32_t last_time;
+  int newest;
+  int fd;
+
+  if(strlen(name) + 4 > SEGMENT_NAME_LENGTH) {
+    return -1;
+  }
+
+  memset(log, 0, sizeof(*log));
+  log->name = name;
+
+  /*
+   * Recover the block count of every segment, and continue appending
+   * to the segment that starts with the most recent timestamp.
+   */
+  newest = -1;
+  last_time = 0;
+  for(segment = 0; segment < TSLOG_SEGMENTS; segment++) {
+    segment_name(log, segment, filename);
+    fd = cfs_open(filename, CFS_READ);
+    if(fd < 0) {
+      continue;
+    }
+
+    for(block = 0; block < TSLOG_SEGMENT_BLOCKS; block++) {
+      if(read_block_header(fd, block, &hdr) < 0) {
+        break;
+      }
+      if(block == 0) {
+        log->segment_start[segment] = hdr.first_time;
+      }
+      if(newest < 0 || log->segment_start[segment] >= log->segment_start[newest]) {
+        last_time = hdr.last_time;
+      }
+    }
+    cfs_close(fd);
+
+    log->segment_blocks[segment] = block;
+    if(block > 0 && (newest < 0 ||
+       log->segment_start[segment] >= log->segment_start[newest])) {
+      newest = segment;
+    }
+  }
+
+  if(newest >= 0) {
+    log->head = newest;
+    log->next_block = log->segment_blocks[newest];
+  }
+  log->current.last_time = last_time;
+
+  PRINTF("tslog: Opened %s at segment %u, block %u\n",
+         name, (unsigned)log->head, (unsigned)log->next_block);
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_append(struct tslog *log, uint32_t time, int32_t value)
+{
+  struct tslog_block_header *hdr;
+  uint8_t buf[10];
+  int n;
+
+  hdr = &log->current;
+  if(time < hdr->last_time) {
+    PRINTF("tslog: Rejected time %lu before %lu\n",
+           (unsigned long)time, (unsigned long)hdr->last_time);
+    log->rejected++;
+    return -1;
+  }
+
+  if(hdr->count > 0) {
+    n = put_varint(buf, time - hdr->last_time);
+    n += put_varint(buf + n,
+                    zigzag_encode((int32_t)((uint32_t)value -
+                                            (uint32_t)log->last_value)));
+    if(hdr->length + n > TSLOG_BLOCK_DATA_SIZE || hdr->count == 0xffff) {
+      if(tslog_flush(log) < 0) {
+        log->rejected++;
+        return -1;
+      }
+    }
+  }
+
+  /* The first sample of a block is stored with an absolute value. */
+  if(hdr->count == 0) {
+    n = put_varint(buf, zigzag_encode(value));
+    hdr->first_time = time;
+    hdr->min = hdr->max = value;
+  }
+
+  memcpy(&log->data[hdr->length], buf, n);
+  hdr->length += n;
+  hdr->count++;
+  hdr->last_time = time;
+  if(value < hdr->min) {
+    hdr->min = value;
+  } else if(value > hdr->max) {
+    hdr->max = value;
+  }
+  log->last_value = value;
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+tslog_last_time(struct tslog *log)
+{
+  return log->current.last_time;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_flush(struct tslog *log)
+{
+  char filename[SEGMENT_NAME_LENGTH];
+  int fd;
+  int r;
+
+  if(log->current.count == 0) {
+    return 0;
+  }
+
+  if(log->next_block >= TSLOG_SEGMENT_BLOCKS) {
+    log->head = (log->head + 1) % TSLOG_SEGMENTS;
+    log->next_block = 0;
+  }
+
+  segment_name(log, log->head, filename);
+
+  if(log->next_block == 0) {
+    /* Start a new segment, dropping the oldest data if necessary. */
+    cfs_remove(filename);
+    log->segment_blocks[log->head] = 0;
+#if TSLOG_COFFEE
+    if(cfs_coffee_reserve(filename, SEGMENT_SIZE) < 0) {
+      PRINTF("tslog: Failed to reserve segment %s\n", filename);
+      return -1;
+    }
+#endif /* TSLOG_COFFEE */
+    log->segment_start[log->head] = log->current.first_time;
+  }
+
+  /*
+   * Blocks are appended in order, so the append mode positions the
+   * file correctly on file systems that ignore seeks for writing.
+   */
+  fd = cfs_open(filename, CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return -1;
+  }
+#if TSLOG_COFFEE
+  cfs_coffee_set_io_semantics(fd, CFS_COFFEE_IO_FLASH_AWARE |
+                              CFS_COFFEE_IO_FIRM_SIZE);
+#endif /* TSLOG_COFFEE */
+
+  memset(&log->data[log->current.length], 0,
+         TSLOG_BLOCK_DATA_SIZE - log->current.length);
+
+  r = -1;
+  if(cfs_seek(fd, (cfs_offset_t)log->next_block * TSLOG_BLOCK_SIZE,
+              CFS_SEEK_SET) != (cfs_offset_t)-1 &&
+     cfs_write(fd, &log->current, sizeof(log->current)) ==
+     sizeof(log->current) &&
+     cfs_write(fd, log->data, TSLOG_BLOCK_DATA_SIZE) == TSLOG_BLOCK_DATA_SIZE) {
+    r = 0;
+  }
+  cfs_close(fd);
+
+  if(r < 0) {
+    PRINTF("tslog: Failed to write block %u of %s\n",
+           (unsigned)log->next_block, filename);
+    return -1;
+  }
+
+  log->segment_blocks[log->head]++;
+  log->next_block++;
+  log->current.count = 0;
+  log->current.length = 0;
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+visit_blocks(struct tslog *log, uint32_t from, uint32_t to,
+             block_visitor_t visit, void *ptr)
+{
+  char filename[SEGMENT_NAME_LENGTH];
+  uint8_t data[TSLOG_BLOCK_DATA_SIZE];
+  struct tslog_block_header hdr;
+  uint8_t i, segment, next;
+  uint16_t block;
+  int fd;
+  int r;
+
+  /* Traverse the segments from the oldest to the newest. */
+  for(i = 1; i <= TSLOG_SEGMENTS; i++) {
+    segment = (log->head + i) % TSLOG_SEGMENTS;
+    if(log->segment_blocks[segment] == 0) {
+      continue;
+    }
+    if(log->segment_start[segment] > to) {
+      return 0;
+    }
+
+    /* Skip the segment if all of its samples precede the range. */
+    for(next = (segment + 1) % TSLOG_SEGMENTS;
+        next != log->head && log->segment_blocks[next] == 0;
+        next = (next + 1) % TSLOG_SEGMENTS);
+    if(segment != log->head && log->segment_blocks[next] > 0 &&
+       log->segment_start[next] < from) {
+      continue;
+    }
+
+    segment_name(log, segment, filename);
+    fd = cfs_open(filename, CFS_READ);
+    if(fd < 0) {
+      return -1;
+    }
+
+    for(block = 0; block < log->segment_blocks[segment]; block++) {
+      if(read_block_header(fd, block, &hdr) < 0) {
+        break;
+      }
+      if(hdr.last_time < from) {
+        continue;
+      }
+      if(hdr.first_time > to) {
+        cfs_close(fd);
+        return 0;
+      }
+
+      r = visit(ptr, &hdr, NULL);
+      if(r == VISIT_DECODE) {
+        if(cfs_read(fd, data, hdr.length) != hdr.length) {
+          break;
+        }
+        r = visit(ptr, &hdr, data);
+      }
+      if(r == VISIT_STOP) {
+        cfs_close(fd);
+        return 0;
+      }
+    }
+    cfs_close(fd);
+  }
+
+  /* Finally, visit the block that has not been written yet. */
+  hdr = log->current;
+  if(hdr.count > 0 && hdr.last_time >= from && hdr.first_time <= to) {
+    if(visit(ptr, &hdr, NULL) == VISIT_DECODE) {
+      visit(ptr, &hdr, log->data);
+    }
+  }
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+visit_read(void *ptr, const struct tslog_block_header *hdr,
+           const uint8_t *data)
+{
+  struct read_state *state;
+  struct decoder d;
+
+  state = ptr;
+
+  if(data == NULL) {
+    if(hdr->first_time >= state->from && hdr->last_time <= state->to &&
+       state->skip >= hdr->count) {
+      state->skip -= hdr->count;
+      return VISIT_NEXT;
+    }
+    return VISIT_DECODE;
+  }
+
+  decoder_init(&d, hdr, data);
+  while(decoder_next(&d)) {
+    if(d.sample.time < state->from) {
+      continue;
+    }
+    if(d.sample.time > state->to) {
+      return VISIT_STOP;
+    }
+    if(state->skip > 0) {
+      state->skip--;
+      continue;
+    }
+    state->samples[state->count++] = d.sample;
+    if(state->count == state->max) {
+      return VISIT_STOP;
+    }
+  }
+  return VISIT_NEXT;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_read(struct tslog *log, uint32_t from, uint32_t to,
+           uint32_t skip, struct tslog_sample *samples, int max)
+{
+  struct read_state state;
+
+  if(max <= 0) {
+    return 0;
+  }
+
+  state.from = from;
+  state.to = to;
+  state.skip = skip;
+  state.samples = samples;
+  state.max = max;
+  state.count = 0;
+
+  if(visit_blocks(log, from, to, visit_read, &state) < 0) {
+    return -1;
+  }
+  return state.count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_to_summary(struct tslog_block_header *summary, uint32_t first_time,
+               uint32_t last_time, int32_t min, int32_t max, uint16_t count)
+{
+  if(summary->count == 0) {
+    summary->first_time = first_time;
+    summary->min = min;
+    summary->max = max;
+  } else {
+    if(min < summary->min) {
+      summary->min = min;
+    }
+    if(max > summary->max) {
+      summary->max = max;
+    }
+  }
+  summary->last_time = last_time;
+  summary->count += count;
+}
+/*---------------------------------------------------------------------------*/
+static int
+visit_summary(void *ptr, const struct tslog_block_header *hdr,
+              const uint8_t *data)
+{
+  struct summary_state *state;
+  struct decoder d;
+
+  state = ptr;
+
+  if(data == NULL) {
+    if(hdr->first_time >= state->from && hdr->last_time <= state->to) {
+      add_to_summary(state->summary, hdr->first_time, hdr->last_time,
+                     hdr->min, hdr->max, hdr->count);
+      return VISIT_NEXT;
+    }
+    return VISIT_DECODE;
+  }
+
+  decoder_init(&d, hdr, data);
+  while(decoder_next(&d)) {
+    if(d.sample.time > state->to) {
+      return VISIT_STOP;
+    }
+    if(d.sample.time >= state->from) {
+      add_to_summary(state->summary, d.sample.time, d.sample.time,
+                     d.sample.value, d.sample.value, 1);
+    }
+  }
+  return VISIT_NEXT;
+}
+/*---------------------------------------------------------------------------*/
+int
+tslog_summarize(struct tslog *log, uint32_t from, uint32_t to,
+                struct tslog_block_header *summary)
+{
+  struct summary_state state;
+
+  memset(summary, 0, sizeof(*summary));
+  state.from = from;
+  state.to = to;
+  state.summary = summary;
+
+  return visit_blocks(log, from, to, visit_summary, &state);
+}
+/*---------------------------------------------------------------------------*/
+#ifdef REST
+static int
+get_time_variable(void *request, const char *name, uint32_t *time)
+{
+  const char *str;
+  char buf[11];
+  int len;
+
+  len = REST.get_query_variable(request, name, &str);
+  if(len <= 0) {
+    return 0;
+  }
+  if(len >= sizeof(buf)) {
+    len = sizeof(buf) - 1;
+  }
+  memcpy(buf, str, len);
+  buf[len] = '\0';
+  *time = strtoul(buf, NULL, 10);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tslog_rest_handler(struct tslog *log, void *request, void *response,
+                   uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  static struct tslog_sample chunk[REST_CHUNK_SAMPLES];
+  struct tslog_block_header summary;
+  struct tslog_sample more;
+  uint32_t from, to;
+  const char *str;
+  int max, count, n, i;
+  uint8_t *p;
+
+  from = 0;
+  to = 0xffffffffUL;
+  get_time_variable(request, "from", &from);
+  get_time_variable(request, "to", &to);
+
+  if(REST.get_query_variable(request, "summary", &str) > 0) {
+    if(tslog_summarize(log, from, to, &summary) < 0) {
+      REST.set_response_status(response, REST.status.INTERNAL_SERVER_ERROR);
+      return;
+    }
+    count = snprintf((char *)buffer, preferred_size, "%u %ld %ld %u\n",
+                     summary.count, (long)summary.min, (long)summary.max,
+                     log->rejected);
+    REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+    REST.set_response_payload(response, buffer,
+                              count < preferred_size ? count : preferred_size);
+    return;
+  }
+
+  /*
+   * Each record has a fixed size, so the block offset maps to a sample.
+   * The samples are read in chunks to bound the stack usage.
+   */
+  max = preferred_size / 8;
+  for(count = 0, p = buffer; count < max; count += n) {
+    n = max - count < REST_CHUNK_SAMPLES ? max - count : REST_CHUNK_SAMPLES;
+    n = tslog_read(log, from, to, *offset / 8 + count, chunk, n);
+    if(n < 0) {
+      REST.set_response_status(response, REST.status.INTERNAL_SERVER_ERROR);
+      return;
+    }
+    if(n == 0) {
+      break;
+    }
+
+    for(i = 0; i < n; i++) {
+      *p++ = chunk[i].time >> 24;
+      *p++ = chunk[i].time >> 16;
+      *p++ = chunk[i].time >> 8;
+      *p++ = chunk[i].time;
+      *p++ = (uint32_t)chunk[i].value >> 24;
+      *p++ = (uint32_t)chunk[i].value >> 16;
+      *p++ = (uint32_t)chunk[i].value >> 8;
+      *p++ = (uint32_t)chunk[i].value;
+    }
+  }
+  if(count == 0 && *offset > 0) {
+    REST.set_response_status(response, REST.status.BAD_OPTION);
+    return;
+  }
+
+  REST.set_header_content_type(response, REST.type.APPLICATION_OCTET_STREAM);
+  REST.set_response_payload(response, buffer, count * 8);
+
+  if(count < max ||
+     tslog_read(log, from, to, *offset / 8 + count, &more, 1) <= 0) {
+    *offset = -1;
+  } else {
+    *offset += count * 8;
+  }
+}
+#endif /* REST */
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *	An append-only time-series log on top of CFS. Samples are
+ *      delta/varint-encoded into fixed-size blocks, each starting with
+ *      a header that records the time range, minimum, and maximum of
+ *      the samples in the block. Range queries only decode the blocks
+ *      that overlap the requested range. The oldest data is dropped
+ *      segment by segment once the configured retention is reached.
+ */
+
+#ifndef TSLOG_H
+#define TSLOG_H
+
+#include "contiki-conf.h"
+
+/* The total size of a block, including its header. */
+#ifdef TSLOG_CONF_BLOCK_SIZE
+#define TSLOG_BLOCK_SIZE		TSLOG_CONF_BLOCK_SIZE
+#else
+#define TSLOG_BLOCK_SIZE		64
+#endif /* TSLOG_CONF_BLOCK_SIZE */
+
+/* The number of blocks in a segment file. */
+#ifdef TSLOG_CONF_SEGMENT_BLOCKS
+#define TSLOG_SEGMENT_BLOCKS		TSLOG_CONF_SEGMENT_BLOCKS
+#else
+#define TSLOG_SEGMENT_BLOCKS		64
+#endif /* TSLOG_CONF_SEGMENT_BLOCKS */
+
+/* The number of segment files; the oldest is reused when all are full. */
+#ifdef TSLOG_CONF_SEGMENTS
+#define TSLOG_SEGMENTS			TSLOG_CONF_SEGMENTS
+#else
+#define TSLOG_SEGMENTS			4
+#endif /* TSLOG_CONF_SEGMENTS */
+
+/* Reserve segments in Coffee and write them with flash-aware semantics. */
+#ifdef TSLOG_CONF_COFFEE
+#define TSLOG_COFFEE			TSLOG_CONF_COFFEE
+#else
+#define TSLOG_COFFEE			1
+#endif /* TSLOG_CONF_COFFEE */
+
+struct tslog_block_header {
+  uint32_t first_time;
+  uint32_t last_time;
+  int32_t min;
+  int32_t max;
+  uint16_t count;
+  uint16_t length;
+};
+
+#define TSLOG_BLOCK_DATA_SIZE	\
+	(TSLOG_BLOCK_SIZE - sizeof(struct tslog_block_header))
+
+struct tslog_sample {
+  uint32_t time;
+  int32_t value;
+};
+
+struct tslog {
+  const char *name;
+  uint8_t head;
+  uint16_t next_block;
+  uint16_t segment_blocks[TSLOG_SEGMENTS];
+  uint32_t segment_start[TSLOG_SEGMENTS];
+  struct tslog_block_header current;
+  int32_t last_value;
+  uint16_t rejected;
+  uint8_t data[TSLOG_BLOCK_DATA_SIZE];
+};
+
+/**
+ * \brief Open a time-series log, recovering any previously stored data.
+ * \param log The log object.
+ * \param name The base name of the segment files. Segment numbers are
+ *        appended to it, so it must be shorter than the file names of
+ *        the underlying file system.
+ * \return 0 on success, -1 on failure.
+ */
+int tslog_open(struct tslog *log, const char *name);
+
+/**
+ * \brief Append a sample to the log.
+ * \param log The log object.
+ * \param time The timestamp of the sample, not earlier than the last one.
+ * \param value The sample value.
+ * \return 0 on success, -1 on failure.
+ *
+ * Samples are collected in RAM until a block is full, and are only
+ * then written to storage. Call tslog_flush() to write a partially
+ * filled block. Samples that cannot be stored are counted in the
+ * rejected field of the log.
+ */
+int tslog_append(struct tslog *log, uint32_t time, int32_t value);
+
+/**
+ * \brief Get the timestamp of the most recent sample.
+ * \param log The log object.
+ * \return The timestamp, or 0 if the log is empty.
+ *
+ * After tslog_open(), this is the last timestamp stored before the
+ * log was closed. Time sources that restart from zero, such as the
+ * uptime, must be offset by it, since earlier timestamps are rejected.
+ */
+uint32_t tslog_last_time(struct tslog *log);
+
+/**
+ * \brief Write the current block to storage even if it is not full.
+ * \param log The log object.
+ * \return 0 on success, -1 on failure.
+ */
+int tslog_flush(struct tslog *log);
+
+/**
+ * \brief Read the samples within a time range.
+ * \param log The log object.
+ * \param from The start of the time range (inclusive).
+ * \param to The end of the time range (inclusive).
+ * \param skip The number of matching samples to skip.
+ * \param samples The array in which to store the samples.
+ * \param max The maximum number of samples to store.
+ * \return The number of samples stored, or -1 on failure.
+ *
+ * Blocks that lie completely within the range and are covered by
+ * the skip count are passed over using their headers only, which
+ * makes it cheap to read a range in consecutive chunks.
+ */
+int tslog_read(struct tslog *log, uint32_t from, uint32_t to,
+               uint32_t skip, struct tslog_sample *samples, int max);
+
+/**
+ * \brief Compute the number, minimum, and maximum of samples in a range.
+ * \param log The log object.
+ * \param from The start of the time range (inclusive).
+ * \param to The end of the time range (inclusive).
+ * \param summary A block header that receives the result.
+ * \return 0 on success, -1 on failure.
+ *
+ * Only blocks that overlap the range boundaries are decoded; the
+ * summary of the other blocks is taken from the block headers.
+ */
+int tslog_summarize(struct tslog *log, uint32_t from, uint32_t to,
+                    struct tslog_block_header *summary);
+
+#ifdef REST
+/**
+ * \brief Serve a time-range query through a REST resource.
+ *
+ * The query variables "from" and "to" select the time range. The
+ * samples are returned as 8-byte records consisting of the timestamp
+ * and the value in network byte order, split into blocks by the
+ * REST engine. The query variable "summary" returns the number,
+ * minimum, and maximum of the samples, followed by the number of
+ * rejected samples, as text instead.
+ */
+void tslog_rest_handler(struct tslog *log, void *request, void *response,
+                        uint8_t *buffer, uint16_t preferred_size,
+                        int32_t *offset);
+#endif /* REST */
+
+#endif /* TSLOG_H */
@@ -58,6 +58,9 @@
 #include "cfs/cfs.h"
 #include "cfs-coffee-arch.h"
 #include "cfs/cfs-coffee.h"
+#if COFFEE_BACKGROUND_GC
+#include "contiki.h"
+#endif
 
 /* Micro logs enable modifications on storage types that do not support
    in-place updates. This applies primarily to flash memories. */
@@ -90,6 +93,32 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING	1
 #endif
 
+/*
+ * Reclaim obsolete sectors in a background process instead of only
+ * from within a failing file reservation. The collector scans and
+ * erases a bounded number of sectors per time slice, and yields to
+ * other processes in between. It is woken up by every file removal,
+ * whatever the COFFEE_EXTENDED_WEAR_LEVELLING setting, since deferring
+ * the erasures to the next failing reservation is what makes that one
+ * slow. A failing reservation itself also erases slice by slice, and
+ * only until the file fits.
+ */
+#ifndef COFFEE_BACKGROUND_GC
+#define COFFEE_BACKGROUND_GC	0
+#endif
+
+#if COFFEE_BACKGROUND_GC
+/* The maximum number of sectors scanned in one time slice. */
+#ifndef COFFEE_GC_SLICE_SECTORS
+#define COFFEE_GC_SLICE_SECTORS	1
+#endif
+
+/* The maximum number of sectors erased in one time slice. */
+#ifndef COFFEE_GC_SLICE_ERASES
+#define COFFEE_GC_SLICE_ERASES	1
+#endif
+#endif /* COFFEE_BACKGROUND_GC */
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -154,6 +183,15 @@
 #define COFFEE_PAGES_PER_SECTOR	\
 	((coffee_page_t)(COFFEE_SECTOR_SIZE / COFFEE_PAGE_SIZE))
 
+/* The state of an iteration over the sectors by get_sector_status(). */
+struct sector_cursor {
+  coffee_page_t skip_pages;
+  uint16_t sector;
+  char last_pages_are_active;
+  /* Set by the collectors when the header of the skipped pages is erased. */
+  char skip_head_erased;
+};
+
 /* This structure is used for garbage collection statistics. */
 struct sector_status {
   coffee_page_t active;
@@ -217,6 +255,24 @@ static struct file_desc * const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t * const next_free = &protected_mem.next_free;
 static char * const gc_wait = &protected_mem.gc_wait;
 
+#if COFFEE_BACKGROUND_GC
+/*
+ * The sector table caches the page statistics of each sector so that
+ * the collector only has to sweep the storage when there is something
+ * to reclaim. It is built by the first sweep after boot and then kept
+ * up to date by the reservation, removal, and erase functions.
+ */
+static struct sector_status sector_table[COFFEE_SECTOR_COUNT];
+static char sector_table_valid;
+
+/* The position of the ongoing sweep; reset whenever the table changes. */
+static struct sector_cursor sweep_cursor;
+static char gc_requested;
+static struct cfs_coffee_gc_stats gc_stats;
+
+PROCESS(coffee_gc_process, "Coffee GC");
+#endif /* COFFEE_BACKGROUND_GC */
+
 /*---------------------------------------------------------------------------*/
 static void
 write_header(struct file_header *hdr, coffee_page_t page)
@@ -242,28 +298,47 @@ absolute_offset(coffee_page_t page, cfs_offset_t offset)
   return page * COFFEE_PAGE_SIZE + sizeof(struct file_header) + offset;
 }
 /*---------------------------------------------------------------------------*/
+static void
+reset_sector_cursor(struct sector_cursor *cursor)
+{
+  cursor->skip_pages = 0;
+  cursor->sector = 0;
+  cursor->last_pages_are_active = 0;
+  cursor->skip_head_erased = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+sector_erasable(struct sector_cursor *cursor, coffee_page_t skipped,
+                struct sector_status *stats)
+{
+  /*
+   * The pages at the start of the sector may belong to a file whose
+   * header lies in a previous sector. Unless that header was erased,
+   * it still extends over this sector. Files reserved here after an
+   * erasure would then be skipped by the quick-skip algorithm.
+   */
+  return stats->active == 0 &&
+    (skipped == 0 || cursor->skip_head_erased);
+}
+/*---------------------------------------------------------------------------*/
 static coffee_page_t
-get_sector_status(uint16_t sector, struct sector_status *stats)
+get_sector_status(struct sector_cursor *cursor, struct sector_status *stats)
 {
-  static coffee_page_t skip_pages;
-  static char last_pages_are_active;
   struct file_header hdr;
   coffee_page_t active, obsolete, free;
   coffee_page_t sector_start, sector_end;
   coffee_page_t page;
+  uint16_t sector;
 
   memset(stats, 0, sizeof(*stats));
   active = obsolete = free = 0;
 
   /*
-   * get_sector_status() is an iterative function using local static 
-   * state. It therefore requires the the caller loops starts from 
-   * sector 0 in order to reset the internal state.
+   * get_sector_status() is an iterative function that keeps its state
+   * in the cursor. The iteration must start from sector 0 with a reset
+   * cursor, and each call advances the cursor to the next sector.
    */
-  if(sector == 0) {
-    skip_pages = 0;
-    last_pages_are_active = 0;
-  }
+  sector = cursor->sector++;
 
   sector_start = sector * COFFEE_PAGES_PER_SECTOR;
   sector_end = sector_start + COFFEE_PAGES_PER_SECTOR;
@@ -273,29 +348,30 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
    * segment that extends into this segment. If the whole segment is 
    * covered, we do not need to continue counting pages in this iteration.
    */
-  if(last_pages_are_active) {
-    if(skip_pages >= COFFEE_PAGES_PER_SECTOR) {
+  if(cursor->last_pages_are_active) {
+    if(cursor->skip_pages >= COFFEE_PAGES_PER_SECTOR) {
       stats->active = COFFEE_PAGES_PER_SECTOR;
-      skip_pages -= COFFEE_PAGES_PER_SECTOR;
+      cursor->skip_pages -= COFFEE_PAGES_PER_SECTOR;
       return 0;
     }
-    active = skip_pages;
+    active = cursor->skip_pages;
   } else {
-    if(skip_pages >= COFFEE_PAGES_PER_SECTOR) {
+    if(cursor->skip_pages >= COFFEE_PAGES_PER_SECTOR) {
       stats->obsolete = COFFEE_PAGES_PER_SECTOR;
-      skip_pages -= COFFEE_PAGES_PER_SECTOR;
-      return skip_pages >= COFFEE_PAGES_PER_SECTOR ? 0 : skip_pages;
+      cursor->skip_pages -= COFFEE_PAGES_PER_SECTOR;
+      return cursor->skip_pages >= COFFEE_PAGES_PER_SECTOR ?
+        0 : cursor->skip_pages;
     }
-    obsolete = skip_pages;
+    obsolete = cursor->skip_pages;
   }
 
   /* Determine the amount of pages of each type that have not been 
      accounted for yet in the current sector. */
-  for(page = sector_start + skip_pages; page < sector_end;) {
+  for(page = sector_start + cursor->skip_pages; page < sector_end;) {
     read_header(&hdr, page);
-    last_pages_are_active = 0;
+    cursor->last_pages_are_active = 0;
     if(HDR_ACTIVE(hdr)) {
-      last_pages_are_active = 1;
+      cursor->last_pages_are_active = 1;
       page += hdr.max_pages;
       active += hdr.max_pages;
     } else if(HDR_ISOLATED(hdr)) {
@@ -318,9 +394,9 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
    * amount is that there is no need to read in the headers of each 
    * of these pages from the storage.
    */
-  skip_pages = active + obsolete + free - COFFEE_PAGES_PER_SECTOR;
-  if(skip_pages > 0) {
-    if(last_pages_are_active) {
+  cursor->skip_pages = active + obsolete + free - COFFEE_PAGES_PER_SECTOR;
+  if(cursor->skip_pages > 0) {
+    if(cursor->last_pages_are_active) {
       active = COFFEE_PAGES_PER_SECTOR - obsolete;
     } else {
       obsolete = COFFEE_PAGES_PER_SECTOR - active;
@@ -338,8 +414,9 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
    * sector, however, the garbage collection can free the next sector 
    * immediately without requiring page isolation. 
    */
-  return (last_pages_are_active || (skip_pages >= COFFEE_PAGES_PER_SECTOR)) ?
-	0 : skip_pages;
+  return (cursor->last_pages_are_active ||
+          (cursor->skip_pages >= COFFEE_PAGES_PER_SECTOR)) ?
+	0 : cursor->skip_pages;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -363,25 +440,116 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
 }
 /*---------------------------------------------------------------------------*/
 static void
+erase_sector(uint16_t sector)
+{
+  COFFEE_ERASE(sector);
+  PRINTF("Coffee: Erased sector %d!\n", sector);
+#if COFFEE_BACKGROUND_GC
+  sector_table[sector].active = 0;
+  sector_table[sector].obsolete = 0;
+  sector_table[sector].free = COFFEE_PAGES_PER_SECTOR;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_BACKGROUND_GC
+static void
+account_pages(coffee_page_t page, coffee_page_t count, int obsoleted)
+{
+  uint16_t sector;
+  coffee_page_t n;
+  struct sector_status *stats;
+
+  /*
+   * Move a page range from the free to the active state when a file is
+   * reserved, and from the active to the obsolete state when it is
+   * removed. The file may extend over the position of an ongoing
+   * sweep, which therefore has to start over.
+   */
+  reset_sector_cursor(&sweep_cursor);
+
+  while(count > 0 && page < COFFEE_PAGE_COUNT) {
+    sector = page / COFFEE_PAGES_PER_SECTOR;
+    n = COFFEE_PAGES_PER_SECTOR - (page % COFFEE_PAGES_PER_SECTOR);
+    if(n > count) {
+      n = count;
+    }
+
+    stats = &sector_table[sector];
+    if(obsoleted) {
+      stats->active = stats->active > n ? stats->active - n : 0;
+      stats->obsolete += n;
+    } else {
+      stats->free = stats->free > n ? stats->free - n : 0;
+      stats->active += n;
+    }
+
+    page += n;
+    count -= n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+gc_needed(uint16_t from)
+{
+  uint16_t sector;
+
+  /* Until the first sweep has built the table, sweep all sectors. */
+  if(!sector_table_valid) {
+    return from < COFFEE_SECTOR_COUNT;
+  }
+
+  for(sector = from; sector < COFFEE_SECTOR_COUNT; sector++) {
+    if(sector_table[sector].active == 0 && sector_table[sector].obsolete > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+gc_notify(void)
+{
+  gc_requested = 1;
+  if(!process_is_running(&coffee_gc_process)) {
+    process_start(&coffee_gc_process, NULL);
+  }
+  process_poll(&coffee_gc_process);
+}
+#endif /* COFFEE_BACKGROUND_GC */
+/*---------------------------------------------------------------------------*/
+static void
 collect_garbage(int mode)
 {
   uint16_t sector;
+  struct sector_cursor cursor;
   struct sector_status stats;
-  coffee_page_t first_page, isolation_count;
+  coffee_page_t first_page, isolation_count, skipped;
+  int erasable;
 
   PRINTF("Coffee: Running the file system garbage collector in %s mode\n",
 	 mode == GC_RELUCTANT ? "reluctant" : "greedy");
+#if COFFEE_BACKGROUND_GC
+  /* The erasures below invalidate the position of any ongoing sweep. */
+  reset_sector_cursor(&sweep_cursor);
+#endif
   /*
    * The garbage collector erases as many sectors as possible. A sector is
    * erasable if there are only free or obsolete pages in it.
    */
+  reset_sector_cursor(&cursor);
   for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
-    isolation_count = get_sector_status(sector, &stats);
+    skipped = cursor.skip_pages;
+    isolation_count = get_sector_status(&cursor, &stats);
     PRINTF("Coffee: Sector %u has %u active, %u obsolete, and %u free pages.\n",
         sector, (unsigned)stats.active,
 	(unsigned)stats.obsolete, (unsigned)stats.free);
+#if COFFEE_BACKGROUND_GC
+    sector_table[sector] = stats;
+#endif
 
-    if(stats.active > 0) {
+    erasable = sector_erasable(&cursor, skipped, &stats);
+    cursor.skip_head_erased = 0;
+    if(!erasable) {
       continue;
     }
 
@@ -396,8 +564,8 @@ collect_garbage(int mode)
         isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
       }
 
-      COFFEE_ERASE(sector);
-      PRINTF("Coffee: Erased sector %d!\n", sector);
+      erase_sector(sector);
+      cursor.skip_head_erased = 1;
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
         break;
@@ -406,6 +574,115 @@ collect_garbage(int mode)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_BACKGROUND_GC
+static void
+gc_slice(void)
+{
+  struct sector_status stats;
+  coffee_page_t first_page, isolation_count, skipped;
+  unsigned scanned, erased;
+  int erasable;
+  uint16_t sector;
+  char carry;
+  rtimer_clock_t start, elapsed;
+
+  start = RTIMER_NOW();
+
+  /*
+   * Continue the sweep where the previous slice stopped. A slice does
+   * not stop after erasing a sector whose obsolete file covers all of
+   * the next sector, because that sector has no header left from which
+   * a later iteration could determine its status.
+   */
+  carry = 0;
+  for(scanned = erased = 0;
+      sweep_cursor.sector < COFFEE_SECTOR_COUNT &&
+      (carry || (scanned < COFFEE_GC_SLICE_SECTORS &&
+                 erased < COFFEE_GC_SLICE_ERASES));
+      scanned++) {
+    sector = sweep_cursor.sector;
+    skipped = sweep_cursor.skip_pages;
+    isolation_count = get_sector_status(&sweep_cursor, &stats);
+    carry = 0;
+
+    erasable = sector_erasable(&sweep_cursor, skipped, &stats);
+    sector_table[sector] = stats;
+    sweep_cursor.skip_head_erased = 0;
+
+    if(erasable && stats.obsolete > 0) {
+      first_page = sector * COFFEE_PAGES_PER_SECTOR;
+      if(first_page < *next_free) {
+        *next_free = first_page;
+      }
+
+      if(isolation_count > 0) {
+        isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
+      }
+
+      erase_sector(sector);
+      sweep_cursor.skip_head_erased = 1;
+      gc_stats.erased_sectors++;
+      erased++;
+      carry = sweep_cursor.skip_pages >= COFFEE_PAGES_PER_SECTOR;
+    }
+  }
+
+  /* A sweep that went through all sectors has refreshed the whole table. */
+  if(sweep_cursor.sector >= COFFEE_SECTOR_COUNT) {
+    sector_table_valid = 1;
+  }
+
+  elapsed = RTIMER_NOW() - start;
+  gc_stats.slices++;
+  gc_stats.total_slice_time += elapsed;
+  if(elapsed > gc_stats.max_slice_time) {
+    gc_stats.max_slice_time = elapsed;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_gc_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    /* Requests that arrived during the previous sweep are served directly. */
+    if(!gc_requested) {
+      PROCESS_WAIT_EVENT_UNTIL(gc_requested);
+    }
+    gc_requested = 0;
+
+    if(!gc_needed(0)) {
+      continue;
+    }
+
+    PRINTF("Coffee: Starting a background sweep\n");
+    gc_stats.sweeps++;
+    reset_sector_cursor(&sweep_cursor);
+
+    /*
+     * Reservations and removals between the slices reset the cursor,
+     * so the sweep then starts over from the first sector.
+     */
+    while(gc_needed(sweep_cursor.sector)) {
+      /* Only work when no other events are waiting to be processed. */
+      do {
+        PROCESS_PAUSE();
+      } while(process_nevents() > 0);
+
+      gc_slice();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_coffee_gc_get_stats(struct cfs_coffee_gc_stats *stats)
+{
+  memcpy(stats, &gc_stats, sizeof(*stats));
+}
+#endif /* COFFEE_BACKGROUND_GC */
+/*---------------------------------------------------------------------------*/
 static coffee_page_t
 next_file(coffee_page_t page, struct file_header *hdr)
 {
@@ -591,6 +868,9 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
   write_header(&hdr, page);
 
   *gc_wait = 0;
+#if COFFEE_BACKGROUND_GC
+  account_pages(page, hdr.max_pages, 1);
+#endif
 
   /* Close all file descriptors that reference the removed file. */
   if(close_fds) {
@@ -609,7 +889,11 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
     }
   }
 
-#if !COFFEE_EXTENDED_WEAR_LEVELLING
+#if COFFEE_BACKGROUND_GC
+  if(gc_allowed) {
+    gc_notify();
+  }
+#elif !COFFEE_EXTENDED_WEAR_LEVELLING
   if(gc_allowed) {
     collect_garbage(GC_RELUCTANT);
   }
@@ -624,6 +908,28 @@ page_count(cfs_offset_t size)
   return (size + sizeof(struct file_header) + COFFEE_PAGE_SIZE - 1) /
 		COFFEE_PAGE_SIZE;
 }
+#if COFFEE_BACKGROUND_GC
+/*---------------------------------------------------------------------------*/
+static coffee_page_t
+reclaim_pages(coffee_page_t pages)
+{
+  coffee_page_t page;
+
+  /*
+   * Continue the sweep of the collector slice by slice until the file
+   * fits. Once the sector table is valid, it tells without reading the
+   * storage whether there is anything left to reclaim at all.
+   */
+  while(gc_needed(sweep_cursor.sector)) {
+    gc_slice();
+    page = find_contiguous_pages(pages);
+    if(page != INVALID_PAGE) {
+      return page;
+    }
+  }
+  return INVALID_PAGE;
+}
+#endif /* COFFEE_BACKGROUND_GC */
 /*---------------------------------------------------------------------------*/
 static struct file *
 reserve(const char *name, coffee_page_t pages,
@@ -632,6 +938,9 @@ reserve(const char *name, coffee_page_t pages,
   struct file_header hdr;
   coffee_page_t page;
   struct file *file;
+#if COFFEE_BACKGROUND_GC
+  clock_time_t start, elapsed;
+#endif
 
   if(!allow_duplicates && find_file(name) != NULL) {
     return NULL;
@@ -642,8 +951,18 @@ reserve(const char *name, coffee_page_t pages,
     if(*gc_wait) {
       return NULL;
     }
+#if COFFEE_BACKGROUND_GC
+    start = clock_time();
+    page = reclaim_pages(pages);
+    elapsed = clock_time() - start;
+    gc_stats.sync_runs++;
+    if(elapsed > gc_stats.max_sync_time) {
+      gc_stats.max_sync_time = elapsed;
+    }
+#else
     collect_garbage(GC_GREEDY);
     page = find_contiguous_pages(pages);
+#endif
     if(page == INVALID_PAGE) {
       *gc_wait = 1;
       return NULL;
@@ -656,6 +975,10 @@ reserve(const char *name, coffee_page_t pages,
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
 
+#if COFFEE_BACKGROUND_GC
+  account_pages(page, pages, 0);
+#endif
+
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
       pages, page, name);
 
@@ -1351,6 +1674,15 @@ cfs_coffee_format(void)
   /* Formatting invalidates the file information. */
   memset(&protected_mem, 0, sizeof(protected_mem));
 
+#if COFFEE_BACKGROUND_GC
+  for(i = 0; i < COFFEE_SECTOR_COUNT; i++) {
+    sector_table[i].active = sector_table[i].obsolete = 0;
+    sector_table[i].free = COFFEE_PAGES_PER_SECTOR;
+  }
+  sector_table_valid = 1;
+  reset_sector_cursor(&sweep_cursor);
+#endif
+
   PRINTF(" done!\n");
 
   return 0;
@@ -138,6 +138,39 @@ int cfs_coffee_format(void);
  */
 void *cfs_coffee_get_protected_mem(unsigned *size);
 
+/**
+ * Statistics of the background garbage collector.
+ *
+ * \sa cfs_coffee_gc_get_stats()
+ */
+struct cfs_coffee_gc_stats {
+  /** Completed or restarted sweeps over the storage. */
+  unsigned long sweeps;
+  /** Time slices executed by the background collector. */
+  unsigned long slices;
+  /** Sectors erased in time slices, including those run by reservations. */
+  unsigned long erased_sectors;
+  /** Synchronous collections run because a reservation failed. */
+  unsigned long sync_runs;
+  /** Total and maximum duration of a time slice, in rtimer ticks. */
+  unsigned long total_slice_time;
+  unsigned long max_slice_time;
+  /** Maximum duration of a synchronous collection, in clock ticks. */
+  unsigned long max_sync_time;
+};
+
+/**
+ * \brief Get the statistics of the background garbage collector.
+ * \param stats A pointer to the structure to fill in.
+ *
+ * When Coffee is compiled with COFFEE_BACKGROUND_GC, obsolete sectors
+ * are erased incrementally by a background process, and synchronous
+ * collections only happen when a reservation cannot be granted before
+ * the background collector has caught up. The statistics allow
+ * applications to monitor the latency of both kinds of collection.
+ */
+void cfs_coffee_gc_get_stats(struct cfs_coffee_gc_stats *stats);
+
 /** @} */
 /** @} */
 
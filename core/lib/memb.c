@@ -48,57 +48,124 @@
 #include "contiki.h"
 #include "lib/memb.h"
 
+#if MEMB_STATS
+static struct memb *pools;
+#endif /* MEMB_STATS */
+/*---------------------------------------------------------------------------*/
+#if MEMB_STATS
+static void
+register_pool(struct memb *m)
+{
+  struct memb *p;
+
+  for(p = pools; p != NULL; p = p->next) {
+    if(p == m) {
+      return;
+    }
+  }
+  m->next = pools;
+  pools = m;
+}
+#endif /* MEMB_STATS */
 /*---------------------------------------------------------------------------*/
 void
 memb_init(struct memb *m)
 {
   memset(m->count, 0, m->num);
   memset(m->mem, 0, m->size * m->num);
+  m->used = 0;
+  m->free = 0;
+#if MEMB_STATS
+  m->allocated = 0;
+  m->failures = 0;
+  register_pool(m);
+#endif /* MEMB_STATS */
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Blocks below m->used that are not allocated are kept on a free list,
+ * so that both memb_alloc() and memb_free() run in constant time. The
+ * reference count of a block on the free list holds the negated link
+ * to the next block on the list. The links fit in the reference count
+ * for up to MAX_LINKED_NUM blocks; larger memory blocks are searched
+ * linearly instead. Either way, freed blocks are reused before new
+ * ones, so m->used is the peak number of blocks in use.
+ */
+#define MAX_LINKED_NUM 128
+#define LINK(m, i) (((signed char *)(m)->count)[i])
+/*---------------------------------------------------------------------------*/
 void *
 memb_alloc(struct memb *m)
 {
-  int i;
+  unsigned short i;
+
+  i = m->used;
+  if(m->free != 0) {
+    /* Reuse the most recently freed block. */
+    i = m->free - 1;
+    m->free = -LINK(m, i);
+  } else if(m->num > MAX_LINKED_NUM) {
+    /* Freed blocks are not linked in large memory blocks. */
+    for(i = 0; i < m->used && m->count[i] != 0; ++i);
+  }
 
-  for(i = 0; i < m->num; ++i) {
-    if(m->count[i] == 0) {
-      /* If this block was unused, we increase the reference count to
-	 indicate that it now is used and return a pointer to the
-	 memory block. */
-      ++(m->count[i]);
-      return (void *)((char *)m->mem + (i * m->size));
+  if(i == m->used) {
+    if(m->used == m->num) {
+      /* No free block was found, so we return NULL to indicate failure
+         to allocate block. */
+#if MEMB_STATS
+      if(m->failures < 0xffff) {
+        m->failures++;
+      }
+#endif /* MEMB_STATS */
+      return NULL;
+    }
+    /* All blocks below m->used are in use, so take the next one. */
+#if MEMB_STATS
+    if(m->used == 0) {
+      register_pool(m);
     }
+#endif /* MEMB_STATS */
+    m->used++;
   }
 
-  /* No free block was found, so we return NULL to indicate failure to
-     allocate block. */
-  return NULL;
+  /* The block was unused, so we set the reference count to indicate
+     that it now is used and return a pointer to the memory block. */
+  m->count[i] = 1;
+#if MEMB_STATS
+  m->allocated++;
+#endif /* MEMB_STATS */
+  return (void *)((char *)m->mem + (i * m->size));
 }
 /*---------------------------------------------------------------------------*/
 char
 memb_free(struct memb *m, void *ptr)
 {
-  int i;
-  char *ptr2;
+  unsigned short i;
 
-  /* Walk through the list of blocks and try to find the block to
-     which the pointer "ptr" points to. */
-  ptr2 = (char *)m->mem;
-  for(i = 0; i < m->num; ++i) {
-    
-    if(ptr2 == (char *)ptr) {
-      /* We've found to block to which "ptr" points so we decrease the
-	 reference count and return the new value of it. */
-      if(m->count[i] > 0) {
-	/* Make sure that we don't deallocate free memory. */
-	--(m->count[i]);
-      }
-      return m->count[i];
+  if(!memb_inmemb(m, ptr) ||
+     ((char *)ptr - (char *)m->mem) % m->size != 0) {
+    return -1;
+  }
+  i = ((char *)ptr - (char *)m->mem) / m->size;
+
+  /* Make sure that we don't deallocate free memory. */
+  if(LINK(m, i) <= 0) {
+    return 0;
+  }
+
+  --(m->count[i]);
+  if(m->count[i] == 0) {
+#if MEMB_STATS
+    m->allocated--;
+#endif /* MEMB_STATS */
+    if(m->num <= MAX_LINKED_NUM) {
+      LINK(m, i) = -(int)m->free;
+      m->free = i + 1;
     }
-    ptr2 += m->size;
+    return 0;
   }
-  return -1;
+  return m->count[i];
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -108,5 +175,13 @@ memb_inmemb(struct memb *m, void *ptr)
     (char *)ptr < (char *)m->mem + (m->num * m->size);
 }
 /*---------------------------------------------------------------------------*/
+#if MEMB_STATS
+struct memb *
+memb_pools(void)
+{
+  return pools;
+}
+#endif /* MEMB_STATS */
+/*---------------------------------------------------------------------------*/
 
 /** @} */
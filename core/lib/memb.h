@@ -92,13 +92,44 @@ MEMB(connections, struct connection, 16);
         static structure CC_CONCAT(name,_memb_mem)[num]; \
         static struct memb name = {sizeof(structure), num, \
                                           CC_CONCAT(name,_memb_count), \
-                                          (void *)CC_CONCAT(name,_memb_mem)}
+                                          (void *)CC_CONCAT(name,_memb_mem) \
+                                          MEMB_STATS_INIT(name)}
+
+/**
+ * If MEMB_CONF_STATS is set, every memory block keeps track of its
+ * current and peak usage and of failed allocations. The memory
+ * blocks register themselves when they are initialized or first
+ * used, and can be enumerated with memb_pools().
+ */
+#ifdef MEMB_CONF_STATS
+#define MEMB_STATS MEMB_CONF_STATS
+#else /* MEMB_CONF_STATS */
+#define MEMB_STATS 0
+#endif /* MEMB_CONF_STATS */
+
+#if MEMB_STATS
+#define MEMB_STATS_INIT(name) , 0, 0, #name
+#else /* MEMB_STATS */
+#define MEMB_STATS_INIT(name)
+#endif /* MEMB_STATS */
 
 struct memb {
   unsigned short size;
   unsigned short num;
   char *count;
   void *mem;
+  /* The number of blocks that have been allocated at least once. Since
+     freed blocks are reused first, this is also the peak usage. */
+  unsigned short used;
+  /* One plus the index of the most recently freed block, or zero. The
+     count of a freed block holds the negated link to the next one. */
+  unsigned short free;
+#if MEMB_STATS
+  const char *name;
+  struct memb *next;
+  unsigned short allocated;
+  unsigned short failures;
+#endif /* MEMB_STATS */
 };
 
 /**
@@ -131,6 +162,15 @@ char  memb_free(struct memb *m, void *ptr);
 
 int memb_inmemb(struct memb *m, void *ptr);
 
+#if MEMB_STATS
+/**
+ * Get the memory blocks that have been initialized or used.
+ * \return The first memory block; the others follow through the
+ * next field.
+ */
+struct memb *memb_pools(void);
+#endif /* MEMB_STATS */
+
 
 /** @} */
 /** @} */
@@ -56,6 +56,355 @@
 #define MMEM_SIZE 4096
 #endif
 
+#ifdef MMEM_CONF_SIZE_CLASSES
+#define MMEM_SIZE_CLASSES MMEM_CONF_SIZE_CLASSES
+#else
+#define MMEM_SIZE_CLASSES 0
+#endif
+
+#if MMEM_SIZE_CLASSES
+#include "sys/process.h"
+
+/*
+ * The size class allocator gives each request a block of its own
+ * (pointer aligned) size and keeps the freed blocks on segregated
+ * free lists, so that a freed block can be reused without moving any
+ * memory. The size classes grow in steps of about 1.5, and a free
+ * block is kept on the list of the largest class that it can
+ * hold. An allocation takes the best fitting block of its own class,
+ * or the first block of a larger class, and splits off the unused
+ * tail when it is large enough to be reused.
+ *
+ * Freed memory that is not reused is reclaimed by compaction, which
+ * slides the allocated blocks towards the start of the heap. When a
+ * block is freed, the compaction process is polled to compact the
+ * heap MMEM_COMPACT_STEP bytes at a time when the system is idle.
+ * With MMEM_CONF_COMPACT_STEP set to 0, the application is
+ * responsible for calling mmem_compact(). An allocation that finds
+ * the memory fragmented falls back to compacting, but only until the
+ * unused memory behind the compacted blocks is large enough for the
+ * request, so that it rarely moves the whole heap.
+ *
+ * Every block starts with a header that points back to the owning
+ * struct mmem, so that the heap can be walked in address order during
+ * compaction. Free blocks have no owner and store the free list link
+ * in their payload.
+ */
+
+/* The smallest block and size class. Must be able to hold a pointer. */
+#ifdef MMEM_CONF_MIN_CLASS
+#define MMEM_MIN_CLASS MMEM_CONF_MIN_CLASS
+#else
+#define MMEM_MIN_CLASS 16
+#endif
+
+#ifdef MMEM_CONF_NUM_CLASSES
+#define MMEM_NUM_CLASSES MMEM_CONF_NUM_CLASSES
+#else
+#define MMEM_NUM_CLASSES 12
+#endif
+
+/* The number of bytes moved per run of the compaction process. */
+#ifdef MMEM_CONF_COMPACT_STEP
+#define MMEM_COMPACT_STEP MMEM_CONF_COMPACT_STEP
+#else
+#define MMEM_COMPACT_STEP 64
+#endif
+
+struct mmem_block {
+  struct mmem *owner;
+  unsigned int size;
+};
+
+#define BLOCK_HDR_SIZE sizeof(struct mmem_block)
+#define BLOCK_ALIGN(s) (((s) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define FREE_LINK(b) (*(struct mmem_block **)((b) + 1))
+
+/* The size of class c: MMEM_MIN_CLASS, 1.5 times that, twice that,
+   and so on. */
+#define CLASS_SIZE(c) (((c) & 1) ?                                \
+                       (MMEM_MIN_CLASS << ((c) >> 1)) * 3 / 2 :  \
+                       (MMEM_MIN_CLASS << ((c) >> 1)))
+
+unsigned int avail_memory;
+static union {
+  char bytes[MMEM_SIZE];
+  struct mmem_block align;
+} heap;
+#define memory heap.bytes
+
+static struct mmem_block *free_list[MMEM_NUM_CLASSES];
+/* The start of the unused memory at the end of the heap. */
+static char *top;
+/* During a compaction pass, the allocated blocks below compact_dst
+   have been compacted and the memory between compact_dst and
+   compact_src is unused. Both are NULL when no pass is in progress. */
+static char *compact_dst;
+static char *compact_src;
+
+#if MMEM_COMPACT_STEP
+PROCESS(mmem_compact_process, "mmem compaction");
+#endif /* MMEM_COMPACT_STEP */
+/*---------------------------------------------------------------------------*/
+static int
+size_class(unsigned int size)
+{
+  int c;
+
+  for(c = 1; c < MMEM_NUM_CLASSES; c++) {
+    if(size < CLASS_SIZE(c)) {
+      break;
+    }
+  }
+  return c - 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_free_block(struct mmem_block *b)
+{
+  int c;
+
+  c = size_class(b->size);
+  FREE_LINK(b) = free_list[c];
+  free_list[c] = b;
+}
+/*---------------------------------------------------------------------------*/
+static struct mmem_block *
+take_free_block(unsigned int size)
+{
+  struct mmem_block *b, **prev, **best;
+  int c;
+
+  /* The best fit among the blocks of the same class. */
+  c = size_class(size);
+  best = NULL;
+  for(prev = &free_list[c]; *prev != NULL; prev = &FREE_LINK(*prev)) {
+    if((*prev)->size >= size &&
+       (best == NULL || (*prev)->size < (*best)->size)) {
+      best = prev;
+      if((*best)->size == size) {
+        break;
+      }
+    }
+  }
+
+  /* Any block of a larger class is large enough. */
+  for(c++; best == NULL && c < MMEM_NUM_CLASSES; c++) {
+    if(free_list[c] != NULL) {
+      best = &free_list[c];
+    }
+  }
+
+  if(best == NULL) {
+    return NULL;
+  }
+  b = *best;
+  *best = FREE_LINK(b);
+  return b;
+}
+/*---------------------------------------------------------------------------*/
+static void
+request_compaction(void)
+{
+#if MMEM_COMPACT_STEP
+  if(!process_is_running(&mmem_compact_process)) {
+    process_start(&mmem_compact_process, NULL);
+  }
+  process_poll(&mmem_compact_process);
+#endif /* MMEM_COMPACT_STEP */
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief      Compact the managed memory
+ * \param max_bytes The maximum number of bytes to move, or 0 to
+ *                  compact all memory.
+ * \return     Non-zero if the compaction is not finished yet.
+ *
+ *             This function moves allocated blocks towards the start
+ *             of the heap so that the memory of freed blocks can be
+ *             used for allocations of any size. With a non-zero
+ *             max_bytes, it can be called repeatedly from idle time to
+ *             spread the cost of compaction. Pointers obtained with
+ *             MMEM_PTR() may be invalid after this function returns.
+ *
+ */
+int
+mmem_compact(unsigned int max_bytes)
+{
+  struct mmem_block *b;
+  unsigned int len, moved;
+  int c;
+
+  if(compact_src == NULL) {
+    if(avail_memory == (unsigned int)(&memory[MMEM_SIZE] - top)) {
+      /* No freed blocks below the top of the heap. */
+      return 0;
+    }
+    /* Blocks on the free lists are reclaimed by this pass. */
+    for(c = 0; c < MMEM_NUM_CLASSES; c++) {
+      free_list[c] = NULL;
+    }
+    compact_dst = compact_src = memory;
+  }
+
+  moved = 0;
+  while(compact_src < top) {
+    b = (struct mmem_block *)compact_src;
+    len = BLOCK_HDR_SIZE + b->size;
+    if(b->owner != NULL) {
+      if(compact_dst != compact_src) {
+        memmove(compact_dst, compact_src, len);
+        b = (struct mmem_block *)compact_dst;
+        b->owner->ptr = b + 1;
+        moved += len;
+      }
+      compact_dst += len;
+    } else {
+      moved += BLOCK_HDR_SIZE;
+    }
+    compact_src += len;
+    if(max_bytes > 0 && moved >= max_bytes && compact_src < top) {
+      return 1;
+    }
+  }
+
+  top = compact_dst;
+  compact_dst = compact_src = NULL;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct mmem_block *
+compact_for(unsigned int len)
+{
+  struct mmem_block *b;
+  int restarted;
+
+  restarted = 0;
+  while(1) {
+    if(compact_src != NULL &&
+       (unsigned int)(compact_src - compact_dst) >= len) {
+      /* Use the unused memory of the ongoing pass. */
+      b = (struct mmem_block *)compact_dst;
+      compact_dst += len;
+      return b;
+    }
+    if(mmem_compact(1)) {
+      continue;
+    }
+    if((unsigned int)(&memory[MMEM_SIZE] - top) >= len) {
+      b = (struct mmem_block *)top;
+      top += len;
+      return b;
+    }
+    if(restarted) {
+      return NULL;
+    }
+    /* Blocks freed behind a pass that was already in progress are
+       only reclaimed by a new pass. */
+    restarted = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+mmem_alloc(struct mmem *m, unsigned int size)
+{
+  struct mmem_block *b, *rest;
+  unsigned int block_size;
+
+  block_size = BLOCK_ALIGN(size);
+  if(block_size < MMEM_MIN_CLASS) {
+    block_size = MMEM_MIN_CLASS;
+  }
+
+  if(avail_memory < BLOCK_HDR_SIZE + block_size) {
+    return 0;
+  }
+
+  b = take_free_block(block_size);
+  if(b != NULL) {
+    if(b->size >= block_size + BLOCK_HDR_SIZE + MMEM_MIN_CLASS) {
+      rest = (struct mmem_block *)((char *)(b + 1) + block_size);
+      rest->owner = NULL;
+      rest->size = b->size - block_size - BLOCK_HDR_SIZE;
+      add_free_block(rest);
+      b->size = block_size;
+    }
+  } else if((unsigned int)(&memory[MMEM_SIZE] - top) >=
+            BLOCK_HDR_SIZE + block_size) {
+    b = (struct mmem_block *)top;
+    b->size = block_size;
+    top += BLOCK_HDR_SIZE + block_size;
+  } else {
+    /* The memory is there, but fragmented. */
+    b = compact_for(BLOCK_HDR_SIZE + block_size);
+    if(b == NULL) {
+      return 0;
+    }
+    b->size = block_size;
+  }
+
+  b->owner = m;
+  m->next = NULL;
+  m->ptr = b + 1;
+  m->size = size;
+  avail_memory -= BLOCK_HDR_SIZE + b->size;
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+mmem_free(struct mmem *m)
+{
+  struct mmem_block *b;
+
+  b = (struct mmem_block *)m->ptr - 1;
+  b->owner = NULL;
+  avail_memory += BLOCK_HDR_SIZE + b->size;
+
+  if((char *)b + BLOCK_HDR_SIZE + b->size == top &&
+     (compact_src == NULL || (char *)b >= compact_src)) {
+    top = (char *)b;
+    return;
+  }
+
+  /* Blocks that an ongoing compaction pass has not reached yet are
+     left for the pass to reclaim. */
+  if(compact_src == NULL || (char *)b < compact_dst) {
+    add_free_block(b);
+  }
+  request_compaction();
+}
+/*---------------------------------------------------------------------------*/
+void
+mmem_init(void)
+{
+  int c;
+
+  for(c = 0; c < MMEM_NUM_CLASSES; c++) {
+    free_list[c] = NULL;
+  }
+  top = memory;
+  compact_dst = compact_src = NULL;
+  avail_memory = MMEM_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+#if MMEM_COMPACT_STEP
+PROCESS_THREAD(mmem_compact_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    while(mmem_compact(MMEM_COMPACT_STEP)) {
+      PROCESS_PAUSE();
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* MMEM_COMPACT_STEP */
+/*---------------------------------------------------------------------------*/
+#else /* MMEM_SIZE_CLASSES */
 LIST(mmemlist);
 unsigned int avail_memory;
 static char memory[MMEM_SIZE];
@@ -140,6 +489,13 @@ mmem_free(struct mmem *m)
   list_remove(mmemlist, m);
 }
 /*---------------------------------------------------------------------------*/
+int
+mmem_compact(unsigned int max_bytes)
+{
+  /* The memory is compacted on every mmem_free(). */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
 /**
  * \brief      Initialize the managed memory module
  * \author     Adam Dunkels
@@ -157,4 +513,6 @@ mmem_init(void)
 }
 /*---------------------------------------------------------------------------*/
 
+#endif /* MMEM_SIZE_CLASSES */
+
 /** @} */
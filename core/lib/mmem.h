@@ -45,6 +45,13 @@
  * stays in place. Therefore, a level of indirection is used: access
  * to allocated memory must always be done using a special macro.
  *
+ * If MMEM_CONF_SIZE_CLASSES is set, freed blocks are instead kept on
+ * size class free lists and reused without moving memory, and the
+ * heap is compacted a few bytes at a time from a background process,
+ * or by mmem_compact(). An allocation only compacts when the free
+ * memory is too fragmented for it. This bounds the time of
+ * mmem_free() at the cost of a small header per block.
+ *
  * \note This module has not been heavily tested.
  * @{
  */
@@ -87,6 +94,7 @@ struct mmem {
 int  mmem_alloc(struct mmem *m, unsigned int size);
 void mmem_free(struct mmem *);
 void mmem_init(void);
+int  mmem_compact(unsigned int max_bytes);
 
 #endif /* __MMEM_H__ */
 
@@ -136,8 +136,43 @@ char elfloader_unknown[30];	/* Name that caused link error. */
 
 struct process * const * elfloader_autostart_processes;
 
+#if ELFLOADER_STATS
+struct elfloader_stats elfloader_stats;
+#define ELFLOADER_STAT(code) (code)
+#else /* ELFLOADER_STATS */
+#define ELFLOADER_STAT(code)
+#endif /* ELFLOADER_STATS */
+
 static struct relevant_section bss, data, rodata, text;
 
+#if ELFLOADER_SYMBOL_INDEX_SIZE > 0
+/*
+ * Open-addressed hash table of the local symbols of the module being
+ * loaded. A symbol is looked up with a single read of its name, to
+ * rule out hash collisions, instead of a scan of the symbol table.
+ */
+struct symbol_index_entry {
+  /* Hash of the symbol name, zero for an empty slot. */
+  uint16_t hash;
+  /* Offset of the name in the string table. */
+  cfs_offset_t name;
+  elf32_addr value;
+  struct relevant_section *sect;
+};
+
+static struct symbol_index_entry symbol_index[ELFLOADER_SYMBOL_INDEX_SIZE];
+/* Whether all local symbols of the module fit in the index. */
+static unsigned char symbol_index_complete;
+#endif /* ELFLOADER_SYMBOL_INDEX_SIZE > 0 */
+
+/* The buffer for batched reads of symbol table and relocation
+   entries. The loader is not reentrant, and the two are never read at
+   the same time. */
+static union {
+  struct elf32_sym syms[ELFLOADER_READ_BATCH];
+  char relas[ELFLOADER_READ_BATCH * sizeof(struct elf32_rela)];
+} batch;
+
 static const unsigned char elf_magic_header[] =
   {0x7f, 0x45, 0x4c, 0x46,  /* 0x7f, 'E', 'L', 'F' */
    0x01,                    /* Only 32-bit objects. */
@@ -151,6 +186,8 @@ seek_read(int fd, unsigned int offset, char *buf, int len)
 {
   cfs_seek(fd, offset, CFS_SEEK_SET);
   cfs_read(fd, buf, len);
+  ELFLOADER_STAT(elfloader_stats.reads++);
+  ELFLOADER_STAT(elfloader_stats.read_bytes += len);
 #if DEBUG
   {
     int i;
@@ -173,6 +210,19 @@ seek_write(int fd, unsigned int offset, char *buf, int len)
 }
 */
 /*---------------------------------------------------------------------------*/
+static struct relevant_section *
+local_section(unsigned int shndx)
+{
+  if(shndx == bss.number) {
+    return &bss;
+  } else if(shndx == data.number) {
+    return &data;
+  } else if(shndx == text.number) {
+    return &text;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 static void *
 find_local_symbol(int fd, const char *symbol,
 		  unsigned int symtab, unsigned short symtabsize,
@@ -182,20 +232,16 @@ find_local_symbol(int fd, const char *symbol,
   unsigned int a;
   char name[30];
   struct relevant_section *sect;
-  
+
+  ELFLOADER_STAT(elfloader_stats.symtab_scans++);
   for(a = symtab; a < symtab + symtabsize; a += sizeof(s)) {
     seek_read(fd, a, (char *)&s, sizeof(s));
 
     if(s.st_name != 0) {
       seek_read(fd, strtab + s.st_name, name, sizeof(name));
       if(strcmp(name, symbol) == 0) {
-	if(s.st_shndx == bss.number) {
-	  sect = &bss;
-	} else if(s.st_shndx == data.number) {
-	  sect = &data;
-	} else if(s.st_shndx == text.number) {
-	  sect = &text;
-	} else {
+	sect = local_section(s.st_shndx);
+	if(sect == NULL) {
 	  return NULL;
 	}
 	return &(sect->address[s.st_value]);
@@ -205,6 +251,166 @@ find_local_symbol(int fd, const char *symbol,
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+#if ELFLOADER_SYMBOL_INDEX_SIZE > 0
+static uint16_t
+symbol_hash(const char *name, int len)
+{
+  uint16_t hash;
+
+  hash = 5381;
+  while(len-- > 0 && *name != 0) {
+    hash = (hash << 5) + hash + (unsigned char)*name++;
+  }
+  /* Zero marks an empty slot. */
+  return hash == 0 ? 1 : hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+build_symbol_index(int fd,
+		   unsigned int symtab, unsigned short symtabsize,
+		   unsigned int strtab)
+{
+  struct elf32_sym *s;
+  struct relevant_section *sect;
+  unsigned int a, len, slot, count;
+  char name[30];
+  uint16_t hash;
+
+  memset(symbol_index, 0, sizeof(symbol_index));
+  symbol_index_complete = 1;
+  count = 0;
+
+  for(a = symtab; a < symtab + symtabsize; a += len) {
+    len = symtab + symtabsize - a;
+    if(len > sizeof(batch.syms)) {
+      len = sizeof(batch.syms);
+    }
+    seek_read(fd, a, (char *)batch.syms, len);
+
+    for(s = batch.syms; s < batch.syms + len / sizeof(struct elf32_sym); s++) {
+      sect = local_section(s->st_shndx);
+      if(s->st_name == 0 || sect == NULL) {
+	continue;
+      }
+      if(count == ELFLOADER_SYMBOL_INDEX_SIZE) {
+	PRINTF("elfloader: symbol index full\n");
+	symbol_index_complete = 0;
+	return;
+      }
+
+      seek_read(fd, strtab + s->st_name, name, sizeof(name));
+      hash = symbol_hash(name, sizeof(name));
+      /* Linear probing keeps symbols with equal names in symbol table
+	 order, so that lookups find the same symbol as a scan. */
+      slot = hash % ELFLOADER_SYMBOL_INDEX_SIZE;
+      while(symbol_index[slot].hash != 0) {
+	slot = (slot + 1) % ELFLOADER_SYMBOL_INDEX_SIZE;
+      }
+      symbol_index[slot].hash = hash;
+      symbol_index[slot].name = s->st_name;
+      symbol_index[slot].value = s->st_value;
+      symbol_index[slot].sect = sect;
+      count++;
+      ELFLOADER_STAT(elfloader_stats.indexed_symbols++);
+    }
+  }
+}
+#endif /* ELFLOADER_SYMBOL_INDEX_SIZE > 0 */
+/*---------------------------------------------------------------------------*/
+static void *
+lookup_local_symbol(int fd, const char *symbol,
+		    unsigned int symtab, unsigned short symtabsize,
+		    unsigned int strtab)
+{
+#if ELFLOADER_SYMBOL_INDEX_SIZE > 0
+  struct symbol_index_entry *e;
+  unsigned int slot, n;
+  char name[30];
+  uint16_t hash;
+
+  hash = symbol_hash(symbol, sizeof(name));
+  slot = hash % ELFLOADER_SYMBOL_INDEX_SIZE;
+  for(n = 0; n < ELFLOADER_SYMBOL_INDEX_SIZE; n++) {
+    e = &symbol_index[slot];
+    if(e->hash == 0) {
+      break;
+    }
+    if(e->hash == hash) {
+      seek_read(fd, strtab + e->name, name, sizeof(name));
+      if(strncmp(name, symbol, sizeof(name)) == 0) {
+	return &(e->sect->address[e->value]);
+      }
+    }
+    slot = (slot + 1) % ELFLOADER_SYMBOL_INDEX_SIZE;
+  }
+  if(symbol_index_complete) {
+    return NULL;
+  }
+#endif /* ELFLOADER_SYMBOL_INDEX_SIZE > 0 */
+  return find_local_symbol(fd, symbol, symtab, symtabsize, strtab);
+}
+/*---------------------------------------------------------------------------*/
+static int
+symbol_address(int fd, unsigned long sym,
+	       unsigned int strtab,
+	       unsigned int symtab, unsigned short symtabsize,
+	       char **addrp)
+{
+  struct elf32_sym s;
+  char name[30];
+  char *addr;
+  struct relevant_section *sect;
+
+  seek_read(fd,
+	    symtab + sizeof(struct elf32_sym) * sym,
+	    (char *)&s, sizeof(s));
+  if(s.st_name != 0) {
+    seek_read(fd, strtab + s.st_name, name, sizeof(name));
+    PRINTF("name: %s\n", name);
+    addr = (char *)symtab_lookup(name);
+    /* ADDED */
+    if(addr == NULL) {
+      PRINTF("name not found in global: %s\n", name);
+      addr = lookup_local_symbol(fd, name, symtab, symtabsize, strtab);
+      PRINTF("found address %p\n", addr);
+    }
+    if(addr == NULL) {
+      if(s.st_shndx == bss.number) {
+	sect = &bss;
+      } else if(s.st_shndx == data.number) {
+	sect = &data;
+      } else if(s.st_shndx == rodata.number) {
+	sect = &rodata;
+      } else if(s.st_shndx == text.number) {
+	sect = &text;
+      } else {
+	PRINTF("elfloader unknown name: '%30s'\n", name);
+	memcpy(elfloader_unknown, name, sizeof(elfloader_unknown));
+	elfloader_unknown[sizeof(elfloader_unknown) - 1] = 0;
+	return ELFLOADER_SYMBOL_NOT_FOUND;
+      }
+      addr = sect->address;
+    }
+  } else {
+    if(s.st_shndx == bss.number) {
+      sect = &bss;
+    } else if(s.st_shndx == data.number) {
+      sect = &data;
+    } else if(s.st_shndx == rodata.number) {
+      sect = &rodata;
+    } else if(s.st_shndx == text.number) {
+      sect = &text;
+    } else {
+      return ELFLOADER_SEGMENT_NOT_FOUND;
+    }
+      
+    addr = sect->address;
+  }
+
+  *addrp = addr;
+  return ELFLOADER_OK;
+}
+/*---------------------------------------------------------------------------*/
 static int
 relocate_section(int fd,
 		 unsigned int section, unsigned short size,
@@ -218,11 +424,10 @@ relocate_section(int fd,
   /* sectionbase added; runtime start address of current section */
   struct elf32_rela rela; /* Now used both for rel and rela data! */
   int rel_size = 0;
-  struct elf32_sym s;
-  unsigned int a;
-  char name[30];
+  unsigned int a, i, len;
+  unsigned long sym, last_sym;
   char *addr;
-  struct relevant_section *sect;
+  int ret;
 
   /* determine correct relocation entry sizes */
   if(using_relas) {
@@ -230,53 +435,31 @@ relocate_section(int fd,
   } else {
     rel_size = sizeof(struct elf32_rel);
   }
-  
-  for(a = section; a < section + size; a += rel_size) {
-    seek_read(fd, a, (char *)&rela, rel_size);
-    seek_read(fd,
-	      symtab + sizeof(struct elf32_sym) * ELF32_R_SYM(rela.r_info),
-	      (char *)&s, sizeof(s));
-    if(s.st_name != 0) {
-      seek_read(fd, strtab + s.st_name, name, sizeof(name));
-      PRINTF("name: %s\n", name);
-      addr = (char *)symtab_lookup(name);
-      /* ADDED */
-      if(addr == NULL) {
-	PRINTF("name not found in global: %s\n", name);
-	addr = find_local_symbol(fd, name, symtab, symtabsize, strtab);
-	PRINTF("found address %p\n", addr);
-      }
-      if(addr == NULL) {
-	if(s.st_shndx == bss.number) {
-	  sect = &bss;
-	} else if(s.st_shndx == data.number) {
-	  sect = &data;
-	} else if(s.st_shndx == rodata.number) {
-	  sect = &rodata;
-	} else if(s.st_shndx == text.number) {
-	  sect = &text;
-	} else {
-	  PRINTF("elfloader unknown name: '%30s'\n", name);
-	  memcpy(elfloader_unknown, name, sizeof(elfloader_unknown));
-	  elfloader_unknown[sizeof(elfloader_unknown) - 1] = 0;
-	  return ELFLOADER_SYMBOL_NOT_FOUND;
-	}
-	addr = sect->address;
+
+  /* The relocation entries are read in batches. Consecutive
+     relocations against the same symbol reuse its address. */
+  addr = NULL;
+  last_sym = 0;
+  len = i = 0;
+  for(a = section; a < section + size; a += rel_size, i += rel_size) {
+    if(i == len) {
+      len = section + size - a;
+      if(len > ELFLOADER_READ_BATCH * rel_size) {
+	len = ELFLOADER_READ_BATCH * rel_size;
       }
-    } else {
-      if(s.st_shndx == bss.number) {
-	sect = &bss;
-      } else if(s.st_shndx == data.number) {
-	sect = &data;
-      } else if(s.st_shndx == rodata.number) {
-	sect = &rodata;
-      } else if(s.st_shndx == text.number) {
-	sect = &text;
-      } else {
-	return ELFLOADER_SEGMENT_NOT_FOUND;
+      seek_read(fd, a, batch.relas, len);
+      i = 0;
+    }
+    memcpy(&rela, &batch.relas[i], rel_size);
+    ELFLOADER_STAT(elfloader_stats.relocations++);
+
+    sym = ELF32_R_SYM(rela.r_info);
+    if(sym == 0 || sym != last_sym) {
+      ret = symbol_address(fd, sym, strtab, symtab, symtabsize, &addr);
+      if(ret != ELFLOADER_OK) {
+	return ret;
       }
-      
-      addr = sect->address;
+      last_sym = sym;
     }
 
     if(!using_relas) {
@@ -358,8 +541,13 @@ elfloader_load(int fd)
 
   struct process **process;
   int ret;
+#if ELFLOADER_STATS
+  clock_time_t start, phase;
+#endif /* ELFLOADER_STATS */
 
   elfloader_unknown[0] = 0;
+  ELFLOADER_STAT(memset(&elfloader_stats, 0, sizeof(elfloader_stats)));
+  ELFLOADER_STAT(start = phase = clock_time());
 
   /* The ELF header is located at the start of the buffer. */
   seek_read(fd, 0, (char *)&ehdr, sizeof(ehdr));
@@ -437,7 +625,9 @@ elfloader_load(int fd)
       PRINTF("symtab\n");
       symtaboff = shdr.sh_offset;
       symtabsize = shdr.sh_size;
-    } else if(shdr.sh_type == SHT_STRTAB/*strncmp(name, ".strtab", 7) == 0*/) {
+    } else if(shdr.sh_type == SHT_STRTAB/*strncmp(name, ".strtab", 7) == 0*/ &&
+	      i != ehdr.e_shstrndx) {
+      /* The section name table is a string table as well. */
       PRINTF("strtab\n");
       strtaboff = shdr.sh_offset;
       strtabsize = shdr.sh_size;
@@ -503,6 +693,14 @@ elfloader_load(int fd)
     return ELFLOADER_NO_TEXT;
   }
 
+  ELFLOADER_STAT(elfloader_stats.parse_time = clock_time() - phase);
+
+#if ELFLOADER_SYMBOL_INDEX_SIZE > 0
+  ELFLOADER_STAT(phase = clock_time());
+  build_symbol_index(fd, symtaboff, symtabsize, strtaboff);
+  ELFLOADER_STAT(elfloader_stats.index_time = clock_time() - phase);
+#endif /* ELFLOADER_SYMBOL_INDEX_SIZE > 0 */
+
   PRINTF("before allocate ram\n");
   bss.address = (char *)elfloader_arch_allocate_ram(bsssize + datasize);
   data.address = (char *)bss.address + bsssize;
@@ -517,6 +715,8 @@ elfloader_load(int fd)
   PRINTF("rodata base address: rodata.address = 0x%08x\n", rodata.address);
 
 
+  ELFLOADER_STAT(phase = clock_time());
+
   /* If we have text segment relocations, we process them. */
   PRINTF("elfloader: relocate text\n");
   if(textrelasize > 0) {
@@ -564,15 +764,20 @@ elfloader_load(int fd)
     }
   }
 
+  ELFLOADER_STAT(elfloader_stats.relocate_time = clock_time() - phase);
+  ELFLOADER_STAT(phase = clock_time());
+
   /* Write text and rodata segment into flash and data segment into RAM. */
   elfloader_arch_write_rom(fd, textoff, textsize, text.address);
   elfloader_arch_write_rom(fd, rodataoff, rodatasize, rodata.address);
   
   memset(bss.address, 0, bsssize);
   seek_read(fd, dataoff, data.address, datasize);
+  ELFLOADER_STAT(elfloader_stats.copy_time = clock_time() - phase);
 
   PRINTF("elfloader: autostart search\n");
-  process = (struct process **) find_local_symbol(fd, "autostart_processes", symtaboff, symtabsize, strtaboff);
+  process = (struct process **) lookup_local_symbol(fd, "autostart_processes", symtaboff, symtabsize, strtaboff);
+  ELFLOADER_STAT(elfloader_stats.total_time = clock_time() - start);
   if(process != NULL) {
     PRINTF("elfloader: autostart found\n");
     elfloader_autostart_processes = process;
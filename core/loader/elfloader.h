@@ -76,6 +76,7 @@
 #define __ELFLOADER_H__
 
 #include "cfs/cfs.h"
+#include "sys/clock.h"
 
 /**
  * Return value from elfloader_load() indicating that loading worked.
@@ -159,6 +160,49 @@ extern struct process * const * elfloader_autostart_processes;
  */
 extern char elfloader_unknown[30];
 
+/**
+ * Statistics of the last call to elfloader_load(). The times are in
+ * clock ticks.
+ */
+struct elfloader_stats {
+  /** Reads from the ELF file, and the number of bytes read. */
+  unsigned long reads;
+  unsigned long read_bytes;
+  /** Relocations applied. */
+  unsigned int relocations;
+  /** Local symbols in the symbol index. */
+  unsigned int indexed_symbols;
+  /** Local symbol lookups that had to scan the whole symbol table. */
+  unsigned int symtab_scans;
+  /** Parsing the ELF and section headers. */
+  clock_time_t parse_time;
+  /** Building the local symbol index. */
+  clock_time_t index_time;
+  /** Relocating the .text, .rodata, and .data segments. */
+  clock_time_t relocate_time;
+  /** Copying the segments to their final location. */
+  clock_time_t copy_time;
+  /** The whole load, including the search for the autostart processes. */
+  clock_time_t total_time;
+};
+
+/*
+ * Whether the loader collects the statistics of the last load. Off by
+ * default, since most images only load modules and never read them.
+ */
+#ifdef ELFLOADER_CONF_STATS
+#define ELFLOADER_STATS ELFLOADER_CONF_STATS
+#else
+#define ELFLOADER_STATS 0
+#endif
+
+#if ELFLOADER_STATS
+/**
+ * Statistics of the last call to elfloader_load().
+ */
+extern struct elfloader_stats elfloader_stats;
+#endif /* ELFLOADER_STATS */
+
 #ifndef ELFLOADER_DATAMEMORY_SIZE
 #ifdef ELFLOADER_CONF_DATAMEMORY_SIZE
 #define ELFLOADER_DATAMEMORY_SIZE ELFLOADER_CONF_DATAMEMORY_SIZE
@@ -175,11 +219,42 @@ extern char elfloader_unknown[30];
 #endif
 #endif /* ELFLOADER_TEXTMEMORY_SIZE */
 
-typedef unsigned long  elf32_word;
-typedef   signed long  elf32_sword;
-typedef unsigned short elf32_half;
-typedef unsigned long  elf32_off;
-typedef unsigned long  elf32_addr;
+/*
+ * The number of local symbols in the in-RAM symbol index that the
+ * loader builds for every module. Each entry takes 10 bytes on 16-bit
+ * platforms. Symbols that do not fit are found by scanning the symbol
+ * table in the ELF file, which costs two reads per symbol. The default
+ * of 0 always scans the symbol table; projects that load large modules
+ * often can afford the RAM for an index.
+ */
+#ifndef ELFLOADER_SYMBOL_INDEX_SIZE
+#ifdef ELFLOADER_CONF_SYMBOL_INDEX_SIZE
+#define ELFLOADER_SYMBOL_INDEX_SIZE ELFLOADER_CONF_SYMBOL_INDEX_SIZE
+#else
+#define ELFLOADER_SYMBOL_INDEX_SIZE 0
+#endif
+#endif /* ELFLOADER_SYMBOL_INDEX_SIZE */
+
+/*
+ * The number of relocation entries, or symbol table entries, that
+ * the loader reads from the ELF file at once. The read buffer is
+ * static and takes 16 bytes per entry, so the default reads one
+ * entry at a time.
+ */
+#ifndef ELFLOADER_READ_BATCH
+#ifdef ELFLOADER_CONF_READ_BATCH
+#define ELFLOADER_READ_BATCH ELFLOADER_CONF_READ_BATCH
+#else
+#define ELFLOADER_READ_BATCH 1
+#endif
+#endif /* ELFLOADER_READ_BATCH */
+
+/* The ELF32 types have the same size on 8, 16, 32, and 64-bit hosts. */
+typedef uint32_t elf32_word;
+typedef  int32_t elf32_sword;
+typedef uint16_t elf32_half;
+typedef uint32_t elf32_off;
+typedef uint32_t elf32_addr;
 
 struct elf32_rela {
   elf32_addr      r_offset;       /* Location to be relocated. */
@@ -46,6 +46,7 @@
 #include "contiki-net.h"
 #if WITH_SWAP
 #include "cfs/cfs.h"
+#include <stddef.h> /* for offsetof() */
 #endif
 
 #include <string.h> /* for memcpy() */
@@ -100,12 +101,35 @@ MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
 /* Swapping allows to store up to QUEUEBUF_NUM - QUEUEBUFRAM_NUM
    queuebufs in CFS. The swap is made of several large CFS files.
    Every buffer stored in CFS has a swap id, referring to a specific
-   offset in one of these files. */
+   offset in one of these files. Swap ids are handed out sequentially,
+   so the swap files are written like a log. */
 #define NQBUF_FILES 4
 #define NQBUF_PER_FILE 256
-#define QBUF_FILE_SIZE (NQBUF_PER_FILE*sizeof(struct queuebuf_data))
+#define QBUF_FILE_SIZE (NQBUF_PER_FILE*sizeof(struct swap_record))
 #define NQBUF_ID (NQBUF_PER_FILE * NQBUF_FILES)
 
+/* The number of swapped queuebufs that are collected in RAM before
+   they are written to CFS with a single write operation. */
+#ifdef QUEUEBUF_CONF_SWAP_BATCH
+#define QUEUEBUF_SWAP_BATCH QUEUEBUF_CONF_SWAP_BATCH
+#else
+#define QUEUEBUF_SWAP_BATCH 4
+#endif
+
+/* The maximum time a partial batch is kept in RAM. */
+#ifdef QUEUEBUF_CONF_SWAP_FLUSH_DELAY
+#define QUEUEBUF_SWAP_FLUSH_DELAY QUEUEBUF_CONF_SWAP_FLUSH_DELAY
+#else
+#define QUEUEBUF_SWAP_FLUSH_DELAY (CLOCK_SECOND / 2)
+#endif
+
+/* A queuebuf as stored in the swap files. Records with a sequence
+   number of zero are unused or were freed before being written. */
+struct swap_record {
+  uint32_t seq;
+  struct queuebuf_data data;
+};
+
 struct qbuf_file {
   int fd;
   int usage;
@@ -118,11 +142,33 @@ static struct queuebuf_data tmpdata;
 static struct queuebuf *tmpdata_qbuf = NULL;
 /* The swap id counter */
 static int next_swap_id = 0;
+/* The sequence number of the last record stored in the swap */
+static uint32_t swap_seq;
 /* The swap files */
 static struct qbuf_file qbuf_files[NQBUF_FILES];
 /* The timer used to renew files during inactivity periods */
 static struct ctimer renew_timer;
 
+/* Records waiting to be written; they have consecutive swap ids
+   starting at batch_first_id. */
+static struct swap_record batch[QUEUEBUF_SWAP_BATCH];
+static int batch_first_id;
+static uint8_t batch_len;
+static struct ctimer flush_timer;
+
+#if QUEUEBUF_SWAP_PERSISTENT
+/* Freed swap ids that have not yet been recorded in the release
+   logs. A swap id is only reused after its file has been renewed, so
+   the release logs need no sequence numbers. */
+static uint16_t pending_release[QUEUEBUF_SWAP_BATCH];
+static uint8_t pending_release_len;
+/* Swap ids found in the swap after a reboot that have not been
+   restored yet, and where to continue looking for them. */
+static uint8_t recovered[NQBUF_ID / 8];
+static int recovered_count;
+static int restore_id;
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
+
 #endif
 
 #if QUEUEBUF_DEBUG
@@ -151,15 +197,29 @@ uint8_t queuebuf_len, queuebuf_ref_len, queuebuf_max_len;
 #if WITH_SWAP
 /*---------------------------------------------------------------------------*/
 static void
+qbuf_file_name(char *name, int file, int release_log)
+{
+  name[0] = (release_log ? 'A' : 'a') + file;
+  name[1] = '\0';
+}
+/*---------------------------------------------------------------------------*/
+static void
 qbuf_renew_file(int file)
 {
   int ret;
   char name[2];
-  name[0] = 'a' + file;
-  name[1] = '\0';
+  qbuf_file_name(name, file, 0);
   if(qbuf_files[file].renewable == 1) {
     PRINTF("qbuf_renew_file: removing file %d\n", file);
+    if(qbuf_files[file].fd != -1) {
+      cfs_close(qbuf_files[file].fd);
+    }
     cfs_remove(name);
+#if QUEUEBUF_SWAP_PERSISTENT
+    qbuf_file_name(name, file, 1);
+    cfs_remove(name);
+    qbuf_file_name(name, file, 0);
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
   }
   ret = cfs_open(name, CFS_READ | CFS_WRITE);
   if(ret == -1) {
@@ -182,15 +242,140 @@ qbuf_renew_all(void *unused)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if QUEUEBUF_SWAP_PERSISTENT
+/* Appends the pending releases to the release logs of their files,
+   with one write per file */
+static void
+qbuf_write_releases(void)
+{
+  char name[2];
+  uint16_t indices[QUEUEBUF_SWAP_BATCH];
+  int i, n, fileid, fd;
+
+  for(fileid = 0; fileid < NQBUF_FILES && pending_release_len > 0; fileid++) {
+    for(i = n = 0; i < pending_release_len; i++) {
+      if(pending_release[i] / NQBUF_PER_FILE == fileid) {
+        indices[n++] = pending_release[i] % NQBUF_PER_FILE;
+      }
+    }
+    /* If the file is renewable, it will be removed anyway. */
+    if(n == 0 || qbuf_files[fileid].renewable) {
+      continue;
+    }
+    qbuf_file_name(name, fileid, 1);
+    fd = cfs_open(name, CFS_WRITE | CFS_APPEND);
+    if(fd == -1) {
+      PRINTF("qbuf_write_releases: cfs open error\n");
+      continue;
+    }
+    cfs_write(fd, indices, n * sizeof(indices[0]));
+    cfs_close(fd);
+  }
+  pending_release_len = 0;
+}
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
+/*---------------------------------------------------------------------------*/
+/* Writes the batch to the swap files */
+static int
+qbuf_flush_batch(void)
+{
+  int i, n, id, fd;
+  uint8_t live;
+
+  ctimer_stop(&flush_timer);
+
+  for(i = live = 0; i < batch_len; i++) {
+    if(batch[i].seq != 0) {
+      live = 1;
+    }
+  }
+
+  /* If every queuebuf of the batch has been freed already, and no other
+     swap id has been handed out since, the swap ids can be reused and
+     nothing needs to be written. */
+  if(!live && next_swap_id == (batch_first_id + batch_len) % NQBUF_ID &&
+     next_swap_id % NQBUF_PER_FILE != 0 &&
+     next_swap_id / NQBUF_PER_FILE == batch_first_id / NQBUF_PER_FILE) {
+    next_swap_id = batch_first_id;
+    batch_len = 0;
+  }
+
+  /* The batch may span two files; write one consecutive run per file. */
+  for(i = 0; i < batch_len; i += n) {
+    id = (batch_first_id + i) % NQBUF_ID;
+    n = NQBUF_PER_FILE - id % NQBUF_PER_FILE;
+    if(n > batch_len - i) {
+      n = batch_len - i;
+    }
+    fd = qbuf_files[id / NQBUF_PER_FILE].fd;
+    if(cfs_seek(fd, (cfs_offset_t)(id % NQBUF_PER_FILE) *
+                sizeof(struct swap_record), CFS_SEEK_SET) == -1 ||
+       cfs_write(fd, &batch[i], n * sizeof(struct swap_record)) == -1) {
+      PRINTF("qbuf_flush_batch: cfs write error\n");
+      /* Keep the records that could not be written. */
+      memmove(&batch[0], &batch[i], (batch_len - i) * sizeof(batch[0]));
+      batch_first_id = id;
+      batch_len -= i;
+      return -1;
+    }
+  }
+  batch_len = 0;
+
+#if QUEUEBUF_SWAP_PERSISTENT
+  qbuf_write_releases();
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+qbuf_flush_timeout(void *unused)
+{
+  qbuf_flush_batch();
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the batch record of a swap id, or NULL if it has been written */
+static struct swap_record *
+qbuf_batch_record(int swap_id)
+{
+  int i;
+  if(batch_len == 0 || swap_id == -1) {
+    return NULL;
+  }
+  i = (swap_id - batch_first_id + NQBUF_ID) % NQBUF_ID;
+  return i < batch_len ? &batch[i] : NULL;
+}
+/*---------------------------------------------------------------------------*/
 /* Removes a queuebuf from its swap file */
 static void
 queuebuf_remove_from_file(int swap_id)
 {
   int fileid;
+  struct swap_record *record;
   if(swap_id != -1) {
     fileid = swap_id / NQBUF_PER_FILE;
     qbuf_files[fileid].usage--;
 
+    record = qbuf_batch_record(swap_id);
+    if(record != NULL) {
+      /* Not written yet; mark the record as unused. */
+      record->seq = 0;
+    }
+#if QUEUEBUF_SWAP_PERSISTENT
+    else {
+      if(pending_release_len == QUEUEBUF_SWAP_BATCH &&
+         qbuf_flush_batch() == -1) {
+        /* The records could not be written, but the releases can. */
+        qbuf_write_releases();
+      }
+      pending_release[pending_release_len++] = swap_id;
+      if(batch_len == 0) {
+        ctimer_set(&flush_timer, QUEUEBUF_SWAP_FLUSH_DELAY,
+                   qbuf_flush_timeout, NULL);
+      }
+    }
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
+
     /* The file is full but doesn't contain any more queuebuf, mark it as renewable */
     if(qbuf_files[fileid].usage == 0 && fileid != next_swap_id / NQBUF_PER_FILE) {
       qbuf_files[fileid].renewable = 1;
@@ -198,7 +383,7 @@ queuebuf_remove_from_file(int swap_id)
       ctimer_set(&renew_timer, 0, qbuf_renew_all, NULL);
     }
 
-    if(tmpdata_qbuf->swap_id == swap_id) {
+    if(tmpdata_qbuf != NULL && tmpdata_qbuf->swap_id == swap_id) {
       tmpdata_qbuf->swap_id = -1;
     }
   }
@@ -211,42 +396,49 @@ get_new_swap_id(void)
   int swap_id = next_swap_id;
   fileid = swap_id / NQBUF_PER_FILE;
   if(swap_id % NQBUF_PER_FILE == 0) { /* This is the first id in the file */
-    if(qbuf_files[fileid].renewable) {
-      qbuf_renew_file(fileid);
-    }
     if(qbuf_files[fileid].usage>0) {
       return -1;
     }
+#if QUEUEBUF_SWAP_PERSISTENT
+    /* Old records and releases must not be recovered from a reused file */
+    qbuf_files[fileid].renewable = 1;
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
+    if(qbuf_files[fileid].renewable) {
+      qbuf_renew_file(fileid);
+    }
   }
   qbuf_files[fileid].usage++;
   next_swap_id = (next_swap_id+1) % NQBUF_ID;
   return swap_id;
 }
 /*---------------------------------------------------------------------------*/
-/* Flush tmpdata to CFS */
+/* Stores tmpdata in the swap under a new swap id. The data is added to
+   the batch, which is written to CFS when it is full or times out. */
 static int
 queuebuf_flush_tmpdata(void)
 {
-  int fileid, fd, ret;
-  cfs_offset_t offset;
+  struct swap_record *record;
   if(tmpdata_qbuf) {
+    if(batch_len == QUEUEBUF_SWAP_BATCH && qbuf_flush_batch() == -1) {
+      return -1;
+    }
     queuebuf_remove_from_file(tmpdata_qbuf->swap_id);
     tmpdata_qbuf->swap_id = get_new_swap_id();
     if(tmpdata_qbuf->swap_id == -1) {
       return -1;
     }
-    fileid = tmpdata_qbuf->swap_id / NQBUF_PER_FILE;
-    offset = (tmpdata_qbuf->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-    fd = qbuf_files[fileid].fd;
-    ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs seek error\n");
-      return -1;
+    if(batch_len == 0) {
+      batch_first_id = tmpdata_qbuf->swap_id;
     }
-    ret = cfs_write(fd, &tmpdata, sizeof(struct queuebuf_data));
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs write error\n");
-      return -1;
+    record = &batch[batch_len++];
+    record->seq = ++swap_seq;
+    memcpy(&record->data, &tmpdata, sizeof(struct queuebuf_data));
+
+    if(batch_len == QUEUEBUF_SWAP_BATCH) {
+      qbuf_flush_batch();
+    } else if(batch_len == 1) {
+      ctimer_set(&flush_timer, QUEUEBUF_SWAP_FLUSH_DELAY,
+                 qbuf_flush_timeout, NULL);
     }
   }
   return 0;
@@ -258,16 +450,23 @@ queuebuf_load_to_ram(struct queuebuf *b)
 {
   int fileid, fd, ret;
   cfs_offset_t offset;
+  struct swap_record *record;
   if(b->location == IN_RAM) { /* the qbuf is loacted in RAM */
     return b->ram_ptr;
   } else { /* the qbuf is located in CFS */
     if(tmpdata_qbuf && tmpdata_qbuf->swap_id == b->swap_id) { /* the qbuf is already in tmpdata */
       return &tmpdata;
+    } else if((record = qbuf_batch_record(b->swap_id)) != NULL) {
+      /* the qbuf has not been written yet */
+      tmpdata_qbuf = b;
+      memcpy(&tmpdata, &record->data, sizeof(struct queuebuf_data));
+      return &tmpdata;
     } else { /* the qbuf needs to be loaded from CFS */
       tmpdata_qbuf = b;
       /* read the qbuf from CFS */
       fileid = b->swap_id / NQBUF_PER_FILE;
-      offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
+      offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct swap_record) +
+        offsetof(struct swap_record, data);
       fd = qbuf_files[fileid].fd;
       ret = cfs_seek(fd, offset, CFS_SEEK_SET);
       if(ret == -1) {
@@ -281,6 +480,79 @@ queuebuf_load_to_ram(struct queuebuf *b)
     }
   }
 }
+/*---------------------------------------------------------------------------*/
+#if QUEUEBUF_SWAP_PERSISTENT
+/* Rebuilds the swap state from the files left by a previous run */
+static void
+qbuf_recover(void)
+{
+  char name[2];
+  uint8_t released[NQBUF_PER_FILE / 8];
+  uint32_t seq, max_seq;
+  uint16_t index;
+  int i, fd, id;
+
+  max_seq = 0;
+  next_swap_id = 0;
+  for(i = 0; i < NQBUF_FILES; i++) {
+    memset(released, 0, sizeof(released));
+    qbuf_file_name(name, i, 1);
+    fd = cfs_open(name, CFS_READ);
+    if(fd != -1) {
+      while(cfs_read(fd, &index, sizeof(index)) == sizeof(index)) {
+        if(index < NQBUF_PER_FILE) {
+          released[index / 8] |= 1 << (index % 8);
+        }
+      }
+      cfs_close(fd);
+    }
+
+    qbuf_file_name(name, i, 0);
+    qbuf_files[i].fd = cfs_open(name, CFS_READ | CFS_WRITE);
+    qbuf_files[i].usage = 0;
+    qbuf_files[i].renewable = 0;
+    if(qbuf_files[i].fd == -1) {
+      continue;
+    }
+
+    for(index = 0; index < NQBUF_PER_FILE; index++) {
+      if(cfs_seek(qbuf_files[i].fd,
+                  (cfs_offset_t)index * sizeof(struct swap_record),
+                  CFS_SEEK_SET) == -1 ||
+         cfs_read(qbuf_files[i].fd, &seq, sizeof(seq)) != sizeof(seq)) {
+        break;
+      }
+      if(seq == 0 || seq == 0xffffffffUL) {
+        continue;
+      }
+      id = i * NQBUF_PER_FILE + index;
+      if(seq > max_seq) {
+        max_seq = seq;
+        next_swap_id = (id + 1) % NQBUF_ID;
+      }
+      if(!(released[index / 8] & (1 << (index % 8)))) {
+        recovered[id / 8] |= 1 << (id % 8);
+        recovered_count++;
+        qbuf_files[i].usage++;
+      }
+    }
+  }
+
+  /* Files without live queuebufs are cleared, except the one that
+     the next swap id points into. */
+  for(i = 0; i < NQBUF_FILES; i++) {
+    if(qbuf_files[i].usage == 0 && i != next_swap_id / NQBUF_PER_FILE) {
+      qbuf_files[i].renewable = 1;
+      qbuf_renew_file(i);
+    }
+  }
+
+  swap_seq = max_seq;
+  /* The oldest queuebufs follow the most recently written one. */
+  restore_id = next_swap_id;
+  PRINTF("qbuf_recover: %d queuebufs recovered\n", recovered_count);
+}
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
 #else /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
 static struct queuebuf_data *
@@ -295,10 +567,19 @@ queuebuf_init(void)
 {
 #if WITH_SWAP
   int i;
+  for(i=0; i<NQBUF_FILES; i++) {
+    qbuf_files[i].fd = -1;
+  }
+  tmpdata_qbuf = NULL;
+  batch_len = 0;
+#if QUEUEBUF_SWAP_PERSISTENT
+  qbuf_recover();
+#else /* QUEUEBUF_SWAP_PERSISTENT */
   for(i=0; i<NQBUF_FILES; i++) {
     qbuf_files[i].renewable = 1;
     qbuf_renew_file(i);
   }
+#endif /* QUEUEBUF_SWAP_PERSISTENT */
 #endif
   memb_init(&buframmem);
   memb_init(&bufmem);
@@ -400,7 +681,13 @@ queuebuf_update_attr_from_packetbuf(struct queuebuf *buf)
   packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
 #if WITH_SWAP
   if(buf->location == IN_CFS) {
-    queuebuf_flush_tmpdata();
+    struct swap_record *record = qbuf_batch_record(buf->swap_id);
+    if(record != NULL) {
+      /* Not written yet, update the batch in place */
+      memcpy(&record->data, buframptr, sizeof(struct queuebuf_data));
+    } else {
+      queuebuf_flush_tmpdata();
+    }
   }
 #endif
 }
@@ -414,6 +701,9 @@ queuebuf_free(struct queuebuf *buf)
       memb_free(&buframmem, buf->ram_ptr);
     } else {
       queuebuf_remove_from_file(buf->swap_id);
+      if(tmpdata_qbuf == buf) {
+        tmpdata_qbuf = NULL;
+      }
     }
 #else
     memb_free(&buframmem, buf->ram_ptr);
@@ -434,6 +724,66 @@ queuebuf_free(struct queuebuf *buf)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT
+struct queuebuf *
+queuebuf_swap_restore(void)
+{
+  struct queuebuf *buf;
+  int i, id;
+
+  for(i = 0; recovered_count > 0 && i < NQBUF_ID; i++) {
+    id = restore_id;
+    if(recovered[id / 8] & (1 << (id % 8))) {
+      buf = memb_alloc(&bufmem);
+      if(buf == NULL) {
+        PRINTF("queuebuf_swap_restore: could not allocate a queuebuf\n");
+        return NULL;
+      }
+      recovered[id / 8] &= ~(1 << (id % 8));
+      recovered_count--;
+#if QUEUEBUF_DEBUG
+      list_add(queuebuf_list, buf);
+      buf->file = __FILE__;
+      buf->line = __LINE__;
+      buf->time = clock_time();
+#endif /* QUEUEBUF_DEBUG */
+      buf->ram_ptr = NULL;
+      buf->location = IN_CFS;
+      buf->swap_id = id;
+#if QUEUEBUF_STATS
+      ++queuebuf_len;
+#endif /* QUEUEBUF_STATS */
+      return buf;
+    }
+    restore_id = (restore_id + 1) % NQBUF_ID;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Hands a queuebuf from queuebuf_swap_restore() back to the swap
+   without removing it, so that it is restored first next time. */
+void
+queuebuf_swap_putback(struct queuebuf *buf)
+{
+  if(!memb_inmemb(&bufmem, buf) || buf->location != IN_CFS) {
+    return;
+  }
+  recovered[buf->swap_id / 8] |= 1 << (buf->swap_id % 8);
+  recovered_count++;
+  restore_id = buf->swap_id;
+  if(tmpdata_qbuf == buf) {
+    tmpdata_qbuf = NULL;
+  }
+#if QUEUEBUF_STATS
+  --queuebuf_len;
+#endif /* QUEUEBUF_STATS */
+#if QUEUEBUF_DEBUG
+  list_remove(queuebuf_list, buf);
+#endif /* QUEUEBUF_DEBUG */
+  memb_free(&bufmem, buf);
+}
+#endif /* WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT */
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_to_packetbuf(struct queuebuf *b)
 {
@@ -80,6 +80,20 @@
   #define WITH_SWAP 0
 #endif /* QUEUEBUFRAM_CONF_NUM */
 
+/* If QUEUEBUF_CONF_SWAP_PERSISTENT is set, the swap files survive a
+   reboot: queuebuf_init() recovers the queuebufs that were swapped
+   out and not freed, and queuebuf_swap_restore() hands them out
+   again, oldest first. queuebuf_swap_putback() returns a restored
+   queuebuf that could not be used yet. Queuebufs are delivered at least once, since
+   a queuebuf freed shortly before a reboot may be recovered. This
+   requires a file system that does not truncate files opened for
+   writing, such as Coffee. */
+#ifdef QUEUEBUF_CONF_SWAP_PERSISTENT
+#define QUEUEBUF_SWAP_PERSISTENT QUEUEBUF_CONF_SWAP_PERSISTENT
+#else /* QUEUEBUF_CONF_SWAP_PERSISTENT */
+#define QUEUEBUF_SWAP_PERSISTENT 0
+#endif /* QUEUEBUF_CONF_SWAP_PERSISTENT */
+
 #ifdef QUEUEBUF_CONF_DEBUG
 #define QUEUEBUF_DEBUG QUEUEBUF_CONF_DEBUG
 #else /* QUEUEBUF_CONF_DEBUG */
@@ -109,6 +123,11 @@ packetbuf_attr_t queuebuf_attr(struct queuebuf *b, uint8_t type);
 
 void queuebuf_debug_print(void);
 
+#if WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT
+struct queuebuf *queuebuf_swap_restore(void);
+void queuebuf_swap_putback(struct queuebuf *b);
+#endif /* WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT */
+
 #endif /* __QUEUEBUF_H__ */
 
 /** @} */
@@ -17,6 +17,16 @@
  * resolved. It is up to the receiving process to determine if the
  * correct hostname has been found by calling the resolv_lookup()
  * function with the hostname.
+ *
+ * Answers are cached for the time to live given by the DNS server,
+ * and names that do not exist are cached for
+ * RESOLV_CONF_NEGATIVE_TTL seconds, so that a repeated
+ * resolv_query() for the name is answered without a network round
+ * trip. Queries for different names are outstanding at the same
+ * time, and are told apart by their IDs. IPv6 builds ask for AAAA
+ * records and IPv4 builds for A records. The name set with
+ * resolv_set_hostname(), with or without the ".local" suffix, is
+ * answered locally with the address of the node.
  */
 
 /**
@@ -63,6 +73,10 @@
 
 #include "net/tcpip.h"
 #include "net/resolv.h"
+#include "lib/random.h"
+#if UIP_CONF_IPV6
+#include "net/uip-ds6.h"
+#endif /* UIP_CONF_IPV6 */
 #if UIP_UDP
 
 #include <string.h>
@@ -71,33 +85,51 @@
 #define NULL (void *)0
 #endif /* NULL */
 
-#if UIP_CONF_IPV6
-
-/* Currently this implementation only supports IPv4 DNS lookups.
-   Until support for IPv6 is added, dummy functions are used to
-   enable compilation with IPv6.
-*/
-
-process_event_t resolv_event_found;
-
-PROCESS(resolv_process, "DNS resolver");
-
-void resolv_conf(const uip_ipaddr_t *dnsserver) { }
-uip_ipaddr_t *resolv_getserver(void) { return NULL; }
-uip_ipaddr_t *resolv_lookup(const char *name) { return NULL; }
-void resolv_query(const char *name) { }
-
-PROCESS_THREAD(resolv_process, ev, data)
-{
-  PROCESS_BEGIN();
-  resolv_event_found = process_alloc_event();
-  PROCESS_END();
-}
-
-#else /* UIP_CONF_IPV6 */
-
-/** \internal The maximum number of retries when asking for a name. */
-#define MAX_RETRIES 8
+/** \internal The maximum number of times that a query is sent. The
+    time between two queries doubles with every retry. */
+#ifdef RESOLV_CONF_MAX_RETRIES
+#define MAX_RETRIES RESOLV_CONF_MAX_RETRIES
+#else /* RESOLV_CONF_MAX_RETRIES */
+#define MAX_RETRIES 5
+#endif /* RESOLV_CONF_MAX_RETRIES */
+
+/** \internal The bounds of the time, in seconds, that an answer is
+    cached. The lower bound leaves the receivers of the
+    resolv_event_found event time to look up the answer. */
+#ifdef RESOLV_CONF_MIN_TTL
+#define MIN_TTL RESOLV_CONF_MIN_TTL
+#else /* RESOLV_CONF_MIN_TTL */
+#define MIN_TTL 10
+#endif /* RESOLV_CONF_MIN_TTL */
+
+#ifdef RESOLV_CONF_MAX_TTL
+#define MAX_TTL RESOLV_CONF_MAX_TTL
+#else /* RESOLV_CONF_MAX_TTL */
+#define MAX_TTL 86400UL
+#endif /* RESOLV_CONF_MAX_TTL */
+
+/** \internal The time, in seconds, that a name that does not exist,
+    or that has no address of the type that we ask for, is cached. */
+#ifdef RESOLV_CONF_NEGATIVE_TTL
+#define NEGATIVE_TTL RESOLV_CONF_NEGATIVE_TTL
+#else /* RESOLV_CONF_NEGATIVE_TTL */
+#define NEGATIVE_TTL 60
+#endif /* RESOLV_CONF_NEGATIVE_TTL */
+
+/** \internal The maximum length of a hostname, including the
+    terminating zero. */
+#ifdef RESOLV_CONF_MAX_NAME_LENGTH
+#define MAX_NAME_LENGTH RESOLV_CONF_MAX_NAME_LENGTH
+#else /* RESOLV_CONF_MAX_NAME_LENGTH */
+#define MAX_NAME_LENGTH 32
+#endif /* RESOLV_CONF_MAX_NAME_LENGTH */
+
+/** \internal The name of this node, which is answered locally. */
+#ifdef RESOLV_CONF_HOSTNAME
+#define HOSTNAME RESOLV_CONF_HOSTNAME
+#else /* RESOLV_CONF_HOSTNAME */
+#define HOSTNAME "contiki"
+#endif /* RESOLV_CONF_HOSTNAME */
 
 /** \internal The DNS message header. */
 struct dns_hdr {
@@ -120,16 +152,16 @@ struct dns_hdr {
   uint16_t numextrarr;
 };
 
-/** \internal The DNS answer message structure. */
-struct dns_answer {
-  /* DNS answer record starts with either a domain name or a pointer
-     to a name already present somewhere in the packet. */
-  uint16_t type;
-  uint16_t class;
-  uint16_t ttl[2];
-  uint16_t len;
-  uint8_t ipaddr[4];
-};
+/** \internal The record type and class that we ask for. An answer
+    record starts with a name, which is followed by the type, the
+    class, the time to live, the length of the data and the data. */
+#define DNS_CLASS_IN              1
+#if UIP_CONF_IPV6
+#define DNS_TYPE_HOST             28 /* AAAA */
+#else /* UIP_CONF_IPV6 */
+#define DNS_TYPE_HOST             1  /* A */
+#endif /* UIP_CONF_IPV6 */
+#define DNS_ANSWER_LEN            10
 
 struct namemap {
 #define STATE_UNUSED 0
@@ -142,7 +174,9 @@ struct namemap {
   uint8_t retries;
   uint8_t seqno;
   uint8_t err;
-  char name[32];
+  uint16_t id;
+  unsigned long expiration;
+  char name[MAX_NAME_LENGTH];
   uip_ipaddr_t ipaddr;
 };
 
@@ -161,6 +195,8 @@ static struct uip_udp_conn *resolv_conn = NULL;
 
 static struct etimer retry;
 
+static char hostname[MAX_NAME_LENGTH] = HOSTNAME;
+
 process_event_t resolv_event_found;
 
 PROCESS(resolv_process, "DNS resolver");
@@ -171,35 +207,122 @@ enum {
   EVENT_NEW_SERVER=0
 };
 
+/*-----------------------------------------------------------------------------------*/
+static uint16_t
+get16(const uint8_t *p)
+{
+  return ((uint16_t)p[0] << 8) | p[1];
+}
 /*-----------------------------------------------------------------------------------*/
 /** \internal
  * Walk through a compact encoded DNS name and return the end of it.
  *
- * \return The end of the name.
+ * \return The end of the name, or NULL if the name does not end
+ * within the packet.
+ */
+/*-----------------------------------------------------------------------------------*/
+static uint8_t *
+skip_name(uint8_t *query, uint8_t *end)
+{
+  while(query < end) {
+    if(*query == 0) {
+      return query + 1;
+    }
+    if((*query & 0xc0) == 0xc0) {
+      /* Compressed name: a pointer ends the name. */
+      return query + 2;
+    }
+    query += *query + 1;
+  }
+  return NULL;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Check if an encoded DNS name is the same as a hostname.
  */
 /*-----------------------------------------------------------------------------------*/
-static unsigned char *
-parse_name(unsigned char *query)
+static int
+match_name(uint8_t *query, uint8_t *end, const char *name)
 {
-  unsigned char n;
+  uint8_t n;
 
-  do {
+  while(query < end && *query != 0) {
     n = *query++;
-    
-    while(n > 0) {
-      /*      printf("%c", *query);*/
-      ++query;
-      --n;
-    };
-    /*    printf(".");*/
-  } while(*query != 0);
-  /*  printf("\n");*/
-  return query + 1;
+    if(query + n > end) {
+      return 0;
+    }
+    for(; n > 0; --n) {
+      if(*query++ != (uint8_t)*name++) {
+        return 0;
+      }
+    }
+    if(*name == '.') {
+      ++name;
+    } else if(*name != 0) {
+      return 0;
+    }
+  }
+  return *name == 0;
+}
+/*-----------------------------------------------------------------------------------*/
+static int
+is_expired(struct namemap *namemapptr)
+{
+  return (long)(clock_seconds() - namemapptr->expiration) >= 0;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Answer the name of this node without asking the DNS server.
+ *
+ * \return The address of this node, or NULL if the name is not the
+ * name of this node.
+ */
+/*-----------------------------------------------------------------------------------*/
+static uip_ipaddr_t *
+lookup_local(const char *name)
+{
+  static uip_ipaddr_t ipaddr;
+  uint8_t len;
+#if UIP_CONF_IPV6
+  uip_ds6_addr_t *addr;
+#endif /* UIP_CONF_IPV6 */
+
+  len = strlen(hostname);
+  if(len == 0 || strncmp(name, hostname, len) != 0 ||
+     (name[len] != 0 && strcmp(&name[len], ".local") != 0)) {
+    return NULL;
+  }
+
+#if UIP_CONF_IPV6
+  addr = uip_ds6_get_global(ADDR_PREFERRED);
+  if(addr == NULL) {
+    addr = uip_ds6_get_link_local(-1);
+  }
+  if(addr == NULL) {
+    return NULL;
+  }
+  uip_ipaddr_copy(&ipaddr, &addr->ipaddr);
+#else /* UIP_CONF_IPV6 */
+  uip_gethostaddr(&ipaddr);
+#endif /* UIP_CONF_IPV6 */
+  return &ipaddr;
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Check if a query should be sent for an entry.
+ */
+/*-----------------------------------------------------------------------------------*/
+static int
+is_due(struct namemap *namemapptr)
+{
+  return namemapptr->state == STATE_NEW ||
+    (namemapptr->state == STATE_ASKING && namemapptr->tmr == 0);
 }
 /*-----------------------------------------------------------------------------------*/
 /** \internal
- * Runs through the list of names to see if there are any that have
- * not yet been queried and, if so, sends out a query.
+ * Sends out a query for the first entry that is due for one. Only
+ * one packet can be sent for every poll, so we ask to be polled
+ * again if there are more queries to send.
  */
 /*-----------------------------------------------------------------------------------*/
 static void
@@ -210,59 +333,98 @@ check_entries(void)
   uint8_t i;
   uint8_t n;
   register struct namemap *namemapptr;
-  
+
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     namemapptr = &names[i];
-    if(namemapptr->state == STATE_NEW ||
-       namemapptr->state == STATE_ASKING) {
+    if(!is_due(namemapptr)) {
+      continue;
+    }
+
+    if(namemapptr->state == STATE_NEW) {
+      namemapptr->state = STATE_ASKING;
+      namemapptr->retries = 0;
+      namemapptr->id = random_rand();
+    }
+    namemapptr->tmr = 1 << namemapptr->retries;
+    if(etimer_expired(&retry)) {
       etimer_set(&retry, CLOCK_SECOND);
-      if(namemapptr->state == STATE_ASKING) {
-	if(--namemapptr->tmr == 0) {
-	  if(++namemapptr->retries == MAX_RETRIES) {
-	    namemapptr->state = STATE_ERROR;
-	    resolv_found(namemapptr->name, NULL);
-	    continue;
-	  }
-	  namemapptr->tmr = namemapptr->retries;
-	} else {
-	  /*	  printf("Timer %d\n", namemapptr->tmr);*/
-	  /* Its timer has not run out, so we move on to next
-	     entry. */
-	  continue;
-	}
-      } else {
-	namemapptr->state = STATE_ASKING;
-	namemapptr->tmr = 1;
-	namemapptr->retries = 0;
+    }
+
+    hdr = (struct dns_hdr *)uip_appdata;
+    memset(hdr, 0, sizeof(struct dns_hdr));
+    hdr->id = uip_htons(namemapptr->id);
+    hdr->flags1 = DNS_FLAG1_RD;
+    hdr->numquestions = UIP_HTONS(1);
+    query = (char *)uip_appdata + sizeof(struct dns_hdr);
+    nameptr = namemapptr->name;
+    --nameptr;
+    /* Convert hostname into suitable query format. */
+    do {
+      ++nameptr;
+      nptr = query;
+      ++query;
+      for(n = 0; *nameptr != '.' && *nameptr != 0; ++nameptr) {
+        *query = *nameptr;
+        ++query;
+        ++n;
       }
-      hdr = (struct dns_hdr *)uip_appdata;
-      memset(hdr, 0, sizeof(struct dns_hdr));
-      hdr->id = uip_htons(i);
-      hdr->flags1 = DNS_FLAG1_RD;
-      hdr->numquestions = UIP_HTONS(1);
-      query = (char *)uip_appdata + 12;
-      nameptr = namemapptr->name;
-      --nameptr;
-      /* Convert hostname into suitable query format. */
-      do {
-	++nameptr;
-	nptr = query;
-	++query;
-	for(n = 0; *nameptr != '.' && *nameptr != 0; ++nameptr) {
-	  *query = *nameptr;
-	  ++query;
-	  ++n;
-	}
-	*nptr = n;
-      } while(*nameptr != 0);
-      {
-	static unsigned char endquery[] =
-	  {0,0,1,0,1};
-	memcpy(query, endquery, 5);
+      *nptr = n;
+    } while(*nameptr != 0);
+    {
+      static unsigned char endquery[] =
+        {0, DNS_TYPE_HOST >> 8, DNS_TYPE_HOST & 0xff,
+         DNS_CLASS_IN >> 8, DNS_CLASS_IN & 0xff};
+      memcpy(query, endquery, 5);
+    }
+    uip_udp_send((unsigned char)(query + 5 - (char *)uip_appdata));
+
+    for(++i; i < RESOLV_ENTRIES; ++i) {
+      if(is_due(&names[i])) {
+        tcpip_poll_udp(resolv_conn);
+        break;
       }
-      uip_udp_send((unsigned char)(query + 5 - (char *)uip_appdata));
-      break;
     }
+    return;
+  }
+}
+/*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Called once per second while there are outstanding queries.
+ */
+/*-----------------------------------------------------------------------------------*/
+static void
+check_timeouts(void)
+{
+  uint8_t i;
+  uint8_t asking, due;
+  register struct namemap *namemapptr;
+
+  asking = due = 0;
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    namemapptr = &names[i];
+    if(namemapptr->state != STATE_ASKING || namemapptr->tmr == 0) {
+      continue;
+    }
+    if(--namemapptr->tmr == 0) {
+      if(namemapptr->retries + 1 >= MAX_RETRIES) {
+        /* The failure is not cached: the next query for the name
+           asks the DNS server again. */
+        namemapptr->state = STATE_ERROR;
+        namemapptr->expiration = clock_seconds();
+        resolv_found(namemapptr->name, NULL);
+        continue;
+      }
+      ++namemapptr->retries;
+      due = 1;
+    }
+    asking = 1;
+  }
+
+  if(asking) {
+    etimer_set(&retry, CLOCK_SECOND);
+  }
+  if(due && resolv_conn != NULL) {
+    tcpip_poll_udp(resolv_conn);
   }
 }
 /*-----------------------------------------------------------------------------------*/
@@ -273,93 +435,100 @@ check_entries(void)
 static void
 newdata(void)
 {
-  unsigned char *nameptr;
-  struct dns_answer *ans;
+  uint8_t *nameptr, *end;
   struct dns_hdr *hdr;
-  static uint8_t nquestions, nanswers;
-  static uint8_t i;
+  uint16_t nanswers, len;
+  unsigned long ttl;
+  uint8_t i;
   register struct namemap *namemapptr;
-  
+
   hdr = (struct dns_hdr *)uip_appdata;
-  /*  printf("ID %d\n", uip_htons(hdr->id));
-  printf("Query %d\n", hdr->flags1 & DNS_FLAG1_RESPONSE);
-  printf("Error %d\n", hdr->flags2 & DNS_FLAG2_ERR_MASK);
-  printf("Num questions %d, answers %d, authrr %d, extrarr %d\n",
-	 uip_htons(hdr->numquestions),
-	 uip_htons(hdr->numanswers),
-	 uip_htons(hdr->numauthrr),
-	 uip_htons(hdr->numextrarr));
-  */
-
-  /* The ID in the DNS header should be our entry into the name
-     table. */
-  i = (uint8_t)uip_htons(hdr->id);
-  namemapptr = &names[i];
-  if(i < RESOLV_ENTRIES &&
-     namemapptr->state == STATE_ASKING) {
-
-    /* This entry is now finished. */
-    namemapptr->state = STATE_DONE;
-    namemapptr->err = hdr->flags2 & DNS_FLAG2_ERR_MASK;
-
-    /* Check for error. If so, call callback to inform. */
-    if(namemapptr->err != 0) {
-      namemapptr->state = STATE_ERROR;
-      resolv_found(namemapptr->name, NULL);
-      return;
+  end = (uint8_t *)uip_appdata + uip_datalen();
+  if(uip_datalen() < sizeof(struct dns_hdr) ||
+     (hdr->flags1 & DNS_FLAG1_RESPONSE) == 0 ||
+     hdr->numquestions != UIP_HTONS(1)) {
+    return;
+  }
+
+  /* The ID in the DNS header tells which of the outstanding queries
+     this is the answer for. */
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    namemapptr = &names[i];
+    if(namemapptr->state == STATE_ASKING &&
+       namemapptr->id == uip_ntohs(hdr->id)) {
+      break;
+    }
+  }
+  if(i == RESOLV_ENTRIES) {
+    return;
+  }
+
+  /* The question must be the one that we asked, or the answer is for
+     an earlier query that used the same ID. */
+  nameptr = (uint8_t *)uip_appdata + sizeof(struct dns_hdr);
+  if(!match_name(nameptr, end, namemapptr->name)) {
+    return;
+  }
+  nameptr = skip_name(nameptr, end);
+  if(nameptr == NULL) {
+    return;
+  }
+  nameptr += 4;
+
+  /* This entry is now finished. */
+  namemapptr->err = hdr->flags2 & DNS_FLAG2_ERR_MASK;
+
+  /* Check for error. If so, call callback to inform. A name that
+     does not exist is cached, other errors are not. */
+  if(namemapptr->err != 0) {
+    namemapptr->state = STATE_ERROR;
+    namemapptr->expiration = clock_seconds();
+    if(namemapptr->err == DNS_FLAG2_ERR_NAME) {
+      namemapptr->expiration += NEGATIVE_TTL;
     }
+    resolv_found(namemapptr->name, NULL);
+    return;
+  }
 
-    /* We only care about the question(s) and the answers. The authrr
-       and the extrarr are simply discarded. */
-    nquestions = (uint8_t)uip_htons(hdr->numquestions);
-    nanswers = (uint8_t)uip_htons(hdr->numanswers);
-
-    /* Skip the name in the question. XXX: This should really be
-       checked agains the name in the question, to be sure that they
-       match. */
-    nameptr = parse_name((uint8_t *)uip_appdata + 12) + 4;
-
-    while(nanswers > 0) {
-      /* The first byte in the answer resource record determines if it
-	 is a compressed record or a normal one. */
-      if(*nameptr & 0xc0) {
-	/* Compressed name. */
-	nameptr +=2;
-	/*	printf("Compressed anwser\n");*/
-      } else {
-	/* Not compressed name. */
-	nameptr = parse_name((uint8_t *)nameptr);
-      }
+  /* We only care about the question(s) and the answers. The authrr
+     and the extrarr are simply discarded. Answers with CNAME records
+     are skipped until we find an address. */
+  nanswers = uip_ntohs(hdr->numanswers);
+  while(nanswers > 0) {
+    nameptr = skip_name(nameptr, end);
+    if(nameptr == NULL || nameptr + DNS_ANSWER_LEN > end) {
+      break;
+    }
+    ttl = ((unsigned long)get16(nameptr + 4) << 16) | get16(nameptr + 6);
+    len = get16(nameptr + 8);
+    if(nameptr + DNS_ANSWER_LEN + len > end) {
+      break;
+    }
 
-      ans = (struct dns_answer *)nameptr;
-      /*      printf("Answer: type %x, class %x, ttl %x, length %x\n",
-	     uip_htons(ans->type), uip_htons(ans->class), (uip_htons(ans->ttl[0])
-	     << 16) | uip_htons(ans->ttl[1]), uip_htons(ans->len));*/
-
-      /* Check for IP address type and Internet class. Others are
-	 discarded. */
-      if(ans->type == UIP_HTONS(1) &&
-	 ans->class == UIP_HTONS(1) &&
-	 ans->len == UIP_HTONS(4)) {
-	/*	printf("IP address %d.%d.%d.%d\n",
-	       ans->ipaddr[0],
-	       ans->ipaddr[1],
-	       ans->ipaddr[2],
-	       ans->ipaddr[3]);*/
-	/* XXX: we should really check that this IP address is the one
-	   we want. */
-        for(i = 0; i < 4; i++) {
-          namemapptr->ipaddr.u8[i] = ans->ipaddr[i];
-        }
-	
-	resolv_found(namemapptr->name, &namemapptr->ipaddr);
-	return;
-      } else {
-	nameptr = nameptr + 10 + uip_htons(ans->len);
+    if(get16(nameptr) == DNS_TYPE_HOST &&
+       get16(nameptr + 2) == DNS_CLASS_IN &&
+       len == sizeof(uip_ipaddr_t)) {
+      memcpy(&namemapptr->ipaddr, nameptr + DNS_ANSWER_LEN,
+             sizeof(uip_ipaddr_t));
+      if(ttl < MIN_TTL) {
+        ttl = MIN_TTL;
+      } else if(ttl > MAX_TTL) {
+        ttl = MAX_TTL;
       }
-      --nanswers;
+      namemapptr->state = STATE_DONE;
+      namemapptr->expiration = clock_seconds() + ttl;
+      resolv_found(namemapptr->name, &namemapptr->ipaddr);
+      return;
     }
+    nameptr += DNS_ANSWER_LEN + len;
+    --nanswers;
   }
+
+  /* The name exists, but it has no address of the type that we asked
+     for. */
+  namemapptr->state = STATE_ERROR;
+  namemapptr->expiration = clock_seconds() + NEGATIVE_TTL;
+  resolv_found(namemapptr->name, NULL);
 }
 /*-----------------------------------------------------------------------------------*/
 /** \internal
@@ -383,16 +552,15 @@ PROCESS_THREAD(resolv_process, ev, data)
     PROCESS_WAIT_EVENT();
     
     if(ev == PROCESS_EVENT_TIMER) {
-      if(resolv_conn != NULL) {
-        tcpip_poll_udp(resolv_conn);
-      }
+      check_timeouts();
 
     } else if(ev == EVENT_NEW_SERVER) {
       if(resolv_conn != NULL) {
 	uip_udp_remove(resolv_conn);
       }
       resolv_conn = udp_new((uip_ipaddr_t *)data, UIP_HTONS(53), NULL);
-      
+      tcpip_poll_udp(resolv_conn);
+
     } else if(ev == tcpip_event) {
       if(uip_udp_conn->rport == UIP_HTONS(53)) {
 	if(uip_poll()) {
@@ -408,39 +576,99 @@ PROCESS_THREAD(resolv_process, ev, data)
   PROCESS_END();
 }
 /*-----------------------------------------------------------------------------------*/
+/** \internal
+ * Find an entry for a new name: an unused entry or an expired
+ * answer, or else the least recently used answer. Entries with an
+ * outstanding question are never reused, since the process waiting
+ * for the answer would not be told.
+ *
+ * \return The entry, or NULL if all entries have outstanding
+ * questions.
+ */
+/*-----------------------------------------------------------------------------------*/
+static struct namemap *
+new_entry(void)
+{
+  uint8_t i;
+  uint8_t lseq;
+  struct namemap *nameptr, *lru;
+
+  lseq = 0;
+  lru = NULL;
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    nameptr = &names[i];
+    if(nameptr->state == STATE_UNUSED ||
+       ((nameptr->state == STATE_DONE || nameptr->state == STATE_ERROR) &&
+        is_expired(nameptr))) {
+      return nameptr;
+    }
+    if(nameptr->state == STATE_NEW || nameptr->state == STATE_ASKING) {
+      continue;
+    }
+    if(lru == NULL || (uint8_t)(seqno - nameptr->seqno) > lseq) {
+      lseq = seqno - nameptr->seqno;
+      lru = nameptr;
+    }
+  }
+  return lru;
+}
+/*-----------------------------------------------------------------------------------*/
 /**
  * Queues a name so that a question for the name will be sent out.
  *
+ * If the name is in the cache, the resolv_event_found event is
+ * posted right away. If a question for the name is already
+ * outstanding, the event is posted when the answer arrives. The name
+ * of this node, and a name that finds all entries waiting for
+ * answers, are answered right away with name itself as the event
+ * data, so name must stay valid until the event has been delivered.
+ *
  * \param name The hostname that is to be queried.
  */
 /*-----------------------------------------------------------------------------------*/
 void
 resolv_query(const char *name)
 {
-  static uint8_t i;
-  static uint8_t lseq, lseqi;
+  uint8_t i;
   register struct namemap *nameptr;
-      
-  lseq = lseqi = 0;
-  nameptr = 0;                //compiler warning if not initialized
-  
+  uip_ipaddr_t *ipaddr;
+
+  ipaddr = lookup_local(name);
+  if(ipaddr != NULL) {
+    resolv_found((char *)name, ipaddr);
+    return;
+  }
+
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     nameptr = &names[i];
-    if(nameptr->state == STATE_UNUSED) {
+    if(nameptr->state != STATE_UNUSED &&
+       strcmp(name, nameptr->name) == 0) {
       break;
     }
-    if(seqno - nameptr->seqno > lseq) {
-      lseq = seqno - nameptr->seqno;
-      lseqi = i;
-    }
   }
 
-  if(i == RESOLV_ENTRIES) {
-    i = lseqi;
-    nameptr = &names[i];
+  if(i < RESOLV_ENTRIES) {
+    if(nameptr->state == STATE_NEW || nameptr->state == STATE_ASKING) {
+      return;
+    }
+    if(!is_expired(nameptr)) {
+      nameptr->seqno = seqno;
+      ++seqno;
+      resolv_found(nameptr->name, nameptr->state == STATE_DONE ?
+                   &nameptr->ipaddr : NULL);
+      return;
+    }
+  } else {
+    nameptr = new_entry();
+    if(nameptr == NULL) {
+      /* All entries are waiting for answers. */
+      resolv_found((char *)name, NULL);
+      return;
+    }
   }
 
-  strncpy(nameptr->name, name, sizeof(nameptr->name));
+  strncpy(nameptr->name, name, sizeof(nameptr->name) - 1);
+  nameptr->name[sizeof(nameptr->name) - 1] = 0;
   nameptr->state = STATE_NEW;
   nameptr->seqno = seqno;
   ++seqno;
@@ -458,23 +686,32 @@ resolv_query(const char *name)
  * was found. The function resolv_query() can be used to send a query
  * for a hostname.
  *
- * \return A pointer to a 4-byte representation of the hostname's IP
+ * \return A pointer to a representation of the hostname's IP
  * address, or NULL if the hostname was not found in the array of
- * hostnames.
+ * hostnames or if its time to live has passed.
  */
 /*-----------------------------------------------------------------------------------*/
 uip_ipaddr_t *
 resolv_lookup(const char *name)
 {
-  static uint8_t i;
+  uint8_t i;
   struct namemap *nameptr;
-  
+  uip_ipaddr_t *ipaddr;
+
+  ipaddr = lookup_local(name);
+  if(ipaddr != NULL) {
+    return ipaddr;
+  }
+
   /* Walk through the list to see if the name is in there. If it is
      not, we return NULL. */
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     nameptr = &names[i];
     if(nameptr->state == STATE_DONE &&
-       strcmp(name, nameptr->name) == 0) {
+       strcmp(name, nameptr->name) == 0 &&
+       !is_expired(nameptr)) {
+      nameptr->seqno = seqno;
+      ++seqno;
       return &nameptr->ipaddr;
     }
   }
@@ -484,9 +721,9 @@ resolv_lookup(const char *name)
 /**
  * Obtain the currently configured DNS server.
  *
- * \return A pointer to a 4-byte representation of the IP address of
- * the currently configured DNS server or NULL if no DNS server has
- * been configured.
+ * \return A pointer to a representation of the IP address of the
+ * currently configured DNS server or NULL if no DNS server has been
+ * configured.
  */
 /*-----------------------------------------------------------------------------------*/
 uip_ipaddr_t *
@@ -501,8 +738,8 @@ resolv_getserver(void)
 /**
  * Configure a DNS server.
  *
- * \param dnsserver A pointer to a 4-byte representation of the IP
- * address of the DNS server to be configured.
+ * \param dnsserver A pointer to a representation of the IP address of
+ * the DNS server to be configured.
  */
 /*-----------------------------------------------------------------------------------*/
 void
@@ -519,6 +756,32 @@ resolv_conf(const uip_ipaddr_t *dnsserver)
   resolv_conn = udp_new(dnsserver, 53, NULL);*/
 }
 /*-----------------------------------------------------------------------------------*/
+/**
+ * Set the name of this node. Queries and lookups for the name, with
+ * or without the ".local" suffix, are answered with the address of
+ * the node.
+ *
+ * \param name The hostname, or an empty string to answer no names
+ * locally.
+ */
+/*-----------------------------------------------------------------------------------*/
+void
+resolv_set_hostname(const char *name)
+{
+  strncpy(hostname, name, sizeof(hostname) - 1);
+  hostname[sizeof(hostname) - 1] = 0;
+}
+/*-----------------------------------------------------------------------------------*/
+/**
+ * Obtain the name of this node.
+ */
+/*-----------------------------------------------------------------------------------*/
+const char *
+resolv_get_hostname(void)
+{
+  return hostname;
+}
+/*-----------------------------------------------------------------------------------*/
 /** \internal
  * Callback function which is called when a hostname is found.
  *
@@ -530,7 +793,6 @@ resolv_found(char *name, uip_ipaddr_t *ipaddr)
   process_post(PROCESS_BROADCAST, resolv_event_found, name);
 }
 /*-----------------------------------------------------------------------------------*/
-#endif /* UIP_CONF_IPV6 */
 #endif /* UIP_UDP */
 
 /** @} */
@@ -52,6 +52,8 @@ CCIF void resolv_conf(const uip_ipaddr_t *dnsserver);
 CCIF uip_ipaddr_t *resolv_getserver(void);
 CCIF uip_ipaddr_t *resolv_lookup(const char *name);
 CCIF void resolv_query(const char *name);
+void resolv_set_hostname(const char *name);
+const char *resolv_get_hostname(void);
 
 PROCESS_NAME(resolv_process);
 
@@ -76,6 +76,9 @@ struct recent_packet {
   struct collect_conn *conn;
   rimeaddr_t originator;
   uint8_t eseqno;
+#if COLLECT_AGGREGATION
+  uint8_t aggregate;
+#endif /* COLLECT_AGGREGATION */
 };
 
 static struct recent_packet recent_packets[NUM_RECENT_PACKETS];
@@ -91,6 +94,23 @@ struct data_msg_hdr {
   uint16_t rtmetric;
 };
 
+/* The DATA_FLAGS_AGGREGATE flag marks a packet that contains
+   aggregated data packets. Each of the data packets is preceded by an
+   aggregate_hdr that holds the packet attributes and the header flags
+   of the data packet. The originator and the sequence number of the
+   aggregated packet itself are those of the node that aggregated the
+   data, and its flags are those of all the data packets it holds. */
+#define DATA_FLAGS_AGGREGATE            0x80
+
+struct aggregate_hdr {
+  rimeaddr_t originator;
+  uint8_t eseqno, hops, len, flags;
+};
+
+#if COLLECT_AGGREGATION && COLLECT_AGGREGATION_SIZE > PACKETBUF_SIZE
+#error COLLECT_CONF_AGGREGATION_SIZE must not exceed PACKETBUF_SIZE
+#endif
+
 
 /* This is the header of ACK packets. It contains a flags field that
    indicates if the node is congested (ACK_FLAGS_CONGESTED), if the
@@ -189,6 +209,10 @@ struct {
   uint32_t ttldrop;
   uint32_t ackdrop;
   uint32_t timedout;
+
+  uint32_t aggregated;
+  uint32_t aggsent;
+  uint32_t deaggregated;
 } stats;
 
 /* Debug definition: draw routing tree in Cooja. */
@@ -462,6 +486,7 @@ enqueue_dummy_packet(struct collect_conn *c, int rexmits)
 
   /* Allocate space for the header. */
   packetbuf_hdralloc(sizeof(struct data_msg_hdr));
+  memset(packetbuf_hdrptr(), 0, sizeof(struct data_msg_hdr));
 
   n = collect_neighbor_list_find(&c->neighbor_list, &c->parent);
   if(n != NULL) {
@@ -541,6 +566,54 @@ proactive_probing_callback(void *ptr)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT
+/**
+ * This function moves queuebufs that were in the swap when the node
+ * rebooted back onto the send queue, so that packets stored before
+ * the reboot are forwarded once there is a route again. It
+ * overwrites the packetbuf, and is only called when the send queue
+ * has drained.
+ *
+ */
+static void
+restore_swapped_packets(struct collect_conn *c)
+{
+  struct queuebuf *q;
+
+  if(c->rtmetric == RTMETRIC_SINK || c->rtmetric == RTMETRIC_MAX) {
+    return;
+  }
+
+  while(packetqueue_len(&c->send_queue) <
+        MAX_SENDING_QUEUE - MIN_AVAILABLE_QUEUE_ENTRIES &&
+        (q = queuebuf_swap_restore()) != NULL) {
+    queuebuf_to_packetbuf(q);
+
+    /* Queuebufs of other layers, and dummy packets, are dropped. */
+    if(packetbuf_datalen() <= sizeof(struct data_msg_hdr) ||
+       packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT) == 0) {
+      queuebuf_free(q);
+      continue;
+    }
+
+    PRINTF("%d.%d: restored packet %d from %d.%d\n",
+           rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+           packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID),
+           packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[0],
+           packetbuf_addr(PACKETBUF_ADDR_ESENDER)->u8[1]);
+    if(!packetqueue_enqueue_packetbuf(&c->send_queue,
+                                      FORWARD_PACKET_LIFETIME_BASE *
+                                      packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT),
+                                      c)) {
+      /* Keep the packet in the swap until the queue has room. */
+      queuebuf_swap_putback(q);
+      break;
+    }
+    queuebuf_free(q);
+  }
+}
+#endif /* WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT */
+/*---------------------------------------------------------------------------*/
 /**
  * This function is called when a queued packet should be sent
  * out. The function takes the first packet on the output queue, adds
@@ -568,6 +641,13 @@ send_queued_packet(struct collect_conn *c)
 
   /* Grab the first packet on the send queue. */
   i = packetqueue_first(&c->send_queue);
+#if WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT
+  if(i == NULL) {
+    /* The queue has drained, or a route has just been found. */
+    restore_swapped_packets(c);
+    i = packetqueue_first(&c->send_queue);
+  }
+#endif /* WITH_SWAP && QUEUEBUF_SWAP_PERSISTENT */
   if(i == NULL) {
     PRINTF("%d.%d: nothing on queue\n",
            rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1]);
@@ -625,8 +705,8 @@ send_queued_packet(struct collect_conn *c)
       stats.datasent++;
 
       /* Copy our rtmetric into the packet header of the outgoing
-         packet. */
-      memset(&hdr, 0, sizeof(hdr));
+         packet. The flags of the queued packet are kept. */
+      memcpy(&hdr, packetbuf_dataptr(), sizeof(struct data_msg_hdr));
       hdr.rtmetric = c->rtmetric;
       memcpy(packetbuf_dataptr(), &hdr, sizeof(struct data_msg_hdr));
 
@@ -724,8 +804,8 @@ retransmit_current_packet(struct collect_conn *c)
       packetbuf_set_attr(PACKETBUF_ATTR_PACKET_ID, c->seqno);
 
       /* Copy our rtmetric into the packet header of the outgoing
-         packet. */
-      memset(&hdr, 0, sizeof(hdr));
+         packet. The flags of the queued packet are kept. */
+      memcpy(&hdr, packetbuf_dataptr(), sizeof(struct data_msg_hdr));
       hdr.rtmetric = c->rtmetric;
       memcpy(packetbuf_dataptr(), &hdr, sizeof(struct data_msg_hdr));
 
@@ -895,9 +975,258 @@ add_packet_to_recent_packets(struct collect_conn *tc)
     rimeaddr_copy(&recent_packets[recent_packet_ptr].originator,
                   packetbuf_addr(PACKETBUF_ADDR_ESENDER));
     recent_packets[recent_packet_ptr].conn = tc;
+#if COLLECT_AGGREGATION
+    recent_packets[recent_packet_ptr].aggregate =
+      ((struct data_msg_hdr *)packetbuf_dataptr())->flags &
+      DATA_FLAGS_AGGREGATE;
+#endif /* COLLECT_AGGREGATION */
     recent_packet_ptr = (recent_packet_ptr + 1) % NUM_RECENT_PACKETS;
   }
 }
+#if COLLECT_AGGREGATION
+/*---------------------------------------------------------------------------*/
+/**
+ * This function puts the aggregated frame on the send queue and
+ * empties the aggregation buffer. The frame gets our address as
+ * originator and a sequence number of its own, which the next hop
+ * uses for duplicate detection. The function overwrites the packetbuf.
+ */
+static int
+aggregation_flush(struct collect_conn *tc)
+{
+  struct data_msg_hdr hdr;
+  int ret;
+
+  if(tc->aggregation_num == 0) {
+    return 1;
+  }
+  ctimer_stop(&tc->aggregation_timer);
+
+  PRINTF("%d.%d: sending %d aggregated packets, %d bytes\n",
+         rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+         tc->aggregation_num, tc->aggregation_len);
+
+  packetbuf_clear();
+  packetbuf_copyfrom(tc->aggregation_buf, tc->aggregation_len);
+  packetbuf_set_attr(PACKETBUF_ATTR_EPACKET_ID, tc->aggregation_seqno);
+  packetbuf_set_addr(PACKETBUF_ADDR_ESENDER, &rimeaddr_node_addr);
+  packetbuf_set_attr(PACKETBUF_ATTR_HOPS, 1);
+  packetbuf_set_attr(PACKETBUF_ATTR_TTL, MAX_HOPLIM);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_REXMIT, tc->aggregation_rexmits);
+  tc->aggregation_seqno = (tc->aggregation_seqno + 1) %
+    (1 << COLLECT_PACKET_ID_BITS);
+
+  packetbuf_hdralloc(sizeof(struct data_msg_hdr));
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.flags = DATA_FLAGS_AGGREGATE | tc->aggregation_flags;
+  memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct data_msg_hdr));
+
+  ret = packetqueue_enqueue_packetbuf(&tc->send_queue,
+                                      FORWARD_PACKET_LIFETIME_BASE *
+                                      tc->aggregation_rexmits,
+                                      tc);
+  if(ret) {
+    stats.aggsent++;
+  } else {
+    PRINTF("%d.%d: drop %d aggregated packets: no queuebuf\n",
+           rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+           tc->aggregation_num);
+    stats.qdrop += tc->aggregation_num;
+  }
+
+  tc->aggregation_len = 0;
+  tc->aggregation_num = 0;
+  tc->aggregation_rexmits = 0;
+  tc->aggregation_flags = 0;
+
+  if(ret) {
+    send_queued_packet(tc);
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+static void
+aggregation_timeout(void *ptr)
+{
+  aggregation_flush(ptr);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * This function makes sure that len more bytes fit in the
+ * aggregation buffer, by sending the current frame if
+ * necessary. The packet in the packetbuf is preserved.
+ */
+static int
+aggregation_reserve(struct collect_conn *tc, int len)
+{
+  struct queuebuf *q;
+
+  if(len > COLLECT_AGGREGATION_SIZE) {
+    return 0;
+  }
+  if(tc->aggregation_len + len <= COLLECT_AGGREGATION_SIZE) {
+    return 1;
+  }
+
+  q = queuebuf_new_from_packetbuf();
+  if(q == NULL) {
+    return 0;
+  }
+  aggregation_flush(tc);
+  queuebuf_to_packetbuf(q);
+  queuebuf_free(q);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+aggregation_add(struct collect_conn *tc, const struct aggregate_hdr *hdr,
+                const uint8_t *data, uint8_t rexmits)
+{
+  memcpy(&tc->aggregation_buf[tc->aggregation_len], hdr,
+         sizeof(struct aggregate_hdr));
+  tc->aggregation_len += sizeof(struct aggregate_hdr);
+  memcpy(&tc->aggregation_buf[tc->aggregation_len], data, hdr->len);
+  tc->aggregation_len += hdr->len;
+
+  if(rexmits > tc->aggregation_rexmits) {
+    tc->aggregation_rexmits = rexmits;
+  }
+  tc->aggregation_flags |= hdr->flags;
+
+  /* The first packet starts the clock: no packet waits longer than
+     COLLECT_AGGREGATION_DELAY for others to join it. */
+  if(tc->aggregation_num++ == 0) {
+    ctimer_set(&tc->aggregation_timer, COLLECT_AGGREGATION_DELAY,
+               aggregation_timeout, tc);
+  }
+  stats.aggregated++;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * This function adds the data packet in the packetbuf to the
+ * aggregation buffer, without the data_msg_hdr if offset is
+ * non-zero, in which case the flags of the data_msg_hdr are kept in
+ * the aggregate_hdr. It returns zero if the packet is too large to be
+ * aggregated, in which case it should be sent on its own.
+ */
+static int
+aggregate_data(struct collect_conn *tc, int offset)
+{
+  struct aggregate_hdr hdr;
+  int len;
+
+  len = packetbuf_datalen() - offset;
+  if(!aggregation_reserve(tc, sizeof(struct aggregate_hdr) + len)) {
+    return 0;
+  }
+
+  rimeaddr_copy(&hdr.originator, packetbuf_addr(PACKETBUF_ADDR_ESENDER));
+  hdr.eseqno = packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID);
+  hdr.hops = packetbuf_attr(PACKETBUF_ATTR_HOPS);
+  hdr.len = len;
+  hdr.flags = offset == 0 ? 0 :
+    ((struct data_msg_hdr *)packetbuf_dataptr())->flags &
+    ~DATA_FLAGS_AGGREGATE;
+  aggregation_add(tc, &hdr, (uint8_t *)packetbuf_dataptr() + offset,
+                  packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT));
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * This function is called for a data packet that we should forward
+ * to our parent. The hop count of the packet has already been
+ * updated. A packet that is itself an aggregated frame has its
+ * contents moved into our frame, with the hop count of each
+ * aggregated packet updated.
+ */
+static int
+aggregate_forwarded(struct collect_conn *tc, const struct data_msg_hdr *msg)
+{
+  struct aggregate_hdr hdr;
+  uint8_t *data;
+  int len, ptr;
+  uint8_t rexmits;
+
+  len = packetbuf_datalen() - sizeof(struct data_msg_hdr);
+  if(len <= 0) {
+    return 0;
+  }
+  if((msg->flags & DATA_FLAGS_AGGREGATE) == 0) {
+    return aggregate_data(tc, sizeof(struct data_msg_hdr));
+  }
+
+  if(!aggregation_reserve(tc, len)) {
+    return 0;
+  }
+
+  data = (uint8_t *)packetbuf_dataptr() + sizeof(struct data_msg_hdr);
+  rexmits = packetbuf_attr(PACKETBUF_ATTR_MAX_REXMIT);
+  for(ptr = 0; ptr + sizeof(struct aggregate_hdr) <= len;
+      ptr += sizeof(struct aggregate_hdr) + hdr.len) {
+    memcpy(&hdr, &data[ptr], sizeof(struct aggregate_hdr));
+    if(ptr + sizeof(struct aggregate_hdr) + hdr.len > len) {
+      break;
+    }
+    if(hdr.hops >= MAX_HOPLIM) {
+      PRINTF("%d.%d: aggregated packet dropped: hops %d\n",
+             rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+             hdr.hops);
+      stats.ttldrop++;
+      continue;
+    }
+    hdr.hops++;
+    aggregation_add(tc, &hdr, &data[ptr + sizeof(struct aggregate_hdr)],
+                    rexmits);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * This function is called at the sink for an aggregated frame, with
+ * the data_msg_hdr removed. The frame is split up into the original
+ * data packets, for which the receive function is called one at a
+ * time. The sink does not aggregate any packets, so we use its
+ * aggregation buffer to hold the frame.
+ */
+static void
+deaggregate(struct collect_conn *tc)
+{
+  struct aggregate_hdr hdr;
+  int len, ptr;
+
+  len = packetbuf_datalen();
+  if(len > COLLECT_AGGREGATION_SIZE) {
+    PRINTF("%d.%d: aggregated frame too large, %d bytes\n",
+           rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1], len);
+    return;
+  }
+  memcpy(tc->aggregation_buf, packetbuf_dataptr(), len);
+
+  for(ptr = 0; ptr + sizeof(struct aggregate_hdr) <= len;
+      ptr += sizeof(struct aggregate_hdr) + hdr.len) {
+    memcpy(&hdr, &tc->aggregation_buf[ptr], sizeof(struct aggregate_hdr));
+    if(ptr + sizeof(struct aggregate_hdr) + hdr.len > len) {
+      break;
+    }
+
+    packetbuf_clear();
+    packetbuf_copyfrom(&tc->aggregation_buf[ptr + sizeof(struct aggregate_hdr)],
+                       hdr.len);
+    packetbuf_set_addr(PACKETBUF_ADDR_ESENDER, &hdr.originator);
+    packetbuf_set_attr(PACKETBUF_ATTR_EPACKET_ID, hdr.eseqno);
+    packetbuf_set_attr(PACKETBUF_ATTR_HOPS, hdr.hops);
+    stats.deaggregated++;
+
+    PRINTF("%d.%d: sink received aggregated packet %d from %d.%d\n",
+           rimeaddr_node_addr.u8[0], rimeaddr_node_addr.u8[1],
+           hdr.eseqno, hdr.originator.u8[0], hdr.originator.u8[1]);
+
+    if(hdr.len > 0 && tc->cb->recv != NULL) {
+      tc->cb->recv(&hdr.originator, hdr.eseqno, hdr.hops);
+    }
+  }
+}
+#endif /* COLLECT_AGGREGATION */
 /*---------------------------------------------------------------------------*/
 static void
 node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
@@ -949,6 +1278,9 @@ node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
 
     for(i = 0; i < NUM_RECENT_PACKETS; i++) {
       if(recent_packets[i].conn == tc &&
+#if COLLECT_AGGREGATION
+         recent_packets[i].aggregate == (hdr.flags & DATA_FLAGS_AGGREGATE) &&
+#endif /* COLLECT_AGGREGATION */
          recent_packets[i].eseqno == packetbuf_attr(PACKETBUF_ATTR_EPACKET_ID) &&
          rimeaddr_cmp(&recent_packets[i].originator,
                       packetbuf_addr(PACKETBUF_ADDR_ESENDER))) {
@@ -997,6 +1329,12 @@ node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
              from->u8[0], from->u8[1]);
 
       packetbuf_hdrreduce(sizeof(struct data_msg_hdr));
+#if COLLECT_AGGREGATION
+      if(hdr.flags & DATA_FLAGS_AGGREGATE) {
+        deaggregate(tc);
+        return;
+      }
+#endif /* COLLECT_AGGREGATION */
       /* Call receive function. */
       if(packetbuf_datalen() > 0 && tc->cb->recv != NULL) {
         tc->cb->recv(packetbuf_addr(PACKETBUF_ADDR_ESENDER),
@@ -1037,7 +1375,16 @@ node_packet_received(struct unicast_conn *c, const rimeaddr_t *from)
          to inform the sender that the packet was dropped due to
          memory problems. We first check the size of our sending queue
          to ensure that we always have entries for packets that
-         are originated by this node. */
+         are originated by this node. If the packet can be
+         aggregated, it is added to the aggregated frame that we are
+         about to send instead. */
+#if COLLECT_AGGREGATION
+      if(aggregate_forwarded(tc, &hdr)) {
+        add_packet_to_recent_packets(tc);
+        send_ack(tc, &ack_to, ackflags);
+        return;
+      }
+#endif /* COLLECT_AGGREGATION */
       if(packetqueue_len(&tc->send_queue) <= MAX_SENDING_QUEUE - MIN_AVAILABLE_QUEUE_ENTRIES &&
          packetqueue_enqueue_packetbuf(&tc->send_queue,
                                        FORWARD_PACKET_LIFETIME_BASE *
@@ -1279,6 +1626,13 @@ collect_open(struct collect_conn *tc, uint16_t channels,
   tc->is_router = is_router;
   tc->seqno = 10;
   tc->eseqno = 0;
+#if COLLECT_AGGREGATION
+  tc->aggregation_len = 0;
+  tc->aggregation_num = 0;
+  tc->aggregation_rexmits = 0;
+  tc->aggregation_flags = 0;
+  tc->aggregation_seqno = 0;
+#endif /* COLLECT_AGGREGATION */
   LIST_STRUCT_INIT(tc, send_queue_list);
   collect_neighbor_list_new(&tc->neighbor_list);
   tc->send_queue.list = &(tc->send_queue_list);
@@ -1354,6 +1708,13 @@ collect_close(struct collect_conn *tc)
   neighbor_discovery_close(&tc->neighbor_discovery_conn);
 #endif /* COLLECT_ANNOUNCEMENTS */
   unicast_close(&tc->unicast_conn);
+#if COLLECT_AGGREGATION
+  ctimer_stop(&tc->aggregation_timer);
+  tc->aggregation_len = 0;
+  tc->aggregation_num = 0;
+  tc->aggregation_rexmits = 0;
+  tc->aggregation_flags = 0;
+#endif /* COLLECT_AGGREGATION */
   while(packetqueue_first(&tc->send_queue) != NULL) {
     packetqueue_dequeue(&tc->send_queue);
   }
@@ -1372,6 +1733,13 @@ collect_set_sink(struct collect_conn *tc, int should_be_sink)
     while(packetqueue_len(&tc->send_queue) > 0) {
       packetqueue_dequeue(&tc->send_queue);
     }
+#if COLLECT_AGGREGATION
+    ctimer_stop(&tc->aggregation_timer);
+    tc->aggregation_len = 0;
+    tc->aggregation_num = 0;
+    tc->aggregation_rexmits = 0;
+    tc->aggregation_flags = 0;
+#endif /* COLLECT_AGGREGATION */
 
     /* Stop the retransmission timer. */
     ctimer_stop(&tc->retransmission_timer);
@@ -1435,8 +1803,15 @@ collect_send(struct collect_conn *tc, int rexmits)
     return 1;
   } else {
 
+#if COLLECT_AGGREGATION
+    if(packetbuf_datalen() > 0 && aggregate_data(tc, 0)) {
+      return 1;
+    }
+#endif /* COLLECT_AGGREGATION */
+
     /* Allocate space for the header. */
     packetbuf_hdralloc(sizeof(struct data_msg_hdr));
+    memset(packetbuf_hdrptr(), 0, sizeof(struct data_msg_hdr));
 
     if(packetqueue_enqueue_packetbuf(&tc->send_queue,
                                      FORWARD_PACKET_LIFETIME_BASE *
@@ -1522,6 +1897,17 @@ collect_print_stats(void)
          stats.ackrecv, stats.badack, stats.duprecv,
          stats.qdrop, stats.rtdrop, stats.ttldrop, stats.ackdrop,
          stats.timedout);
+#if COLLECT_AGGREGATION
+  PRINTF("collect stats aggregated %lu aggsent %lu deaggregated %lu\n",
+         stats.aggregated, stats.aggsent, stats.deaggregated);
+#endif /* COLLECT_AGGREGATION */
+}
+/*---------------------------------------------------------------------------*/
+void
+collect_aggregation_stats(uint32_t *packets, uint32_t *frames)
+{
+  *packets = stats.aggregated;
+  *frames = stats.aggsent;
 }
 /*---------------------------------------------------------------------------*/
 /** @} */
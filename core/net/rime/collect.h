@@ -93,6 +93,31 @@ struct collect_callbacks {
 #define COLLECT_ANNOUNCEMENTS COLLECT_CONF_ANNOUNCEMENTS
 #endif /* COLLECT_CONF_ANNOUNCEMENTS */
 
+/* COLLECT_CONF_AGGREGATION enables the aggregation of data packets:
+   small packets headed for the same parent are coalesced into one
+   frame, which is split up into the original packets at the
+   sink. COLLECT_CONF_AGGREGATION_SIZE is the maximum size of the
+   aggregated data in a frame and COLLECT_CONF_AGGREGATION_DELAY is
+   the maximum time that a packet waits for other packets to join
+   it. */
+#ifdef COLLECT_CONF_AGGREGATION
+#define COLLECT_AGGREGATION COLLECT_CONF_AGGREGATION
+#else /* COLLECT_CONF_AGGREGATION */
+#define COLLECT_AGGREGATION 0
+#endif /* COLLECT_CONF_AGGREGATION */
+
+#ifdef COLLECT_CONF_AGGREGATION_SIZE
+#define COLLECT_AGGREGATION_SIZE COLLECT_CONF_AGGREGATION_SIZE
+#else /* COLLECT_CONF_AGGREGATION_SIZE */
+#define COLLECT_AGGREGATION_SIZE 80
+#endif /* COLLECT_CONF_AGGREGATION_SIZE */
+
+#ifdef COLLECT_CONF_AGGREGATION_DELAY
+#define COLLECT_AGGREGATION_DELAY COLLECT_CONF_AGGREGATION_DELAY
+#else /* COLLECT_CONF_AGGREGATION_DELAY */
+#define COLLECT_AGGREGATION_DELAY (CLOCK_SECOND * 2)
+#endif /* COLLECT_CONF_AGGREGATION_DELAY */
+
 struct collect_conn {
   struct unicast_conn unicast_conn;
 #if ! COLLECT_ANNOUNCEMENTS
@@ -120,6 +145,14 @@ struct collect_conn {
   uint8_t is_router;
 
   clock_time_t send_time;
+
+#if COLLECT_AGGREGATION
+  struct ctimer aggregation_timer;
+  uint8_t aggregation_buf[COLLECT_AGGREGATION_SIZE];
+  uint16_t aggregation_len;
+  uint8_t aggregation_num, aggregation_flags;
+  uint8_t aggregation_rexmits, aggregation_seqno;
+#endif /* COLLECT_AGGREGATION */
 };
 
 enum {
@@ -143,6 +176,11 @@ void collect_set_keepalive(struct collect_conn *c, clock_time_t period);
 
 void collect_print_stats(void);
 
+/* Get the number of data packets that were sent as part of an
+   aggregated frame, and the number of aggregated frames that were
+   sent. The difference is the number of transmissions saved. */
+void collect_aggregation_stats(uint32_t *packets, uint32_t *frames);
+
 #define COLLECT_MAX_DEPTH (COLLECT_LINK_ESTIMATE_UNIT * 64 - 1)
 
 #endif /* __COLLECT_H__ */
@@ -43,6 +43,23 @@
 #define RPL_CONF_STATS 0
 #endif /* RPL_CONF_STATS */
 
+/*
+ * With statistics enabled, parent switches, rank changes and repairs
+ * are kept in a log of the last RPL_STATS_EVENTS events, and the last
+ * RPL_STATS_LINK_METRIC_HISTORY link metrics of every parent are kept.
+ */
+#ifdef RPL_CONF_STATS_EVENTS
+#define RPL_STATS_EVENTS               RPL_CONF_STATS_EVENTS
+#else
+#define RPL_STATS_EVENTS               16
+#endif /* RPL_CONF_STATS_EVENTS */
+
+#ifdef RPL_CONF_STATS_LINK_METRIC_HISTORY
+#define RPL_STATS_LINK_METRIC_HISTORY  RPL_CONF_STATS_LINK_METRIC_HISTORY
+#else
+#define RPL_STATS_LINK_METRIC_HISTORY  4
+#endif /* RPL_CONF_STATS_LINK_METRIC_HISTORY */
+
 /* 
  * Select routing metric supported at runtime. This must be a valid
  * DAG Metric Container Object Type (see below). Currently, we only 
@@ -57,7 +74,8 @@
 /*
  * The objective function used by RPL is configurable through the 
  * RPL_CONF_OF parameter. This should be defined to be the name of an 
- * rpl_of_t object linked into the system image, e.g., rpl_of0.
+ * rpl_of_t object linked into the system image, e.g., rpl_of0, or
+ * rpl_of_etx_probing together with RPL_CONF_WITH_PROBING.
  */
 #ifdef RPL_CONF_OF
 #define RPL_OF RPL_CONF_OF
@@ -154,4 +172,129 @@
 #define RPL_DIO_REDUNDANCY          10
 #endif
 
+/* DAG Mode of Operation */
+#define RPL_MOP_NO_DOWNWARD_ROUTES      0
+#define RPL_MOP_NON_STORING             1
+#define RPL_MOP_STORING_NO_MULTICAST    2
+#define RPL_MOP_STORING_MULTICAST       3
+
+/*
+ * The mode of operation of the DAGs. All nodes of a network must be
+ * built with the same mode, since DIOs announcing another mode are
+ * ignored.
+ */
+#ifdef  RPL_CONF_MOP
+#define RPL_MOP_DEFAULT                 RPL_CONF_MOP
+#else
+#define RPL_MOP_DEFAULT                 RPL_MOP_STORING_NO_MULTICAST
+#endif
+
+/*
+ * In non-storing mode, nodes send their DAOs directly to the DAG root
+ * and keep no downward routes. The root stores one child-parent link
+ * per node and inserts a source routing header (RFC 6554) in every
+ * packet that it sends down the DAG.
+ */
+#define RPL_WITH_NON_STORING (RPL_MOP_DEFAULT == RPL_MOP_NON_STORING)
+
+/*
+ * Number of child-parent links that the root can store. The links are
+ * allocated on every node, but only the root uses them, so the default
+ * is minimal and border routers configure one link per node of the DAG.
+ */
+#ifdef RPL_CONF_NS_LINK_NUM
+#define RPL_NS_LINK_NUM             RPL_CONF_NS_LINK_NUM
+#else
+#define RPL_NS_LINK_NUM             1
+#endif
+
+/* Maximum number of hops that the root puts in a source route. */
+#ifdef RPL_CONF_NS_MAX_DEPTH
+#define RPL_NS_MAX_DEPTH            RPL_CONF_NS_MAX_DEPTH
+#else
+#define RPL_NS_MAX_DEPTH            8
+#endif
+
+/*
+ * Multicast forwarding. Packets sent to a multicast group with a scope
+ * wider than link-local are flooded through the DAG: every router
+ * rebroadcasts a new packet a few times according to a Trickle timer,
+ * and suppresses its transmissions when it hears enough copies from its
+ * neighbors (MPL-style proactive forwarding, RFC 7731).
+ */
+#ifdef RPL_CONF_MULTICAST
+#define RPL_WITH_MULTICAST          RPL_CONF_MULTICAST
+#else
+#define RPL_WITH_MULTICAST          0
+#endif
+
+/* Number of multicast packets that can be buffered for forwarding. */
+#ifdef RPL_CONF_MCAST_BUFFER_NUM
+#define RPL_MCAST_BUFFER_NUM        RPL_CONF_MCAST_BUFFER_NUM
+#else
+#define RPL_MCAST_BUFFER_NUM        2
+#endif
+
+/* Largest multicast packet that is forwarded. */
+#ifdef RPL_CONF_MCAST_BUFFER_SIZE
+#define RPL_MCAST_BUFFER_SIZE       RPL_CONF_MCAST_BUFFER_SIZE
+#else
+#define RPL_MCAST_BUFFER_SIZE       128
+#endif
+
+/* Number of recently seen packets remembered for duplicate detection. */
+#ifdef RPL_CONF_MCAST_SEEN_NUM
+#define RPL_MCAST_SEEN_NUM          RPL_CONF_MCAST_SEEN_NUM
+#else
+#define RPL_MCAST_SEEN_NUM          8
+#endif
+
+/*
+ * Trickle parameters of the forwarding: the minimum interval in clock
+ * ticks, the number of interval doublings, the redundancy constant and
+ * the number of intervals after which a packet is no longer sent.
+ */
+#ifdef RPL_CONF_MCAST_IMIN
+#define RPL_MCAST_IMIN              RPL_CONF_MCAST_IMIN
+#else
+#define RPL_MCAST_IMIN              (CLOCK_SECOND / 4)
+#endif
+
+#ifdef RPL_CONF_MCAST_DOUBLINGS
+#define RPL_MCAST_DOUBLINGS         RPL_CONF_MCAST_DOUBLINGS
+#else
+#define RPL_MCAST_DOUBLINGS         2
+#endif
+
+#ifdef RPL_CONF_MCAST_REDUNDANCY
+#define RPL_MCAST_REDUNDANCY        RPL_CONF_MCAST_REDUNDANCY
+#else
+#define RPL_MCAST_REDUNDANCY        1
+#endif
+
+#ifdef RPL_CONF_MCAST_EXPIRATIONS
+#define RPL_MCAST_EXPIRATIONS       RPL_CONF_MCAST_EXPIRATIONS
+#else
+#define RPL_MCAST_EXPIRATIONS       3
+#endif
+
+/*
+ * Active probing of the parent set. Every RPL_PROBING_INTERVAL seconds
+ * (with jitter), the parent whose link metric has gone longest without
+ * an update is sent a unicast DIS, so that the link estimator also
+ * learns about the parents that carry no traffic. The rpl_of_etx_probing
+ * objective function requires probing.
+ */
+#ifdef RPL_CONF_WITH_PROBING
+#define RPL_WITH_PROBING            RPL_CONF_WITH_PROBING
+#else
+#define RPL_WITH_PROBING            0
+#endif
+
+#ifdef RPL_CONF_PROBING_INTERVAL
+#define RPL_PROBING_INTERVAL        RPL_CONF_PROBING_INTERVAL
+#else
+#define RPL_PROBING_INTERVAL        60
+#endif
+
 #endif /* RPL_CONF_H */
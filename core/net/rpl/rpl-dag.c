@@ -502,6 +502,16 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
   p->link_metric = INITIAL_LINK_METRIC;
   memcpy(&p->mc, &dio->mc, sizeof(p->mc));
   list_add(dag->parents, p);
+#if RPL_WITH_PROBING
+  /* Make the new parent the first probing target. */
+  p->last_metric_update = clock_seconds() - RPL_PROBING_INTERVAL;
+  p->link_metric_dev = NEIGHBOR_INFO_ETX_DIVISOR;
+#endif /* RPL_WITH_PROBING */
+#if RPL_CONF_STATS
+  memset(p->link_metric_history, 0, sizeof(p->link_metric_history));
+  p->link_metric_next = 0;
+  rpl_stats_event(RPL_STATS_EVENT_PARENT_ADD, addr, dag->rank, p->rank);
+#endif /* RPL_CONF_STATS */
   return p;
 }
 /************************************************************************/
@@ -629,6 +639,9 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
     PRINTF("RPL: Changed preferred parent, rank changed from %u to %u\n",
   	(unsigned)old_rank, best_dag->rank);
     RPL_STAT(rpl_stats.parent_switch++);
+    RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_PARENT_SWITCH,
+                             &best_dag->preferred_parent->addr,
+                             old_rank, best_dag->rank));
     if(instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
       if(last_parent != NULL) {
         /* Send a No-Path DAO to the removed preferred parent. */
@@ -642,6 +655,11 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
   } else if(best_dag->rank != old_rank) {
     PRINTF("RPL: Preferred parent update, rank changed from %u to %u\n",
   	(unsigned)old_rank, best_dag->rank);
+    RPL_STAT(rpl_stats.rank_changes++);
+    RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_RANK,
+                             best_dag->preferred_parent == NULL ? NULL :
+                             &best_dag->preferred_parent->addr,
+                             old_rank, best_dag->rank));
   }
   return best_dag;
 }
@@ -678,6 +696,8 @@ rpl_remove_parent(rpl_dag_t *dag, rpl_parent_t *parent)
   PRINT6ADDR(&parent->addr);
   PRINTF("\n");
 
+  RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_PARENT_REMOVE, &parent->addr,
+                           parent->rank, INFINITE_RANK));
   list_remove(dag->parents, parent);
   memb_free(&parent_memb, parent);
 }
@@ -863,6 +883,8 @@ rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio)
   PRINTF("\n");
 
   ANNOTATE("#A join=%u\n", dag->dag_id.u8[sizeof(dag->dag_id) - 1]);
+  RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_JOIN, from,
+                           INFINITE_RANK, dag->rank));
 
   rpl_reset_dio_timer(instance);
   rpl_set_default_route(instance, from);
@@ -949,6 +971,8 @@ rpl_add_dag(uip_ipaddr_t *from, rpl_dio_t *dio)
   PRINTF("\n");
 
   ANNOTATE("#A join=%u\n", dag->dag_id.u8[sizeof(dag->dag_id) - 1]);
+  RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_JOIN, from,
+                           INFINITE_RANK, dag->rank));
 
   rpl_process_parent_event(instance, p);
   p->dtsn = dio->dtsn;
@@ -980,6 +1004,8 @@ global_repair(uip_ipaddr_t *from, rpl_dag_t *dag, rpl_dio_t *dio)
          dag->version, dag->rank);
 
   RPL_STAT(rpl_stats.global_repairs++);
+  RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_GLOBAL_REPAIR, from,
+                           INFINITE_RANK, dag->rank));
 }
 /************************************************************************/
 void
@@ -998,6 +1024,8 @@ rpl_local_repair(rpl_instance_t *instance)
   rpl_reset_dio_timer(instance);
 
   RPL_STAT(rpl_stats.local_repairs++);
+  RPL_STAT(rpl_stats_event(RPL_STATS_EVENT_LOCAL_REPAIR, NULL,
+                           INFINITE_RANK, INFINITE_RANK));
 }
 /************************************************************************/
 void
@@ -293,3 +293,216 @@ rpl_invert_header(void)
   }
 }
 /************************************************************************/
+#if RPL_WITH_NON_STORING
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+
+/* RPL Source Routing Header, RFC 6554. */
+#define RPL_RH_TYPE_SRH           3
+#define RPL_SRH_LEN               8
+#define RPL_SRH_CMPR(hdr)         (((uint8_t *)(hdr))[4])
+#define RPL_SRH_PAD(hdr)          (((uint8_t *)(hdr))[5])
+#define RPL_SRH_ADDRESSES(hdr)    (&((uint8_t *)(hdr))[RPL_SRH_LEN])
+/************************************************************************/
+static struct uip_routing_hdr *
+find_srh(void)
+{
+  uint8_t *next;
+  struct uip_ext_hdr *ext;
+  int offset;
+
+  /* The SRH may follow a hop-by-hop options header. */
+  next = &UIP_IP_BUF->proto;
+  offset = UIP_LLH_LEN + UIP_IPH_LEN;
+  while(*next == UIP_PROTO_HBHO || *next == UIP_PROTO_DESTO) {
+    ext = (struct uip_ext_hdr *)&uip_buf[offset];
+    next = &ext->next;
+    offset += (ext->len << 3) + 8;
+    if(offset >= uip_len + UIP_LLH_LEN) {
+      return NULL;
+    }
+  }
+  if(*next == UIP_PROTO_ROUTING &&
+     ((struct uip_routing_hdr *)&uip_buf[offset])->routing_type == RPL_RH_TYPE_SRH) {
+    return (struct uip_routing_hdr *)&uip_buf[offset];
+  }
+  return NULL;
+}
+/************************************************************************/
+static void
+set_link_local_next_hop(uip_ipaddr_t *nexthop, uip_ipaddr_t *addr)
+{
+  /* All nodes of the DAG derive their addresses from the same IID. */
+  uip_ip6addr(nexthop, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  memcpy(&nexthop->u8[8], &addr->u8[8], 8);
+}
+/************************************************************************/
+static int
+insert_srh(uip_ipaddr_t **path, int hops)
+{
+  struct uip_routing_hdr *rh;
+  uint8_t *addresses;
+  uint8_t cmpr;
+  uint8_t pad;
+  uint8_t temp_len;
+  int srh_len;
+  int i;
+
+  /*
+   * The IPv6 destination becomes the first hop, path[hops - 1], and the
+   * remaining hops, down to the target, are put in the header. All
+   * addresses are elided by the prefix that they share with the first
+   * hop.
+   */
+  cmpr = 15;
+  for(i = 0; i < hops - 1; i++) {
+    uint8_t common;
+    for(common = 0; common < cmpr &&
+          path[i]->u8[common] == path[hops - 1]->u8[common]; common++);
+    cmpr = common;
+  }
+
+  srh_len = RPL_SRH_LEN + (hops - 1) * (16 - cmpr);
+  pad = (8 - (srh_len & 7)) & 7;
+  srh_len += pad;
+
+  if(uip_len + srh_len > UIP_LINK_MTU ||
+     uip_len + srh_len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long for a source routing header\n");
+    return 0;
+  }
+
+  /* The hop-by-hop RPL option is not needed on a source route. */
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    rpl_remove_header();
+  }
+  uip_ext_len = 0;
+
+  memmove(&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + srh_len],
+          &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN], uip_len - UIP_IPH_LEN);
+
+  rh = UIP_RH_BUF;
+  memset(rh, 0, srh_len);
+  rh->next = UIP_IP_BUF->proto;
+  rh->len = (srh_len >> 3) - 1;
+  rh->routing_type = RPL_RH_TYPE_SRH;
+  rh->seg_left = hops - 1;
+  RPL_SRH_CMPR(rh) = (cmpr << 4) | cmpr;
+  RPL_SRH_PAD(rh) = pad << 4;
+
+  addresses = RPL_SRH_ADDRESSES(rh);
+  for(i = hops - 2; i >= 0; i--) {
+    memcpy(addresses, &path[i]->u8[cmpr], 16 - cmpr);
+    addresses += 16 - cmpr;
+  }
+
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, path[hops - 1]);
+  uip_len += srh_len;
+  uip_ext_len = srh_len;
+  temp_len = UIP_IP_BUF->len[1];
+  UIP_IP_BUF->len[1] += srh_len;
+  if(UIP_IP_BUF->len[1] < temp_len) {
+    UIP_IP_BUF->len[0]++;
+  }
+
+  return 1;
+}
+/************************************************************************/
+int
+rpl_srh_route(uip_ipaddr_t *nexthop)
+{
+  rpl_dag_t *dag;
+  uip_ipaddr_t *path[RPL_NS_MAX_DEPTH];
+  int hops;
+
+  /* Forward packets that already have a source route to the next hop. */
+  if(find_srh() != NULL) {
+    set_link_local_next_hop(nexthop, &UIP_IP_BUF->destipaddr);
+    return 1;
+  }
+
+  if(default_instance == NULL || default_instance->current_dag == NULL ||
+     default_instance->mop != RPL_MOP_NON_STORING) {
+    return 0;
+  }
+  dag = default_instance->current_dag;
+  if(!dag->joined || dag->rank != ROOT_RANK(default_instance)) {
+    return 0;
+  }
+
+  hops = rpl_ns_get_path(dag, &UIP_IP_BUF->destipaddr, path, RPL_NS_MAX_DEPTH);
+  if(hops <= 0) {
+    return 0;
+  }
+
+  if(hops > 1 && !insert_srh(path, hops)) {
+    return 0;
+  }
+
+  PRINTF("RPL: Source routing over %d hops to ", hops);
+  PRINT6ADDR(path[0]);
+  PRINTF("\n");
+
+  set_link_local_next_hop(nexthop, &UIP_IP_BUF->destipaddr);
+  return 1;
+}
+/************************************************************************/
+int
+rpl_process_srh_header(void)
+{
+  struct uip_routing_hdr *rh;
+  uint8_t *address;
+  uint8_t cmpri, cmpre, cmpr;
+  uint8_t tmp;
+  int size;
+  int n;
+  int i;
+
+  rh = UIP_RH_BUF;
+  if(rh->routing_type != RPL_RH_TYPE_SRH) {
+    return 0;
+  }
+
+  cmpri = RPL_SRH_CMPR(rh) >> 4;
+  cmpre = RPL_SRH_CMPR(rh) & 0x0f;
+  size = ((rh->len + 1) << 3) - RPL_SRH_LEN - (RPL_SRH_PAD(rh) >> 4) -
+    (16 - cmpre);
+  if(size < 0 || size % (16 - cmpri) != 0) {
+    PRINTF("RPL: Malformed source routing header\n");
+    return 0;
+  }
+  n = size / (16 - cmpri) + 1;
+  if(rh->seg_left > n) {
+    PRINTF("RPL: Bad segments left in source routing header\n");
+    return 0;
+  }
+
+  i = n - rh->seg_left;
+  cmpr = i == n - 1 ? cmpre : cmpri;
+  address = RPL_SRH_ADDRESSES(rh) + i * (16 - cmpri);
+
+  if(cmpr == 0 && address[0] == 0xff) {
+    PRINTF("RPL: Multicast address in source routing header\n");
+    return 0;
+  }
+
+  /* Swap the destination address with the next address of the route. */
+  rh->seg_left--;
+  for(i = cmpr; i < 16; i++) {
+    tmp = UIP_IP_BUF->destipaddr.u8[i];
+    UIP_IP_BUF->destipaddr.u8[i] = address[i - cmpr];
+    address[i - cmpr] = tmp;
+  }
+
+  if(uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr)) {
+    PRINTF("RPL: Loop in source routing header\n");
+    return 0;
+  }
+
+  PRINTF("RPL: Source routing to ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("\n");
+  return 1;
+}
+/************************************************************************/
+#endif /* RPL_WITH_NON_STORING */
@@ -197,6 +197,7 @@ dis_output(uip_ipaddr_t *addr)
   PRINTF("\n");
 
   uip_icmp6_send(addr, ICMP6_RPL, RPL_CODE_DIS, 2);
+  RPL_STAT(rpl_stats.dis_sent++);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -542,6 +543,7 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
     uip_icmp6_send(uc_addr, ICMP6_RPL, RPL_CODE_DIO, pos);
   }
 #endif /* RPL_LEAF_ONLY */
+  RPL_STAT(rpl_stats.dio_sent++);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -560,15 +562,24 @@ dao_input(void)
   uint8_t pathcontrol;
   uint8_t pathsequence;
   uip_ipaddr_t prefix;
-  uip_ds6_route_t *rep;
   uint8_t buffer_length;
   int pos;
   int len;
   int i;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t parent_addr;
+  int parent_present;
+  rpl_ns_node_t *node;
+#else
+  uip_ds6_route_t *rep;
   int learned_from;
   rpl_parent_t *p;
+#endif /* RPL_WITH_NON_STORING */
 
   prefixlen = 0;
+#if RPL_WITH_NON_STORING
+  parent_present = 0;
+#endif /* RPL_WITH_NON_STORING */
 
   uip_ipaddr_copy(&dao_sender_addr, &UIP_IP_BUF->srcipaddr);
 
@@ -632,7 +643,13 @@ dao_input(void)
       pathcontrol = buffer[i + 3];
       pathsequence = buffer[i + 4];
       lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
+#if RPL_WITH_NON_STORING
+      /* Non-storing DAOs carry the address of the parent. */
+      if(buffer[i + 1] >= 4 + sizeof(parent_addr)) {
+        memcpy(&parent_addr, buffer + i + 6, sizeof(parent_addr));
+        parent_present = 1;
+      }
+#endif /* RPL_WITH_NON_STORING */
       break;
     }
   }
@@ -642,6 +659,38 @@ dao_input(void)
   PRINT6ADDR(&prefix);
   PRINTF("\n");
 
+#if RPL_WITH_NON_STORING
+  if(dag->rank != ROOT_RANK(instance)) {
+    PRINTF("RPL: Ignoring a non-storing DAO at a non-root node\n");
+    return;
+  }
+  if(!parent_present) {
+    PRINTF("RPL: Ignoring a non-storing DAO without a parent address\n");
+    return;
+  }
+
+  if(lifetime == RPL_ZERO_LIFETIME) {
+    PRINTF("RPL: No-Path DAO, removing the link of ");
+    PRINT6ADDR(&prefix);
+    PRINTF("\n");
+    node = rpl_ns_get_node(dag, &prefix);
+    if(node != NULL) {
+      rpl_ns_remove_node(node);
+    }
+    return;
+  }
+
+  if(rpl_ns_update_node(dag, &prefix, &parent_addr,
+                        RPL_LIFETIME(instance, lifetime)) == NULL) {
+    RPL_STAT(rpl_stats.mem_overflows++);
+    PRINTF("RPL: Could not add a link after receiving a DAO\n");
+    return;
+  }
+
+  if(flags & RPL_DAO_K_FLAG) {
+    dao_ack_output(instance, &dao_sender_addr, sequence);
+  }
+#else /* RPL_WITH_NON_STORING */
   rep = uip_ds6_route_lookup(&prefix);
 
   if(lifetime == RPL_ZERO_LIFETIME) {
@@ -690,11 +739,13 @@ dao_input(void)
       PRINTF("\n");
       uip_icmp6_send(&dag->preferred_parent->addr,
                      ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+      RPL_STAT(rpl_stats.dao_sent++);
     }
     if(flags & RPL_DAO_K_FLAG) {
       dao_ack_output(instance, &dao_sender_addr, sequence);
     }
   }
+#endif /* RPL_WITH_NON_STORING */
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -705,6 +756,10 @@ dao_output(rpl_parent_t *n, uint8_t lifetime)
   unsigned char *buffer;
   uint8_t prefixlen;
   uip_ipaddr_t prefix;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t parent_addr;
+#endif /* RPL_WITH_NON_STORING */
+  uip_ipaddr_t *dest;
   int pos;
 
   /* Destination Advertisement Object */
@@ -753,19 +808,40 @@ dao_output(rpl_parent_t *n, uint8_t lifetime)
 
   /* Create a transit information sub-option. */
   buffer[pos++] = RPL_OPTION_TRANSIT;
+#if RPL_WITH_NON_STORING
+  buffer[pos++] = 4 + sizeof(parent_addr);
+#else
   buffer[pos++] = 4;
+#endif /* RPL_WITH_NON_STORING */
   buffer[pos++] = 0; /* flags - ignored */
   buffer[pos++] = 0; /* path control - ignored */
   buffer[pos++] = 0; /* path seq - ignored */
   buffer[pos++] = lifetime;
 
+#if RPL_WITH_NON_STORING
+  /*
+   * The DAO goes directly to the root, which needs the global address
+   * of the parent to build source routes. The parent uses the prefix
+   * of the DAG together with the interface identifier of its
+   * link-local address.
+   */
+  memcpy(&parent_addr, &dag->prefix_info.prefix, 8);
+  memcpy(&parent_addr.u8[8], &n->addr.u8[8], 8);
+  memcpy(buffer + pos, &parent_addr, sizeof(parent_addr));
+  pos += sizeof(parent_addr);
+  dest = &dag->dag_id;
+#else
+  dest = &n->addr;
+#endif /* RPL_WITH_NON_STORING */
+
   PRINTF("RPL: Sending DAO with prefix ");
   PRINT6ADDR(&prefix);
   PRINTF(" to ");
-  PRINT6ADDR(&n->addr);
+  PRINT6ADDR(dest);
   PRINTF("\n");
 
-  uip_icmp6_send(&n->addr, ICMP6_RPL, RPL_CODE_DAO, pos);
+  uip_icmp6_send(dest, ICMP6_RPL, RPL_CODE_DAO, pos);
+  RPL_STAT(rpl_stats.dao_sent++);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -815,12 +891,15 @@ uip_rpl_input(void)
   PRINTF("Received an RPL control message\n");
   switch(UIP_ICMP_BUF->icode) {
   case RPL_CODE_DIO:
+    RPL_STAT(rpl_stats.dio_recv++);
     dio_input();
     break;
   case RPL_CODE_DIS:
+    RPL_STAT(rpl_stats.dis_recv++);
     dis_input();
     break;
   case RPL_CODE_DAO:
+    RPL_STAT(rpl_stats.dao_recv++);
     dao_input();
     break;
   case RPL_CODE_DAO_ACK:
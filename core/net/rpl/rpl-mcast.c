@@ -0,0 +1,333 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         Trickle-based multicast forwarding over RPL DAGs.
+ *
+ *         A node that joined a DAG rebroadcasts every new packet sent to
+ *         a multicast group wider than link-local scope. The
+ *         retransmissions follow a Trickle timer per packet, so that
+ *         dense neighborhoods send few copies while lossy links still
+ *         get the packet through. Duplicates are recognized by an
+ *         FNV-1a hash of the source address and the IP payload, since
+ *         the packets carry no sequence number.
+ */
+
+#include "net/uip.h"
+#include "net/tcpip.h"
+#include "net/uip-ds6.h"
+#include "net/rpl/rpl-private.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "lib/random.h"
+#include "sys/ctimer.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if RPL_WITH_MULTICAST
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/* Multicast scope, RFC 4291. Link-local packets are never forwarded. */
+#define MCAST_SCOPE(addr)     ((addr)->u8[1] & 0x0f)
+#define MCAST_SCOPE_LINK      2
+
+#define RPL_MCAST_IMAX        (RPL_MCAST_IMIN << RPL_MCAST_DOUBLINGS)
+
+/* 32-bit FNV-1a parameters for the packet fingerprint. */
+#define FNV_OFFSET_BASIS      2166136261UL
+#define FNV_PRIME             16777619UL
+
+/* Position of the checksum field in the transport headers. */
+#define UDP_CHKSUM_OFFSET     6
+#define ICMP6_CHKSUM_OFFSET   2
+
+struct mcast_packet {
+  struct mcast_packet *next;
+  struct ctimer timer;
+  uint32_t fingerprint;
+  clock_time_t interval;
+  clock_time_t remaining;
+  uint8_t counter;
+  uint8_t expirations;
+  uint16_t len;
+  uint8_t data[RPL_MCAST_BUFFER_SIZE];
+};
+
+MEMB(packet_memb, struct mcast_packet, RPL_MCAST_BUFFER_NUM);
+LIST(packet_list);
+
+static uint32_t seen[RPL_MCAST_SEEN_NUM];
+static uint8_t seen_next;
+
+static void handle_transmit(void *ptr);
+/*---------------------------------------------------------------------------*/
+static uint32_t
+fnv_add(uint32_t hash, const uint8_t *data, uint16_t len)
+{
+  while(len-- > 0) {
+    hash = (hash ^ *data++) * FNV_PRIME;
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+fingerprint(void)
+{
+  const uint8_t *payload;
+  uint16_t payload_len;
+  uint16_t chksum_offset;
+  uint32_t hash;
+
+  /*
+   * A ones-complement sum over the payload would be worthless: with a
+   * valid transport checksum inside, it only depends on the pseudo
+   * header, so that all packets of the same length collide. Hash the
+   * bytes instead, and leave out the checksum field, which only
+   * repeats them.
+   */
+  payload = &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+  payload_len = uip_len - UIP_IPH_LEN;
+  switch(UIP_IP_BUF->proto) {
+  case UIP_PROTO_UDP:
+    chksum_offset = UDP_CHKSUM_OFFSET;
+    break;
+  case UIP_PROTO_ICMP6:
+    chksum_offset = ICMP6_CHKSUM_OFFSET;
+    break;
+  default:
+    chksum_offset = payload_len;
+    break;
+  }
+  if(chksum_offset + 2 > payload_len) {
+    chksum_offset = payload_len;
+  }
+
+  hash = fnv_add(FNV_OFFSET_BASIS, (uint8_t *)&UIP_IP_BUF->srcipaddr,
+                 sizeof(uip_ipaddr_t));
+  hash = fnv_add(hash, payload, chksum_offset);
+  if(chksum_offset < payload_len) {
+    hash = fnv_add(hash, payload + chksum_offset + 2,
+                   payload_len - chksum_offset - 2);
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_seen(uint32_t fp)
+{
+  int i;
+
+  for(i = 0; i < RPL_MCAST_SEEN_NUM; i++) {
+    if(seen[i] == fp) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+new_interval(struct mcast_packet *p)
+{
+  clock_time_t t;
+
+  p->counter = 0;
+  t = p->interval / 2;
+  t += random_rand() % (t > 0 ? t : 1);
+  p->remaining = p->interval - t;
+  ctimer_set(&p->timer, t, handle_transmit, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_interval_end(void *ptr)
+{
+  struct mcast_packet *p;
+
+  p = ptr;
+  if(++p->expirations >= RPL_MCAST_EXPIRATIONS) {
+    /* The fingerprint stays in the seen list for duplicate detection. */
+    PRINTF("RPL: Done forwarding multicast packet %08lx\n",
+           (unsigned long)p->fingerprint);
+    list_remove(packet_list, p);
+    memb_free(&packet_memb, p);
+    return;
+  }
+
+  p->interval <<= 1;
+  if(p->interval > RPL_MCAST_IMAX) {
+    p->interval = RPL_MCAST_IMAX;
+  }
+  new_interval(p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_transmit(void *ptr)
+{
+  struct mcast_packet *p;
+
+  p = ptr;
+  if(p->counter < RPL_MCAST_REDUNDANCY) {
+    PRINTF("RPL: Forwarding multicast packet %08lx\n",
+           (unsigned long)p->fingerprint);
+    memcpy(UIP_IP_BUF, p->data, p->len);
+    uip_len = p->len;
+    uip_ext_len = 0;
+    tcpip_output(NULL);
+    uip_len = 0;
+    RPL_STAT(rpl_stats.mcast_forwarded++);
+  } else {
+    RPL_STAT(rpl_stats.mcast_suppressed++);
+  }
+  ctimer_set(&p->timer, p->remaining, handle_interval_end, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+buffer_packet(uint32_t fp, int forwarded)
+{
+  struct mcast_packet *p;
+  rpl_dag_t *dag;
+
+  dag = rpl_get_any_dag();
+  if(dag == NULL || RPL_LEAF_ONLY) {
+    return;
+  }
+
+  if(uip_len > RPL_MCAST_BUFFER_SIZE) {
+    PRINTF("RPL: Multicast packet too long to forward (%u)\n", uip_len);
+    return;
+  }
+
+  p = memb_alloc(&packet_memb);
+  if(p == NULL) {
+    PRINTF("RPL: No buffer to forward multicast packet\n");
+    RPL_STAT(rpl_stats.mem_overflows++);
+    return;
+  }
+
+  p->fingerprint = fp;
+  p->len = uip_len;
+  memcpy(p->data, UIP_IP_BUF, uip_len);
+  p->interval = RPL_MCAST_IMIN;
+  p->expirations = 0;
+  list_add(packet_list, p);
+
+  if(forwarded) {
+    /* The hop limit of the buffered copy was checked by the caller. */
+    ((struct uip_ip_hdr *)p->data)->ttl--;
+  }
+  new_interval(p);
+}
+/*---------------------------------------------------------------------------*/
+static int
+register_packet(uint32_t fp)
+{
+  struct mcast_packet *p;
+
+  for(p = list_head(packet_list); p != NULL; p = list_item_next(p)) {
+    if(p->fingerprint == fp) {
+      /* A neighbor sent a copy: this may suppress our transmission. */
+      p->counter++;
+      return 0;
+    }
+  }
+
+  if(is_seen(fp)) {
+    return 0;
+  }
+
+  seen[seen_next] = fp;
+  seen_next = (seen_next + 1) % RPL_MCAST_SEEN_NUM;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_mcast_input(void)
+{
+  uint32_t fp;
+
+  if(MCAST_SCOPE(&UIP_IP_BUF->destipaddr) <= MCAST_SCOPE_LINK) {
+    return 1;
+  }
+
+  fp = fingerprint();
+  if(!register_packet(fp)) {
+    PRINTF("RPL: Dropping duplicate multicast packet\n");
+    return 0;
+  }
+
+#if UIP_CONF_ROUTER
+  if(UIP_IP_BUF->ttl > 1 &&
+     !uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) &&
+     !uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr)) {
+    buffer_packet(fp, 1);
+  }
+#endif /* UIP_CONF_ROUTER */
+
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_mcast_output(void)
+{
+  uint32_t fp;
+
+  if(MCAST_SCOPE(&UIP_IP_BUF->destipaddr) <= MCAST_SCOPE_LINK) {
+    return;
+  }
+
+  /*
+   * We are the source of the packet, which is sent right away by the
+   * caller. Keep it for the Trickle retransmissions, and to recognize
+   * the copies that our neighbors forward.
+   */
+  fp = fingerprint();
+  if(register_packet(fp)) {
+    buffer_packet(fp, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_mcast_init(void)
+{
+  memb_init(&packet_memb);
+  list_init(packet_list);
+  memset(seen, 0, sizeof(seen));
+  seen_next = 0;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_WITH_MULTICAST */
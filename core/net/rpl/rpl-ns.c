@@ -0,0 +1,190 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         Topology bookkeeping of the DAG root in RPL non-storing mode.
+ *         The root learns one child-parent link from every DAO and
+ *         computes source routes from these links.
+ */
+
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+#include "net/rpl/rpl-private.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if RPL_WITH_NON_STORING
+
+MEMB(ns_node_memb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+LIST(ns_node_list);
+/************************************************************************/
+void
+rpl_ns_init(void)
+{
+  memb_init(&ns_node_memb);
+  list_init(ns_node_list);
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_get_node(rpl_dag_t *dag, uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+
+  for(node = list_head(ns_node_list); node != NULL; node = list_item_next(node)) {
+    if(node->dag == dag && uip_ipaddr_cmp(&node->addr, addr)) {
+      return node;
+    }
+  }
+  return NULL;
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, uip_ipaddr_t *child, uip_ipaddr_t *parent,
+                   uint32_t lifetime)
+{
+  rpl_ns_node_t *node;
+
+  node = rpl_ns_get_node(dag, child);
+  if(node == NULL) {
+    node = memb_alloc(&ns_node_memb);
+    if(node == NULL) {
+      PRINTF("RPL: No space for more non-storing links\n");
+      return NULL;
+    }
+    node->dag = dag;
+    uip_ipaddr_copy(&node->addr, child);
+    list_add(ns_node_list, node);
+  }
+
+  uip_ipaddr_copy(&node->parent, parent);
+  node->lifetime = lifetime;
+
+  PRINTF("RPL: Non-storing link ");
+  PRINT6ADDR(child);
+  PRINTF(" -> ");
+  PRINT6ADDR(parent);
+  PRINTF(" (%lu s)\n", (unsigned long)lifetime);
+
+  return node;
+}
+/************************************************************************/
+void
+rpl_ns_remove_node(rpl_ns_node_t *node)
+{
+  list_remove(ns_node_list, node);
+  memb_free(&ns_node_memb, node);
+}
+/************************************************************************/
+void
+rpl_ns_remove_dag(rpl_dag_t *dag)
+{
+  rpl_ns_node_t *node;
+  rpl_ns_node_t *next;
+
+  for(node = list_head(ns_node_list); node != NULL; node = next) {
+    next = list_item_next(node);
+    if(node->dag == dag) {
+      rpl_ns_remove_node(node);
+    }
+  }
+}
+/************************************************************************/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *node;
+  rpl_ns_node_t *next;
+
+  for(node = list_head(ns_node_list); node != NULL; node = next) {
+    next = list_item_next(node);
+    if(node->lifetime <= 1) {
+      rpl_ns_remove_node(node);
+    } else {
+      node->lifetime--;
+    }
+  }
+}
+/************************************************************************/
+int
+rpl_ns_get_path(rpl_dag_t *dag, uip_ipaddr_t *target,
+                uip_ipaddr_t **path, int max_hops)
+{
+  rpl_ns_node_t *node;
+  int hops;
+
+  /*
+   * Walk from the target towards the root. The path is stored in that
+   * order, so path[0] is the target and path[hops - 1] is a child of
+   * the root.
+   */
+  hops = 0;
+  while(hops < max_hops) {
+    node = rpl_ns_get_node(dag, target);
+    if(node == NULL) {
+      PRINTF("RPL: No non-storing link for ");
+      PRINT6ADDR(target);
+      PRINTF("\n");
+      return -1;
+    }
+    path[hops++] = &node->addr;
+    if(uip_ds6_is_my_addr(&node->parent)) {
+      return hops;
+    }
+    target = &node->parent;
+  }
+
+  /* The path is too long, or the links contain a loop. */
+  PRINTF("RPL: Source route longer than %d hops\n", max_hops);
+  return -1;
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_node_head(void)
+{
+  return list_head(ns_node_list);
+}
+/************************************************************************/
+rpl_ns_node_t *
+rpl_ns_node_next(rpl_ns_node_t *node)
+{
+  return list_item_next(node);
+}
+/************************************************************************/
+#endif /* RPL_WITH_NON_STORING */
@@ -0,0 +1,268 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \file
+ *         The minrank-hysteresis objective function (OCP 1) with link
+ *         freshness and adaptive hysteresis.
+ *
+ *         Like rpl_of_etx, this objective function uses ETX as the
+ *         additive routing metric. It differs in how parents are
+ *         compared. A link metric that has not been updated recently
+ *         is no longer trusted and moves towards the initial estimate.
+ *         The preferred parent is replaced only if the other parent is
+ *         better by a margin that grows with the variation of both
+ *         link metrics, so that stable links switch on small gains and
+ *         noisy links do not make the parent oscillate. Parent probing
+ *         (RPL_CONF_WITH_PROBING) keeps the metrics of the parents that
+ *         carry no traffic up to date.
+ *
+ *         The freshness-weighted link metric is the only one used:
+ *         parent selection, the rank and the advertised path metric
+ *         all derive from it, so that a node never advertises a cost
+ *         that disagrees with the rank it computed. While probing
+ *         works, the metric of the preferred parent stays fresh and
+ *         equals its plain link metric.
+ */
+
+#include "net/rpl/rpl-private.h"
+#include "net/neighbor-info.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if RPL_WITH_PROBING
+
+static void reset(rpl_dag_t *);
+static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
+static rpl_dag_t *best_dag(rpl_dag_t *, rpl_dag_t *);
+static rpl_rank_t calculate_rank(rpl_parent_t *, rpl_rank_t);
+static void update_metric_container(rpl_instance_t *);
+
+rpl_of_t rpl_of_etx_probing = {
+  reset,
+  NULL,
+  best_parent,
+  best_dag,
+  calculate_rank,
+  update_metric_container,
+  1
+};
+
+/* Reject parents that have a higher path cost than the following. */
+#define MAX_PATH_COST			100
+
+/*
+ * A link metric is fully trusted for FRESHNESS_TIME seconds after its
+ * last update. During the following FRESHNESS_TIME seconds, it moves
+ * linearly towards INITIAL_LINK_METRIC.
+ */
+#define FRESHNESS_TIME			(2 * RPL_PROBING_INTERVAL)
+
+/*
+ * Hysteresis bounds in units of RPL_DAG_MC_ETX_DIVISOR. The margin is
+ * MIN_HYSTERESIS plus twice the link metric variation of both parents.
+ */
+#define MIN_HYSTERESIS			(RPL_DAG_MC_ETX_DIVISOR / 4)
+#define MAX_HYSTERESIS			(2 * RPL_DAG_MC_ETX_DIVISOR)
+
+typedef uint16_t rpl_path_metric_t;
+
+static uint16_t
+fresh_link_metric(rpl_parent_t *p)
+{
+  uint32_t age;
+
+  age = clock_seconds() - p->last_metric_update;
+  if(age <= FRESHNESS_TIME) {
+    return p->link_metric;
+  }
+  if(age >= 2 * FRESHNESS_TIME) {
+    return INITIAL_LINK_METRIC;
+  }
+  age -= FRESHNESS_TIME;
+  return (p->link_metric * (FRESHNESS_TIME - age) +
+          INITIAL_LINK_METRIC * age) / FRESHNESS_TIME;
+}
+
+static rpl_path_metric_t
+calculate_path_metric(rpl_parent_t *p)
+{
+  if(p == NULL || (p->mc.obj.etx == 0 && p->rank > ROOT_RANK(p->dag->instance))) {
+    return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR;
+  } else {
+    long etx = fresh_link_metric(p);
+    etx = (etx * RPL_DAG_MC_ETX_DIVISOR) / NEIGHBOR_INFO_ETX_DIVISOR;
+    return p->mc.obj.etx + (uint16_t) etx;
+  }
+}
+
+static void
+reset(rpl_dag_t *sag)
+{
+}
+
+static rpl_rank_t
+calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
+{
+  rpl_rank_t new_rank;
+  rpl_rank_t rank_increase;
+
+  if(p == NULL) {
+    if(base_rank == 0) {
+      return INFINITE_RANK;
+    }
+    rank_increase = NEIGHBOR_INFO_FIX2ETX(INITIAL_LINK_METRIC) * RPL_MIN_HOPRANKINC;
+  } else {
+    /* Multiply first, then scale down to avoid truncation effects. */
+    rank_increase = NEIGHBOR_INFO_FIX2ETX(fresh_link_metric(p) * p->dag->instance->min_hoprankinc);
+    if(base_rank == 0) {
+      base_rank = p->rank;
+    }
+  }
+
+  if(INFINITE_RANK - base_rank < rank_increase) {
+    /* Reached the maximum rank. */
+    new_rank = INFINITE_RANK;
+  } else {
+    new_rank = base_rank + rank_increase;
+  }
+
+  return new_rank;
+}
+
+static rpl_dag_t *
+best_dag(rpl_dag_t *d1, rpl_dag_t *d2)
+{
+  if(d1->grounded != d2->grounded) {
+    return d1->grounded ? d1 : d2;
+  }
+
+  if(d1->preference != d2->preference) {
+    return d1->preference > d2->preference ? d1 : d2;
+  }
+
+  return d1->rank < d2->rank ? d1 : d2;
+}
+
+static rpl_parent_t *
+best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
+{
+  rpl_dag_t *dag;
+  rpl_path_metric_t min_diff;
+  rpl_path_metric_t p1_metric;
+  rpl_path_metric_t p2_metric;
+
+  dag = p1->dag; /* Both parents must be in the same DAG. */
+
+  p1_metric = calculate_path_metric(p1);
+  p2_metric = calculate_path_metric(p2);
+
+  /* Maintain stability of the preferred parent in case of similar ranks. */
+  if(p1 == dag->preferred_parent || p2 == dag->preferred_parent) {
+    min_diff = MIN_HYSTERESIS +
+      (2 * ((long)p1->link_metric_dev + p2->link_metric_dev) *
+       RPL_DAG_MC_ETX_DIVISOR) / NEIGHBOR_INFO_ETX_DIVISOR;
+    if(min_diff > MAX_HYSTERESIS) {
+      min_diff = MAX_HYSTERESIS;
+    }
+    if(p1_metric < p2_metric + min_diff &&
+       p1_metric + min_diff > p2_metric) {
+      PRINTF("RPL: Probing MRHOF hysteresis %u: %u vs %u\n",
+             min_diff, p1_metric, p2_metric);
+      return dag->preferred_parent;
+    }
+  }
+
+  return p1_metric < p2_metric ? p1 : p2;
+}
+
+static void
+update_metric_container(rpl_instance_t *instance)
+{
+  rpl_path_metric_t path_metric;
+  rpl_dag_t *dag;
+#if RPL_DAG_MC == RPL_DAG_MC_ENERGY
+  uint8_t type;
+#endif
+
+  instance->mc.flags = RPL_DAG_MC_FLAG_P;
+  instance->mc.aggr = RPL_DAG_MC_AGGR_ADDITIVE;
+  instance->mc.prec = 0;
+
+  dag = instance->current_dag;
+
+  if (!dag->joined) {
+    return;
+  }
+
+  if(dag->rank == ROOT_RANK(instance)) {
+    path_metric = 0;
+  } else {
+    path_metric = calculate_path_metric(dag->preferred_parent);
+  }
+
+#if RPL_DAG_MC == RPL_DAG_MC_ETX
+
+  instance->mc.type = RPL_DAG_MC_ETX;
+  instance->mc.length = sizeof(instance->mc.obj.etx);
+  instance->mc.obj.etx = path_metric;
+
+  PRINTF("RPL: My path ETX to the root is %u.%u\n",
+	instance->mc.obj.etx / RPL_DAG_MC_ETX_DIVISOR,
+	(instance->mc.obj.etx % RPL_DAG_MC_ETX_DIVISOR * 100) / RPL_DAG_MC_ETX_DIVISOR);
+
+#elif RPL_DAG_MC == RPL_DAG_MC_ENERGY
+
+  instance->mc.type = RPL_DAG_MC_ENERGY;
+  instance->mc.length = sizeof(instance->mc.obj.energy);
+
+  if(dag->rank == ROOT_RANK(instance)) {
+    type = RPL_DAG_MC_ENERGY_TYPE_MAINS;
+  } else {
+    type = RPL_DAG_MC_ENERGY_TYPE_BATTERY;
+  }
+
+  instance->mc.obj.energy.flags = type << RPL_DAG_MC_ENERGY_TYPE;
+  instance->mc.obj.energy.energy_est = path_metric;
+
+#else
+
+#error "Unsupported RPL_DAG_MC configured. See rpl.h."
+
+#endif /* RPL_DAG_MC */
+}
+
+#endif /* RPL_WITH_PROBING */
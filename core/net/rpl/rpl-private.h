@@ -173,18 +173,6 @@
 #define RPL_ROUTE_FROM_MULTICAST_DAO    2
 #define RPL_ROUTE_FROM_DIO              3
 
-/* DAG Mode of Operation */
-#define RPL_MOP_NO_DOWNWARD_ROUTES      0
-#define RPL_MOP_NON_STORING             1
-#define RPL_MOP_STORING_NO_MULTICAST    2
-#define RPL_MOP_STORING_MULTICAST       3
-
-#ifdef  RPL_CONF_MOP
-#define RPL_MOP_DEFAULT                 RPL_CONF_MOP
-#else
-#define RPL_MOP_DEFAULT                 RPL_MOP_STORING_NO_MULTICAST
-#endif
-
 /*
  * The ETX in the metric container is expressed as a fixed-point value 
  * whose integer part can be obtained by dividing the value by 
@@ -239,20 +227,6 @@ struct rpl_dio {
 };
 typedef struct rpl_dio rpl_dio_t;
 
-#if RPL_CONF_STATS
-/* Statistics for fault management. */
-struct rpl_stats {
-  uint16_t mem_overflows;
-  uint16_t local_repairs;
-  uint16_t global_repairs;
-  uint16_t malformed_msgs;
-  uint16_t resets;
-  uint16_t parent_switch;
-};
-typedef struct rpl_stats rpl_stats_t;
-
-extern rpl_stats_t rpl_stats;
-#endif
 /*---------------------------------------------------------------------------*/
 /* RPL macros. */
 
@@ -303,6 +277,36 @@ uip_ds6_route_t *rpl_add_route(rpl_dag_t *dag, uip_ipaddr_t *prefix,
                                int prefix_len, uip_ipaddr_t *next_hop);
 void rpl_purge_routes(void);
 
+#if RPL_WITH_NON_STORING
+/* Child-parent link learned by the root from a non-storing DAO. */
+struct rpl_ns_node {
+  struct rpl_ns_node *next;
+  rpl_dag_t *dag;
+  uint32_t lifetime;
+  uip_ipaddr_t addr;
+  uip_ipaddr_t parent;
+};
+typedef struct rpl_ns_node rpl_ns_node_t;
+
+/* Non-storing mode topology at the root. */
+void rpl_ns_init(void);
+rpl_ns_node_t *rpl_ns_get_node(rpl_dag_t *dag, uip_ipaddr_t *addr);
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, uip_ipaddr_t *child,
+                                  uip_ipaddr_t *parent, uint32_t lifetime);
+void rpl_ns_remove_node(rpl_ns_node_t *node);
+void rpl_ns_remove_dag(rpl_dag_t *dag);
+void rpl_ns_periodic(void);
+int rpl_ns_get_path(rpl_dag_t *dag, uip_ipaddr_t *target,
+                    uip_ipaddr_t **path, int max_hops);
+rpl_ns_node_t *rpl_ns_node_head(void);
+rpl_ns_node_t *rpl_ns_node_next(rpl_ns_node_t *node);
+#endif /* RPL_WITH_NON_STORING */
+
+#if RPL_WITH_MULTICAST
+/* Multicast forwarding. */
+void rpl_mcast_init(void);
+#endif /* RPL_WITH_MULTICAST */
+
 /* Objective function. */
 rpl_of_t *rpl_find_of(rpl_ocp_t);
 
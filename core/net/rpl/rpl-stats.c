@@ -0,0 +1,132 @@
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+/**
+ * \file
+ *         Event log and link metric history of the RPL statistics.
+ *
+ *         The counters in rpl_stats tell how often the topology changed;
+ *         the event log tells when and to what, so that parent churn
+ *         can be correlated with the link metrics that caused it.
+ */
+
+#include "net/uip.h"
+#include "net/rpl/rpl-private.h"
+#include "sys/clock.h"
+
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#if RPL_CONF_STATS
+
+static struct rpl_stats_event events[RPL_STATS_EVENTS];
+static uint8_t events_next;
+static uint8_t events_num;
+
+static const char *event_names[] = {
+  "?", "join", "switch", "rank", "add", "remove", "local-repair",
+  "global-repair"
+};
+/*---------------------------------------------------------------------------*/
+void
+rpl_stats_event(uint8_t type, uip_ipaddr_t *parent,
+                rpl_rank_t old_rank, rpl_rank_t new_rank)
+{
+  struct rpl_stats_event *e;
+
+  e = &events[events_next];
+  e->time = clock_seconds();
+  e->type = type;
+  e->parent = parent == NULL ? 0 :
+    ((uint16_t)parent->u8[14] << 8) | parent->u8[15];
+  e->old_rank = old_rank;
+  e->new_rank = new_rank;
+
+  events_next = (events_next + 1) % RPL_STATS_EVENTS;
+  if(events_num < RPL_STATS_EVENTS) {
+    events_num++;
+  }
+
+  PRINTF("RPL: Event %u parent %04x rank %u -> %u\n",
+         type, e->parent, old_rank, new_rank);
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_stats_num_events(void)
+{
+  return events_num;
+}
+/*---------------------------------------------------------------------------*/
+struct rpl_stats_event *
+rpl_stats_get_event(int index)
+{
+  if(index < 0 || index >= events_num) {
+    return NULL;
+  }
+  /* Index 0 is the oldest event still in the log. */
+  return &events[(events_next + RPL_STATS_EVENTS - events_num + index) %
+                 RPL_STATS_EVENTS];
+}
+/*---------------------------------------------------------------------------*/
+const char *
+rpl_stats_event_name(uint8_t type)
+{
+  if(type >= sizeof(event_names) / sizeof(event_names[0])) {
+    type = 0;
+  }
+  return event_names[type];
+}
+/*---------------------------------------------------------------------------*/
+/* The average number of times per minute that a counter of rpl_stats
+   was incremented since boot. */
+unsigned long
+rpl_stats_per_minute(uint16_t count)
+{
+  unsigned long uptime;
+
+  uptime = clock_seconds();
+  return uptime == 0 ? 0 : (unsigned long)count * 60 / uptime;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_stats_link_metric(rpl_parent_t *parent, uint8_t link_metric)
+{
+  parent->link_metric_history[parent->link_metric_next] = link_metric;
+  parent->link_metric_next =
+    (parent->link_metric_next + 1) % RPL_STATS_LINK_METRIC_HISTORY;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_CONF_STATS */
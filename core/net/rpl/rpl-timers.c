@@ -59,11 +59,55 @@ static uint16_t next_dis;
 /* dio_send_ok is true if the node is ready to send DIOs */
 static uint8_t dio_send_ok;
 
+#if RPL_WITH_PROBING
+static uint16_t next_probe;
+#endif /* RPL_WITH_PROBING */
+
+/************************************************************************/
+#if RPL_WITH_PROBING
+static void
+probe_parent(void)
+{
+  rpl_dag_t *dag;
+  rpl_parent_t *p;
+  rpl_parent_t *target;
+  uint32_t now;
+
+  dag = rpl_get_any_dag();
+  if(dag == NULL) {
+    return;
+  }
+
+  /* Probe the parent whose link metric is the least recent. */
+  now = clock_seconds();
+  target = NULL;
+  for(p = list_head(dag->parents); p != NULL; p = list_item_next(p)) {
+    if(p->rank != INFINITE_RANK &&
+       (target == NULL ||
+        now - p->last_metric_update > now - target->last_metric_update)) {
+      target = p;
+    }
+  }
+
+  /* Parents that carry traffic are fresh and need no probes. */
+  if(target != NULL && now - target->last_metric_update >= RPL_PROBING_INTERVAL) {
+    PRINTF("RPL: Probing parent ");
+    PRINT6ADDR(&target->addr);
+    PRINTF(" (%lu s since last update)\n",
+           (unsigned long)(now - target->last_metric_update));
+    dis_output(&target->addr);
+  }
+}
+#endif /* RPL_WITH_PROBING */
+
 /************************************************************************/
 static void
 handle_periodic_timer(void *ptr)
 {
   rpl_purge_routes();
+#if RPL_WITH_NON_STORING
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
   rpl_recalculate_ranks();
 
   /* handle DIS */
@@ -74,6 +118,15 @@ handle_periodic_timer(void *ptr)
     dis_output(NULL);
   }
 #endif
+#if RPL_WITH_PROBING
+  if(next_probe > 0) {
+    next_probe--;
+  } else {
+    probe_parent();
+    next_probe = RPL_PROBING_INTERVAL / 2 +
+      random_rand() % RPL_PROBING_INTERVAL;
+  }
+#endif /* RPL_WITH_PROBING */
   ctimer_reset(&periodic_timer);
 }
 /************************************************************************/
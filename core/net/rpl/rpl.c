@@ -85,6 +85,9 @@ rpl_remove_routes(rpl_dag_t *dag)
       uip_ds6_route_rm(&uip_ds6_routing_table[i]);
     }
   }
+#if RPL_WITH_NON_STORING
+  rpl_ns_remove_dag(dag);
+#endif /* RPL_WITH_NON_STORING */
 }
 /************************************************************************/
 void
@@ -157,7 +160,15 @@ rpl_link_neighbor_callback(const rimeaddr_t *addr, int known, int etx)
       if(parent != NULL) {
         /* Trigger DAG rank recalculation. */
         parent->updated = 1;
+#if RPL_WITH_PROBING
+        parent->last_metric_update = clock_seconds();
+        parent->link_metric_dev = (3 * parent->link_metric_dev +
+                                   (etx > parent->link_metric ?
+                                    etx - parent->link_metric :
+                                    parent->link_metric - etx)) / 4;
+#endif /* RPL_WITH_PROBING */
         parent->link_metric = etx;
+        RPL_STAT(rpl_stats_link_metric(parent, etx));
 
         if(instance->of->parent_state_callback != NULL) {
           instance->of->parent_state_callback(parent, known, etx);
@@ -212,6 +223,12 @@ rpl_init(void)
   default_instance = NULL;
 
   rpl_reset_periodic_timer();
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_WITH_MULTICAST
+  rpl_mcast_init();
+#endif /* RPL_WITH_MULTICAST */
   neighbor_info_subscribe(rpl_link_neighbor_callback);
 
   /* add rpl multicast address */
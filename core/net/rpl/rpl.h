@@ -116,6 +116,18 @@ struct rpl_parent {
   uint8_t link_metric;
   uint8_t dtsn;
   uint8_t updated;
+#if RPL_CONF_STATS
+  /* The last link metrics reported for the parent, oldest first from
+     link_metric_next. */
+  uint8_t link_metric_history[RPL_STATS_LINK_METRIC_HISTORY];
+  uint8_t link_metric_next;
+#endif /* RPL_CONF_STATS */
+#if RPL_WITH_PROBING
+  /* clock_seconds() of the last link metric update. */
+  uint32_t last_metric_update;
+  /* Smoothed absolute change of the link metric, same unit. */
+  uint8_t link_metric_dev;
+#endif /* RPL_WITH_PROBING */
 };
 typedef struct rpl_parent rpl_parent_t;
 /*---------------------------------------------------------------------------*/
@@ -226,6 +238,55 @@ struct rpl_instance {
   struct ctimer dao_timer;
 };
 
+/*---------------------------------------------------------------------------*/
+#if RPL_CONF_STATS
+/* Statistics for fault management. */
+struct rpl_stats {
+  uint16_t mem_overflows;
+  uint16_t local_repairs;
+  uint16_t global_repairs;
+  uint16_t malformed_msgs;
+  uint16_t resets;
+  uint16_t parent_switch;
+  uint16_t mcast_forwarded;
+  uint16_t mcast_suppressed;
+  uint16_t rank_changes;
+  uint16_t dis_sent;
+  uint16_t dis_recv;
+  uint16_t dio_sent;
+  uint16_t dio_recv;
+  uint16_t dao_sent;
+  uint16_t dao_recv;
+};
+typedef struct rpl_stats rpl_stats_t;
+
+extern rpl_stats_t rpl_stats;
+
+/* Routing events kept in the event log. */
+#define RPL_STATS_EVENT_JOIN            1 /* Joined a DAG through parent */
+#define RPL_STATS_EVENT_PARENT_SWITCH   2 /* New preferred parent */
+#define RPL_STATS_EVENT_RANK            3 /* Rank changed, same parent */
+#define RPL_STATS_EVENT_PARENT_ADD      4 /* Parent added, new rank is its rank */
+#define RPL_STATS_EVENT_PARENT_REMOVE   5 /* Parent removed */
+#define RPL_STATS_EVENT_LOCAL_REPAIR    6
+#define RPL_STATS_EVENT_GLOBAL_REPAIR   7
+
+struct rpl_stats_event {
+  uint32_t time;        /* clock_seconds() of the event */
+  uint16_t parent;      /* last two bytes of the parent address */
+  rpl_rank_t old_rank;
+  rpl_rank_t new_rank;
+  uint8_t type;
+};
+
+void rpl_stats_event(uint8_t type, uip_ipaddr_t *parent,
+                     rpl_rank_t old_rank, rpl_rank_t new_rank);
+int rpl_stats_num_events(void);
+struct rpl_stats_event *rpl_stats_get_event(int index);
+const char *rpl_stats_event_name(uint8_t type);
+unsigned long rpl_stats_per_minute(uint16_t count);
+void rpl_stats_link_metric(rpl_parent_t *parent, uint8_t link_metric);
+#endif /* RPL_CONF_STATS */
 /*---------------------------------------------------------------------------*/
 /* Public RPL functions. */
 void rpl_init(void);
@@ -240,6 +301,14 @@ void rpl_update_header_empty(void);
 int rpl_update_header_final(uip_ipaddr_t *addr);
 int rpl_verify_header(int);
 void rpl_remove_header(void);
+#if RPL_WITH_NON_STORING
+int rpl_srh_route(uip_ipaddr_t *nexthop);
+int rpl_process_srh_header(void);
+#endif /* RPL_WITH_NON_STORING */
+#if RPL_WITH_MULTICAST
+int rpl_mcast_input(void);
+void rpl_mcast_output(void);
+#endif /* RPL_WITH_MULTICAST */
 uint8_t rpl_invert_header(void);
 /*---------------------------------------------------------------------------*/
 #endif /* RPL_H */
@@ -107,6 +107,19 @@ void uip_log(char *msg);
 #define SICSLOWPAN_MAX_MAC_TRANSMISSIONS 4
 #endif
 
+/*
+ * The number of flows for which the HC06 address compression modes are
+ * remembered. A flow is identified by the link-layer next hop and the
+ * IPv6 source and destination addresses. An entry takes about 43 bytes
+ * of RAM, so the cache is off by default; builds that send long runs of
+ * packets to the same destination can enable it.
+ */
+#ifdef SICSLOWPAN_CONF_ADDR_CACHE_SIZE
+#define SICSLOWPAN_ADDR_CACHE_SIZE SICSLOWPAN_CONF_ADDR_CACHE_SIZE
+#else
+#define SICSLOWPAN_ADDR_CACHE_SIZE 0
+#endif
+
 #ifndef SICSLOWPAN_COMPRESSION
 #ifdef SICSLOWPAN_CONF_COMPRESSION
 #define SICSLOWPAN_COMPRESSION SICSLOWPAN_CONF_COMPRESSION
@@ -324,6 +337,20 @@ addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
 /** pointer to an address context. */
 static struct sicslowpan_addr_context *context;
 
+#if SICSLOWPAN_ADDR_CACHE_SIZE > 0
+/** The address compression modes of recently sent packets. */
+struct addr_cache_entry {
+  rimeaddr_t nexthop;
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  uint8_t used;
+  uint8_t iphc1;
+  uint8_t cid;
+};
+
+static struct addr_cache_entry addr_cache[SICSLOWPAN_ADDR_CACHE_SIZE];
+#endif /* SICSLOWPAN_ADDR_CACHE_SIZE > 0 */
+
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
@@ -384,6 +411,12 @@ addr_context_lookup_by_number(uint8_t number)
 /* Remove code to avoid warnings and save flash if no context is used */ 
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
   int i;
+  /* Contexts are normally stored at the index of their number. */
+  if(number < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS &&
+     addr_contexts[number].used == 1 &&
+     addr_contexts[number].number == number) {
+    return &addr_contexts[number];
+  }
   for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
     if((addr_contexts[i].used == 1) &&
        addr_contexts[i].number == number) {
@@ -401,14 +434,154 @@ compress_addr_64(uint8_t bitpos, uip_ipaddr_t *ipaddr, uip_lladdr_t *lladdr)
     return 3 << bitpos; /* 0-bits */
   } else if(sicslowpan_is_iid_16_bit_compressable(ipaddr)) {
     /* compress IID to 16 bits xxxx::0000:00ff:fe00:XXXX */
-    memcpy(hc06_ptr, &ipaddr->u16[7], 2);
-    hc06_ptr += 2;
     return 2 << bitpos; /* 16-bits */
   } else {
     /* do not compress IID => xxxx::IID */
+    return 1 << bitpos; /* 64-bits */
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Choose the address compression modes for the packet in uip_buf
+ *
+ * Sets the CID, SAC, SAM, M, DAC and DAM bits of the second IPHC byte,
+ * and the context identifier byte. Nothing is written to the packet.
+ */
+static void
+compress_addr_modes(rimeaddr_t *rime_destaddr, uint8_t *iphc1, uint8_t *cid)
+{
+  *iphc1 = 0;
+  *cid = 0;
+
+  /* source address - cannot be multicast */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("IPHC: compressing unspecified - setting SAC\n");
+    *iphc1 |= SICSLOWPAN_IPHC_SAC;
+    *iphc1 |= SICSLOWPAN_IPHC_SAM_00;
+  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
+     != NULL) {
+    /* elide the prefix - indicate by CID and set context + SAC */
+    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
+	   context->number);
+    *iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
+    *cid |= context->number << 4;
+    /* compession compare with this nodes address (source) */
+
+    *iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                               &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+    /* No context found for this address */
+  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
+	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
+    *iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                               &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+  } else {
+    /* send the full address => SAC = 0, SAM = 00 */
+    *iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
+  }
+
+  /* dest address*/
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    /* Address is multicast, try to compress */
+    *iphc1 |= SICSLOWPAN_IPHC_M;
+    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
+      *iphc1 |= SICSLOWPAN_IPHC_DAM_11;
+    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
+      *iphc1 |= SICSLOWPAN_IPHC_DAM_10;
+    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
+      *iphc1 |= SICSLOWPAN_IPHC_DAM_01;
+    } else {
+      *iphc1 |= SICSLOWPAN_IPHC_DAM_00;
+    }
+  } else {
+    /* Address is unicast, try to compress */
+    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
+      /* elide the prefix */
+      *iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_DAC;
+      *cid |= context->number;
+      /* compession compare with link adress (destination) */
+
+      *iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+                                 &UIP_IP_BUF->destipaddr,
+                                 (uip_lladdr_t *)rime_destaddr);
+      /* No context found for this address */
+    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
+	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
+      *iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+                                 &UIP_IP_BUF->destipaddr,
+                                 (uip_lladdr_t *)rime_destaddr);
+    } else {
+      /* send the full address */
+      *iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Look up the address compression modes for the packet in uip_buf
+ *
+ * The modes only depend on the addresses and on the link-layer next hop,
+ * so they are remembered for the flows that were seen last, and the
+ * address contexts are only searched for new flows.
+ */
+static void
+lookup_addr_modes(rimeaddr_t *rime_destaddr, uint8_t *iphc1, uint8_t *cid)
+{
+#if SICSLOWPAN_ADDR_CACHE_SIZE > 0
+  struct addr_cache_entry *e;
+
+  e = &addr_cache[(rime_destaddr->u8[RIMEADDR_SIZE - 1] ^
+                   UIP_IP_BUF->destipaddr.u8[15]) %
+                  SICSLOWPAN_ADDR_CACHE_SIZE];
+  if(e->used &&
+     uip_ipaddr_cmp(&e->destipaddr, &UIP_IP_BUF->destipaddr) &&
+     uip_ipaddr_cmp(&e->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+     rimeaddr_cmp(&e->nexthop, rime_destaddr)) {
+    *iphc1 = e->iphc1;
+    *cid = e->cid;
+    return;
+  }
+
+  compress_addr_modes(rime_destaddr, iphc1, cid);
+
+  rimeaddr_copy(&e->nexthop, rime_destaddr);
+  uip_ipaddr_copy(&e->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&e->destipaddr, &UIP_IP_BUF->destipaddr);
+  e->iphc1 = *iphc1;
+  e->cid = *cid;
+  e->used = 1;
+#else /* SICSLOWPAN_ADDR_CACHE_SIZE > 0 */
+  compress_addr_modes(rime_destaddr, iphc1, cid);
+#endif /* SICSLOWPAN_ADDR_CACHE_SIZE > 0 */
+}
+/*--------------------------------------------------------------------*/
+/** \brief Write the inline part of a unicast address for address mode
+ * (SAM or DAM) mode */
+static void
+compress_addr(uint8_t mode, uip_ipaddr_t *ipaddr)
+{
+  switch(mode) {
+  case 0:
+    /* full address */
+    memcpy(hc06_ptr, &ipaddr->u16[0], 16);
+    hc06_ptr += 16;
+    break;
+  case 1:
+    /* xxxx::IID */
     memcpy(hc06_ptr, &ipaddr->u16[4], 8);
     hc06_ptr += 8;
-    return 1 << bitpos; /* 64-bits */
+    break;
+  case 2:
+    /* xxxx::0000:00ff:fe00:XXXX */
+    memcpy(hc06_ptr, &ipaddr->u16[7], 2);
+    hc06_ptr += 2;
+    break;
+  default:
+    /* derived from the link-layer address */
+    break;
   }
 }
 
@@ -492,7 +665,7 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
 static void
 compress_hdr_hc06(rimeaddr_t *rime_destaddr)
 {
-  uint8_t tmp, iphc0, iphc1;
+  uint8_t tmp, iphc0, iphc1, cid;
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -513,24 +686,17 @@ compress_hdr_hc06(rimeaddr_t *rime_destaddr)
    */
 
   iphc0 = SICSLOWPAN_DISPATCH_IPHC;
-  iphc1 = 0;
-  RIME_IPHC_BUF[2] = 0; /* might not be used - but needs to be cleared */
 
   /*
    * Address handling needs to be made first since it might
    * cause an extra byte with [ SCI | DCI ]
    *
    */
-
-
-  /* check if dest context exists (for allocating third byte) */
-  /* TODO: fix this so that it remembers the looked up values for
-     avoiding two lookups - or set the lookup values immediately */
-  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
-     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
-    /* set context flag and increase hc06_ptr */
+  lookup_addr_modes(rime_destaddr, &iphc1, &cid);
+  if(iphc1 & SICSLOWPAN_IPHC_CID) {
+    /* set context identifier and increase hc06_ptr */
     PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n");
-    iphc1 |= SICSLOWPAN_IPHC_CID;
+    RIME_IPHC_BUF[2] = cid;
     hc06_ptr++;
   }
 
@@ -618,86 +784,42 @@ compress_hdr_hc06(rimeaddr_t *rime_destaddr)
       break;
   }
 
-  /* source address - cannot be multicast */
-  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-    PRINTF("IPHC: compressing unspecified - setting SAC\n");
-    iphc1 |= SICSLOWPAN_IPHC_SAC;
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00;
-  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
-     != NULL) {
-    /* elide the prefix - indicate by CID and set context + SAC */
-    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
-	   context->number);
-    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
-    RIME_IPHC_BUF[2] |= context->number << 4;
-    /* compession compare with this nodes address (source) */
-
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-    /* No context found for this address */
-  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
-	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-  } else {
-    /* send the full address => SAC = 0, SAM = 00 */
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
-    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
-    hc06_ptr += 16;
+  /* source address - nothing inline for the unspecified address */
+  if((iphc1 & (SICSLOWPAN_IPHC_SAC | SICSLOWPAN_IPHC_SAM_11)) !=
+     SICSLOWPAN_IPHC_SAC) {
+    compress_addr((iphc1 >> SICSLOWPAN_IPHC_SAM_BIT) & 0x03,
+                  &UIP_IP_BUF->srcipaddr);
   }
 
   /* dest address*/
-  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
-    /* Address is multicast, try to compress */
-    iphc1 |= SICSLOWPAN_IPHC_M;
-    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_11;
+  if(iphc1 & SICSLOWPAN_IPHC_M) {
+    switch(iphc1 & SICSLOWPAN_IPHC_DAM_11) {
+    case SICSLOWPAN_IPHC_DAM_11:
       /* use last byte */
       *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
       hc06_ptr += 1;
-    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_10;
+      break;
+    case SICSLOWPAN_IPHC_DAM_10:
       /* second byte + the last three */
       *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
       memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
       hc06_ptr += 4;
-    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_01;
+      break;
+    case SICSLOWPAN_IPHC_DAM_01:
       /* second byte + the last five */
       *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
       memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
       hc06_ptr += 6;
-    } else {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00;
+      break;
+    default:
       /* full address */
       memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
       hc06_ptr += 16;
+      break;
     }
   } else {
-    /* Address is unicast, try to compress */
-    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
-      /* elide the prefix */
-      iphc1 |= SICSLOWPAN_IPHC_DAC;
-      RIME_IPHC_BUF[2] |= context->number;
-      /* compession compare with link adress (destination) */
-
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)rime_destaddr);
-      /* No context found for this address */
-    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
-	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)rime_destaddr);
-    } else {
-      /* send the full address */
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
-      hc06_ptr += 16;
-    }
+    compress_addr((iphc1 >> SICSLOWPAN_IPHC_DAM_BIT) & 0x03,
+                  &UIP_IP_BUF->destipaddr);
   }
 
   uncomp_hdr_len = UIP_IPH_LEN;
@@ -1792,6 +1914,10 @@ sicslowpan_init(void)
   tcpip_set_outputfunc(output);
 
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+#if SICSLOWPAN_ADDR_CACHE_SIZE > 0
+  memset(addr_cache, 0, sizeof(addr_cache));
+#endif /* SICSLOWPAN_ADDR_CACHE_SIZE > 0 */
+
 /* Preinitialize any address contexts for better header compression
  * (Saves up to 13 bytes per 6lowpan packet)
  * The platform contiki-conf.h file can override this using e.g.
@@ -539,6 +539,9 @@ tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
 
   if(uip_len == 0) {
     return;
@@ -559,6 +562,12 @@ tcpip_ipv6_output(void)
   if(!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
     /* Next hop determination */
     nbr = NULL;
+#if UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING
+    /* Source routes are set up by the root of a non-storing DAG. */
+    if(rpl_srh_route(&srh_nexthop)) {
+      nexthop = &srh_nexthop;
+    } else
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_NON_STORING */
     if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
       nexthop = &UIP_IP_BUF->destipaddr;
     } else {
@@ -667,6 +676,9 @@ tcpip_ipv6_output(void)
   }
 
   /* Multicast IP destination address. */
+#if UIP_CONF_IPV6_RPL && RPL_WITH_MULTICAST
+  rpl_mcast_output();
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_MULTICAST */
   tcpip_output(NULL);
   uip_len = 0;
   uip_ext_len = 0;
@@ -77,6 +77,7 @@ uip_icmp6_echo_request_input(void)
 #if UIP_CONF_IPV6_RPL
   uint8_t temp_ext_len;
 #endif /* UIP_CONF_IPV6_RPL */
+  uint16_t chksum, type_code;
   /*
    * we send an echo reply. It is trivial if there was no extension
    * headers in the request otherwise we need to remove the extension
@@ -88,12 +89,22 @@ uip_icmp6_echo_request_input(void)
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
   PRINTF("\n");
 
+  /* The reply carries the same payload as the request, so its
+     checksum is derived from the checksum of the request. */
+  chksum = UIP_ICMP_BUF->icmpchksum;
+  type_code = uip_htons((UIP_ICMP_BUF->type << 8) + UIP_ICMP_BUF->icode);
+
   /* IP header */
   UIP_IP_BUF->ttl = uip_ds6_if.cur_hop_limit;
 
   if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)){
+    uip_ipaddr_copy(&tmp_ipaddr, &UIP_IP_BUF->destipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &UIP_IP_BUF->srcipaddr);
     uip_ds6_select_src(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
+    /* The multicast destination was replaced by our source address. */
+    chksum = uip_chksum_adjust_buf(chksum, &tmp_ipaddr,
+                                   &UIP_IP_BUF->srcipaddr,
+                                   sizeof(uip_ipaddr_t));
   } else {
     uip_ipaddr_copy(&tmp_ipaddr, &UIP_IP_BUF->srcipaddr);
     uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &UIP_IP_BUF->destipaddr);
@@ -146,8 +157,8 @@ uip_icmp6_echo_request_input(void)
   /* Note: now UIP_ICMP_BUF points to the beginning of the echo reply */
   UIP_ICMP_BUF->type = ICMP6_ECHO_REPLY;
   UIP_ICMP_BUF->icode = 0;
-  UIP_ICMP_BUF->icmpchksum = 0;
-  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+  UIP_ICMP_BUF->icmpchksum = uip_chksum_adjust(chksum, type_code,
+                                               UIP_HTONS(ICMP6_ECHO_REPLY << 8));
 
   PRINTF("Sending Echo Reply to");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
@@ -54,8 +54,11 @@ uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
   if(data != NULL) {
     uip_udp_conn = c;
     uip_slen = len;
-    memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], data,
-           len > UIP_BUFSIZE? UIP_BUFSIZE: len);
+    /* Data may already have been written in place, e.g., by CoAP. */
+    if((const uint8_t *)data != &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN]) {
+      memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], data,
+             len > UIP_BUFSIZE? UIP_BUFSIZE: len);
+    }
     uip_process(UIP_UDP_SEND_CONN);
 #if UIP_CONF_IPV6
     tcpip_ipv6_output();
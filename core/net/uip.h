@@ -2190,6 +2190,41 @@ uint16_t uip_udpchksum(void);
  */
 uint16_t uip_icmp6chksum(void);
 
+/**
+ * Update a checksum after a 16-bit word of the data changed.
+ *
+ * The checksum is updated incrementally as described in RFC1624, so
+ * that a forwarded or modified packet does not have to be summed
+ * again.
+ *
+ * \param hc The checksum as stored in the packet.
+ *
+ * \param old_word The previous value of the word, as stored in the
+ * packet.
+ *
+ * \param new_word The new value of the word, as stored in the packet.
+ *
+ * \return The new checksum, to be stored in the packet.
+ */
+uint16_t uip_chksum_adjust(uint16_t hc, uint16_t old_word, uint16_t new_word);
+
+/**
+ * Update a checksum after a field of the data changed.
+ *
+ * \param hc The checksum as stored in the packet.
+ *
+ * \param old_data The previous contents of the field.
+ *
+ * \param new_data The new contents of the field.
+ *
+ * \param len The length of the field, which must start at an even
+ * offset from the start of the checksummed data.
+ *
+ * \return The new checksum, to be stored in the packet.
+ */
+uint16_t uip_chksum_adjust_buf(uint16_t hc, const void *old_data,
+                               const void *new_data, uint16_t len);
+
 
 #endif /* __UIP_H__ */
 
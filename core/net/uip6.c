@@ -76,6 +76,9 @@
 #include "net/uip-icmp6.h"
 #include "net/uip-nd6.h"
 #include "net/uip-ds6.h"
+#if UIP_ARCH_CHKSUM_BLOCK
+#include "net/uip_arch.h"
+#endif /* UIP_ARCH_CHKSUM_BLOCK */
 
 #include <string.h>
 
@@ -298,6 +301,58 @@ uip_add32(uint8_t *op32, uint16_t op16)
 
 #if ! UIP_ARCH_CHKSUM
 /*---------------------------------------------------------------------------*/
+#if UIP_ARCH_CHKSUM_BLOCK
+#define chksum uip_arch_chksum
+#elif UIP_CONF_CHKSUM_WIDE
+static uint16_t
+chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint64_t acc;
+  uint32_t w[4];
+  uint16_t t;
+
+  /* Sum the data as native 32-bit words, which is equivalent to summing
+     16-bit words in either byte order (RFC 1071), and defer the carry
+     handling to the end. */
+  acc = 0;
+  while(len >= sizeof(w)) {
+    memcpy(w, data, sizeof(w));
+    acc += (uint64_t)w[0] + w[1] + w[2] + w[3];
+    data += sizeof(w);
+    len -= sizeof(w);
+  }
+  while(len >= sizeof(w[0])) {
+    memcpy(w, data, sizeof(w[0]));
+    acc += w[0];
+    data += sizeof(w[0]);
+    len -= sizeof(w[0]);
+  }
+  if(len >= sizeof(t)) {
+    memcpy(&t, data, sizeof(t));
+    acc += t;
+    data += sizeof(t);
+    len -= sizeof(t);
+  }
+  if(len > 0) {
+    t = 0;
+    memcpy(&t, data, 1);
+    acc += t;
+  }
+
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+
+  /* Add the network order sum to the host order sum. */
+  t = uip_ntohs((uint16_t)acc);
+  sum += t;
+  if(sum < t) {
+    sum++;      /* carry */
+  }
+  return sum;
+}
+#else /* UIP_CONF_CHKSUM_WIDE */
 static uint16_t
 chksum(uint16_t sum, const uint8_t *data, uint16_t len)
 {
@@ -328,6 +383,7 @@ chksum(uint16_t sum, const uint8_t *data, uint16_t len)
   /* Return sum in host byte order. */
   return sum;
 }
+#endif /* UIP_CONF_CHKSUM_WIDE */
 /*---------------------------------------------------------------------------*/
 uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
@@ -404,6 +460,38 @@ uip_udpchksum(void)
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_adjust(uint16_t hc, uint16_t old_word, uint16_t new_word)
+{
+  uint32_t sum;
+
+  /* RFC 1624, equation 3: HC' = ~(~HC + ~m + m') */
+  sum = (uint16_t)~hc;
+  sum += (uint16_t)~old_word;
+  sum += new_word;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum += sum >> 16;
+  return ~sum;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_adjust_buf(uint16_t hc, const void *old_data,
+                      const void *new_data, uint16_t len)
+{
+  const uint8_t *o = old_data;
+  const uint8_t *n = new_data;
+  uint16_t i;
+
+  for(i = 0; i + 1 < len; i += 2) {
+    hc = uip_chksum_adjust(hc, uip_htons((o[i] << 8) + o[i + 1]),
+                           uip_htons((n[i] << 8) + n[i + 1]));
+  }
+  if(i < len) {
+    hc = uip_chksum_adjust(hc, uip_htons(o[i] << 8), uip_htons(n[i] << 8));
+  }
+  return hc;
+}
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
@@ -1111,6 +1199,14 @@ uip_process(uint8_t flag)
     goto drop;
   }
 
+#if UIP_CONF_IPV6_RPL && RPL_WITH_MULTICAST
+  /* Drop duplicates, and keep new packets for forwarding in the DAG. */
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) && !rpl_mcast_input()) {
+    UIP_STAT(++uip_stat.ip.drop);
+    goto drop;
+  }
+#endif /* UIP_CONF_IPV6_RPL && RPL_WITH_MULTICAST */
+
 #if UIP_CONF_ROUTER
   /*
    * Next header field processing. In IPv6, we can have extension headers,
@@ -1298,6 +1394,23 @@ uip_process(uint8_t flag)
 
         PRINTF("Processing Routing header\n");
         if(UIP_ROUTING_BUF->seg_left > 0) {
+#if UIP_CONF_IPV6_RPL && UIP_CONF_ROUTER && RPL_WITH_NON_STORING
+          if(rpl_process_srh_header()) {
+            /* The destination is now the next hop of the source route. */
+            if(UIP_IP_BUF->ttl <= 1) {
+              uip_icmp6_error_output(ICMP6_TIME_EXCEEDED,
+                                     ICMP6_TIME_EXCEED_TRANSIT, 0);
+              UIP_STAT(++uip_stat.ip.drop);
+              goto send;
+            }
+            UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+            PRINTF("Forwarding source routed packet to ");
+            PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+            PRINTF("\n");
+            UIP_STAT(++uip_stat.ip.forwarded);
+            goto send;
+          }
+#endif /* UIP_CONF_IPV6_RPL && UIP_CONF_ROUTER && RPL_WITH_NON_STORING */
           uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
           UIP_STAT(++uip_stat.ip.drop);
           UIP_LOG("ip6: unrecognized routing type");
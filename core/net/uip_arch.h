@@ -132,6 +132,23 @@ uint16_t uip_tcpchksum(void);
 
 uint16_t uip_udpchksum(void);
 
+/**
+ * Sum a buffer for the Internet checksum.
+ *
+ * If an architecture defines UIP_ARCH_CHKSUM_BLOCK instead of
+ * UIP_ARCH_CHKSUM, the IPv6 stack keeps computing the pseudo-headers
+ * itself and only uses this function to sum the data. This makes it
+ * possible to provide an optimized summing loop without duplicating
+ * the protocol logic.
+ *
+ * \param sum The sum of the preceding data, in host byte order.
+ * \param data A pointer to the data, which need not be aligned.
+ * \param len The length of the data, in bytes.
+ * \return The one's complement sum of sum and the 16-bit big endian
+ * words of the data, in host byte order and not complemented.
+ */
+uint16_t uip_arch_chksum(uint16_t sum, const uint8_t *data, uint16_t len);
+
 /** @} */
 /** @} */
 
@@ -199,6 +199,12 @@
 #define UIP_CONF_IPV6_CHECKS          1
 #endif
 
+#ifndef UIP_CONF_CHKSUM_WIDE
+/** Do we sum checksums 32 bits at a time into a 64-bit accumulator
+    (faster on 32 and 64-bit CPUs, default: no) */
+#define UIP_CONF_CHKSUM_WIDE          0
+#endif
+
 #ifndef UIP_CONF_IPV6_REASSEMBLY
 /** Do we do IPv6 fragmentation (default: no) */
 #define UIP_CONF_IPV6_REASSEMBLY      0
@@ -48,6 +48,10 @@
 
 #include "sys/process.h"
 #include "sys/arg.h"
+#if PROCESS_CONF_ACCOUNTING
+#include "sys/clock.h"
+#include "sys/rtimer.h"
+#endif /* PROCESS_CONF_ACCOUNTING */
 
 /*
  * Pointer to the currently running process structure.
@@ -64,6 +68,9 @@ struct event_data {
   process_event_t ev;
   process_data_t data;
   struct process *p;
+#if PROCESS_CONF_ACCOUNTING
+  rtimer_clock_t time;
+#endif /* PROCESS_CONF_ACCOUNTING */
 };
 
 static process_num_events_t nevents, fevent;
@@ -75,6 +82,13 @@ process_num_events_t process_maxevents;
 
 static volatile unsigned char poll_requested;
 
+#if PROCESS_CONF_ACCOUNTING
+/* Run time of the processes called by the running process. The sums
+   are kept in 32 bits, as rtimer_clock_t is only 16 bits on some
+   platforms. */
+static unsigned long nested_time;
+#endif /* PROCESS_CONF_ACCOUNTING */
+
 #define PROCESS_STATE_NONE        0
 #define PROCESS_STATE_RUNNING     1
 #define PROCESS_STATE_CALLED      2
@@ -172,10 +186,34 @@ exit_process(struct process *p, struct process *fromprocess)
   process_current = old_current;
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_ACCOUNTING
+static void
+account_wait(struct process *p, rtimer_clock_t posted)
+{
+  unsigned long wait;
+
+  if(p->state & PROCESS_STATE_RUNNING) {
+    /* Wrap-safe for waits shorter than one rtimer_clock_t period. */
+    wait = (rtimer_clock_t)(RTIMER_NOW() - posted);
+    p->acct.events++;
+    p->acct.wait += wait;
+    if(wait > p->acct.max_wait) {
+      p->acct.max_wait = wait;
+    }
+  }
+}
+#endif /* PROCESS_CONF_ACCOUNTING */
+/*---------------------------------------------------------------------------*/
 static void
 call_process(struct process *p, process_event_t ev, process_data_t data)
 {
   int ret;
+#if PROCESS_CONF_ACCOUNTING
+  rtimer_clock_t start;
+  unsigned long elapsed;
+  unsigned long self;
+  unsigned long outer_nested_time;
+#endif /* PROCESS_CONF_ACCOUNTING */
 
 #if DEBUG
   if(p->state == PROCESS_STATE_CALLED) {
@@ -188,7 +226,23 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
     PRINTF("process: calling process '%s' with event %d\n", PROCESS_NAME_STRING(p), ev);
     process_current = p;
     p->state = PROCESS_STATE_CALLED;
+#if PROCESS_CONF_ACCOUNTING
+    outer_nested_time = nested_time;
+    nested_time = 0;
+    start = RTIMER_NOW();
+#endif /* PROCESS_CONF_ACCOUNTING */
     ret = p->thread(&p->pt, ev, data);
+#if PROCESS_CONF_ACCOUNTING
+    elapsed = (rtimer_clock_t)(RTIMER_NOW() - start);
+    /* Time spent in processes that p called synchronously is theirs. */
+    self = elapsed - nested_time;
+    p->acct.calls++;
+    p->acct.time += self;
+    if(self > p->acct.max_time) {
+      p->acct.max_time = self;
+    }
+    nested_time = outer_nested_time + elapsed;
+#endif /* PROCESS_CONF_ACCOUNTING */
     if(ret == PT_EXITED ||
        ret == PT_ENDED ||
        ev == PROCESS_EVENT_EXIT) {
@@ -250,6 +304,9 @@ do_event(void)
   static process_data_t data;
   static struct process *receiver;
   static struct process *p;
+#if PROCESS_CONF_ACCOUNTING
+  static rtimer_clock_t posted;
+#endif /* PROCESS_CONF_ACCOUNTING */
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -266,6 +323,9 @@ do_event(void)
     
     data = events[fevent].data;
     receiver = events[fevent].p;
+#if PROCESS_CONF_ACCOUNTING
+    posted = events[fevent].time;
+#endif /* PROCESS_CONF_ACCOUNTING */
 
     /* Since we have seen the new event, we move pointer upwards
        and decrese the number of events. */
@@ -282,6 +342,9 @@ do_event(void)
 	if(poll_requested) {
 	  do_poll();
 	}
+#if PROCESS_CONF_ACCOUNTING
+	account_wait(p, posted);
+#endif /* PROCESS_CONF_ACCOUNTING */
 	call_process(p, ev, data);
       }
     } else {
@@ -294,6 +357,9 @@ do_event(void)
       }
 
       /* Make sure that the process actually is running. */
+#if PROCESS_CONF_ACCOUNTING
+      account_wait(receiver, posted);
+#endif /* PROCESS_CONF_ACCOUNTING */
       call_process(receiver, ev, data);
     }
   }
@@ -348,6 +414,9 @@ process_post(struct process *p, process_event_t ev, process_data_t data)
   events[snum].ev = ev;
   events[snum].data = data;
   events[snum].p = p;
+#if PROCESS_CONF_ACCOUNTING
+  events[snum].time = RTIMER_NOW();
+#endif /* PROCESS_CONF_ACCOUNTING */
   ++nevents;
 
 #if PROCESS_CONF_STATS
@@ -376,6 +445,7 @@ process_poll(struct process *p)
        p->state == PROCESS_STATE_CALLED) {
       p->needspoll = 1;
       poll_requested = 1;
+      PROCESS_CONF_POLL_HOOK();
     }
   }
 }
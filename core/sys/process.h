@@ -89,6 +89,28 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/*
+ * With PROCESS_CONF_ACCOUNTING, every process keeps count of how often
+ * it runs, for how long, and how long the events posted to it wait in
+ * the event queue. The times are in rtimer ticks, so their resolution
+ * is that of RTIMER_NOW(): 1 ms on native, where the rtimer runs on
+ * clock_time(). A single run or wait longer than one period of
+ * rtimer_clock_t (2 s on 16-bit msp430 rtimers) is not measured
+ * correctly.
+ */
+#ifndef PROCESS_CONF_ACCOUNTING
+#define PROCESS_CONF_ACCOUNTING 0
+#endif /* PROCESS_CONF_ACCOUNTING */
+
+/*
+ * Called by process_poll() after a poll has been requested. Platforms
+ * whose main loop sleeps until it has work to do use it to wake up
+ * the loop.
+ */
+#ifndef PROCESS_CONF_POLL_HOOK
+#define PROCESS_CONF_POLL_HOOK()
+#endif /* PROCESS_CONF_POLL_HOOK */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -313,6 +335,21 @@ static PT_THREAD(process_thread_##name(struct pt *process_pt,	\
 
 /** @} */
 
+#if PROCESS_CONF_ACCOUNTING
+struct process_accounting {
+  /* Number of times the process ran, and events delivered from the
+     queue. Polls and synchronous events are not queued. */
+  unsigned long calls;
+  unsigned long events;
+  /* Run time, not including processes called synchronously. */
+  unsigned long time;
+  unsigned long max_time;
+  /* Time from process_post() to delivery. */
+  unsigned long wait;
+  unsigned long max_wait;
+};
+#endif /* PROCESS_CONF_ACCOUNTING */
+
 struct process {
   struct process *next;
 #if PROCESS_CONF_NO_PROCESS_NAMES
@@ -324,6 +361,9 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+#if PROCESS_CONF_ACCOUNTING
+  struct process_accounting acct;
+#endif /* PROCESS_CONF_ACCOUNTING */
 };
 
 /**
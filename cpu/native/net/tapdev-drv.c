@@ -46,6 +46,32 @@
 
 PROCESS(tapdev_process, "TAP driver");
 
+struct tapdev_stats tapdev_stats;
+
+/* Frames handed to the driver since it last ran. */
+static int tx_batch;
+
+/*---------------------------------------------------------------------------*/
+static int
+batch_bin(int n)
+{
+  int bin;
+
+  bin = 0;
+  while(bin < TAPDEV_BATCH_BINS - 1 && (n >> (bin + 1)) > 0) {
+    bin++;
+  }
+  return bin;
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_tx(void)
+{
+  /* Close the batch when the driver runs next. */
+  if(tx_batch++ == 0) {
+    process_poll(&tapdev_process);
+  }
+}
 /*---------------------------------------------------------------------------*/
 #if !UIP_CONF_IPV6
 uint8_t
@@ -53,39 +79,98 @@ tapdev_output(void)
 {
    uip_arp_out();
    tapdev_send();  
+   count_tx();
    return 0;
 }
-#endif
+#else /* !UIP_CONF_IPV6 */
+static uint8_t
+tapdev_output6(uip_lladdr_t *lladdr)
+{
+  count_tx();
+  return tapdev_send(lladdr);
+}
+#endif /* !UIP_CONF_IPV6 */
+/*---------------------------------------------------------------------------*/
+#ifdef CONTIKI_TARGET_NATIVE
+/* The native main loop polls the driver when the device is readable. */
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(tapdev_fd(), rset);
+  return 1;
+}
 /*---------------------------------------------------------------------------*/
 static void
-pollhandler(void)
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  if(FD_ISSET(tapdev_fd(), rset)) {
+    process_poll(&tapdev_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback tapdev_callback = { set_fd, handle_fd };
+#endif /* CONTIKI_TARGET_NATIVE */
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
 {
-  process_poll(&tapdev_process);
-  uip_len = tapdev_poll();
-
-  if(uip_len > 0) {
 #if UIP_CONF_IPV6
-    if(BUF->type == uip_htons(UIP_ETHTYPE_IPV6)) {
-      tcpip_input();
-    } else
+  if(BUF->type == uip_htons(UIP_ETHTYPE_IPV6)) {
+    tcpip_input();
+  } else
 #endif /* UIP_CONF_IPV6 */
-    if(BUF->type == uip_htons(UIP_ETHTYPE_IP)) {
-      uip_len -= sizeof(struct uip_eth_hdr);
-      tcpip_input();
-    } else if(BUF->type == uip_htons(UIP_ETHTYPE_ARP)) {
+  if(BUF->type == uip_htons(UIP_ETHTYPE_IP)) {
+    uip_len -= sizeof(struct uip_eth_hdr);
+    tcpip_input();
+  } else if(BUF->type == uip_htons(UIP_ETHTYPE_ARP)) {
 #if !UIP_CONF_IPV6 //math
-       uip_arp_arpin();
-       /* If the above function invocation resulted in data that
-	  should be sent out on the network, the global variable
-	  uip_len is set to a value > 0. */
-       if(uip_len > 0) {
-	  tapdev_send();
-       }
+     uip_arp_arpin();
+     /* If the above function invocation resulted in data that
+	should be sent out on the network, the global variable
+	uip_len is set to a value > 0. */
+     if(uip_len > 0) {
+	tapdev_send();
+	count_tx();
+     }
 #endif              
-    } else {
-      uip_len = 0;
+  } else {
+    uip_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+pollhandler(void)
+{
+  int n;
+
+  if(tx_batch > 0) {
+    tapdev_stats.tx_batches++;
+    tapdev_stats.tx_batch_hist[batch_bin(tx_batch)]++;
+    tx_batch = 0;
+  }
+
+  for(n = 0; n < TAPDEV_RX_BATCH; n++) {
+    uip_len = tapdev_poll();
+    if(uip_len == 0) {
+      break;
     }
+    input();
+  }
+
+  if(n > 0) {
+    tapdev_stats.rx_frames += n;
+    tapdev_stats.rx_batches++;
+    tapdev_stats.rx_batch_hist[batch_bin(n)]++;
+  }
+
+#ifdef CONTIKI_TARGET_NATIVE
+  /* More frames may be waiting if the batch was full. */
+  if(n == TAPDEV_RX_BATCH) {
+    process_poll(&tapdev_process);
   }
+#else /* CONTIKI_TARGET_NATIVE */
+  process_poll(&tapdev_process);
+#endif /* CONTIKI_TARGET_NATIVE */
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(tapdev_process, ev, data)
@@ -98,12 +183,20 @@ PROCESS_THREAD(tapdev_process, ev, data)
 #if !UIP_CONF_IPV6
   tcpip_set_outputfunc(tapdev_output);
 #else
-  tcpip_set_outputfunc(tapdev_send);
+  tcpip_set_outputfunc(tapdev_output6);
 #endif
+#ifdef CONTIKI_TARGET_NATIVE
+  if(tapdev_fd() > 0) {
+    select_set_callback(tapdev_fd(), &tapdev_callback);
+  }
+#endif /* CONTIKI_TARGET_NATIVE */
   process_poll(&tapdev_process);
 
   PROCESS_WAIT_UNTIL(ev == PROCESS_EVENT_EXIT);
 
+#ifdef CONTIKI_TARGET_NATIVE
+  select_set_callback(tapdev_fd(), NULL);
+#endif /* CONTIKI_TARGET_NATIVE */
   tapdev_exit();
 
   PROCESS_END();
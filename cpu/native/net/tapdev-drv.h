@@ -40,4 +40,36 @@ PROCESS_NAME(tapdev_process);
 
 uint8_t tapdev_output(void);
 
+/*
+ * The number of frames read each time the driver runs. Frames are
+ * passed to uIP one at a time, but reading all the ready frames in one
+ * run saves a process scheduling round per frame during bursts.
+ */
+#ifdef TAPDEV_CONF_RX_BATCH
+#define TAPDEV_RX_BATCH TAPDEV_CONF_RX_BATCH
+#else
+#define TAPDEV_RX_BATCH 16
+#endif
+
+/* Bins of the batch size histograms: 1, 2-3, 4-7, 8-15, 16 and more. */
+#define TAPDEV_BATCH_BINS 5
+
+/*
+ * A receive batch is the frames read in one run of the driver. A
+ * transmit batch is the frames handed to the driver between two of its
+ * runs. tx_frames counts the frames that were written to the device,
+ * tx_drops the frames that were dropped because its queue was full.
+ */
+struct tapdev_stats {
+  unsigned long rx_frames;
+  unsigned long rx_batches;
+  unsigned long rx_batch_hist[TAPDEV_BATCH_BINS];
+  unsigned long tx_frames;
+  unsigned long tx_drops;
+  unsigned long tx_batches;
+  unsigned long tx_batch_hist[TAPDEV_BATCH_BINS];
+};
+
+extern struct tapdev_stats tapdev_stats;
+
 #endif /* __TAPDEV_DRV_H__ */
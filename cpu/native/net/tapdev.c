@@ -34,6 +34,7 @@
  * $Id: tapdev.c,v 1.2 2007/05/20 21:32:24 oliverschmidt Exp $
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -57,6 +58,7 @@
 
 #include "contiki-net.h"
 #include "tapdev.h"
+#include "tapdev-drv.h"
 
 #define DROP 0
 
@@ -86,7 +88,7 @@ tapdev_init(void)
 {
   char buf[1024];
   
-  fd = open(DEVTAP, O_RDWR);
+  fd = open(DEVTAP, O_RDWR | O_NONBLOCK);
   if(fd == -1) {
     perror("tapdev: tapdev_init: open");
     return;
@@ -125,31 +127,30 @@ tapdev_init(void)
 uint16_t
 tapdev_poll(void)
 {
-  fd_set fdset;
-  struct timeval tv;
   int ret;
-  
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
-  
-  FD_ZERO(&fdset);
-  if(fd > 0) {
-    FD_SET(fd, &fdset);
-  }
 
-  ret = select(fd + 1, &fdset, NULL, NULL, &tv);
-
-  if(ret == 0) {
+  if(fd <= 0) {
     return 0;
   }
+
+  /* The device is non-blocking: no frame is not an error. */
   ret = read(fd, uip_buf, UIP_BUFSIZE);
 
   if(ret == -1) {
-    perror("tapdev_poll: read");
+    if(errno != EAGAIN && errno != EWOULDBLOCK) {
+      perror("tapdev_poll: read");
+    }
+    return 0;
   }
   return ret;
 }
 /*---------------------------------------------------------------------------*/
+int
+tapdev_fd(void)
+{
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
 void
 tapdev_send(void)
 {
@@ -165,6 +166,7 @@ tapdev_send(void)
 #if DROP
   drop++;
   if(drop % 8 == 7) {
+    tapdev_stats.tx_drops++;
     printf("Dropped an output packet!\n");
     return;
   }
@@ -173,9 +175,15 @@ tapdev_send(void)
   ret = write(fd, uip_buf, uip_len);
 
   if(ret == -1) {
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      /* The queue of the interface is full: drop the frame. */
+      tapdev_stats.tx_drops++;
+      return;
+    }
     perror("tap_dev: tapdev_send: writev");
     exit(1);
   }
+  tapdev_stats.tx_frames++;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -39,6 +39,7 @@
 
 void tapdev_init(void);
 uint16_t tapdev_poll(void);
+int tapdev_fd(void);
 void tapdev_send(void);
 void tapdev_exit(void);
 
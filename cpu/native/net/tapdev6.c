@@ -35,6 +35,7 @@
  */
 
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -60,6 +61,7 @@
 
 #include "tapdev6.h"
 #include "contiki-net.h"
+#include "tapdev-drv.h"
 
 #define DROP 0
 
@@ -90,39 +92,38 @@ uint8_t tapdev_send(uip_lladdr_t *lladdr);
 uint16_t
 tapdev_poll(void)
 {
-  fd_set fdset;
-  struct timeval tv;
   int ret;
-  
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
-  
-  FD_ZERO(&fdset);
-  if(fd > 0) {
-    FD_SET(fd, &fdset);
-  }
-
-  ret = select(fd + 1, &fdset, NULL, NULL, &tv);
 
-  if(ret == 0) {
+  if(fd <= 0) {
     return 0;
   }
+
+  /* The device is non-blocking: no frame is not an error. */
   ret = read(fd, uip_buf, UIP_BUFSIZE);
 
   PRINTF("tapdev6: read %d bytes (max %d)\n", ret, UIP_BUFSIZE);
-  
+
   if(ret == -1) {
-    perror("tapdev_poll: read");
+    if(errno != EAGAIN && errno != EWOULDBLOCK) {
+      perror("tapdev_poll: read");
+    }
+    return 0;
   }
   return ret;
 }
 /*---------------------------------------------------------------------------*/
+int
+tapdev_fd(void)
+{
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
 void
 tapdev_init(void)
 {
   char buf[1024];
   
-  fd = open(DEVTAP, O_RDWR);
+  fd = open(DEVTAP, O_RDWR | O_NONBLOCK);
   if(fd == -1) {
     perror("tapdev: tapdev_init: open");
     return;
@@ -179,6 +180,7 @@ do_send(void)
 #if DROP
   drop++;
   if(drop % 8 == 7) {
+    tapdev_stats.tx_drops++;
     PRINTF("Dropped an output packet!\n");
     return;
   }
@@ -187,9 +189,15 @@ do_send(void)
   ret = write(fd, uip_buf, uip_len);
 
   if(ret == -1) {
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      /* The queue of the interface is full: drop the frame. */
+      tapdev_stats.tx_drops++;
+      return;
+    }
     perror("tap_dev: tapdev_send: writev");
     exit(1);
   }
+  tapdev_stats.tx_frames++;
 }
 /*---------------------------------------------------------------------------*/
 uint8_t tapdev_send(uip_lladdr_t *lladdr)
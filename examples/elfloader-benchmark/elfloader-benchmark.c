@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Load time benchmark for the ELF loader, for the native
+ *         platform. Loads module.ce repeatedly and prints the number
+ *         of file reads and the time spent in each loading phase.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "loader/elfloader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MODULE      "module.ce"
+/* The loader modifies the file, so every load uses a fresh copy. */
+#define LOAD_FILE   "module-load.ce"
+#define LOADS       200
+
+PROCESS(elfloader_benchmark_process, "ELF loader benchmark");
+AUTOSTART_PROCESSES(&elfloader_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static int
+open_copy(void)
+{
+  char buf[128];
+  int src, dst, len;
+
+  src = cfs_open(MODULE, CFS_READ);
+  if(src < 0) {
+    return -1;
+  }
+  dst = cfs_open(LOAD_FILE, CFS_READ | CFS_WRITE);
+  if(dst < 0) {
+    cfs_close(src);
+    return -1;
+  }
+  while((len = cfs_read(src, buf, sizeof(buf))) > 0) {
+    cfs_write(dst, buf, len);
+  }
+  cfs_close(src);
+  return dst;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_phase(const char *name, clock_time_t ticks)
+{
+  printf("  %-10s %8.3f ms\n", name,
+         (double)ticks * 1000 / CLOCK_SECOND / LOADS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(elfloader_benchmark_process, ev, data)
+{
+  static struct elfloader_stats total;
+  unsigned long start, load_ns, max_ns;
+  int i, fd, ret;
+
+  PROCESS_BEGIN();
+
+  elfloader_init();
+  load_ns = max_ns = 0;
+
+  for(i = 0; i < LOADS; i++) {
+    fd = open_copy();
+    if(fd < 0) {
+      printf("cannot copy %s, run from the example directory\n", MODULE);
+      exit(1);
+    }
+
+    start = now_ns();
+    ret = elfloader_load(fd);
+    start = now_ns() - start;
+    cfs_close(fd);
+
+    if(ret != ELFLOADER_OK) {
+      printf("load failed: %d %s\n", ret, elfloader_unknown);
+      exit(1);
+    }
+
+    load_ns += start;
+    if(start > max_ns) {
+      max_ns = start;
+    }
+    total.reads += elfloader_stats.reads;
+    total.read_bytes += elfloader_stats.read_bytes;
+    total.parse_time += elfloader_stats.parse_time;
+    total.index_time += elfloader_stats.index_time;
+    total.relocate_time += elfloader_stats.relocate_time;
+    total.copy_time += elfloader_stats.copy_time;
+    total.total_time += elfloader_stats.total_time;
+  }
+  cfs_remove(LOAD_FILE);
+
+  printf("ELF loader benchmark, symbol index of %d entries\n",
+         ELFLOADER_SYMBOL_INDEX_SIZE);
+  printf("%u relocations, %u indexed symbols, %u symbol table scans\n",
+         elfloader_stats.relocations, elfloader_stats.indexed_symbols,
+         elfloader_stats.symtab_scans);
+  printf("%lu reads, %lu bytes per load\n",
+         total.reads / LOADS, total.read_bytes / LOADS);
+  printf("load time avg %lu ns, max %lu ns\n", load_ns / LOADS, max_ns);
+  printf("average time per phase:\n");
+  print_phase("parse", total.parse_time);
+  print_phase("index", total.index_time);
+  print_phase("relocate", total.relocate_time);
+  print_phase("copy", total.copy_time);
+  print_phase("total", total.total_time);
+
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A loadable module with many local symbols, loaded by the ELF
+ *         loader benchmark. It is relocated but never run.
+ */
+
+/*
+ * The module is a 32-bit x86 object, built without the host C library
+ * headers. It therefore declares its own process structure, laid out
+ * as struct process of the 32-bit native platform.
+ */
+struct process {
+  struct process *next;
+  const char *name;
+  char (* thread)(void *, unsigned char, void *);
+  unsigned short pt;
+  unsigned char state, needspoll;
+};
+
+#define NULL ((void *)0)
+
+/* Defines a function and a variable that refer to each other. */
+#define SYMBOL(n)                       \
+  int counter##n = 1;                   \
+  int function##n(int x)                \
+  {                                     \
+    counter##n += x;                    \
+    return table[x & 7] + counter##n;   \
+  }
+#define SYMBOLS(n)                      \
+  SYMBOL(n##0) SYMBOL(n##1) SYMBOL(n##2) SYMBOL(n##3) \
+  SYMBOL(n##4) SYMBOL(n##5) SYMBOL(n##6) SYMBOL(n##7)
+#define FUNCTIONS(n)                                    \
+  function##n##0, function##n##1, function##n##2, function##n##3, \
+  function##n##4, function##n##5, function##n##6, function##n##7
+
+int table[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+SYMBOLS(1)
+SYMBOLS(2)
+SYMBOLS(3)
+SYMBOLS(4)
+SYMBOLS(5)
+SYMBOLS(6)
+
+int (*functions[])(int) = {
+  FUNCTIONS(1), FUNCTIONS(2), FUNCTIONS(3),
+  FUNCTIONS(4), FUNCTIONS(5), FUNCTIONS(6)
+};
+/*---------------------------------------------------------------------------*/
+static char
+module_thread(void *pt, unsigned char ev, void *data)
+{
+  int i;
+
+  for(i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+    functions[i](i);
+  }
+  return 3; /* PT_EXITED */
+}
+/*---------------------------------------------------------------------------*/
+static struct process module_process = {
+  NULL, "Benchmark module", module_thread
+};
+
+struct process *autostart_processes[] = { &module_process, NULL };
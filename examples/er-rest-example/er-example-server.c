@@ -41,6 +41,7 @@
 #include <string.h>
 #include "contiki.h"
 #include "contiki-net.h"
+#include "lib/memb.h"
 
 
 /* Define which resources to include to meet memory constraints. */
@@ -56,6 +57,9 @@
 #define REST_RES_BATTERY 0
 #define REST_RES_RADIO 0
 #define REST_RES_MIRROR 0 /* causes largest code size */
+#define REST_RES_MEMB 1 /* requires MEMB_CONF_STATS */
+#define REST_RES_RPL 1 /* requires RPL_CONF_STATS */
+#define REST_RES_PS 1 /* requires PROCESS_CONF_ACCOUNTING */
 
 
 
@@ -783,6 +787,233 @@ radio_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred
 }
 #endif
 
+/******************************************************************************/
+#if (REST_RES_MEMB && MEMB_STATS) || (REST_RES_RPL && UIP_CONF_IPV6_RPL && RPL_CONF_STATS) || \
+    (REST_RES_PS && PROCESS_CONF_ACCOUNTING)
+#define REPORT_LINE_SIZE 80
+
+/*
+ * Sends the block at *offset of a text report that is generated one line at
+ * a time. get_line formats line number index into line and returns its
+ * length, or -1 past the last line. Lines are regenerated for every block,
+ * so that the report does not have to be kept in memory.
+ */
+static void
+send_report_block(void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset,
+                  int (*get_line)(int index, char *line, int size))
+{
+  char line[REPORT_LINE_SIZE];
+  int32_t pos = 0;
+  int32_t start;
+  int32_t strpos = 0;
+  int index;
+  int len;
+  int n;
+
+  for (index = 0; (len = get_line(index, line, sizeof(line))) >= 0; ++index)
+  {
+    if (len >= (int)sizeof(line))
+    {
+      len = sizeof(line) - 1;
+    }
+
+    /* Copy the part of the line that falls into the requested block. */
+    if (pos + len > *offset)
+    {
+      if (strpos == preferred_size)
+      {
+        /* The block is full and more of the report follows. */
+        break;
+      }
+      start = *offset > pos ? *offset - pos : 0;
+      n = len - start;
+      if (n > preferred_size - strpos)
+      {
+        n = preferred_size - strpos;
+      }
+      memcpy(buffer + strpos, line + start, n);
+      strpos += n;
+    }
+    pos += len;
+  }
+
+  if (strpos == 0 && *offset > 0)
+  {
+    REST.set_response_status(response, REST.status.BAD_OPTION);
+    const char *error_msg = "BlockOutOfScope";
+    REST.set_response_payload(response, error_msg, strlen(error_msg));
+    return;
+  }
+
+  REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+  REST.set_response_payload(response, buffer, strpos);
+
+  *offset += strpos;
+  if (len < 0 && pos <= *offset)
+  {
+    *offset = -1;
+  }
+}
+#endif /* report resources */
+
+/******************************************************************************/
+#if REST_RES_MEMB && MEMB_STATS
+/*
+ * Reports one line per memory block: name, blocks in use, total blocks,
+ * peak usage, and failed allocations. The report can exceed one chunk
+ * and is transferred blockwise.
+ */
+RESOURCE(memb, METHOD_GET, "debug/memb", "title=\"Memory block usage\";rt=\"Debug\"");
+
+/* Formats line number index of the report. Returns -1 past the last line. */
+static int
+memb_line(int index, char *line, int size)
+{
+  struct memb *m;
+
+  for (m = memb_pools(); m != NULL && index > 0; m = m->next)
+  {
+    --index;
+  }
+  if (m == NULL)
+  {
+    return -1;
+  }
+  return snprintf(line, size, "%s %u %u %u %u\n", m->name, m->allocated, m->num, m->used, m->failures);
+}
+
+void
+memb_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  send_report_block(response, buffer, preferred_size, offset, memb_line);
+}
+#endif /* REST_RES_MEMB && MEMB_STATS */
+
+/******************************************************************************/
+#if REST_RES_RPL && UIP_CONF_IPV6_RPL && RPL_CONF_STATS
+#include "net/rpl/rpl.h"
+
+/*
+ * Reports the RPL statistics as lines of text: the DIO, DAO, and DIS
+ * counters with their average rates per minute since boot, the topology
+ * counters, one
+ * line per parent with its link metric history, and the event log.
+ */
+RESOURCE(rpl, METHOD_GET, "debug/rpl", "title=\"RPL statistics\";rt=\"Debug\"");
+
+/* Formats line number index of the report. Returns -1 past the last line. */
+static int
+rpl_stats_line(int index, char *line, int size)
+{
+  rpl_dag_t *dag;
+  rpl_parent_t *p;
+  struct rpl_stats_event *e;
+  int i, len;
+
+  switch (index)
+  {
+    case 0:
+      return snprintf(line, size, "dio %u %lu %u %lu\n",
+                      rpl_stats.dio_sent, rpl_stats_per_minute(rpl_stats.dio_sent),
+                      rpl_stats.dio_recv, rpl_stats_per_minute(rpl_stats.dio_recv));
+    case 1:
+      return snprintf(line, size, "dao %u %lu %u %lu\n",
+                      rpl_stats.dao_sent, rpl_stats_per_minute(rpl_stats.dao_sent),
+                      rpl_stats.dao_recv, rpl_stats_per_minute(rpl_stats.dao_recv));
+    case 2:
+      return snprintf(line, size, "dis %u %lu %u %lu\n",
+                      rpl_stats.dis_sent, rpl_stats_per_minute(rpl_stats.dis_sent),
+                      rpl_stats.dis_recv, rpl_stats_per_minute(rpl_stats.dis_recv));
+    case 3:
+      return snprintf(line, size, "topology %u %u %u %u\n",
+                      rpl_stats.parent_switch, rpl_stats.rank_changes,
+                      rpl_stats.local_repairs, rpl_stats.global_repairs);
+  }
+  index -= 4;
+
+  dag = rpl_get_any_dag();
+  if (dag != NULL)
+  {
+    for (p = list_head(dag->parents); p != NULL && index > 0; p = list_item_next(p))
+    {
+      --index;
+    }
+    if (p != NULL)
+    {
+      len = snprintf(line, size, "parent %02x%02x %u %c", p->addr.u8[14], p->addr.u8[15],
+                     p->rank, p == dag->preferred_parent ? '*' : '-');
+      for (i = 0; i < RPL_STATS_LINK_METRIC_HISTORY && len < size - 1; ++i)
+      {
+        len += snprintf(line + len, size - len, " %u",
+                        p->link_metric_history[(p->link_metric_next + i) % RPL_STATS_LINK_METRIC_HISTORY]);
+      }
+      if (len < size - 1)
+      {
+        line[len++] = '\n';
+        line[len] = '\0';
+      }
+      return len;
+    }
+  }
+
+  e = rpl_stats_get_event(index);
+  if (e == NULL)
+  {
+    return -1;
+  }
+  return snprintf(line, size, "event %lu %s %04x %u %u\n", (unsigned long)e->time,
+                  rpl_stats_event_name(e->type),
+                  e->parent, e->old_rank, e->new_rank);
+}
+
+void
+rpl_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  send_report_block(response, buffer, preferred_size, offset, rpl_stats_line);
+}
+#endif /* REST_RES_RPL && UIP_CONF_IPV6_RPL && RPL_CONF_STATS */
+
+/******************************************************************************/
+#if REST_RES_PS && PROCESS_CONF_ACCOUNTING
+#include "sys/rtimer.h"
+
+/*
+ * Reports the rtimer ticks per second, then one line per process: name,
+ * calls, run time, maximum run time, queued events, total and maximum
+ * time the events waited in the queue. Times are in rtimer ticks.
+ */
+RESOURCE(ps, METHOD_GET, "debug/ps", "title=\"Process accounting\";rt=\"Debug\"");
+
+/* Formats line number index of the report. Returns -1 past the last line. */
+static int
+ps_line(int index, char *line, int size)
+{
+  struct process *p;
+
+  if (index == 0)
+  {
+    return snprintf(line, size, "ticks %lu\n", (unsigned long)RTIMER_SECOND);
+  }
+
+  for (p = PROCESS_LIST(); p != NULL && index > 1; p = p->next)
+  {
+    --index;
+  }
+  if (p == NULL)
+  {
+    return -1;
+  }
+  return snprintf(line, size, "%s %lu %lu %lu %lu %lu %lu\n", PROCESS_NAME_STRING(p),
+                  p->acct.calls, p->acct.time, p->acct.max_time,
+                  p->acct.events, p->acct.wait, p->acct.max_wait);
+}
+
+void
+ps_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  send_report_block(response, buffer, preferred_size, offset, ps_line);
+}
+#endif /* REST_RES_PS && PROCESS_CONF_ACCOUNTING */
 
 
 PROCESS(rest_server_example, "Erbium Example Server");
@@ -816,6 +1047,15 @@ PROCESS_THREAD(rest_server_example, ev, data)
 #if REST_RES_MIRROR
   rest_activate_resource(&resource_mirror);
 #endif
+#if REST_RES_MEMB && MEMB_STATS
+  rest_activate_resource(&resource_memb);
+#endif
+#if REST_RES_RPL && UIP_CONF_IPV6_RPL && RPL_CONF_STATS
+  rest_activate_resource(&resource_rpl);
+#endif
+#if REST_RES_PS && PROCESS_CONF_ACCOUNTING
+  rest_activate_resource(&resource_ps);
+#endif
 #if REST_RES_CHUNKS
   rest_activate_resource(&resource_chunks);
 #endif
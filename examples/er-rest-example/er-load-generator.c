@@ -0,0 +1,677 @@
+/*
+ * Copyright (c) 2013, Institute for Pervasive Computing, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *      CoAP load generator for the native and minimal-net platforms.
+ *
+ *      Keeps a number of requests outstanding against one resource and
+ *      reports throughput and latency percentiles. Each request can be a
+ *      CON or a NON, can fetch the whole Block2 body of the resource, and
+ *      a resource can be observed during the run to measure how regular
+ *      its notifications stay under load. Latencies are taken from the
+ *      host clock, as the Contiki clock only has millisecond resolution.
+ *
+ *      On native, the defaults below can be overridden on the command line:
+ *        -a address   server address
+ *        -p path      resource to request
+ *        -c number    requests outstanding at the same time
+ *        -n number    requests to complete, 0 for no limit
+ *        -d seconds   stop starting requests after this time, 0 for no limit
+ *        -N percent   share of NON requests
+ *        -b size      fetch the whole body in Block2 blocks of this size
+ *        -o path      observe this resource during the run
+ *        -w seconds   wait before the first request
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#if CONTIKI_TARGET_NATIVE
+#include <unistd.h>
+#endif
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "lib/random.h"
+
+#if WITH_COAP == 13
+#include "er-coap-13.h"
+#else
+#error "The load generator requires WITH_COAP=13"
+#endif
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#ifdef LOAD_GENERATOR_CONF_SERVER
+#define LOAD_GENERATOR_SERVER LOAD_GENERATOR_CONF_SERVER
+#elif CONTIKI_TARGET_MINIMAL_NET
+/* er-plugtest-server on minimal-net */
+#define LOAD_GENERATOR_SERVER "fdfd::ff:fe00:10"
+#else
+/* Node 1 of a tools/native-sim network */
+#define LOAD_GENERATOR_SERVER "fe80::302:304:506:1"
+#endif
+
+#ifdef LOAD_GENERATOR_CONF_PATH
+#define LOAD_GENERATOR_PATH LOAD_GENERATOR_CONF_PATH
+#else
+#define LOAD_GENERATOR_PATH "test"
+#endif
+
+#ifdef LOAD_GENERATOR_CONF_CONCURRENCY
+#define LOAD_GENERATOR_CONCURRENCY LOAD_GENERATOR_CONF_CONCURRENCY
+#else
+#define LOAD_GENERATOR_CONCURRENCY 1
+#endif
+
+#ifdef LOAD_GENERATOR_CONF_REQUESTS
+#define LOAD_GENERATOR_REQUESTS LOAD_GENERATOR_CONF_REQUESTS
+#else
+#define LOAD_GENERATOR_REQUESTS 1000
+#endif
+
+#ifdef LOAD_GENERATOR_CONF_NON_PERCENT
+#define LOAD_GENERATOR_NON_PERCENT LOAD_GENERATOR_CONF_NON_PERCENT
+#else
+#define LOAD_GENERATOR_NON_PERCENT 0
+#endif
+
+/* The most requests that can be outstanding at the same time. */
+#ifdef LOAD_GENERATOR_CONF_MAX_CONCURRENCY
+#define MAX_CONCURRENCY LOAD_GENERATOR_CONF_MAX_CONCURRENCY
+#else
+#define MAX_CONCURRENCY 32
+#endif
+
+/* Latencies kept for the percentiles; later requests are only counted. */
+#ifdef LOAD_GENERATOR_CONF_MAX_SAMPLES
+#define MAX_SAMPLES LOAD_GENERATOR_CONF_MAX_SAMPLES
+#else
+#define MAX_SAMPLES 65536
+#endif
+
+#define MAX_NOTIFICATIONS 1024
+
+#define LOCAL_PORT      UIP_HTONS(COAP_DEFAULT_PORT+1)
+#define REMOTE_PORT     UIP_HTONS(COAP_DEFAULT_PORT)
+
+/* Retransmission timing as in er-coap-13-transactions.c. */
+#define RESPONSE_TIMEOUT_TICKS (CLOCK_SECOND * COAP_RESPONSE_TIMEOUT)
+#define RESPONSE_TIMEOUT_BACKOFF_MASK ((CLOCK_SECOND * COAP_RESPONSE_TIMEOUT * (COAP_RESPONSE_RANDOM_FACTOR - 1)) + 1.5)
+/* A NON request or a separate response is given up after as long as all
+ * retransmissions of a CON would take. */
+#define EXCHANGE_TIMEOUT_TICKS (RESPONSE_TIMEOUT_TICKS * ((1 << (COAP_MAX_RETRANSMIT + 1)) - 1))
+
+#define TICK (CLOCK_SECOND / 100)
+
+/* The observe request uses the slot after the load. */
+#define OBSERVE_SLOT MAX_CONCURRENCY
+
+enum {
+  SLOT_FREE,
+  SLOT_WAITING,   /* request sent, nothing received yet */
+  SLOT_ACKED,     /* empty ACK received, waiting for a separate response */
+  SLOT_OBSERVING  /* observe relationship established */
+};
+
+struct request {
+  uint8_t state;
+  uint8_t type;
+  uint8_t seq;
+  uint8_t retransmissions;
+  uint16_t mid;
+  uint32_t block;
+  unsigned long start;
+  clock_time_t sent;
+  clock_time_t timeout;
+  uint16_t len;
+  uint8_t buf[COAP_MAX_PACKET_SIZE];
+};
+
+PROCESS(load_generator, "CoAP load generator");
+AUTOSTART_PROCESSES(&load_generator);
+
+static struct uip_udp_conn *conn;
+static uip_ipaddr_t server_ipaddr;
+static struct etimer et;
+
+static const char *server = LOAD_GENERATOR_SERVER;
+static const char *path = LOAD_GENERATOR_PATH;
+static const char *observe_path;
+static int concurrency = LOAD_GENERATOR_CONCURRENCY;
+static unsigned long requests = LOAD_GENERATOR_REQUESTS;
+static unsigned long duration;
+static int non_percent = LOAD_GENERATOR_NON_PERCENT;
+static uint16_t block_size;
+static unsigned long wait = 2;
+
+static struct request slots[MAX_CONCURRENCY + 1];
+static uint16_t next_mid;
+static int stopping;
+
+static unsigned long started, completed, failed, timeouts, retransmissions;
+static unsigned long blocks, errors, separate, rst;
+static unsigned long start_time, end_time;
+static unsigned long samples[MAX_SAMPLES];
+static unsigned long num_samples;
+
+static unsigned long notifications, notifications_lost;
+static unsigned long last_notification;
+static uint32_t last_observe;
+static unsigned long intervals[MAX_NOTIFICATIONS];
+static unsigned long num_intervals;
+/*---------------------------------------------------------------------------*/
+/* Microseconds of the host clock. */
+static unsigned long
+now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_options(void)
+{
+#if CONTIKI_TARGET_NATIVE
+  extern int contiki_argc;
+  extern char **contiki_argv;
+  int opt;
+
+  while((opt = getopt(contiki_argc, contiki_argv, "a:p:c:n:d:N:b:o:w:")) != -1) {
+    switch(opt) {
+    case 'a':
+      server = optarg;
+      break;
+    case 'p':
+      path = optarg;
+      break;
+    case 'c':
+      concurrency = atoi(optarg);
+      break;
+    case 'n':
+      requests = strtoul(optarg, NULL, 0);
+      break;
+    case 'd':
+      duration = strtoul(optarg, NULL, 0);
+      break;
+    case 'N':
+      non_percent = atoi(optarg);
+      break;
+    case 'b':
+      block_size = atoi(optarg);
+      break;
+    case 'o':
+      observe_path = optarg;
+      break;
+    case 'w':
+      wait = strtoul(optarg, NULL, 0);
+      break;
+    default:
+      printf("usage: %s [-a address] [-p path] [-c concurrency] [-n requests] "
+             "[-d seconds] [-N non-percent] [-b block-size] [-o observe-path] "
+             "[-w seconds]\n", contiki_argv[0]);
+      exit(1);
+    }
+  }
+#endif /* CONTIKI_TARGET_NATIVE */
+
+  if(concurrency < 1) {
+    concurrency = 1;
+  } else if(concurrency > MAX_CONCURRENCY) {
+    printf("load: concurrency limited to %u\n", MAX_CONCURRENCY);
+    concurrency = MAX_CONCURRENCY;
+  }
+  if(block_size > REST_MAX_CHUNK_SIZE) {
+    printf("load: block size limited to %u\n", REST_MAX_CHUNK_SIZE);
+    block_size = REST_MAX_CHUNK_SIZE;
+  }
+  if(requests == 0 && duration == 0) {
+    requests = LOAD_GENERATOR_REQUESTS;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_request(struct request *r)
+{
+  uip_udp_packet_sendto(conn, r->buf, r->len, &server_ipaddr, REMOTE_PORT);
+  r->sent = clock_time();
+}
+/*---------------------------------------------------------------------------*/
+static void
+prepare_request(struct request *r, const char *uri, int observe)
+{
+  static coap_packet_t request[1];
+  uint8_t token[2];
+
+  r->mid = next_mid++;
+  r->retransmissions = 0;
+  r->timeout = r->type == COAP_TYPE_CON ?
+    RESPONSE_TIMEOUT_TICKS + (random_rand() % (clock_time_t)RESPONSE_TIMEOUT_BACKOFF_MASK) :
+    EXCHANGE_TIMEOUT_TICKS;
+
+  /* The token tells the slot and which of its requests this is. */
+  token[0] = r - slots;
+  token[1] = r->seq;
+
+  coap_init_message(request, r->type, COAP_GET, r->mid);
+  coap_set_header_uri_path(request, uri);
+  coap_set_header_token(request, token, sizeof(token));
+  if(observe) {
+    coap_set_header_observe(request, 0);
+  }
+  if(block_size > 0 && r != &slots[OBSERVE_SLOT]) {
+    coap_set_header_block2(request, r->block, 0, block_size);
+  }
+  r->len = coap_serialize_message(request, r->buf);
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_request(struct request *r)
+{
+  r->state = SLOT_WAITING;
+  r->seq++;
+  r->block = 0;
+  r->type = (int)(random_rand() % 100) < non_percent ? COAP_TYPE_NON : COAP_TYPE_CON;
+  r->start = now_us();
+  started++;
+  prepare_request(r, path, 0);
+  send_request(r);
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_requests(void)
+{
+  int i;
+
+  if(duration > 0 && now_us() - start_time >= duration * 1000000UL) {
+    stopping = 1;
+  }
+  for(i = 0; i < concurrency; i++) {
+    if(slots[i].state == SLOT_FREE && !stopping &&
+       (requests == 0 || started < requests)) {
+      start_request(&slots[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+finish_request(struct request *r, int ok)
+{
+  unsigned long latency;
+
+  r->state = SLOT_FREE;
+  if(ok) {
+    latency = now_us() - r->start;
+    completed++;
+    if(num_samples < MAX_SAMPLES) {
+      samples[num_samples++] = latency;
+    }
+  } else {
+    failed++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_empty(coap_message_type_t type, uint16_t mid)
+{
+  static coap_packet_t message[1];
+  uint8_t buf[COAP_HEADER_LEN];
+
+  coap_init_message(message, type, 0, mid);
+  uip_udp_packet_sendto(conn, buf, coap_serialize_message(message, buf),
+                        &server_ipaddr, REMOTE_PORT);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_notification(coap_packet_t *message)
+{
+  unsigned long t;
+  uint32_t observe;
+
+  t = now_us();
+  if(notifications > 0) {
+    if(num_intervals < MAX_NOTIFICATIONS) {
+      intervals[num_intervals++] = t - last_notification;
+    }
+    if(coap_get_header_observe(message, &observe) &&
+       observe > last_observe + 1) {
+      notifications_lost += observe - last_observe - 1;
+    }
+  }
+  coap_get_header_observe(message, &last_observe);
+  last_notification = t;
+  notifications++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_response(struct request *r, coap_packet_t *message)
+{
+  uint32_t num;
+  uint8_t more;
+
+  if(r == &slots[OBSERVE_SLOT]) {
+    if(r->state != SLOT_OBSERVING) {
+      printf("load: observe registered in %lu us\n", now_us() - r->start);
+      r->state = SLOT_OBSERVING;
+    } else {
+      handle_notification(message);
+    }
+    return;
+  }
+
+  if(message->code >= BAD_REQUEST_4_00) {
+    errors++;
+    finish_request(r, 0);
+    return;
+  }
+
+  blocks++;
+  if(block_size > 0 &&
+     coap_get_header_block2(message, &num, &more, NULL, NULL) && more) {
+    /* The next block goes out with the same token and a new MID. */
+    r->state = SLOT_WAITING;
+    r->block = num + 1;
+    prepare_request(r, path, 0);
+    send_request(r);
+    return;
+  }
+  finish_request(r, 1);
+}
+/*---------------------------------------------------------------------------*/
+static struct request *
+find_by_mid(uint16_t mid)
+{
+  int i;
+
+  for(i = 0; i <= OBSERVE_SLOT; i++) {
+    if(slots[i].state == SLOT_WAITING && slots[i].mid == mid) {
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static struct request *
+find_by_token(coap_packet_t *message)
+{
+  struct request *r;
+
+  if(message->token_len != 2 || message->token[0] > OBSERVE_SLOT) {
+    return NULL;
+  }
+  r = &slots[message->token[0]];
+  if(r->state == SLOT_FREE || r->seq != message->token[1]) {
+    return NULL;
+  }
+  return r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_message(void)
+{
+  static coap_packet_t message[1];
+  struct request *r;
+
+  if(coap_parse_message(message, uip_appdata, uip_datalen()) != NO_ERROR) {
+    PRINTF("load: malformed message\n");
+    return;
+  }
+
+  if(message->type == COAP_TYPE_ACK || message->type == COAP_TYPE_RST) {
+    r = find_by_mid(message->mid);
+    if(r == NULL) {
+      /* A duplicate, or the ACK of a request that was already given up. */
+      return;
+    }
+    if(message->type == COAP_TYPE_RST) {
+      rst++;
+      if(r == &slots[OBSERVE_SLOT]) {
+        r->state = SLOT_FREE;
+      } else {
+        finish_request(r, 0);
+      }
+    } else if(message->code == 0) {
+      /* Empty ACK: the response will follow separately. */
+      separate++;
+      r->state = SLOT_ACKED;
+      r->sent = clock_time();
+      r->timeout = EXCHANGE_TIMEOUT_TICKS;
+    } else {
+      handle_response(r, message);
+    }
+    return;
+  }
+
+  /* Separate responses, NON responses and notifications. */
+  r = find_by_token(message);
+  if(message->type == COAP_TYPE_CON) {
+    send_empty(r == NULL ? COAP_TYPE_RST : COAP_TYPE_ACK, message->mid);
+  }
+  if(r != NULL) {
+    handle_response(r, message);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_timeouts(void)
+{
+  struct request *r;
+  int i;
+
+  for(i = 0; i <= OBSERVE_SLOT; i++) {
+    r = &slots[i];
+    if((r->state != SLOT_WAITING && r->state != SLOT_ACKED) ||
+       clock_time() - r->sent < r->timeout) {
+      continue;
+    }
+    if(r->state == SLOT_WAITING && r->type == COAP_TYPE_CON &&
+       r->retransmissions < COAP_MAX_RETRANSMIT) {
+      r->retransmissions++;
+      r->timeout <<= 1;
+      retransmissions++;
+      send_request(r);
+      continue;
+    }
+    if(i == OBSERVE_SLOT) {
+      printf("load: observe registration timed out\n");
+      r->state = SLOT_FREE;
+    } else {
+      timeouts++;
+      finish_request(r, 0);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_event(process_event_t ev, process_data_t data)
+{
+  if(ev == tcpip_event && uip_newdata()) {
+    handle_message();
+  } else if(ev == PROCESS_EVENT_TIMER && data == &et) {
+    check_timeouts();
+    etimer_reset(&et);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset_statistics(void)
+{
+  started = completed = failed = 0;
+  timeouts = retransmissions = 0;
+  blocks = errors = separate = rst = 0;
+  num_samples = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+outstanding(void)
+{
+  int i;
+
+  for(i = 0; i < concurrency; i++) {
+    if(slots[i].state != SLOT_FREE) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+compare(const void *a, const void *b)
+{
+  unsigned long x = *(const unsigned long *)a;
+  unsigned long y = *(const unsigned long *)b;
+
+  return x < y ? -1 : x > y;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_percentiles(const char *what, unsigned long *values, unsigned long n)
+{
+  unsigned long long sum;
+  unsigned long i;
+
+  if(n == 0) {
+    return;
+  }
+  qsort(values, n, sizeof(unsigned long), compare);
+  for(sum = 0, i = 0; i < n; i++) {
+    sum += values[i];
+  }
+  printf("load: %s us min %lu mean %lu p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n",
+         what, values[0], (unsigned long)(sum / n),
+         values[(n - 1) * 50 / 100], values[(n - 1) * 90 / 100],
+         values[(n - 1) * 99 / 100], values[(n - 1) * 999 / 1000],
+         values[n - 1]);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(void)
+{
+  unsigned long elapsed;
+
+  elapsed = end_time - start_time;
+  printf("load: %lu completed, %lu failed (%lu timeouts, %lu errors, %lu resets) in %lu ms\n",
+         completed, failed, timeouts, errors, rst, elapsed / 1000);
+  printf("load: %lu responses, %lu separate, %lu retransmissions\n",
+         blocks, separate, retransmissions);
+  if(elapsed > 0) {
+    printf("load: throughput %lu.%02lu requests/s\n",
+           (unsigned long)(completed * 1000000ULL / elapsed),
+           (unsigned long)(completed * 100000000ULL / elapsed % 100));
+  }
+  print_percentiles("latency", samples, num_samples);
+  if(observe_path != NULL) {
+    printf("load: %lu notifications, %lu missed\n",
+           notifications, notifications_lost);
+    print_percentiles("notification interval", intervals, num_intervals);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(load_generator, ev, data)
+{
+  PROCESS_BEGIN();
+
+  parse_options();
+  if(!uiplib_ipaddrconv(server, &server_ipaddr)) {
+    printf("load: bad server address %s\n", server);
+    exit(1);
+  }
+
+  conn = udp_new(NULL, 0, NULL);
+  udp_bind(conn, LOCAL_PORT);
+  next_mid = random_rand();
+
+  /* Give the network time to come up. */
+  etimer_set(&et, wait * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+  printf("load: GET /%s from %s, %d outstanding, %d%% NON",
+         path, server, concurrency, non_percent);
+  if(block_size > 0) {
+    printf(", Block2 size %u", block_size);
+  }
+  printf("\n");
+
+  /* A first request, not measured, lets neighbor discovery complete. */
+  slots[0].state = SLOT_WAITING;
+  slots[0].type = COAP_TYPE_CON;
+  slots[0].seq++;
+  prepare_request(&slots[0], path, 0);
+  send_request(&slots[0]);
+  etimer_set(&et, TICK);
+  while(slots[0].state != SLOT_FREE) {
+    PROCESS_WAIT_EVENT();
+    handle_event(ev, data);
+  }
+  reset_statistics();
+
+  if(observe_path != NULL) {
+    slots[OBSERVE_SLOT].type = COAP_TYPE_CON;
+    slots[OBSERVE_SLOT].state = SLOT_WAITING;
+    slots[OBSERVE_SLOT].start = now_us();
+    prepare_request(&slots[OBSERVE_SLOT], observe_path, 1);
+    send_request(&slots[OBSERVE_SLOT]);
+  }
+
+  start_time = now_us();
+  start_requests();
+
+  while(outstanding() || !stopping) {
+    PROCESS_WAIT_EVENT();
+    handle_event(ev, data);
+    start_requests();
+    if(requests > 0 && started >= requests) {
+      stopping = 1;
+    }
+  }
+  end_time = now_us();
+
+  if(slots[OBSERVE_SLOT].state == SLOT_OBSERVING) {
+    /* A GET without Observe cancels the relationship. */
+    slots[OBSERVE_SLOT].type = COAP_TYPE_NON;
+    prepare_request(&slots[OBSERVE_SLOT], observe_path, 0);
+    send_request(&slots[OBSERVE_SLOT]);
+  }
+
+  report();
+  exit(0);
+
+  PROCESS_END();
+}
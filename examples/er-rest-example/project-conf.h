@@ -72,6 +72,24 @@
 #define COAP_LINK_FORMAT_FILTERING      0
 */
 
+/* Memory block statistics for the debug/memb resource. */
+/*
+#undef MEMB_CONF_STATS
+#define MEMB_CONF_STATS 1
+*/
+
+/* RPL statistics and event log for the debug/rpl resource. */
+/*
+#undef RPL_CONF_STATS
+#define RPL_CONF_STATS 1
+*/
+
+/* Per-process run time and event latency for the debug/ps resource. */
+/*
+#undef PROCESS_CONF_ACCOUNTING
+#define PROCESS_CONF_ACCOUNTING 1
+*/
+
 /* Save some memory for the sky platform. */
 #undef UIP_CONF_DS6_NBR_NBU
 #define UIP_CONF_DS6_NBR_NBU     10
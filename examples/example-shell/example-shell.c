@@ -68,6 +68,7 @@ PROCESS_THREAD(example_shell_process, ev, data)
   shell_file_init();
   shell_httpd_init();
   shell_irc_init();
+  shell_memdebug_init();
   shell_netfile_init();
   /*shell_ping_init();*/ /* uIP ping */
   shell_power_init();
@@ -80,10 +81,12 @@ PROCESS_THREAD(example_shell_process, ev, data)
   shell_rime_sendcmd_init();
   shell_rime_sniff_init();
   shell_rime_init();
+  shell_rpl_init(); /* needs UIP_CONF_IPV6_RPL and RPL_CONF_STATS */
   /*shell_rsh_init();*/
   shell_run_init();
   shell_sendtest_init();
   /*shell_sky_init();*/
+  shell_tapdev_init(); /* native and minimal-net */
   shell_tcpsend_init();
   shell_text_init();
   shell_time_init();
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Checks the IPv6 checksum functions against a straightforward
+ *         RFC 1071 implementation and measures their throughput. Runs
+ *         on the native platform.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/uip-icmp6.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS      20000
+#define BENCH_ROUNDS 20000
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF ((struct uip_icmp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define MAX_PAYLOAD  (UIP_BUFSIZE - UIP_LLIPH_LEN)
+
+static unsigned long failures;
+
+PROCESS(chksum_test_process, "Checksum test");
+AUTOSTART_PROCESSES(&chksum_test_process);
+/*---------------------------------------------------------------------------*/
+static uint16_t
+ref_sum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint32_t acc = sum;
+  uint16_t i;
+
+  for(i = 0; i + 1 < len; i += 2) {
+    acc += (data[i] << 8) + data[i + 1];
+  }
+  if(i < len) {
+    acc += data[i] << 8;
+  }
+  while(acc >> 16) {
+    acc = (acc >> 16) + (acc & 0xffff);
+  }
+  return acc;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+ref_upper_layer_chksum(uint8_t proto)
+{
+  uint16_t len, sum;
+
+  len = (UIP_IP_BUF->len[0] << 8) + UIP_IP_BUF->len[1];
+  sum = ref_sum(len + proto, (uint8_t *)&UIP_IP_BUF->srcipaddr,
+                2 * sizeof(uip_ipaddr_t));
+  sum = ref_sum(sum, &uip_buf[UIP_LLIPH_LEN], len);
+  return (sum == 0) ? 0xffff : uip_htons(sum);
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_packet(uint16_t len, uint8_t proto)
+{
+  uint16_t i;
+
+  for(i = 0; i < UIP_LLIPH_LEN + len; i++) {
+    uip_buf[i] = random_rand();
+  }
+  /* Exercise the carry handling with runs of 0xff. */
+  if(random_rand() & 1) {
+    memset(&uip_buf[UIP_LLIPH_LEN], 0xff, len);
+  }
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->proto = proto;
+  UIP_IP_BUF->len[0] = len >> 8;
+  UIP_IP_BUF->len[1] = len & 0xff;
+  uip_ext_len = 0;
+  uip_len = UIP_IPH_LEN + len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fail(const char *test, unsigned long round, uint16_t got, uint16_t expected)
+{
+  printf("FAIL %s round %lu: 0x%04x, expected 0x%04x\n",
+         test, round, got, expected);
+  failures++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_chksum(void)
+{
+  static uint8_t buf[MAX_PAYLOAD + 8];
+  unsigned long round;
+  uint16_t offset, len, i, got, expected;
+
+  for(round = 0; round < ROUNDS; round++) {
+    /* Vary the alignment and length of the data. */
+    offset = random_rand() % 8;
+    len = random_rand() % MAX_PAYLOAD;
+    for(i = 0; i < len; i++) {
+      buf[offset + i] = random_rand();
+    }
+    got = uip_chksum((uint16_t *)&buf[offset], len);
+    expected = uip_htons(ref_sum(0, &buf[offset], len));
+    if(got != expected) {
+      fail("uip_chksum", round, got, expected);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_upper_layer(void)
+{
+  unsigned long round;
+  uint16_t got, expected;
+
+  for(round = 0; round < ROUNDS; round++) {
+    random_packet(random_rand() % MAX_PAYLOAD, UIP_PROTO_UDP);
+    got = uip_udpchksum();
+    expected = ref_upper_layer_chksum(UIP_PROTO_UDP);
+    if(got != expected) {
+      fail("uip_udpchksum", round, got, expected);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_adjust(void)
+{
+  static uint8_t old[32];
+  unsigned long round;
+  uint16_t len, field, field_len, i, chksum;
+  uint8_t *ptr;
+
+  for(round = 0; round < ROUNDS; round++) {
+    len = UIP_ICMPH_LEN + 2 + random_rand() % (MAX_PAYLOAD - UIP_ICMPH_LEN - 2);
+    random_packet(len, UIP_PROTO_ICMP6);
+    UIP_ICMP_BUF->icmpchksum = 0;
+    chksum = ~uip_icmp6chksum();
+
+    if(random_rand() & 1) {
+      /* Change the source address of the pseudo-header. */
+      ptr = (uint8_t *)&UIP_IP_BUF->srcipaddr;
+      field_len = sizeof(uip_ipaddr_t);
+    } else {
+      /* Change an even-aligned field after the checksum. */
+      field = UIP_ICMPH_LEN + 2 * (random_rand() % ((len - UIP_ICMPH_LEN) / 2));
+      field_len = 1 + random_rand() % sizeof(old);
+      if(field + field_len > len) {
+        field_len = len - field;
+      }
+      ptr = &uip_buf[UIP_LLIPH_LEN + field];
+    }
+    memcpy(old, ptr, field_len);
+    for(i = 0; i < field_len; i++) {
+      ptr[i] = random_rand();
+    }
+    UIP_ICMP_BUF->icmpchksum = uip_chksum_adjust_buf(chksum, old, ptr,
+                                                     field_len);
+    if(uip_icmp6chksum() != 0xffff) {
+      fail("uip_chksum_adjust_buf", round, uip_icmp6chksum(), 0xffff);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_echo_reply(void)
+{
+  unsigned long round;
+
+  for(round = 0; round < ROUNDS / 10; round++) {
+    random_packet(UIP_ICMPH_LEN + random_rand() % (MAX_PAYLOAD - UIP_ICMPH_LEN),
+                  UIP_PROTO_ICMP6);
+    /* A unicast request. */
+    UIP_IP_BUF->destipaddr.u8[0] = 0xfe;
+    UIP_ICMP_BUF->type = ICMP6_ECHO_REQUEST;
+    UIP_ICMP_BUF->icode = 0;
+    UIP_ICMP_BUF->icmpchksum = 0;
+    UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+    uip_icmp6_echo_request_input();
+    if(UIP_ICMP_BUF->type != ICMP6_ECHO_REPLY ||
+       uip_icmp6chksum() != 0xffff) {
+      fail("echo reply", round, uip_icmp6chksum(), 0xffff);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+benchmark(void)
+{
+  volatile uint16_t sink;
+  unsigned long start, stack_ns, ref_ns, adjust_ns;
+  uint16_t len, addr[8];
+  int round;
+
+  len = MAX_PAYLOAD;
+  random_packet(len, UIP_PROTO_UDP);
+
+  start = now_ns();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    sink = uip_udpchksum();
+  }
+  stack_ns = now_ns() - start;
+
+  start = now_ns();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    sink = ref_upper_layer_chksum(UIP_PROTO_UDP);
+  }
+  ref_ns = now_ns() - start;
+
+  memset(addr, 0, sizeof(addr));
+  start = now_ns();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    sink = uip_chksum_adjust_buf(sink, &UIP_IP_BUF->srcipaddr, addr,
+                                 sizeof(addr));
+  }
+  adjust_ns = now_ns() - start;
+
+  printf("%u byte upper layer checksum: %lu ns (%lu MB/s), reference %lu ns (%lu MB/s)\n",
+         len, stack_ns / BENCH_ROUNDS,
+         (unsigned long)((unsigned long long)len * BENCH_ROUNDS * 1000 / (stack_ns + 1)),
+         ref_ns / BENCH_ROUNDS,
+         (unsigned long)((unsigned long long)len * BENCH_ROUNDS * 1000 / (ref_ns + 1)));
+  printf("incremental address update: %lu ns\n", adjust_ns / BENCH_ROUNDS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  random_init(1);
+  test_chksum();
+  test_upper_layer();
+  test_adjust();
+  test_echo_reply();
+  printf("%s: %lu failures\n", failures ? "FAIL" : "PASS", failures);
+
+  benchmark();
+
+  exit(failures ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -44,6 +44,10 @@
 
 #define SLIP_DEV_CONF_SEND_DELAY (CLOCK_SECOND / 32)
 
+/* In non-storing mode, the root keeps one link per node of the DAG. */
+#undef RPL_CONF_NS_LINK_NUM
+#define RPL_CONF_NS_LINK_NUM     64
+
 #undef WEBSERVER_CONF_CFS_CONNS
 #define WEBSERVER_CONF_CFS_CONNS 2
 
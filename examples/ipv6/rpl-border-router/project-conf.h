@@ -51,6 +51,11 @@
 #define UIP_CONF_RECEIVE_WINDOW  60
 #endif
 
+/* In non-storing mode, the root keeps one link per node of the DAG. */
+#ifndef RPL_CONF_NS_LINK_NUM
+#define RPL_CONF_NS_LINK_NUM     30
+#endif
+
 #ifndef WEBSERVER_CONF_CFS_CONNS
 #define WEBSERVER_CONF_CFS_CONNS 2
 #endif
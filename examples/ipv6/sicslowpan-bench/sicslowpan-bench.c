@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+
+/**
+ * \file
+ *         Checks that 6LoWPAN header compression and decompression
+ *         restore the original IPv6 packets, and measures how many
+ *         packets per second are compressed and decompressed. Runs on
+ *         the native platform.
+ */
+
+#include "contiki.h"
+#include "contiki-net.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/mac/mac.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NEIGHBORS    8
+#define FLOW_TYPES   6
+#define NUM_FLOWS    (NEIGHBORS * FLOW_TYPES)
+#define BURST        8
+#define ROUNDS       (NUM_FLOWS * BURST * 4)
+#define BENCH_ROUNDS 1000000
+
+#define MAX_PACKET   (UIP_IPUDPH_LEN + 64)
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+struct flow {
+  uip_lladdr_t nexthop;
+  uint8_t broadcast;
+  uint16_t len;
+  uint8_t packet[MAX_PACKET];
+  uint8_t frame[PACKETBUF_SIZE];
+  uint16_t frame_len;
+};
+
+static struct flow flows[NUM_FLOWS];
+static unsigned long failures;
+
+static uint8_t frame[PACKETBUF_SIZE];
+static uint16_t frame_len;
+
+PROCESS(sicslowpan_bench_process, "6LoWPAN benchmark");
+AUTOSTART_PROCESSES(&sicslowpan_bench_process);
+/*---------------------------------------------------------------------------*/
+/* A MAC driver that keeps the last frame instead of sending it. */
+static void
+init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+send(mac_callback_t sent, void *ptr)
+{
+  frame_len = packetbuf_datalen();
+  memcpy(frame, packetbuf_dataptr(), frame_len);
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const struct mac_driver bench_mac_driver = {
+  "bench",
+  init,
+  send,
+  input,
+  on,
+  off,
+  channel_check_interval
+};
+/*---------------------------------------------------------------------------*/
+static void
+set_iid(uip_ipaddr_t *ipaddr, const uip_lladdr_t *lladdr)
+{
+  memcpy(&ipaddr->u8[8], lladdr, 8);
+  ipaddr->u8[8] ^= 0x02;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init_flow(struct flow *f, int neighbor, int type)
+{
+  struct uip_ip_hdr *ip;
+  struct uip_udp_hdr *udp;
+  uint16_t payload_len, i;
+
+  memset(f, 0, sizeof(*f));
+  memcpy(&f->nexthop, &uip_lladdr, sizeof(uip_lladdr_t));
+  f->nexthop.addr[7] = 0x40 + neighbor;
+
+  payload_len = random_rand() % (MAX_PACKET - UIP_IPUDPH_LEN);
+  f->len = UIP_IPUDPH_LEN + payload_len;
+  ip = (struct uip_ip_hdr *)f->packet;
+  udp = (struct uip_udp_hdr *)&f->packet[UIP_IPH_LEN];
+
+  ip->vtc = 0x60;
+  if(neighbor & 1) {
+    /* Traffic class and flow label are carried inline. */
+    ip->vtc |= 0x0b;
+    ip->tcflow = 0x82;
+    ip->flow = 0x3412;
+  }
+  ip->len[0] = (f->len - UIP_IPH_LEN) >> 8;
+  ip->len[1] = (f->len - UIP_IPH_LEN) & 0xff;
+  ip->proto = UIP_PROTO_UDP;
+  ip->ttl = (neighbor & 2) ? 64 : 17;
+
+  switch(type) {
+  case 0:
+    /* Link-local addresses derived from the link-layer addresses. */
+    uip_ip6addr(&ip->srcipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    set_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    set_iid(&ip->destipaddr, &f->nexthop);
+    break;
+  case 1:
+    /* Global addresses in the prefix of context 0. */
+    uip_ip6addr(&ip->srcipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+    set_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, 0xaaaa, 0, 0, 0, 0, 0x00ff, 0xfe00,
+                0x100 + neighbor);
+    break;
+  case 2:
+    /* Link-local broadcast. */
+    uip_ip6addr(&ip->srcipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    set_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, 0xff02, 0, 0, 0, 0, 0, 0, 0x1a);
+    f->broadcast = 1;
+    break;
+  case 3:
+    /* A global destination routed through a neighbor. */
+    uip_ip6addr(&ip->srcipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+    set_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, 0xaaaa, 0, 0, 0, 0x0212, 0x7402, 0x0002,
+                0x200 + neighbor);
+    break;
+  case 4:
+    /* Addresses outside of the contexts. */
+    uip_ip6addr(&ip->srcipaddr, 0x2001, 0xdb8, 0, 0, 0, 0, 0, 1);
+    uip_ip6addr(&ip->destipaddr, 0x2001, 0xdb8, 0, 1, 0, 0, 0, neighbor);
+    break;
+  default:
+    /* Site-local multicast. */
+    uip_ip6addr(&ip->srcipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+    set_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, 0xff05, 0, 0, 0, 0, 0, 0x0001, 0x0003);
+    f->broadcast = 1;
+    break;
+  }
+
+  if(neighbor & 4) {
+    udp->srcport = UIP_HTONS(0xf0b0 + neighbor);
+    udp->destport = UIP_HTONS(0xf0b1);
+  } else {
+    udp->srcport = UIP_HTONS(0x8000 + neighbor);
+    udp->destport = UIP_HTONS(5683);
+  }
+  udp->udplen = UIP_HTONS(f->len - UIP_IPH_LEN);
+  udp->udpchksum = random_rand();
+  for(i = 0; i < payload_len; i++) {
+    f->packet[UIP_IPUDPH_LEN + i] = random_rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+compress(struct flow *f)
+{
+  memcpy(UIP_IP_BUF, f->packet, f->len);
+  uip_len = f->len;
+  tcpip_output(f->broadcast ? NULL : &f->nexthop);
+}
+/*---------------------------------------------------------------------------*/
+static void
+uncompress(struct flow *f)
+{
+  packetbuf_copyfrom(f->frame, f->frame_len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, (rimeaddr_t *)&uip_lladdr);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, f->broadcast ?
+                     &rimeaddr_null : (rimeaddr_t *)&f->nexthop);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_roundtrip(void)
+{
+  unsigned long round;
+  struct flow *f;
+  int i;
+
+  for(i = 0; i < NUM_FLOWS; i++) {
+    init_flow(&flows[i], i / FLOW_TYPES, i % FLOW_TYPES);
+  }
+
+  for(round = 0; round < ROUNDS; round++) {
+    f = &flows[(round / BURST) % NUM_FLOWS];
+    frame_len = 0;
+    compress(f);
+    if(frame_len == 0 || frame_len > f->len) {
+      printf("FAIL round %lu: %u byte frame for a %u byte packet\n",
+             round, frame_len, f->len);
+      failures++;
+      continue;
+    }
+    if(f->frame_len != 0 &&
+       (f->frame_len != frame_len || memcmp(f->frame, frame, frame_len) != 0)) {
+      printf("FAIL round %lu: the frame changed between packets\n", round);
+      failures++;
+    }
+    f->frame_len = frame_len;
+    memcpy(f->frame, frame, frame_len);
+
+    memset(UIP_IP_BUF, 0, MAX_PACKET);
+    uncompress(f);
+    if(memcmp(UIP_IP_BUF, f->packet, f->len) != 0) {
+      printf("FAIL round %lu: flow %d is not restored\n",
+             round, (int)(f - flows));
+      failures++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+benchmark(void)
+{
+  unsigned long round, start, compress_ns, uncompress_ns;
+  unsigned long packet_bytes, frame_bytes;
+  int i;
+
+  packet_bytes = frame_bytes = 0;
+  for(i = 0; i < NUM_FLOWS; i++) {
+    packet_bytes += flows[i].len;
+    frame_bytes += flows[i].frame_len;
+  }
+
+  start = now_ns();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    compress(&flows[(round / BURST) % NUM_FLOWS]);
+  }
+  compress_ns = now_ns() - start;
+
+  start = now_ns();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    uncompress(&flows[(round / BURST) % NUM_FLOWS]);
+  }
+  uncompress_ns = now_ns() - start;
+
+  printf("%d flows, %lu bytes of IPv6 packets in %lu bytes of frames\n",
+         NUM_FLOWS, packet_bytes, frame_bytes);
+  printf("compress: %lu packets/s (%lu ns), uncompress: %lu packets/s (%lu ns)\n",
+         (unsigned long)(BENCH_ROUNDS * 1000000000ULL / (compress_ns + 1)),
+         compress_ns / BENCH_ROUNDS,
+         (unsigned long)(BENCH_ROUNDS * 1000000000ULL / (uncompress_ns + 1)),
+         uncompress_ns / BENCH_ROUNDS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sicslowpan_bench_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  /* Keep the decompressed packets in uip_buf, instead of handing them
+     to the IP stack. */
+  process_exit(&tcpip_process);
+
+  random_init(1);
+  test_roundtrip();
+  printf("%s: %lu failures\n", failures ? "FAIL" : "PASS", failures);
+
+  benchmark();
+
+  exit(failures ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
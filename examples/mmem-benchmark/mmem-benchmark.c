@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Fragmentation and latency benchmark for the managed memory
+ *         allocator, for the native platform.
+ */
+
+#include "contiki.h"
+#include "lib/mmem.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef MMEM_CONF_SIZE
+#define HEAP_SIZE MMEM_CONF_SIZE
+#else
+#define HEAP_SIZE 4096
+#endif
+
+#define HANDLES     32
+#define OPERATIONS  200000UL
+#define MIN_SIZE    8
+#define MAX_SIZE    320
+/* Bytes to compact per operation, emulating idle time. */
+#define COMPACT_STEP 64
+
+static struct mmem handles[HANDLES];
+static unsigned char used[HANDLES];
+
+/* Latencies are also counted in buckets of BUCKET_NS, so that a
+   percentile can be reported that is not skewed by the host
+   preempting the benchmark. */
+#define BUCKET_NS   100
+#define BUCKETS     1000
+
+struct latency {
+  unsigned long count;
+  unsigned long max;
+  unsigned long long total;
+  unsigned long buckets[BUCKETS];
+};
+
+static struct latency alloc_latency, free_latency, compact_latency;
+
+PROCESS(mmem_benchmark_process, "mmem benchmark");
+AUTOSTART_PROCESSES(&mmem_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static void
+record(struct latency *l, unsigned long start)
+{
+  unsigned long t = now_ns() - start;
+  l->count++;
+  l->total += t;
+  l->buckets[t / BUCKET_NS < BUCKETS ? t / BUCKET_NS : BUCKETS - 1]++;
+  if(t > l->max) {
+    l->max = t;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+percentile(struct latency *l, unsigned long per_mille)
+{
+  unsigned long n;
+  int b;
+
+  n = 0;
+  for(b = 0; b < BUCKETS - 1; b++) {
+    n += l->buckets[b];
+    if(n * 1000 >= l->count * per_mille) {
+      break;
+    }
+  }
+  return (b + 1) * BUCKET_NS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_latency(const char *name, struct latency *l)
+{
+  printf("%-8s %8lu ops  avg %6llu ns  99.9%% < %6lu ns  max %8lu ns\n",
+         name, l->count, l->count ? l->total / l->count : 0,
+         percentile(l, 999), l->max);
+}
+/*---------------------------------------------------------------------------*/
+static int
+check(int i)
+{
+  unsigned char *p = (unsigned char *)MMEM_PTR(&handles[i]);
+  unsigned int j;
+
+  for(j = 0; j < handles[i].size; j++) {
+    if(p[j] != (unsigned char)i) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mmem_benchmark_process, ev, data)
+{
+  unsigned long op, start, failures, fragmented, corrupt;
+  unsigned long live_bytes, peak_live;
+  unsigned int size;
+  int i;
+
+  PROCESS_BEGIN();
+
+  mmem_init();
+  random_init(1);
+  failures = fragmented = corrupt = 0;
+  live_bytes = peak_live = 0;
+
+  for(op = 0; op < OPERATIONS; op++) {
+    i = random_rand() % HANDLES;
+    if(used[i]) {
+      if(!check(i)) {
+        corrupt++;
+      }
+      live_bytes -= handles[i].size;
+      start = now_ns();
+      mmem_free(&handles[i]);
+      record(&free_latency, start);
+      used[i] = 0;
+    } else {
+      size = MIN_SIZE + random_rand() % (MAX_SIZE - MIN_SIZE);
+      start = now_ns();
+      if(mmem_alloc(&handles[i], size)) {
+        record(&alloc_latency, start);
+        memset(MMEM_PTR(&handles[i]), i, size);
+        used[i] = 1;
+        live_bytes += size;
+        if(live_bytes > peak_live) {
+          peak_live = live_bytes;
+        }
+      } else {
+        record(&alloc_latency, start);
+        failures++;
+        if(size + live_bytes < HEAP_SIZE) {
+          fragmented++;
+        }
+      }
+    }
+
+    start = now_ns();
+    if(mmem_compact(COMPACT_STEP)) {
+      record(&compact_latency, start);
+    }
+  }
+
+  for(i = 0; i < HANDLES; i++) {
+    if(used[i] && !check(i)) {
+      corrupt++;
+    }
+  }
+
+  printf("mmem benchmark, %s allocator\n",
+#if MMEM_CONF_SIZE_CLASSES
+         "size class"
+#else
+         "compacting"
+#endif
+         );
+  print_latency("alloc", &alloc_latency);
+  print_latency("free", &free_latency);
+  print_latency("compact", &compact_latency);
+  printf("failed allocations %lu (%lu with enough free memory)\n",
+         failures, fragmented);
+  printf("peak live bytes %lu, corrupt blocks %lu\n", peak_live, corrupt);
+
+  exit(corrupt ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
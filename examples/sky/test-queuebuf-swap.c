@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2013, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A test program for the persistent queuebuf swap. The sender
+ *         queues collect packets while there is no sink, reboots, and
+ *         forwards the packets that were swapped out once the sink
+ *         appears. Build with QUEUEBUFRAM_CONF_NUM smaller than
+ *         QUEUEBUF_CONF_NUM and QUEUEBUF_CONF_SWAP_PERSISTENT=1.
+ */
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "dev/watchdog.h"
+#include "net/rime.h"
+#include "net/rime/collect.h"
+#include "node-id.h"
+
+#include <stdio.h>
+
+#ifndef SINK_ID
+#define SINK_ID	1
+#endif
+
+#define NUM_PACKETS	8
+
+/* The sink starts late, so that the packets of the sender are still
+   queued when it reboots. */
+#define SINK_DELAY	(CLOCK_SECOND * 60)
+
+#define BOOT_FILE	"boot"
+
+static struct collect_conn tc;
+
+PROCESS(test_queuebuf_swap_process, "Queuebuf swap test");
+AUTOSTART_PROCESSES(&test_queuebuf_swap_process);
+/*---------------------------------------------------------------------------*/
+static void
+recv(const rimeaddr_t *originator, uint8_t seqno, uint8_t hops)
+{
+  printf("Sink got message from %d.%d, seqno %d, hops %d: '%.*s'\n",
+         originator->u8[0], originator->u8[1], seqno, hops,
+         packetbuf_datalen(), (char *)packetbuf_dataptr());
+}
+/*---------------------------------------------------------------------------*/
+static const struct collect_callbacks callbacks = { recv };
+/*---------------------------------------------------------------------------*/
+static int
+first_boot(void)
+{
+  int fd;
+
+  fd = cfs_open(BOOT_FILE, CFS_READ);
+  if(fd >= 0) {
+    cfs_close(fd);
+    return 0;
+  }
+
+  fd = cfs_open(BOOT_FILE, CFS_WRITE);
+  if(fd >= 0) {
+    cfs_write(fd, "1", 1);
+    cfs_close(fd);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_queuebuf_swap_process, ev, data)
+{
+  static struct etimer et;
+  static int i;
+
+  PROCESS_BEGIN();
+
+  if(node_id == SINK_ID) {
+    etimer_set(&et, SINK_DELAY);
+    PROCESS_WAIT_UNTIL(etimer_expired(&et));
+    collect_open(&tc, 130, COLLECT_ROUTER, &callbacks);
+    collect_set_sink(&tc, 1);
+    printf("Sink started\n");
+    PROCESS_EXIT();
+  }
+
+  collect_open(&tc, 130, COLLECT_ROUTER, &callbacks);
+
+  if(!first_boot()) {
+    /* The recovered packets are sent when a route is found. */
+    printf("Sender restarted\n");
+    PROCESS_EXIT();
+  }
+
+  for(i = 0; i < NUM_PACKETS; i++) {
+    etimer_set(&et, CLOCK_SECOND);
+    PROCESS_WAIT_UNTIL(etimer_expired(&et));
+    packetbuf_clear();
+    packetbuf_set_datalen(sprintf(packetbuf_dataptr(),
+                                  "before reboot %d", i) + 1);
+    collect_send(&tc, 15);
+    printf("Sender queued packet %d\n", i);
+  }
+
+  /* Give the swap time to write the batch, then reboot. */
+  etimer_set(&et, CLOCK_SECOND * 5);
+  PROCESS_WAIT_UNTIL(etimer_expired(&et));
+  printf("Sender rebooting\n");
+  watchdog_reboot();
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
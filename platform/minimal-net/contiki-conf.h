@@ -158,6 +158,7 @@ typedef unsigned short uip_stats_t;
 #if UIP_CONF_IPV6
 #define UIP_CONF_IPV6_QUEUE_PKT       1
 #define UIP_CONF_IPV6_CHECKS          1
+#define UIP_CONF_CHKSUM_WIDE          1
 #define UIP_CONF_IPV6_REASSEMBLY      1
 //#define UIP_CONF_NETIF_MAX_ADDRESSES  5
 //#define UIP_CONF_ND6_MAX_PREFIXES     3
@@ -33,6 +33,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/select.h>
 
@@ -57,15 +59,48 @@
 
 #include "net/rime.h"
 
+#include "profiler.h"
+#include "dev/sim-radio.h"
+
 #ifdef SELECT_CONF_MAX
 #define SELECT_MAX SELECT_CONF_MAX
 #else
-#define SELECT_MAX 8
+/* The epoll and wake-up descriptors take two of the low numbers. */
+#define SELECT_MAX 16
+#endif
+
+/*
+ * Wait for file descriptors with epoll instead of select. The file
+ * descriptors stay registered with the kernel between iterations, and
+ * are only updated when a callback changes its interest.
+ */
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#elif defined(__linux__)
+#define SELECT_EPOLL 1
+#else
+#define SELECT_EPOLL 0
 #endif
 
+#if SELECT_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif /* SELECT_EPOLL */
+
 static const struct select_callback *select_callback[SELECT_MAX];
 static int select_max = 0;
 
+#if SELECT_EPOLL
+static int epoll_fd = -1;
+static int wakeup_fd = -1;
+
+/* Events registered with epoll for each file descriptor. */
+static uint32_t select_events[SELECT_MAX];
+
+/* Regular files cannot be watched by epoll, and are always ready. */
+static uint8_t select_always_ready[SELECT_MAX];
+#endif /* SELECT_EPOLL */
+
 SENSORS(&pir_sensor, &vib_sensor, &button_sensor);
 
 static uint8_t serial_id[] = {0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08};
@@ -84,6 +119,14 @@ select_set_callback(int fd, const struct select_callback *callback)
 
     select_callback[fd] = callback;
 
+#if SELECT_EPOLL
+    if(select_events[fd] != 0) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    select_events[fd] = 0;
+    select_always_ready[fd] = 0;
+#endif /* SELECT_EPOLL */
+
     /* Update fd max */
     if(callback != NULL) {
       if(fd > select_max) {
@@ -103,6 +146,188 @@ select_set_callback(int fd, const struct select_callback *callback)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+void
+select_wakeup(void)
+{
+#if SELECT_EPOLL
+  uint64_t one = 1;
+
+  if(write(wakeup_fd, &one, sizeof(one)) < 0) {
+    /* The counter is saturated, so the loop will wake up anyway. */
+  }
+#endif /* SELECT_EPOLL */
+}
+/*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+static void
+select_update(int fd, uint32_t events)
+{
+  struct epoll_event ev;
+  int op;
+
+  if(select_always_ready[fd] || select_events[fd] == events) {
+    return;
+  }
+
+  if(events == 0) {
+    op = EPOLL_CTL_DEL;
+  } else if(select_events[fd] == 0) {
+    op = EPOLL_CTL_ADD;
+  } else {
+    op = EPOLL_CTL_MOD;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.fd = fd;
+  if(epoll_ctl(epoll_fd, op, fd, &ev) < 0) {
+    if(errno == EPERM) {
+      select_always_ready[fd] = 1;
+    } else {
+      perror("epoll_ctl");
+    }
+    events = 0;
+  }
+  select_events[fd] = events;
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
+/*
+ * Returns the number of milliseconds until the next etimer expires, 0
+ * if there is work to do right away, or -1 if there is nothing to wait
+ * for except file descriptors.
+ */
+static int
+select_timeout(void)
+{
+  clock_time_t now;
+  clock_time_t next;
+  long diff;
+
+  if(process_nevents() > 0) {
+    return 0;
+  }
+  if(!etimer_pending()) {
+    return -1;
+  }
+
+  now = clock_time();
+  next = etimer_next_expiration_time();
+  diff = (long)(next - now);
+  if(diff <= 0) {
+    return 0;
+  }
+  return (diff * 1000 + CLOCK_SECOND - 1) / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static void
+select_wait(void)
+{
+  fd_set fdr;
+  fd_set fdw;
+  int maxfd;
+  int i;
+  int retval;
+  int timeout;
+  sigset_t mask;
+  sigset_t origmask;
+#if SELECT_EPOLL
+  struct epoll_event events[SELECT_MAX + 1];
+  uint32_t ev;
+  uint64_t count;
+#else /* SELECT_EPOLL */
+  struct timespec ts;
+#endif /* SELECT_EPOLL */
+
+  /*
+   * The rtimer signal handler may poll processes. Block it until the
+   * wait starts, so that such a poll cannot slip in between computing
+   * the timeout and going to sleep.
+   */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGALRM);
+  sigprocmask(SIG_BLOCK, &mask, &origmask);
+
+  timeout = select_timeout();
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  maxfd = -1;
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
+      maxfd = i;
+    }
+  }
+
+#if SELECT_EPOLL
+  for(i = 0; i <= select_max; i++) {
+    ev = 0;
+    if(FD_ISSET(i, &fdr)) {
+      ev |= EPOLLIN;
+    }
+    if(FD_ISSET(i, &fdw)) {
+      ev |= EPOLLOUT;
+    }
+    select_update(i, ev);
+    if(ev != 0 && select_always_ready[i]) {
+      timeout = 0;
+    }
+  }
+
+  retval = epoll_pwait(epoll_fd, events, SELECT_MAX + 1, timeout, &origmask);
+  sigprocmask(SIG_SETMASK, &origmask, NULL);
+  if(retval < 0) {
+    if(errno != EINTR) {
+      perror("epoll_pwait");
+    }
+    return;
+  }
+
+  /* Pass the ready descriptors to the callbacks like select does. */
+  for(i = 0; i <= select_max; i++) {
+    if(!select_always_ready[i]) {
+      FD_CLR(i, &fdr);
+      FD_CLR(i, &fdw);
+    }
+  }
+  for(i = 0; i < retval; i++) {
+    if(events[i].data.fd == wakeup_fd) {
+      if(read(wakeup_fd, &count, sizeof(count)) < 0) {
+        /* Nothing to do, the counter was reset by another read. */
+      }
+      continue;
+    }
+    if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) &&
+       select_events[events[i].data.fd] & EPOLLIN) {
+      FD_SET(events[i].data.fd, &fdr);
+    }
+    if(events[i].events & (EPOLLOUT | EPOLLERR) &&
+       select_events[events[i].data.fd] & EPOLLOUT) {
+      FD_SET(events[i].data.fd, &fdw);
+    }
+  }
+#else /* SELECT_EPOLL */
+  ts.tv_sec = timeout / 1000;
+  ts.tv_nsec = (timeout % 1000) * 1000000L;
+  retval = pselect(maxfd + 1, &fdr, &fdw, NULL,
+                   timeout < 0 ? NULL : &ts, &origmask);
+  sigprocmask(SIG_SETMASK, &origmask, NULL);
+  if(retval <= 0) {
+    /* timeout => retval == 0 */
+    if(retval < 0 && errno != EINTR) {
+      perror("select");
+    }
+    return;
+  }
+#endif /* SELECT_EPOLL */
+
+  for(i = 0; i <= maxfd; i++) {
+    if(select_callback[i] != NULL) {
+      select_callback[i]->handle_fd(&fdr, &fdw);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 static int
 stdin_set_fd(fd_set *rset, fd_set *wset)
 {
@@ -113,9 +338,14 @@ static void
 stdin_handle_fd(fd_set *rset, fd_set *wset)
 {
   char c;
+  int len;
   if(FD_ISSET(STDIN_FILENO, rset)) {
-    if(read(STDIN_FILENO, &c, 1) > 0) {
+    len = read(STDIN_FILENO, &c, 1);
+    if(len > 0) {
       serial_line_input_byte(c);
+    } else if(len == 0) {
+      /* End of file: stop watching, or the loop would never sleep. */
+      select_set_callback(STDIN_FILENO, NULL);
     }
   }
 }
@@ -129,6 +359,13 @@ set_rime_addr(void)
   rimeaddr_t addr;
   int i;
 
+  /* Every node of a simulated network gets its own address. */
+  if(sim_radio_node_id() > 0) {
+    node_id = sim_radio_node_id();
+    serial_id[6] = node_id >> 8;
+    serial_id[7] = node_id & 0xff;
+  }
+
   memset(&addr, 0, sizeof(rimeaddr_t));
 #if UIP_CONF_IPV6
   memcpy(addr.u8, serial_id, sizeof(addr.u8));
@@ -184,9 +421,29 @@ main(int argc, char **argv)
 #endif
 #endif
 
+#if SELECT_EPOLL
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(epoll_fd < 0 || wakeup_fd < 0) {
+    perror("epoll");
+    return 1;
+  }
+  {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeup_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev);
+  }
+#endif /* SELECT_EPOLL */
+
   process_init();
   process_start(&etimer_process, NULL);
   ctimer_init();
+#if NATIVE_PROFILER
+  profiler_init();
+#endif /* NATIVE_PROFILER */
 
   set_rime_addr();
 
@@ -229,38 +486,11 @@ main(int argc, char **argv)
 
   select_set_callback(STDIN_FILENO, &stdin_fd);
   while(1) {
-    fd_set fdr;
-    fd_set fdw;
-    int maxfd;
-    int i;
-    int retval;
-    struct timeval tv;
-
-    retval = process_run();
-
-    tv.tv_sec = 0;
-    tv.tv_usec = retval ? 1 : 1000;
-
-    FD_ZERO(&fdr);
-    FD_ZERO(&fdw);
-    maxfd = 0;
-    for(i = 0; i <= select_max; i++) {
-      if(select_callback[i] != NULL && select_callback[i]->set_fd(&fdr, &fdw)) {
-        maxfd = i;
-      }
-    }
+    process_run();
 
-    retval = select(maxfd + 1, &fdr, &fdw, NULL, &tv);
-    if(retval < 0) {
-      perror("select");
-    } else if(retval > 0) {
-      /* timeout => retval == 0 */
-      for(i = 0; i <= maxfd; i++) {
-        if(select_callback[i] != NULL) {
-          select_callback[i]->handle_fd(&fdr, &fdw);
-        }
-      }
-    }
+    /* Sleep until a file descriptor is ready, the next etimer expires,
+       or select_wakeup() is called. */
+    select_wait();
 
     etimer_request_poll();
   }
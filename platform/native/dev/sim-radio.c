@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Simulated radio for networks of native nodes.
+ */
+
+#include "contiki.h"
+#include "net/packetbuf.h"
+#include "net/netstack.h"
+#include "net/rime/rimestats.h"
+#include "dev/sim-radio.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Frames received while waiting for the result of a transmission. */
+#ifdef SIM_RADIO_CONF_RX_QUEUE_SIZE
+#define RX_QUEUE_SIZE SIM_RADIO_CONF_RX_QUEUE_SIZE
+#else
+#define RX_QUEUE_SIZE 32
+#endif
+
+/* The hub answers right away; no answer means it is gone. */
+#define ACK_TIMEOUT_MS 1000
+
+struct frame {
+  unsigned short len;
+  uint8_t data[SIM_RADIO_MAX_FRAME];
+};
+
+static struct frame rx_queue[RX_QUEUE_SIZE];
+static int rx_first;
+static int rx_num;
+
+static uint8_t tx_buf[SIM_RADIO_HDR_LEN + SIM_RADIO_MAX_FRAME];
+static unsigned short tx_len;
+
+static int sock = -1;
+
+PROCESS(sim_radio_process, "Simulated radio");
+/*---------------------------------------------------------------------------*/
+int
+sim_radio_node_id(void)
+{
+  const char *id;
+
+  id = getenv(SIM_RADIO_ENV_NODE_ID);
+  return id == NULL ? 0 : atoi(id);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+addr_to_node_id(const rimeaddr_t *addr)
+{
+  /* The inverse of the node address assignment in contiki-main.c. */
+#if RIMEADDR_SIZE == 2
+  return addr->u8[0] | (addr->u8[1] << 8);
+#else
+  return (addr->u8[RIMEADDR_SIZE - 2] << 8) | addr->u8[RIMEADDR_SIZE - 1];
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reads one message from the hub. Frames go to the receive queue.
+ * Returns 1 for the result of a transmission, which is stored in
+ * result, 0 for other messages, and -1 if nothing could be read.
+ */
+static int
+read_message(int flags, int *result)
+{
+  uint8_t buf[SIM_RADIO_HDR_LEN + SIM_RADIO_MAX_FRAME];
+  struct frame *f;
+  int len;
+
+  len = recv(sock, buf, sizeof(buf), flags);
+  if(len <= 0) {
+    if(len == 0 || (errno != EAGAIN && errno != EINTR)) {
+      printf("sim-radio: lost the connection to the hub\n");
+      select_set_callback(sock, NULL);
+      close(sock);
+      sock = -1;
+    }
+    return -1;
+  }
+
+  if(buf[0] == SIM_RADIO_ACK && len >= 2) {
+    if(result != NULL) {
+      *result = buf[1] ? RADIO_TX_OK : RADIO_TX_NOACK;
+    }
+    return 1;
+  }
+  if(buf[0] != SIM_RADIO_FRAME || len <= SIM_RADIO_HDR_LEN) {
+    return 0;
+  }
+
+  if(rx_num == RX_QUEUE_SIZE) {
+    PRINTF("sim-radio: receive queue full, dropping frame\n");
+    return 0;
+  }
+  f = &rx_queue[(rx_first + rx_num) % RX_QUEUE_SIZE];
+  f->len = len - SIM_RADIO_HDR_LEN;
+  memcpy(f->data, buf + SIM_RADIO_HDR_LEN, f->len);
+  rx_num++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  if(sock >= 0) {
+    FD_SET(sock, rset);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  if(sock >= 0 && FD_ISSET(sock, rset)) {
+    process_poll(&sim_radio_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static const struct select_callback sim_radio_callback = { set_fd, handle_fd };
+/*---------------------------------------------------------------------------*/
+static int
+init(void)
+{
+  struct sockaddr_un addr;
+  const char *path;
+  uint8_t hello[3];
+  int id;
+
+  process_start(&sim_radio_process, NULL);
+
+  path = getenv(SIM_RADIO_ENV_SOCKET);
+  id = sim_radio_node_id();
+  if(path == NULL || id <= 0) {
+    printf("sim-radio: not in a simulation, frames are dropped\n");
+    return 0;
+  }
+
+  sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if(sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("sim-radio: connect");
+    exit(1);
+  }
+
+  hello[0] = SIM_RADIO_HELLO;
+  hello[1] = id >> 8;
+  hello[2] = id & 0xff;
+  send(sock, hello, sizeof(hello), 0);
+
+  if(!select_set_callback(sock, &sim_radio_callback)) {
+    printf("sim-radio: descriptor %d is above SELECT_CONF_MAX\n", sock);
+    exit(1);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prepare(const void *payload, unsigned short payload_len)
+{
+  if(payload_len > SIM_RADIO_MAX_FRAME) {
+    return 1;
+  }
+  memcpy(tx_buf + SIM_RADIO_HDR_LEN, payload, payload_len);
+  tx_len = payload_len;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit(unsigned short transmit_len)
+{
+  const rimeaddr_t *receiver;
+  struct pollfd pfd;
+  uint16_t dst;
+  int ret;
+
+  if(sock < 0) {
+    return RADIO_TX_OK;
+  }
+
+  receiver = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  dst = rimeaddr_cmp(receiver, &rimeaddr_null) ?
+    SIM_RADIO_BROADCAST : addr_to_node_id(receiver);
+  tx_buf[0] = SIM_RADIO_FRAME;
+  tx_buf[1] = dst >> 8;
+  tx_buf[2] = dst & 0xff;
+
+  if(send(sock, tx_buf, SIM_RADIO_HDR_LEN + tx_len, 0) < 0) {
+    return RADIO_TX_ERR;
+  }
+  RIMESTATS_ADD(lltx);
+
+  /* Wait for the result, queueing the frames that arrive meanwhile. */
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+  ret = RADIO_TX_ERR;
+  while(sock >= 0 && poll(&pfd, 1, ACK_TIMEOUT_MS) > 0) {
+    if(read_message(0, &ret) == 1) {
+      break;
+    }
+  }
+
+  if(rx_num > 0) {
+    process_poll(&sim_radio_process);
+  }
+  return ret;
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_packet(const void *payload, unsigned short payload_len)
+{
+  if(prepare(payload, payload_len) != 0) {
+    return RADIO_TX_ERR;
+  }
+  return transmit(payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_packet(void *buf, unsigned short buf_len)
+{
+  struct frame *f;
+  int len;
+
+  if(rx_num == 0) {
+    return 0;
+  }
+  f = &rx_queue[rx_first];
+  len = f->len < buf_len ? f->len : buf_len;
+  memcpy(buf, f->data, len);
+  rx_first = (rx_first + 1) % RX_QUEUE_SIZE;
+  rx_num--;
+  RIMESTATS_ADD(llrx);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_channel(unsigned short ch)
+{
+  /* All nodes share one channel. */
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending_packet(void)
+{
+  return rx_num > 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+pollhandler(void)
+{
+  int len;
+
+  while(1) {
+    while(sock >= 0 && rx_num < RX_QUEUE_SIZE &&
+          read_message(MSG_DONTWAIT, NULL) != -1);
+    if(rx_num == 0) {
+      break;
+    }
+    packetbuf_clear();
+    len = read_packet(packetbuf_dataptr(), PACKETBUF_SIZE);
+    packetbuf_set_datalen(len);
+    NETSTACK_RDC.input();
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sim_radio_process, ev, data)
+{
+  PROCESS_POLLHANDLER(pollhandler());
+
+  PROCESS_BEGIN();
+
+  PROCESS_WAIT_UNTIL(ev == PROCESS_EVENT_EXIT);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver sim_radio_driver = {
+  init,
+  prepare,
+  transmit,
+  send_packet,
+  read_packet,
+  set_channel,
+  channel_clear,
+  receiving_packet,
+  pending_packet,
+  on,
+  off,
+};
+/*---------------------------------------------------------------------------*/
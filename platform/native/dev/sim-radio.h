@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Simulated radio for networks of native nodes.
+ *
+ *         Each node is a native Contiki process, connected to the
+ *         tools/native-sim hub through a Unix socket. The hub forwards
+ *         every transmitted frame over the links of its topology file,
+ *         with their loss and latency, and tells the sender whether a
+ *         unicast frame reached its destination, which the driver
+ *         reports as an acknowledgement.
+ *
+ *         Build the nodes with DEFINES=NETSTACK_CONF_RADIO=sim_radio_driver.
+ *         Without a hub, the radio drops all frames, like nullradio.
+ */
+
+#ifndef __SIM_RADIO_H__
+#define __SIM_RADIO_H__
+
+#include "contiki.h"
+#include "dev/radio.h"
+
+/* Environment variables set by the hub for each node. */
+#define SIM_RADIO_ENV_SOCKET  "NATIVE_SIM_SOCKET"
+#define SIM_RADIO_ENV_NODE_ID "NATIVE_SIM_NODE_ID"
+
+/*
+ * Messages on the socket. Node ids are 16 bits in network byte order.
+ *
+ *   node to hub: 'H' id           Register as node id.
+ *   node to hub: 'F' dst frame    Transmit; dst is 0xffff for broadcast.
+ *   hub to node: 'A' acked        Result of the last transmission.
+ *   hub to node: 'F' src frame    A frame was received.
+ */
+#define SIM_RADIO_HELLO     'H'
+#define SIM_RADIO_FRAME     'F'
+#define SIM_RADIO_ACK       'A'
+#define SIM_RADIO_BROADCAST 0xffff
+#define SIM_RADIO_HDR_LEN   3
+#define SIM_RADIO_MAX_FRAME 127
+
+extern const struct radio_driver sim_radio_driver;
+
+/**
+ * \brief The node id given by the hub, or 0 outside a simulation.
+ */
+int sim_radio_node_id(void);
+
+#endif /* __SIM_RADIO_H__ */
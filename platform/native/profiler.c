@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Sampling profiler for native builds.
+ */
+
+#define _GNU_SOURCE
+#include "contiki.h"
+#include "profiler.h"
+
+#if NATIVE_PROFILER
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <link.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+struct stack {
+  struct process *p;
+  unsigned long count;
+  int depth;
+  /* Return addresses, the interrupted function first. */
+  void *pc[NATIVE_PROFILER_DEPTH];
+};
+
+static struct stack stacks[NATIVE_PROFILER_STACKS];
+static unsigned long samples;
+static unsigned long lost;
+
+static volatile sig_atomic_t exit_requested;
+
+/* Function symbols of the executable, sorted by address. */
+struct symbol {
+  uintptr_t addr;
+  size_t size;
+  const char *name;
+};
+
+static struct symbol *symbols;
+static int num_symbols;
+static char *image;
+static uintptr_t load_base;
+
+PROCESS(profiler_process, "Profiler");
+/*---------------------------------------------------------------------------*/
+static void *
+interrupted_pc(void *context)
+{
+  ucontext_t *uc = context;
+
+#if defined(__x86_64__)
+  return (void *)uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+  return (void *)uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+  return (void *)uc->uc_mcontext.pc;
+#else
+  return NULL;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+sample(int signo, siginfo_t *info, void *context)
+{
+  void *frames[NATIVE_PROFILER_DEPTH + 3];
+  void *pc;
+  struct stack *s;
+  unsigned long h;
+  int saved_errno;
+  int first, depth, i, n;
+
+  saved_errno = errno;
+
+  /*
+   * The first frames belong to this handler and the signal trampoline.
+   * The stack of the interrupted code starts at its program counter.
+   */
+  n = backtrace(frames, sizeof(frames) / sizeof(frames[0]));
+  pc = interrupted_pc(context);
+  for(first = 0; first < n && frames[first] != pc; first++);
+  if(first == n) {
+    first = n > 2 ? 2 : n;
+  }
+  depth = n - first;
+  if(depth > NATIVE_PROFILER_DEPTH) {
+    depth = NATIVE_PROFILER_DEPTH;
+  }
+
+  h = (unsigned long)(uintptr_t)process_current;
+  for(i = 0; i < depth; i++) {
+    h = h * 31 + (unsigned long)(uintptr_t)frames[first + i];
+  }
+
+  samples++;
+  for(i = 0; i < NATIVE_PROFILER_STACKS; i++) {
+    s = &stacks[(h + i) % NATIVE_PROFILER_STACKS];
+    if(s->count == 0) {
+      s->p = process_current;
+      s->depth = depth;
+      memcpy(s->pc, &frames[first], depth * sizeof(void *));
+      s->count = 1;
+      break;
+    }
+    if(s->p == process_current && s->depth == depth &&
+       memcmp(s->pc, &frames[first], depth * sizeof(void *)) == 0) {
+      s->count++;
+      break;
+    }
+  }
+  if(i == NATIVE_PROFILER_STACKS) {
+    lost++;
+  }
+
+  errno = saved_errno;
+}
+/*---------------------------------------------------------------------------*/
+static void
+request_write(int signo)
+{
+  if(signo != SIGUSR1) {
+    exit_requested = 1;
+  }
+  /* On native, process_poll() also wakes up the main loop. */
+  process_poll(&profiler_process);
+}
+/*---------------------------------------------------------------------------*/
+static int
+find_base(struct dl_phdr_info *info, size_t size, void *data)
+{
+  /* The executable is the first object. */
+  load_base = info->dlpi_addr;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+compare_symbols(const void *a, const void *b)
+{
+  const struct symbol *sa = a;
+  const struct symbol *sb = b;
+
+  return sa->addr < sb->addr ? -1 : sa->addr > sb->addr;
+}
+/*---------------------------------------------------------------------------*/
+static void
+load_symbols(void)
+{
+  FILE *f;
+  long len;
+  ElfW(Ehdr) *ehdr;
+  ElfW(Shdr) *shdr;
+  ElfW(Sym) *sym;
+  const char *strtab;
+  int i, j, n;
+
+  f = fopen("/proc/self/exe", "rb");
+  if(f == NULL) {
+    return;
+  }
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  rewind(f);
+  image = malloc(len);
+  if(image == NULL || fread(image, 1, len, f) != (size_t)len) {
+    fclose(f);
+    return;
+  }
+  fclose(f);
+
+  ehdr = (ElfW(Ehdr) *)image;
+  if(memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+     ehdr->e_ident[EI_CLASS] !=
+     (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32)) {
+    return;
+  }
+
+  shdr = (ElfW(Shdr) *)(image + ehdr->e_shoff);
+  for(i = 0; i < ehdr->e_shnum; i++) {
+    if(shdr[i].sh_type != SHT_SYMTAB) {
+      continue;
+    }
+    sym = (ElfW(Sym) *)(image + shdr[i].sh_offset);
+    n = shdr[i].sh_size / sizeof(ElfW(Sym));
+    strtab = image + shdr[shdr[i].sh_link].sh_offset;
+    symbols = malloc(n * sizeof(struct symbol));
+    if(symbols == NULL) {
+      return;
+    }
+    for(j = 0; j < n; j++) {
+      if(ELF64_ST_TYPE(sym[j].st_info) == STT_FUNC && sym[j].st_value != 0) {
+        symbols[num_symbols].addr = sym[j].st_value;
+        symbols[num_symbols].size = sym[j].st_size;
+        symbols[num_symbols].name = strtab + sym[j].st_name;
+        num_symbols++;
+      }
+    }
+    qsort(symbols, num_symbols, sizeof(struct symbol), compare_symbols);
+    break;
+  }
+
+  dl_iterate_phdr(find_base, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static const char *
+lookup(void *pc)
+{
+  static char buf[32];
+  uintptr_t addr;
+  Dl_info info;
+  int low, high, mid;
+
+  addr = (uintptr_t)pc - load_base;
+  low = 0;
+  high = num_symbols - 1;
+  while(low <= high) {
+    mid = (low + high) / 2;
+    if(symbols[mid].addr <= addr) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  if(high >= 0 && addr < symbols[high].addr + symbols[high].size) {
+    return symbols[high].name;
+  }
+
+  /* Not in the executable: a shared library. */
+  if(dladdr(pc, &info) != 0) {
+    if(info.dli_sname != NULL) {
+      return info.dli_sname;
+    }
+    if(info.dli_fname != NULL) {
+      snprintf(buf, sizeof(buf), "[%s]", strrchr(info.dli_fname, '/') != NULL ?
+               strrchr(info.dli_fname, '/') + 1 : info.dli_fname);
+      return buf;
+    }
+  }
+  snprintf(buf, sizeof(buf), "%p", pc);
+  return buf;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_frame(FILE *f, const char *name)
+{
+  /* Semicolons separate the frames, and the count follows a space. */
+  for(; *name != '\0'; name++) {
+    fputc(*name == ';' ? ':' : (*name == '\n' ? ' ' : *name), f);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+profiler_write(const char *filename)
+{
+  sigset_t mask, old_mask;
+  struct stack *s;
+  const char *name;
+  FILE *f;
+  int i, j, in_process;
+
+  f = fopen(filename, "w");
+  if(f == NULL) {
+    return -1;
+  }
+
+  if(symbols == NULL) {
+    load_symbols();
+  }
+
+  /* Do not let the samples change under our feet. */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGPROF);
+  sigprocmask(SIG_BLOCK, &mask, &old_mask);
+
+  for(i = 0; i < NATIVE_PROFILER_STACKS; i++) {
+    s = &stacks[i];
+    if(s->count == 0) {
+      continue;
+    }
+
+    /*
+     * process_current still points to the last process after it
+     * returns, so the sample only belongs to it if a process thread
+     * is on the stack.
+     */
+    in_process = 0;
+    for(j = 0; j < s->depth; j++) {
+      if(strncmp(lookup(j == 0 ? s->pc[j] : (char *)s->pc[j] - 1),
+                 "process_thread_", 15) == 0) {
+        in_process = 1;
+        break;
+      }
+    }
+    if(in_process && s->p != NULL) {
+      name = PROCESS_NAME_STRING(s->p);
+      write_frame(f, *name != '\0' ? name : "[process]");
+    } else {
+      write_frame(f, "[no process]");
+    }
+
+    /* Return addresses point after the call: look up the call itself. */
+    for(j = s->depth - 1; j >= 0; j--) {
+      fputc(';', f);
+      write_frame(f, lookup(j == 0 ? s->pc[j] : (char *)s->pc[j] - 1));
+    }
+    fprintf(f, " %lu\n", s->count);
+  }
+
+  sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+  fclose(f);
+  printf("Profiler: %lu samples (%lu lost) written to %s\n",
+         samples, lost, filename);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_at_exit(void)
+{
+  profiler_write(NATIVE_PROFILER_FILE);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(profiler_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(exit_requested) {
+      /* The profile is written by write_at_exit(). */
+      exit(0);
+    }
+    profiler_write(NATIVE_PROFILER_FILE);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+profiler_init(void)
+{
+  struct sigaction sa;
+  struct itimerval timer;
+  void *frames[1];
+
+  process_start(&profiler_process, NULL);
+  atexit(write_at_exit);
+
+  /* The first call of backtrace() loads the unwinder, which must not
+     happen in the signal handler. */
+  backtrace(frames, 1);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = request_write;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGUSR1, &sa, NULL);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = sample;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, NULL);
+
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 1000000 / NATIVE_PROFILER_HZ;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+
+  printf("Profiler: sampling at %d Hz, SIGUSR1 writes %s\n",
+         NATIVE_PROFILER_HZ, NATIVE_PROFILER_FILE);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* NATIVE_PROFILER */
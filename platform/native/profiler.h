@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/**
+ * \file
+ *         Sampling profiler for native builds.
+ *
+ *         The profiler samples the call stack on SIGPROF, that is, at a
+ *         fixed rate of consumed CPU time, and attributes every sample to
+ *         the Contiki process that was running. The samples are written
+ *         in the collapsed stack format, one line per distinct stack:
+ *
+ *           process name;main;process_run;...;leaf function count
+ *
+ *         which is the input format of flamegraph.pl and compatible
+ *         tools. The profile is written when Contiki exits on SIGINT or
+ *         SIGTERM, and whenever it receives SIGUSR1.
+ *
+ *         Build with DEFINES=NATIVE_CONF_PROFILER=1 to enable it.
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "contiki-conf.h"
+
+#ifdef NATIVE_CONF_PROFILER
+#define NATIVE_PROFILER NATIVE_CONF_PROFILER
+#else
+#define NATIVE_PROFILER 0
+#endif
+
+/* Samples per second of CPU time. Not a round number, so that the
+   samples do not run in lockstep with periodic timers. */
+#ifdef NATIVE_CONF_PROFILER_HZ
+#define NATIVE_PROFILER_HZ NATIVE_CONF_PROFILER_HZ
+#else
+#define NATIVE_PROFILER_HZ 997
+#endif
+
+/* Maximum number of stack frames recorded per sample. */
+#ifdef NATIVE_CONF_PROFILER_DEPTH
+#define NATIVE_PROFILER_DEPTH NATIVE_CONF_PROFILER_DEPTH
+#else
+#define NATIVE_PROFILER_DEPTH 32
+#endif
+
+/* Number of distinct stacks that can be recorded. */
+#ifdef NATIVE_CONF_PROFILER_STACKS
+#define NATIVE_PROFILER_STACKS NATIVE_CONF_PROFILER_STACKS
+#else
+#define NATIVE_PROFILER_STACKS 2048
+#endif
+
+#ifdef NATIVE_CONF_PROFILER_FILE
+#define NATIVE_PROFILER_FILE NATIVE_CONF_PROFILER_FILE
+#else
+#define NATIVE_PROFILER_FILE "contiki-profile.folded"
+#endif
+
+/**
+ * \brief Start sampling.
+ *
+ * Starts the profiler process and the sampling timer. Called once by
+ * the platform at boot, after process_init().
+ */
+void profiler_init(void);
+
+/**
+ * \brief Write the collapsed stacks sampled so far.
+ * \param filename The file to write, which is replaced.
+ * \return 0 on success, -1 if the file could not be written.
+ */
+int profiler_write(const char *filename);
+
+#endif /* __PROFILER_H__ */
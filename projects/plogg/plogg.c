@@ -41,6 +41,9 @@
 #include "contiki-raven.h"
 #include "rs232.h"
 #include "ringbuf.h"
+#if WITH_TSLOG
+#include "tslog.h"
+#endif
 
 #if WITH_COAP == 3
 #include "er-coap-03.h"
@@ -178,6 +181,13 @@ static struct {
 
 } poll_data;
 
+#if WITH_TSLOG
+// History of the active power readings
+static struct tslog watts_log;
+// The uptime restarts at 0, so the readings continue from the last stored one
+static uint32_t watts_time_base;
+#endif
+
 /*---------------------------------------------------------------------------*/
 static int uart_get_char(unsigned char c)
 {
@@ -257,6 +267,10 @@ static void parse_Poll(){
 	}
 	else if (strncmp_P(poll_return,PSTR("Watts (-Gen +Con)"),17) == 0) {
 		poll_data.active_total = get_signed_pseudo_float_3(poll_return+27);
+#if WITH_TSLOG
+		// Failures are counted in the log and reported by history?summary=1
+		tslog_append(&watts_log, watts_time_base + clock_seconds(), poll_data.active_total);
+#endif
 	}
 	
 	else if (strncmp_P(poll_return,PSTR("Cumulative Watts (Gen)"),22) == 0) {
@@ -1397,12 +1411,36 @@ power_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred
 }
 
 
+#if WITH_TSLOG
+/****************************** History ****************************************/
+// GET history?from=<seconds>&to=<seconds> returns blocks of 8 byte records
+// (time, watts), history?summary=1 the number, min and max of the readings
+// and the number of readings that could not be stored
+RESOURCE(history, METHOD_GET, "history", "Watts History");
+
+void
+history_handler(void* request, void* response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset){
+	tslog_rest_handler(&watts_log, request, response, buffer, preferred_size, offset);
+}
+#endif
+
+
 /****************************** Coap Process ***********************************/
 PROCESS_THREAD(coap_process, ev, data)
 {
+#if RPL_CONF_MULTICAST
+  uip_ipaddr_t group_addr;
+#endif
+
   PROCESS_BEGIN();
 
   rest_init_framework();
+
+#if RPL_CONF_MULTICAST
+  /* Accept group requests, e.g., PUT /power, sent to all CoAP nodes (ff03::fd). */
+  uip_ip6addr(&group_addr, 0xff03, 0, 0, 0, 0, 0, 0, 0xfd);
+  uip_ds6_maddr_add(&group_addr);
+#endif
   
   rest_activate_resource(&resource_time);
   rest_activate_resource(&resource_date);
@@ -1422,6 +1460,12 @@ PROCESS_THREAD(coap_process, ev, data)
 	rest_activate_resource(&resource_power);
 	rest_activate_resource(&resource_mode);
 
+#if WITH_TSLOG
+	tslog_open(&watts_log, "watts");
+	watts_time_base = tslog_last_time(&watts_log);
+	rest_activate_resource(&resource_history);
+#endif
+
 	memset(&poll_data, 0, sizeof(poll_data));	
 	poll_data.powered=1;
 	poll_data.mode=255;
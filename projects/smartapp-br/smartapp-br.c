@@ -63,6 +63,10 @@ extern uip_ds6_route_t uip_ds6_routing_table[];
 
 static uip_ipaddr_t prefix;
 static uint8_t prefix_set;
+#if RPL_WITH_NON_STORING
+/* Nodes send their DAOs to the DODAGID, which must be our own address. */
+static uip_ipaddr_t global_ipaddr;
+#endif /* RPL_WITH_NON_STORING */
 
 PROCESS(border_router_process, "Border router process");
 
@@ -344,6 +348,9 @@ set_prefix_64(uip_ipaddr_t *prefix_64)
   prefix_set = 1;
   uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
   uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_copy(&global_ipaddr, &ipaddr);
+#endif /* RPL_WITH_NON_STORING */
 }
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(border_router_process, ev, data)
@@ -374,7 +381,11 @@ PROCESS_THREAD(border_router_process, ev, data)
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
   }
 
+#if RPL_WITH_NON_STORING
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &global_ipaddr);
+#else
   dag = rpl_set_root(RPL_DEFAULT_INSTANCE,(uip_ip6addr_t *)dag_id);
+#endif /* RPL_WITH_NON_STORING */
   if(dag != NULL) {
     rpl_set_prefix(dag, &prefix, 64);
     PRINTF("created a new RPL dag\n");
@@ -80,6 +80,8 @@ public interface SensorInfo {
   public static final int TEMPERATURE = 24;
   public static final int HUMIDITY = 25;
   public static final int RSSI = 26;
+  public static final int AGGREGATED_PACKETS = 28;
+  public static final int AGGREGATE_FRAMES = 29;
 
   public static final int VALUES_COUNT = 30;
 
@@ -145,6 +145,17 @@ public class NodeInfoPanel extends JPanel implements Visualizer, Configurable {
             return (long)(node.getSensorDataAggregator().getAverageValue(SensorData.BEACON_INTERVAL) * 1000);
           }
         },
+        new TableData("Aggregated", "Packets Sent in Aggregated Frames", Number.class) {
+          public Object getValue(Node node) {
+            return node.getSensorDataAggregator().getValue(SensorData.AGGREGATED_PACKETS);
+          }
+        },
+        new TableData("Tx Saved", "Transmissions Saved by Aggregation", Number.class) {
+          public Object getValue(Node node) {
+            return node.getSensorDataAggregator().getValue(SensorData.AGGREGATED_PACKETS)
+            - node.getSensorDataAggregator().getValue(SensorData.AGGREGATE_FRAMES);
+          }
+        },
 
         new TableData("Reboots", "Estimated Node Restart Count", Number.class) {
           public Object getValue(Node node) {
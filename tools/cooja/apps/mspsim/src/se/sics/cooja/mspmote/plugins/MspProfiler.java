@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+package se.sics.cooja.mspmote.plugins;
+
+import java.awt.BorderLayout;
+import java.awt.GridLayout;
+import java.awt.event.ActionEvent;
+import java.awt.event.ActionListener;
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import java.io.PrintWriter;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.Map;
+
+import javax.swing.BorderFactory;
+import javax.swing.JButton;
+import javax.swing.JFileChooser;
+import javax.swing.JLabel;
+import javax.swing.JPanel;
+import javax.swing.JTextField;
+
+import org.apache.log4j.Logger;
+
+import se.sics.cooja.ClassDescription;
+import se.sics.cooja.GUI;
+import se.sics.cooja.Mote;
+import se.sics.cooja.MotePlugin;
+import se.sics.cooja.PluginType;
+import se.sics.cooja.Simulation;
+import se.sics.cooja.SupportedArguments;
+import se.sics.cooja.TimeEvent;
+import se.sics.cooja.VisPlugin;
+import se.sics.cooja.mspmote.MspMote;
+import se.sics.cooja.mspmote.MspMoteMemory;
+import se.sics.mspsim.core.MSP430;
+import se.sics.mspsim.core.MSP430Constants;
+import se.sics.mspsim.core.Profiler;
+import se.sics.mspsim.util.MapEntry;
+import se.sics.mspsim.util.SimpleProfiler;
+
+/**
+ * Samples the call stack of an emulated mote at a fixed interval of
+ * simulated time, and attributes each sample to the running Contiki
+ * process. The samples are saved in the collapsed stack format used
+ * by flamegraph.pl:
+ *
+ *   process name;main;process_run;...;leaf function count
+ *
+ * Samples taken while the CPU is in a low power mode are recorded as
+ * the name of the mode, so that the profile also shows the duty cycle.
+ */
+@ClassDescription("Msp Profiler")
+@PluginType(PluginType.MOTE_PLUGIN)
+@SupportedArguments(motes = {MspMote.class})
+public class MspProfiler extends VisPlugin implements MotePlugin {
+  private static Logger logger = Logger.getLogger(MspProfiler.class);
+
+  private static final int MAX_DEPTH = 32;
+
+  private MspMote mspMote;
+  private MSP430 cpu;
+  private MspMoteMemory memory;
+  private Simulation simulation;
+
+  private long interval = Simulation.MILLISECOND;
+  private boolean sampling = false;
+  private long samples = 0;
+  private HashMap<String, Long> stacks = new HashMap<String, Long>();
+  private HashMap<Integer, String> processNames = new HashMap<Integer, String>();
+
+  private JTextField samplesTextField = new JTextField("0");
+  private JButton startButton = new JButton("Start");
+
+  private TimeEvent sampleEvent = new TimeEvent(0) {
+    public void execute(long t) {
+      if (!sampling) {
+        return;
+      }
+      sample();
+      simulation.scheduleEvent(this, t + interval);
+    }
+  };
+
+  public MspProfiler(Mote mote, Simulation simulationToVisualize, GUI gui) {
+    super("Msp Profiler", gui);
+    this.mspMote = (MspMote) mote;
+    cpu = mspMote.getCPU();
+    memory = (MspMoteMemory) mspMote.getMemory();
+    simulation = simulationToVisualize;
+
+    samplesTextField.setEditable(false);
+
+    getContentPane().setLayout(new BorderLayout());
+
+    startButton.addActionListener(new ActionListener() {
+      public void actionPerformed(ActionEvent e) {
+        setSampling(!sampling);
+      }
+    });
+
+    JButton clearButton = new JButton("Clear");
+    clearButton.addActionListener(new ActionListener() {
+      public void actionPerformed(ActionEvent e) {
+        simulation.invokeSimulationThread(new Runnable() {
+          public void run() {
+            stacks.clear();
+            samples = 0;
+            updateLabels();
+          }
+        });
+      }
+    });
+
+    JButton saveButton = new JButton("Save...");
+    saveButton.addActionListener(new ActionListener() {
+      public void actionPerformed(ActionEvent e) {
+        JFileChooser fc = new JFileChooser();
+        fc.setSelectedFile(new File("mote" + mspMote.getID() + ".folded"));
+        if (fc.showSaveDialog(GUI.getTopParentContainer()) != JFileChooser.APPROVE_OPTION) {
+          return;
+        }
+        try {
+          save(fc.getSelectedFile());
+        } catch (IOException ex) {
+          logger.fatal("Could not write profile: " + ex.getMessage());
+        }
+      }
+    });
+
+    JPanel controlPanel = new JPanel(new GridLayout(2,3,5,5));
+    controlPanel.setBorder(BorderFactory.createEmptyBorder(10, 10, 10, 10));
+    controlPanel.add(new JLabel("Samples:"));
+    controlPanel.add(samplesTextField);
+    controlPanel.add(startButton);
+    controlPanel.add(new JLabel(""));
+    controlPanel.add(clearButton);
+    controlPanel.add(saveButton);
+
+    add(BorderLayout.CENTER, controlPanel);
+
+    setSize(370, 100);
+
+    // Tries to select this plugin
+    try {
+      setSelected(true);
+    } catch (java.beans.PropertyVetoException e) {
+      // Could not select
+    }
+  }
+
+  /**
+   * Starts or stops sampling.
+   *
+   * @param on True to start sampling
+   */
+  public void setSampling(final boolean on) {
+    simulation.invokeSimulationThread(new Runnable() {
+      public void run() {
+        if (on == sampling) {
+          return;
+        }
+        sampling = on;
+        if (on) {
+          simulation.scheduleEvent(sampleEvent, simulation.getSimulationTime() + interval);
+        } else {
+          sampleEvent.remove();
+        }
+        startButton.setText(on ? "Stop" : "Start");
+      }
+    });
+  }
+
+  /**
+   * @return The samples in the collapsed stack format, one stack per line
+   */
+  public String getCollapsedStacks() {
+    StringBuilder sb = new StringBuilder();
+    synchronized (stacks) {
+      for (Map.Entry<String, Long> entry: stacks.entrySet()) {
+        sb.append(entry.getKey()).append(' ').append(entry.getValue()).append('\n');
+      }
+    }
+    return sb.toString();
+  }
+
+  /**
+   * Writes the samples to a file in the collapsed stack format.
+   *
+   * @param file File
+   * @throws IOException If the file could not be written
+   */
+  public void save(File file) throws IOException {
+    PrintWriter out = new PrintWriter(new FileWriter(file));
+    out.print(getCollapsedStacks());
+    out.close();
+  }
+
+  private void sample() {
+    ArrayList<String> frames = new ArrayList<String>();
+    StringBuilder sb = new StringBuilder();
+    boolean inProcess = false;
+    String key;
+    int mode;
+
+    mode = cpu.getMode();
+    if (mode != MSP430Constants.MODE_ACTIVE) {
+      key = "[" + MSP430Constants.MODE_NAMES[mode] + "]";
+    } else {
+      /* The call stack is only tracked while the MSPSim profiler is on. */
+      Profiler profiler = cpu.getProfiler();
+      if (profiler instanceof SimpleProfiler) {
+        try {
+          for (int i = 0; i < MAX_DEPTH; i++) {
+            MapEntry entry = ((SimpleProfiler) profiler).getCallMapEntry(i);
+            if (entry == null) {
+              break;
+            }
+            frames.add(entry.getName());
+          }
+        } catch (Exception e) {
+          /* Past the bottom of the stack */
+        }
+      }
+      if (frames.isEmpty()) {
+        String pc = mspMote.getPCString();
+        frames.add(pc == null ? "?" : pc.substring(pc.lastIndexOf(':') + 1));
+      }
+
+      for (String frame: frames) {
+        if (frame.startsWith("process_thread_")) {
+          inProcess = true;
+        }
+      }
+
+      /* process_current still points to the last process after it returns */
+      sb.append(inProcess ? currentProcessName() : "[no process]");
+      for (int i = frames.size() - 1; i >= 0; i--) {
+        sb.append(';').append(frames.get(i).replace(';', ':'));
+      }
+      key = sb.toString();
+    }
+
+    synchronized (stacks) {
+      Long count = stacks.get(key);
+      stacks.put(key, count == null ? 1 : count + 1);
+    }
+    samples++;
+    if (samples % 1000 == 0) {
+      updateLabels();
+    }
+  }
+
+  private String currentProcessName() {
+    int process;
+    int name;
+
+    try {
+      process = memory.getIntValueOf("process_current") & 0xffff;
+    } catch (Exception e) {
+      return "[process]";
+    }
+    String cached = processNames.get(process);
+    if (cached != null) {
+      return cached;
+    }
+
+    /* struct process starts with the next pointer and the name. */
+    name = memory.parseInt(memory.getMemorySegment(process + 2, 2)) & 0xffff;
+    StringBuilder sb = new StringBuilder();
+    byte[] data = memory.getMemorySegment(name, 32);
+    for (int i = 0; i < data.length && data[i] != 0; i++) {
+      sb.append(data[i] == ';' ? ':' : (char) data[i]);
+    }
+    String processName = sb.length() > 0 ? sb.toString() : "[process]";
+    processNames.put(process, processName);
+    return processName;
+  }
+
+  private void updateLabels() {
+    java.awt.EventQueue.invokeLater(new Runnable() {
+      public void run() {
+        samplesTextField.setText("" + samples);
+      }
+    });
+  }
+
+  public void closePlugin() {
+    setSampling(false);
+  }
+
+  public Mote getMote() {
+    return mspMote;
+  }
+
+}
@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2012, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ */
+
+/*
+ * Hub of a simulated network of native Contiki nodes.
+ *
+ * The hub starts one process per node of a topology file, and forwards
+ * the frames that the nodes send with the sim-radio driver
+ * (platform/native/dev/sim-radio.h) over the links of the topology.
+ * A topology file has one statement per line:
+ *
+ *   node <id> <command>                 Start a node with this command.
+ *   link <a> <b> <prr> <latency-ms>     A link in both directions.
+ *   dlink <from> <to> <prr> <latency-ms>  A link in one direction.
+ *
+ * where prr is the probability, between 0 and 1, that a frame gets
+ * through. Lines starting with # are comments. The output of every node
+ * is printed line by line as "<time-ms> ID:<id> <line>", like the log
+ * of Cooja, so that benchmark scripts can parse it.
+ *
+ * Losses are drawn from a pseudo-random generator with a fixed seed, so
+ * the same run sees the same channel. The nodes run in real time, so
+ * the interleaving of their processing can still differ between runs.
+ *
+ * The simulation ends after -t seconds, when node -e exits, or when all
+ * nodes have exited.
+ *
+ * Usage: native-sim [-s seed] [-t seconds] [-e node] topology-file
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Must match platform/native/dev/sim-radio.h. */
+#define SIM_RADIO_ENV_SOCKET  "NATIVE_SIM_SOCKET"
+#define SIM_RADIO_ENV_NODE_ID "NATIVE_SIM_NODE_ID"
+#define SIM_RADIO_HELLO     'H'
+#define SIM_RADIO_FRAME     'F'
+#define SIM_RADIO_ACK       'A'
+#define SIM_RADIO_BROADCAST 0xffff
+#define SIM_RADIO_HDR_LEN   3
+#define SIM_RADIO_MAX_FRAME 127
+
+#define MAX_NODES 65535
+#define LINE_SIZE 1024
+
+struct link {
+  struct link *next;
+  struct node *to;
+  double prr;
+  unsigned long latency;
+};
+
+struct node {
+  int id;
+  char *command;
+  pid_t pid;
+  int sock;
+  int out;
+  char line[LINE_SIZE];
+  int line_len;
+  struct link *links;
+  unsigned long tx, rx;
+};
+
+struct delivery {
+  struct delivery *next;
+  unsigned long time;
+  struct node *to;
+  int len;
+  uint8_t msg[SIM_RADIO_HDR_LEN + SIM_RADIO_MAX_FRAME];
+};
+
+static struct node *nodes[MAX_NODES + 1];
+static struct node **node_list;
+static int num_nodes;
+
+static struct delivery *deliveries;
+
+static unsigned long frames_sent, frames_delivered, frames_lost;
+static unsigned long unicast_sent, unicast_acked;
+
+static uint32_t random_state = 1;
+static struct timespec start_time;
+static volatile sig_atomic_t stop;
+
+static char socket_dir[] = "/tmp/native-sim.XXXXXX";
+static char socket_path[sizeof(socket_dir) + 8];
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - start_time.tv_sec) * 1000 +
+    (ts.tv_nsec - start_time.tv_nsec) / 1000000;
+}
+/*---------------------------------------------------------------------------*/
+static double
+random_uniform(void)
+{
+  /* xorshift32 */
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state >> 8) / (double)(1 << 24);
+}
+/*---------------------------------------------------------------------------*/
+static struct node *
+get_node(int id, int create)
+{
+  if(id <= 0 || id > MAX_NODES) {
+    return NULL;
+  }
+  if(nodes[id] == NULL && create) {
+    nodes[id] = calloc(1, sizeof(struct node));
+    nodes[id]->id = id;
+    nodes[id]->sock = -1;
+    nodes[id]->out = -1;
+    node_list = realloc(node_list, (num_nodes + 1) * sizeof(struct node *));
+    node_list[num_nodes++] = nodes[id];
+  }
+  return nodes[id];
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_link(int from, int to, double prr, unsigned long latency)
+{
+  struct link *l;
+
+  l = calloc(1, sizeof(struct link));
+  l->to = get_node(to, 1);
+  l->prr = prr;
+  l->latency = latency;
+  l->next = get_node(from, 1)->links;
+  get_node(from, 1)->links = l;
+}
+/*---------------------------------------------------------------------------*/
+static int
+read_topology(const char *filename)
+{
+  FILE *f;
+  char line[LINE_SIZE];
+  char *command;
+  int lineno, a, b, n;
+  double prr;
+  unsigned long latency;
+
+  f = fopen(filename, "r");
+  if(f == NULL) {
+    perror(filename);
+    return -1;
+  }
+
+  for(lineno = 1; fgets(line, sizeof(line), f) != NULL; lineno++) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if(line[0] == '#' || line[strspn(line, " \t")] == '\0') {
+      continue;
+    }
+    if(sscanf(line, "node %d %n", &a, &n) == 1 && line[n] != '\0') {
+      command = line + n;
+      if(get_node(a, 1) == NULL) {
+        break;
+      }
+      free(nodes[a]->command);
+      nodes[a]->command = strdup(command);
+    } else if(sscanf(line, "link %d %d %lf %lu", &a, &b, &prr, &latency) == 4 &&
+              get_node(a, 0) != NULL && get_node(b, 0) != NULL) {
+      add_link(a, b, prr, latency);
+      add_link(b, a, prr, latency);
+    } else if(sscanf(line, "dlink %d %d %lf %lu", &a, &b, &prr, &latency) == 4 &&
+              get_node(a, 0) != NULL && get_node(b, 0) != NULL) {
+      add_link(a, b, prr, latency);
+    } else {
+      break;
+    }
+  }
+  if(!feof(f)) {
+    fprintf(stderr, "%s:%d: syntax error, or a link to an undeclared node\n",
+            filename, lineno);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_node(struct node *n)
+{
+  char id[8];
+  char *command;
+  int pipefd[2];
+  int fd;
+
+  if(pipe(pipefd) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  n->pid = fork();
+  if(n->pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if(n->pid == 0) {
+    snprintf(id, sizeof(id), "%d", n->id);
+    setenv(SIM_RADIO_ENV_NODE_ID, id, 1);
+    setenv(SIM_RADIO_ENV_SOCKET, socket_path, 1);
+    dup2(pipefd[1], STDOUT_FILENO);
+    dup2(pipefd[1], STDERR_FILENO);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    /* The node should not read the input of the hub. */
+    fd = open("/dev/null", O_RDONLY);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+    command = malloc(strlen(n->command) + 6);
+    sprintf(command, "exec %s", n->command);
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+  close(pipefd[1]);
+  n->out = pipefd[0];
+  /* Nodes started later should not inherit it. */
+  fcntl(n->out, F_SETFD, FD_CLOEXEC);
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule(struct node *to, const uint8_t *msg, int len, unsigned long time)
+{
+  struct delivery *d, **p;
+
+  d = malloc(sizeof(struct delivery));
+  d->time = time;
+  d->to = to;
+  d->len = len;
+  memcpy(d->msg, msg, len);
+
+  for(p = &deliveries; *p != NULL && (*p)->time <= time; p = &(*p)->next);
+  d->next = *p;
+  *p = d;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_frame(struct node *from, uint8_t *msg, int len)
+{
+  struct link *l;
+  uint8_t ack[2];
+  int dst, delivered;
+
+  from->tx++;
+  frames_sent++;
+  dst = (msg[1] << 8) | msg[2];
+
+  /* The receivers see the sender in the header. */
+  msg[1] = from->id >> 8;
+  msg[2] = from->id & 0xff;
+
+  delivered = 0;
+  for(l = from->links; l != NULL; l = l->next) {
+    if(dst != SIM_RADIO_BROADCAST && l->to->id != dst) {
+      continue;
+    }
+    if(random_uniform() < l->prr) {
+      schedule(l->to, msg, len, now() + l->latency);
+      delivered = 1;
+    } else {
+      frames_lost++;
+    }
+  }
+
+  if(dst != SIM_RADIO_BROADCAST) {
+    unicast_sent++;
+    unicast_acked += delivered;
+  }
+  ack[0] = SIM_RADIO_ACK;
+  ack[1] = dst == SIM_RADIO_BROADCAST || delivered;
+  send(from->sock, ack, sizeof(ack), MSG_DONTWAIT);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_socket(struct node *n)
+{
+  uint8_t msg[SIM_RADIO_HDR_LEN + SIM_RADIO_MAX_FRAME];
+  int len;
+
+  len = recv(n->sock, msg, sizeof(msg), MSG_DONTWAIT);
+  if(len <= 0) {
+    if(len == 0 || errno != EAGAIN) {
+      close(n->sock);
+      n->sock = -1;
+    }
+    return;
+  }
+  if(msg[0] == SIM_RADIO_FRAME && len > SIM_RADIO_HDR_LEN) {
+    handle_frame(n, msg, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_connection(int listen_sock)
+{
+  uint8_t hello[3];
+  struct node *n;
+  int sock;
+
+  sock = accept(listen_sock, NULL, NULL);
+  if(sock < 0) {
+    return;
+  }
+  fcntl(sock, F_SETFD, FD_CLOEXEC);
+  /* Nodes say hello right after connecting. */
+  if(recv(sock, hello, sizeof(hello), 0) != sizeof(hello) ||
+     hello[0] != SIM_RADIO_HELLO ||
+     (n = get_node((hello[1] << 8) | hello[2], 0)) == NULL) {
+    close(sock);
+    return;
+  }
+  if(n->sock >= 0) {
+    close(n->sock);
+  }
+  n->sock = sock;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_output(struct node *n)
+{
+  char buf[LINE_SIZE];
+  int i, len;
+
+  len = read(n->out, buf, sizeof(buf));
+  if(len <= 0) {
+    close(n->out);
+    n->out = -1;
+    len = 0;
+  }
+
+  for(i = 0; i < len; i++) {
+    if(buf[i] == '\n' || n->line_len == LINE_SIZE - 1) {
+      n->line[n->line_len] = '\0';
+      printf("%lu\tID:%d\t%s\n", now(), n->id, n->line);
+      n->line_len = 0;
+    }
+    if(buf[i] != '\n') {
+      n->line[n->line_len++] = buf[i];
+    }
+  }
+  fflush(stdout);
+}
+/*---------------------------------------------------------------------------*/
+static void
+deliver(void)
+{
+  struct delivery *d;
+  unsigned long t;
+
+  t = now();
+  while(deliveries != NULL && deliveries->time <= t) {
+    d = deliveries;
+    deliveries = d->next;
+    if(d->to->sock >= 0 &&
+       send(d->to->sock, d->msg, d->len, MSG_DONTWAIT) == d->len) {
+      d->to->rx++;
+      frames_delivered++;
+    } else {
+      frames_lost++;
+    }
+    free(d);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_signal(int sig)
+{
+  stop = 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char **argv)
+{
+  struct sockaddr_un addr;
+  struct pollfd *pfds;
+  unsigned long duration;
+  struct node *last;
+  long timeout;
+  int listen_sock;
+  int opt, i, n, running;
+
+  duration = 0;
+  last = NULL;
+  while((opt = getopt(argc, argv, "s:t:e:")) != -1) {
+    switch(opt) {
+    case 's':
+      random_state = strtoul(optarg, NULL, 0);
+      if(random_state == 0) {
+        random_state = 1;
+      }
+      break;
+    case 't':
+      duration = strtoul(optarg, NULL, 0) * 1000;
+      break;
+    case 'e':
+      last = get_node(atoi(optarg), 1);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-t seconds] [-e node] topology-file\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if(optind != argc - 1 || read_topology(argv[optind]) < 0) {
+    fprintf(stderr, "usage: %s [-s seed] [-t seconds] [-e node] topology-file\n",
+            argv[0]);
+    return 1;
+  }
+  for(i = 0; i < num_nodes; i++) {
+    if(node_list[i]->command == NULL) {
+      fprintf(stderr, "node %d has links but no command\n", node_list[i]->id);
+      return 1;
+    }
+  }
+
+  if(mkdtemp(socket_dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(socket_path, sizeof(socket_path), "%s/hub", socket_dir);
+  listen_sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  if(listen_sock < 0 ||
+     bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+     listen(listen_sock, 128) < 0) {
+    perror("socket");
+    rmdir(socket_dir);
+    return 1;
+  }
+  fcntl(listen_sock, F_SETFD, FD_CLOEXEC);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, handle_signal);
+  signal(SIGTERM, handle_signal);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for(i = 0; i < num_nodes; i++) {
+    start_node(node_list[i]);
+  }
+
+  pfds = malloc((2 * num_nodes + 1) * sizeof(struct pollfd));
+  while(!stop && (duration == 0 || now() < duration)) {
+    n = 0;
+    pfds[n].fd = listen_sock;
+    pfds[n++].events = POLLIN;
+    running = 0;
+    for(i = 0; i < num_nodes; i++) {
+      pfds[n].fd = node_list[i]->sock;
+      pfds[n++].events = POLLIN;
+      pfds[n].fd = node_list[i]->out;
+      pfds[n++].events = POLLIN;
+      running += node_list[i]->out >= 0;
+    }
+    if(running == 0 || (last != NULL && last->out < 0)) {
+      break;
+    }
+
+    timeout = deliveries == NULL ? 1000 : (long)(deliveries->time - now());
+    if(deliveries != NULL && deliveries->time < now()) {
+      timeout = 0;
+    }
+    if(duration > 0 && (long)(duration - now()) < timeout) {
+      timeout = duration - now();
+    }
+    if(poll(pfds, n, timeout) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+
+    if(pfds[0].revents & POLLIN) {
+      handle_connection(listen_sock);
+    }
+    for(i = 0; i < num_nodes; i++) {
+      if(pfds[1 + 2 * i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        handle_socket(node_list[i]);
+      }
+      if(pfds[2 + 2 * i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        handle_output(node_list[i]);
+      }
+    }
+    deliver();
+  }
+
+  for(i = 0; i < num_nodes; i++) {
+    if(node_list[i]->pid > 0) {
+      kill(node_list[i]->pid, SIGTERM);
+    }
+  }
+  for(i = 0; i < num_nodes; i++) {
+    if(node_list[i]->pid > 0) {
+      waitpid(node_list[i]->pid, NULL, 0);
+    }
+    if(node_list[i]->out >= 0) {
+      /* Print what the node wrote on its way out. */
+      while(node_list[i]->out >= 0) {
+        handle_output(node_list[i]);
+      }
+    }
+  }
+
+  unlink(socket_path);
+  rmdir(socket_dir);
+
+  fprintf(stderr, "native-sim: %lu ms, %d nodes, %lu frames sent, "
+          "%lu delivered, %lu lost, %lu/%lu unicast frames acked\n",
+          now(), num_nodes, frames_sent, frames_delivered, frames_lost,
+          unicast_acked, unicast_sent);
+  return 0;
+}